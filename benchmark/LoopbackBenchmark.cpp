@@ -0,0 +1,312 @@
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "RealtimeChecker.hpp"
+#include "ReceiveEngine.hpp"
+#include "SendThread.hpp"
+
+namespace {
+constexpr double sampleRate = 48000.0;
+/** One pulse, and so one latency measurement, every 100 ms. */
+constexpr int64 pulseInterval = 4800;
+/** Long enough for the pulse to survive resampling nearly unchanged. */
+constexpr int pulseLength = 32;
+
+struct Config {
+    int blockSize;
+    int numChannels;
+};
+
+struct Result {
+    std::vector<double> latenciesMs;
+    uint64 numMissedPulses{0};
+    double jitterMs{0.0};
+    double packetsPerSecond{0.0};
+    /** Time spent in pushBlock() per block, as the audio callback sees it. */
+    double sendCallbackUs{0.0};
+    /** Time spent in ReceiveEngine::read() per block. */
+    double receiveCallbackUs{0.0};
+    /** CPU time of the whole process per block, every thread included. */
+    double processCpuUs{0.0};
+    uint64 numUnderruns{0};
+    uint64 numOverruns{0};
+    uint64 numDroppedBlocks{0};
+    uint64 numLost{0};
+};
+
+/** Silence with a raised cosine pulse every pulseInterval samples. */
+float generate(int64 position) {
+    const auto offset = position % pulseInterval;
+    if (offset >= pulseLength) {
+        return 0.0f;
+    }
+    return 0.5f - 0.5f * std::cos(MathConstants<float>::twoPi *
+                                  static_cast<float>(offset) / pulseLength);
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    const auto index = static_cast<size_t>(
+        std::round(fraction * static_cast<double>(values.size() - 1)));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+/**
+ * Streams synthetic audio from a SendThread to a ReceiveEngine over
+ * localhost, both driven by one simulated device clock. Latency is the
+ * distance between a pulse's rising edge at the input and at the output.
+ */
+Result run(const Config& config, double seconds) {
+    Result result;
+
+    ReceiveEngine engine;
+    engine.prepare(config.blockSize, sampleRate);
+    if (!engine.connect(0)) {
+        std::cerr << "Couldn't bind a local port\n";
+        return result;
+    }
+
+    const SharedResourcePointer<UdpSender> udpSender;
+    if (!udpSender->connect("127.0.0.1", engine.getLocalPort())) {
+        std::cerr << "Couldn't connect to the receiver\n";
+        return result;
+    }
+
+    SendThread sendThread;
+    sendThread.prepare(sampleRate);
+    sendThread.start({});
+    engine.start({});
+
+    const auto blockSize = static_cast<size_t>(config.blockSize);
+    std::vector<float> input(blockSize * config.numChannels);
+    std::vector<float> output(blockSize * config.numChannels);
+    std::vector<const float*> inputs;
+    std::vector<float*> outputs;
+    for (auto channel = 0; channel < config.numChannels; ++channel) {
+        inputs.push_back(input.data() + channel * blockSize);
+        outputs.push_back(output.data() + channel * blockSize);
+    }
+
+    // The rising edge of a raised cosine reaches half scale a quarter in,
+    // where an unchanged pulse is exactly 0.5
+    const auto edgeOffset = pulseLength / 4;
+    std::deque<int64> pendingEdges;
+    auto isInPulse = false;
+
+    const auto numBlocks =
+        static_cast<int64>(seconds * sampleRate / config.blockSize);
+    const auto period = std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+        config.blockSize / sampleRate));
+    auto sendTime = std::chrono::steady_clock::duration::zero();
+    auto receiveTime = std::chrono::steady_clock::duration::zero();
+
+    const auto cpuStart = std::clock();
+    const auto start = std::chrono::steady_clock::now();
+    auto deadline = start;
+
+    for (int64 block = 0; block < numBlocks; ++block) {
+        const auto position = block * config.blockSize;
+
+        for (size_t i = 0; i < blockSize; ++i) {
+            const auto sample = generate(position + static_cast<int64>(i));
+            for (auto channel = 0; channel < config.numChannels; ++channel) {
+                input[channel * blockSize + i] = sample;
+            }
+
+            if ((position + static_cast<int64>(i)) % pulseInterval ==
+                edgeOffset) {
+                pendingEdges.push_back(position + static_cast<int64>(i));
+            }
+        }
+
+        const auto beforeSend = std::chrono::steady_clock::now();
+        {
+            const RealtimeChecker::ScopedCallback callback;
+            sendThread.pushBlock(inputs.data(), config.numChannels,
+                                 config.blockSize);
+        }
+        const auto beforeReceive = std::chrono::steady_clock::now();
+        {
+            const RealtimeChecker::ScopedCallback callback;
+            engine.read(outputs.data(), config.numChannels, config.blockSize);
+        }
+        const auto afterReceive = std::chrono::steady_clock::now();
+
+        sendTime += beforeReceive - beforeSend;
+        receiveTime += afterReceive - beforeReceive;
+
+        for (size_t i = 0; i < blockSize; ++i) {
+            const auto sample = output[i];
+            const auto outputPosition = position + static_cast<int64>(i);
+
+            if (!isInPulse && sample >= 0.5f) {
+                isInPulse = true;
+
+                // Edges that never came out are missed, e.g. when lost
+                while (!pendingEdges.empty() &&
+                       outputPosition - pendingEdges.front() >=
+                           pulseInterval) {
+                    pendingEdges.pop_front();
+                    ++result.numMissedPulses;
+                }
+
+                if (!pendingEdges.empty() &&
+                    pendingEdges.front() <= outputPosition) {
+                    result.latenciesMs.push_back(
+                        static_cast<double>(outputPosition -
+                                            pendingEdges.front()) *
+                        1000.0 / sampleRate);
+                    pendingEdges.pop_front();
+                }
+            } else if (isInPulse && sample < 0.25f) {
+                isInPulse = false;
+            }
+        }
+
+        deadline += period;
+        std::this_thread::sleep_until(deadline);
+    }
+
+    const auto elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    const auto cpuSeconds =
+        static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    for (size_t slot = 0; slot < engine.getStreamTable().getNumSlots();
+         ++slot) {
+        const auto& receiveThread = engine.getReceiveThread();
+        if (engine.getStreamTable().getState(slot) ==
+            StreamTable::State::active) {
+            result.jitterMs =
+                receiveThread.getJitterEstimator(slot)
+                    .getInterarrivalJitter() *
+                1000.0 / sampleRate;
+            result.numLost = receiveThread.getReorderBuffer(slot).getNumLost();
+        }
+    }
+
+    const auto toUs = [numBlocks](std::chrono::steady_clock::duration time) {
+        return std::chrono::duration<double, std::micro>(time).count() /
+               static_cast<double>(numBlocks);
+    };
+
+    result.packetsPerSecond =
+        static_cast<double>(udpSender->getNumSent()) / elapsed;
+    result.sendCallbackUs = toUs(sendTime);
+    result.receiveCallbackUs = toUs(receiveTime);
+    result.processCpuUs =
+        cpuSeconds * 1.0e6 / static_cast<double>(numBlocks);
+    result.numUnderruns = engine.getNumUnderruns();
+    result.numOverruns = engine.getNumOverruns();
+    result.numDroppedBlocks = sendThread.getNumDroppedBlocks();
+
+    engine.disconnect();
+    sendThread.stop();
+    return result;
+}
+
+void printResult(const Config& config, const Result& result, bool csv) {
+    const auto& latencies = result.latenciesMs;
+    const auto p50 = percentile(latencies, 0.5);
+    const auto p95 = percentile(latencies, 0.95);
+    const auto p99 = percentile(latencies, 0.99);
+    const auto max = latencies.empty()
+                         ? 0.0
+                         : *std::max_element(latencies.begin(),
+                                             latencies.end());
+
+    if (csv) {
+        std::cout << config.blockSize << "," << config.numChannels << ","
+                  << p50 << "," << p95 << "," << p99 << "," << max << ","
+                  << result.jitterMs << "," << result.packetsPerSecond << ","
+                  << result.sendCallbackUs << "," << result.receiveCallbackUs
+                  << "," << result.processCpuUs << "," << result.numUnderruns
+                  << "," << result.numOverruns << ","
+                  << result.numDroppedBlocks << "," << result.numLost << ","
+                  << result.numMissedPulses << "\n";
+        return;
+    }
+
+    std::cout << std::fixed << std::setprecision(2) << std::setw(6)
+              << config.blockSize << std::setw(4) << config.numChannels
+              << std::setw(8) << p50 << std::setw(8) << p95 << std::setw(8)
+              << p99 << std::setw(8) << max << std::setw(8)
+              << result.jitterMs << std::setw(9)
+              << std::setprecision(0) << result.packetsPerSecond
+              << std::setprecision(2) << std::setw(8)
+              << result.sendCallbackUs << std::setw(8)
+              << result.receiveCallbackUs << std::setw(9)
+              << result.processCpuUs << std::setw(6) << result.numUnderruns
+              << std::setw(6) << result.numOverruns << std::setw(6)
+              << result.numDroppedBlocks << std::setw(6) << result.numLost
+              << "\n";
+}
+}  // namespace
+
+//==============================================================================
+/**
+ * Usage: AudioStreamBenchmark [--seconds n] [--csv]
+ *
+ * Runs every combination of block size and channel count for n seconds
+ * (default 5) and prints one line per run. Latencies are in milliseconds,
+ * callback and CPU times in microseconds per block.
+ */
+int main(int argc, char* argv[]) {
+    auto seconds = 5.0;
+    auto csv = false;
+
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = std::max(1.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--seconds n] [--csv]\n";
+            return 1;
+        }
+    }
+
+    // Threads and the message manager need JUCE set up, no window is made
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    if (csv) {
+        std::cout << "block_size,channels,latency_p50_ms,latency_p95_ms,"
+                     "latency_p99_ms,latency_max_ms,jitter_ms,packets_per_s,"
+                     "send_us,receive_us,process_cpu_us,underruns,overruns,"
+                     "dropped_blocks,lost,missed_pulses\n";
+    } else {
+        std::cout << " block  ch     p50     p95     p99     max  jitter"
+                     "  packets    send receive  process  undr   ovr"
+                     "  drop  lost\n";
+    }
+
+    for (const auto blockSize : {64, 128, 256, 512}) {
+        for (const auto numChannels : {1, 2, 8}) {
+            const Config config{blockSize, numChannels};
+            printResult(config, run(config, seconds), csv);
+        }
+    }
+
+    if (RealtimeChecker::isEnabled()) {
+        std::cerr << "Real-time violations: "
+                  << RealtimeChecker::getNumViolations() << "\n";
+    }
+
+    return 0;
+}
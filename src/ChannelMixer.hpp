@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "StreamMixer.hpp"
+
+//==============================================================================
+/**
+ * @class ChannelMixer
+ * @brief Maps a stream's channels onto a different number of output
+ * channels.
+ *
+ * A mono stream feeds the first two outputs, so it plays from both sides of
+ * a stereo device. Otherwise input channel i goes to output i % numOutputs,
+ * each output scaled by one over the number of inputs folded into it: a
+ * stereo stream is averaged on a mono device, and extra outputs of a larger
+ * device stay silent rather than getting made-up content.
+ *
+ * Only needed when the counts differ. process() uses the vectorised loops of
+ * StreamMixer and doesn't allocate.
+ */
+class ChannelMixer {
+  public:
+    /** Gain from an input channel to an output channel. */
+    static float getGain(int input, int output, int numInputs,
+                         int numOutputs) {
+        if (numInputs == 1) {
+            return output < 2 ? 1.0f : 0.0f;
+        }
+
+        if (input % numOutputs != output) {
+            return 0.0f;
+        }
+
+        // Inputs output, output + numOutputs, ... land on this output
+        const auto numFolded = (numInputs - output + numOutputs - 1) /
+                               numOutputs;
+        return 1.0f / static_cast<float>(numFolded);
+    }
+
+    /**
+     * Writes numOutputs channels of numSamples samples, mixed from
+     * numInputs channels. Inputs and outputs must not overlap.
+     */
+    static void process(const float* const* inputs, int numInputs,
+                        float* const* outputs, int numOutputs,
+                        int numSamples) {
+        const auto count = static_cast<size_t>(std::max(0, numSamples));
+
+        for (auto output = 0; output < numOutputs; ++output) {
+            std::fill(outputs[output], outputs[output] + count, 0.0f);
+
+            for (auto input = 0; input < numInputs; ++input) {
+                const auto gain =
+                    getGain(input, output, numInputs, numOutputs);
+                if (gain != 0.0f) {
+                    StreamMixer::addWithGain(outputs[output], inputs[input],
+                                             gain, count);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ForwardErrorCorrection.hpp"
+#include "StreamConfig.hpp"
+#include "StreamPacket.hpp"
+
+//==============================================================================
+/**
+ * @struct CommandLineOptions
+ * @brief Settings of a headless sender or receiver, parsed from the command
+ * line.
+ *
+ * Options take their value either as the next argument or after an equals
+ * sign, as in `--send host:port` or `--send=host:port`.
+ */
+struct CommandLineOptions {
+    enum class Mode { none, send, receive, listDevices, help };
+
+    struct Destination {
+        std::string host;
+        int port{0};
+    };
+
+    Mode mode{Mode::none};
+    /** Every host the sender sends to, in the order given. */
+    std::vector<Destination> destinations;
+    /** Port the receiver listens on. */
+    int port{0};
+    /** Multicast group the receiver joins, empty for unicast only. */
+    std::string multicastGroup;
+    /** Audio device to open, empty for the system default. */
+    std::string deviceName;
+    int numChannels{2};
+    /** Device block size in samples, 0 for the device default. */
+    int blockSize{0};
+    /** Device sample rate, 0 for the device default. */
+    double sampleRate{0.0};
+    /** Receive jitter buffer depth. */
+    int bufferMs{AUDIO_STREAM_JITTER_BUFFER_MS};
+    /** Duration of the frames sent, whatever the device block size. */
+    double frameDurationMs{AUDIO_STREAM_FRAME_DURATION_MS};
+    /** Largest IP packet the network path carries. */
+    int mtu{AUDIO_STREAM_MTU};
+    SampleFormat sampleFormat{SampleFormat::float32};
+    bool compress{false};
+    bool osc{false};
+    /** Send lost packets again when receivers ask for them. */
+    bool retransmit{false};
+    /** Stop sending during silence, with comfort noise in its place. */
+    bool dtx{false};
+    /** Parity packets sent per fecNumData audio packets, 0 for no FEC. */
+    int fecNumData{AUDIO_STREAM_FEC_NUM_DATA};
+    int fecNumParity{AUDIO_STREAM_FEC_NUM_PARITY};
+    /**
+     * Send latency probes, or measure the latency from them when
+     * receiving.
+     */
+    bool measureLatency{false};
+    /** File the metrics are written to, empty for none. */
+    std::string metricsFile;
+    int metricsIntervalMs{AUDIO_STREAM_METRICS_INTERVAL_MS};
+    /** File the audio sent or played is recorded to, empty for none. */
+    std::string recordFile;
+
+    static const char* getUsage() {
+        return "Usage:\n"
+               "  AudioStreamCli --send host:port[,host:port...] [options]\n"
+               "  AudioStreamCli --recv port [options]\n"
+               "  AudioStreamCli --list-devices\n"
+               "\n"
+               "Options:\n"
+               "  --group address     multicast group to join when receiving\n"
+               "  --device name       audio device, default: system default\n"
+               "  --channels n        channels to send or play, default: 2\n"
+               "  --block-size n      device block size in samples\n"
+               "  --sample-rate hz    device sample rate\n"
+               "  --buffer-ms n       receive buffer depth, default: 200\n"
+               "  --frame-ms n        duration of a packet, e.g. 1, 2.5, 5 or\n"
+               "                      10, default: 5\n"
+               "  --mtu bytes         largest IP packet, default: 1500\n"
+               "  --format f          float32, int24 or int16\n"
+               "  --compress          compress the audio losslessly\n"
+               "  --osc               send OSC messages for older receivers\n"
+               "  --nack              resend lost packets receivers ask for\n"
+               "                      in time, not with --osc\n"
+               "  --dtx               send nothing but comfort noise levels\n"
+               "                      during silence\n"
+               "  --fec data:parity   send parity packets per data packets\n"
+               "                      to rebuild losses from, e.g. 8:2,\n"
+               "                      default: none\n"
+               "  --measure-latency   send latency probes, or measure the\n"
+               "                      latency from them on the first\n"
+               "                      output and input when receiving\n"
+               "  --metrics-file path write metrics to path, as JSON if it\n"
+               "                      ends in .json, else Prometheus text\n"
+               "  --metrics-interval ms\n"
+               "                      time between writes, default: 10000\n"
+               "  --record path       record the audio sent or played to\n"
+               "                      path, as FLAC if it ends in .flac,\n"
+               "                      else WAV\n"
+               "  --help              show this message\n";
+    }
+
+    /**
+     * @brief Parses the arguments that follow the program name.
+     * @return false with a message in error if they are not valid.
+     */
+    bool parse(const std::vector<std::string>& args, std::string& error) {
+        for (size_t i = 0; i < args.size(); ++i) {
+            auto name = args[i];
+            std::string value;
+            auto hasValue = false;
+
+            if (const auto equals = name.find('='); equals != name.npos) {
+                value = name.substr(equals + 1);
+                name.resize(equals);
+                hasValue = true;
+            }
+
+            auto takeValue = [&]() -> bool {
+                if (!hasValue) {
+                    if (i + 1 >= args.size()) {
+                        error = name + " needs a value";
+                        return false;
+                    }
+                    value = args[++i];
+                }
+                return true;
+            };
+
+            if (name == "--help" || name == "-h") {
+                mode = Mode::help;
+                return true;
+            } else if (name == "--list-devices") {
+                setMode(Mode::listDevices, error);
+            } else if (name == "--send") {
+                if (takeValue() && setMode(Mode::send, error)) {
+                    parseDestinations(value, error);
+                }
+            } else if (name == "--recv") {
+                if (takeValue() && setMode(Mode::receive, error)) {
+                    parseInt(name, value, 1, 65535, port, error);
+                }
+            } else if (name == "--group") {
+                if (takeValue()) {
+                    multicastGroup = value;
+                }
+            } else if (name == "--device") {
+                if (takeValue()) {
+                    deviceName = value;
+                }
+            } else if (name == "--channels") {
+                if (takeValue()) {
+                    parseInt(name, value, 1, AUDIO_STREAM_MAX_CHANNELS,
+                             numChannels, error);
+                }
+            } else if (name == "--block-size") {
+                if (takeValue()) {
+                    parseInt(name, value, 1, AUDIO_STREAM_MAX_BLOCK_SIZE,
+                             blockSize, error);
+                }
+            } else if (name == "--sample-rate") {
+                if (takeValue()) {
+                    parseSampleRate(value, error);
+                }
+            } else if (name == "--buffer-ms") {
+                if (takeValue()) {
+                    parseInt(name, value, 10, 10000, bufferMs, error);
+                }
+            } else if (name == "--frame-ms") {
+                if (takeValue()) {
+                    parseFrameDuration(value, error);
+                }
+            } else if (name == "--mtu") {
+                if (takeValue()) {
+                    parseInt(name, value, AUDIO_STREAM_MIN_MTU,
+                             AUDIO_STREAM_MAX_DATAGRAM_SIZE, mtu, error);
+                }
+            } else if (name == "--format") {
+                if (takeValue()) {
+                    parseFormat(value, error);
+                }
+            } else if (name == "--compress") {
+                compress = true;
+            } else if (name == "--osc") {
+                osc = true;
+            } else if (name == "--nack") {
+                retransmit = true;
+            } else if (name == "--dtx") {
+                dtx = true;
+            } else if (name == "--fec") {
+                if (takeValue()) {
+                    parseFec(value, error);
+                }
+            } else if (name == "--measure-latency") {
+                measureLatency = true;
+            } else if (name == "--metrics-file") {
+                if (takeValue()) {
+                    metricsFile = value;
+                }
+            } else if (name == "--metrics-interval") {
+                if (takeValue()) {
+                    parseInt(name, value, 100, 3600000, metricsIntervalMs,
+                             error);
+                }
+            } else if (name == "--record") {
+                if (takeValue()) {
+                    recordFile = value;
+                }
+            } else {
+                error = "Unknown option: " + args[i];
+            }
+
+            if (!error.empty()) {
+                return false;
+            }
+        }
+
+        if (mode == Mode::none) {
+            error = "One of --send, --recv or --list-devices is required";
+            return false;
+        }
+
+        return true;
+    }
+
+  private:
+    bool setMode(Mode newMode, std::string& error) {
+        if (mode != Mode::none && mode != newMode) {
+            error = "--send, --recv and --list-devices are exclusive";
+            return false;
+        }
+        mode = newMode;
+        return true;
+    }
+
+    static bool parseInt(const std::string& name, const std::string& value,
+                         int min, int max, int& result, std::string& error) {
+        char* end = nullptr;
+        const auto parsed = std::strtol(value.c_str(), &end, 10);
+
+        if (value.empty() || *end != 0 || parsed < min || parsed > max) {
+            error = name + " must be a number from " + std::to_string(min) +
+                    " to " + std::to_string(max) + ", not '" + value + "'";
+            return false;
+        }
+
+        result = static_cast<int>(parsed);
+        return true;
+    }
+
+    /** Adds each of a comma separated list of destinations. */
+    bool parseDestinations(const std::string& value, std::string& error) {
+        size_t start = 0;
+        while (true) {
+            const auto comma = value.find(',', start);
+            if (!parseDestination(value.substr(start, comma - start), error)) {
+                return false;
+            }
+            if (comma == value.npos) {
+                return true;
+            }
+            start = comma + 1;
+        }
+    }
+
+    bool parseDestination(const std::string& value, std::string& error) {
+        // The last colon separates the port, so IPv6 hosts work in brackets
+        const auto colon = value.rfind(':');
+        if (colon == value.npos || colon == 0) {
+            error = "--send needs host:port, not '" + value + "'";
+            return false;
+        }
+
+        Destination destination;
+        destination.host = value.substr(0, colon);
+        auto& host = destination.host;
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        if (!parseInt("--send port", value.substr(colon + 1), 1, 65535,
+                      destination.port, error)) {
+            return false;
+        }
+
+        destinations.push_back(destination);
+        return true;
+    }
+
+    bool parseSampleRate(const std::string& value, std::string& error) {
+        char* end = nullptr;
+        const auto parsed = std::strtod(value.c_str(), &end);
+
+        if (value.empty() || *end != 0 || parsed < 8000.0 ||
+            parsed > 384000.0) {
+            error = "--sample-rate must be from 8000 to 384000, not '" +
+                    value + "'";
+            return false;
+        }
+
+        sampleRate = parsed;
+        return true;
+    }
+
+    bool parseFrameDuration(const std::string& value, std::string& error) {
+        char* end = nullptr;
+        const auto parsed = std::strtod(value.c_str(), &end);
+
+        if (value.empty() || *end != 0 || parsed < 0.5 || parsed > 20.0) {
+            error = "--frame-ms must be from 0.5 to 20, not '" + value + "'";
+            return false;
+        }
+
+        frameDurationMs = parsed;
+        return true;
+    }
+
+    bool parseFec(const std::string& value, std::string& error) {
+        const auto colon = value.find(':');
+        if (colon == value.npos) {
+            error = "--fec needs data:parity, not '" + value + "'";
+            return false;
+        }
+
+        return parseInt("--fec data", value.substr(0, colon), 1,
+                        FecEncoder::maxNumData, fecNumData, error) &&
+               parseInt("--fec parity", value.substr(colon + 1), 0,
+                        FecEncoder::maxNumParity, fecNumParity, error);
+    }
+
+    bool parseFormat(const std::string& value, std::string& error) {
+        if (value == "float32") {
+            sampleFormat = SampleFormat::float32;
+        } else if (value == "int24") {
+            sampleFormat = SampleFormat::int24;
+        } else if (value == "int16") {
+            sampleFormat = SampleFormat::int16;
+        } else {
+            error = "--format must be float32, int24 or int16, not '" +
+                    value + "'";
+            return false;
+        }
+        return true;
+    }
+};
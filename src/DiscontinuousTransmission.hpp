@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define AUDIO_STREAM_DTX_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIO_STREAM_DTX_NEON 1
+#endif
+
+//==============================================================================
+/**
+ * @class SilenceDetector
+ * @brief Decides, frame by frame, whether a stream is worth sending or can
+ * be replaced by comfort noise.
+ *
+ * A frame is silent when both its RMS level and its peak are below their
+ * thresholds on every channel. Silence only takes over after hangover
+ * seconds of silent frames, so word endings and short pauses still go out.
+ * From then on frames are suppressed, except that a comfort noise
+ * descriptor goes out when the silence starts and every keepAlive seconds
+ * after, which carries the background level and keeps the stream alive at
+ * the receiver.
+ *
+ * The level of the background is tracked per channel over the silent
+ * frames. Peak and energy are measured with SSE2 or NEON where available.
+ * Owned by the send thread; process() doesn't allocate.
+ */
+class SilenceDetector {
+  public:
+    enum class Decision {
+        /** Send the frame as usual. */
+        send,
+        /** Silence started: send a comfort noise descriptor instead. */
+        startSilence,
+        /** Still silent: send a descriptor again to keep the stream alive. */
+        keepAlive,
+        /** Still silent: send nothing. */
+        suppress
+    };
+
+    SilenceDetector() = default;
+
+    /**
+     * @brief Sets the detector up for a stream, which starts out active.
+     * @param thresholdDb RMS level in dBFS below which a frame is silent.
+     * @param peakThresholdDb Peak in dBFS below which a frame is silent.
+     */
+    void prepare(int maxChannels, double sampleRate, double thresholdDb,
+                 double peakThresholdDb, double hangoverSeconds,
+                 double keepAliveSeconds) {
+        levels.assign(static_cast<size_t>(std::max(1, maxChannels)), 0.0f);
+        meanSquareThreshold =
+            static_cast<float>(std::pow(10.0, thresholdDb / 10.0));
+        peakThreshold =
+            static_cast<float>(std::pow(10.0, peakThresholdDb / 20.0));
+        hangover = static_cast<uint64_t>(sampleRate * hangoverSeconds);
+        keepAlive = static_cast<uint64_t>(sampleRate * keepAliveSeconds);
+        silentLength = 0;
+        sinceDescriptor = 0;
+        silent = false;
+    }
+
+    /** Classifies a planar frame of numChannels * numSamples samples. */
+    Decision process(const float* samples, int numChannels, int numSamples) {
+        const auto length = static_cast<size_t>(std::max(0, numSamples));
+        numChannels = std::min(numChannels, static_cast<int>(levels.size()));
+        auto isSilent = true;
+
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            const auto level = measure(
+                samples + static_cast<size_t>(channel) * length, length);
+            isSilent = isSilent && level.meanSquare < meanSquareThreshold &&
+                       level.peak < peakThreshold;
+
+            // Background level, settling within a few frames
+            auto& background = levels[static_cast<size_t>(channel)];
+            background = silentLength == 0
+                             ? level.meanSquare
+                             : background + (level.meanSquare - background) *
+                                                smoothing;
+        }
+
+        if (!isSilent) {
+            silentLength = 0;
+            silent = false;
+            return Decision::send;
+        }
+
+        silentLength += length;
+        if (silentLength <= hangover) {
+            return Decision::send;
+        }
+
+        if (!silent) {
+            silent = true;
+            sinceDescriptor = 0;
+            return Decision::startSilence;
+        }
+
+        sinceDescriptor += length;
+        if (sinceDescriptor >= keepAlive) {
+            sinceDescriptor = 0;
+            return Decision::keepAlive;
+        }
+        return Decision::suppress;
+    }
+
+    /** Whether frames are being suppressed. */
+    bool isSilent() const { return silent; }
+
+    /** RMS level of the background on a channel, linear. */
+    float getNoiseLevel(int channel) const {
+        return std::sqrt(levels[static_cast<size_t>(channel)]);
+    }
+
+    struct Level {
+        float peak{0.0f};
+        float meanSquare{0.0f};
+    };
+
+    /** Peak magnitude and mean square of numSamples samples. */
+    static Level measure(const float* samples, size_t numSamples) {
+        if (numSamples == 0) {
+            return {};
+        }
+
+        size_t i = 0;
+        float peak = 0.0f;
+        float sum = 0.0f;
+
+#if AUDIO_STREAM_DTX_SSE2
+        const auto signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        auto peaks = _mm_setzero_ps();
+        auto sums = _mm_setzero_ps();
+        for (; i + 4 <= numSamples; i += 4) {
+            const auto x = _mm_loadu_ps(samples + i);
+            peaks = _mm_max_ps(peaks, _mm_and_ps(x, signMask));
+            sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, peaks);
+        peak = std::max(std::max(lanes[0], lanes[1]),
+                        std::max(lanes[2], lanes[3]));
+        _mm_storeu_ps(lanes, sums);
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif AUDIO_STREAM_DTX_NEON
+        auto peaks = vdupq_n_f32(0.0f);
+        auto sums = vdupq_n_f32(0.0f);
+        for (; i + 4 <= numSamples; i += 4) {
+            const auto x = vld1q_f32(samples + i);
+            peaks = vmaxq_f32(peaks, vabsq_f32(x));
+            sums = vmlaq_f32(sums, x, x);
+        }
+        peak = vmaxvq_f32(peaks);
+        sum = vaddvq_f32(sums);
+#endif
+
+        for (; i < numSamples; ++i) {
+            peak = std::max(peak, std::abs(samples[i]));
+            sum += samples[i] * samples[i];
+        }
+
+        return {peak, sum / static_cast<float>(numSamples)};
+    }
+
+  private:
+    static constexpr float smoothing = 0.25f;
+
+    std::vector<float> levels;
+    float meanSquareThreshold{0.0f};
+    float peakThreshold{0.0f};
+    uint64_t hangover{0};
+    uint64_t keepAlive{0};
+    uint64_t silentLength{0};
+    uint64_t sinceDescriptor{0};
+    bool silent{false};
+};
+
+//==============================================================================
+/**
+ * @class ComfortNoise
+ * @brief Generates the background noise a receiver plays while the sender
+ * is silent, at the level the sender measured.
+ *
+ * The noise is white, from a xorshift generator per channel, so it costs a
+ * few operations per sample and never allocates after prepare().
+ */
+class ComfortNoise {
+  public:
+    ComfortNoise() = default;
+
+    void prepare(int maxChannels) {
+        const auto numChannels = static_cast<size_t>(std::max(1, maxChannels));
+        gains.assign(numChannels, 0.0f);
+        states.resize(numChannels);
+        for (size_t channel = 0; channel < numChannels; ++channel) {
+            states[channel] = 0x9e3779b9u * static_cast<uint32_t>(channel + 1);
+        }
+    }
+
+    /** Sets the RMS level of a channel's noise, linear. */
+    void setLevel(int channel, float level) {
+        if (channel >= 0 && static_cast<size_t>(channel) < gains.size()) {
+            // Uniform noise in [-1, 1) has an RMS level of 1 / sqrt(3)
+            gains[static_cast<size_t>(channel)] = level * std::sqrt(3.0f);
+        }
+    }
+    float getLevel(int channel) const {
+        return gains[static_cast<size_t>(channel)] / std::sqrt(3.0f);
+    }
+
+    /** Sets every channel's level to the RMS level of a planar frame. */
+    void setLevels(const float* samples, int numChannels, int numSamples) {
+        const auto length = static_cast<size_t>(std::max(0, numSamples));
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            const auto level = SilenceDetector::measure(
+                samples + static_cast<size_t>(channel) * length, length);
+            setLevel(channel, std::sqrt(level.meanSquare));
+        }
+    }
+
+    /** Writes count samples of noise from start into each output. */
+    void generate(float* const* outputs, int numChannels, int start,
+                  int count) {
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            generate(channel, outputs[channel] + start, count);
+        }
+    }
+
+    /** Writes count samples of a channel's noise into dest. */
+    void generate(int channel, float* dest, int count) {
+        if (channel < 0 || static_cast<size_t>(channel) >= gains.size()) {
+            std::fill(dest, dest + std::max(0, count), 0.0f);
+            return;
+        }
+
+        const auto gain = gains[static_cast<size_t>(channel)];
+        auto state = states[static_cast<size_t>(channel)];
+        constexpr auto scale = 1.0f / 2147483648.0f;
+
+        for (auto i = 0; i < count; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            dest[i] = static_cast<float>(static_cast<int32_t>(state)) *
+                      scale * gain;
+        }
+
+        states[static_cast<size_t>(channel)] = state;
+    }
+
+  private:
+    std::vector<float> gains;
+    std::vector<uint32_t> states;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+//==============================================================================
+/**
+ * @class DriftEstimator
+ * @brief Estimates the clock drift between sender and receiver from the
+ * playout delay and derives the resampling ratio that holds the delay on
+ * target.
+ *
+ * This is a PI controller on the smoothed delay error. The proportional term
+ * steers the delay towards a new target within a few seconds. The integral
+ * term converges on the rate mismatch between the two audio clocks, so a
+ * constant 48000 vs 48005 Hz offset is cancelled without a standing error.
+ *
+ * Until the delay first strays further than deadbandTime from its target,
+ * the ratio stays at exactly 1, so two ends on one clock are never
+ * resampled.
+ *
+ * update() is called from the audio thread, the getters may be called from
+ * any thread.
+ */
+class DriftEstimator {
+  public:
+    DriftEstimator() = default;
+
+    /**
+     * @brief Resets the controller.
+     * @param sampleRate Rate of the output device.
+     * @param maxDeviation Largest deviation of the ratio from 1.
+     */
+    void prepare(double sampleRate, double maxDeviation) {
+        rate = sampleRate;
+        limit = maxDeviation;
+        smoothedError = 0.0;
+        integral = 0.0;
+        hasError = false;
+        isSteering = false;
+
+        ratio.store(1.0, std::memory_order_relaxed);
+        driftPpm.store(0.0, std::memory_order_relaxed);
+    }
+
+    /** Forgets the delay history but keeps the drift learnt so far. */
+    void restart() {
+        hasError = false;
+        isSteering = integral != 0.0;
+    }
+
+    /**
+     * @brief Feeds one block's measurement.
+     * @param delay Audio queued ahead of the output, in samples.
+     * @param targetDelay Delay to hold, in samples.
+     * @param numSamples Length of the block.
+     * @return Input samples to consume per output sample.
+     */
+    double update(double delay, double targetDelay, int numSamples) {
+        const auto seconds = numSamples / rate;
+        const auto error = delay - targetDelay;
+
+        if (!hasError) {
+            smoothedError = error;
+            hasError = true;
+        }
+
+        smoothedError +=
+            (error - smoothedError) * std::min(seconds / smoothingTime, 1.0);
+
+        isSteering =
+            isSteering || std::abs(smoothedError) >= deadbandTime * rate;
+        if (!isSteering) {
+            ratio.store(1.0, std::memory_order_relaxed);
+            return 1.0;
+        }
+
+        // Anti-windup: the integral alone may never exceed the ratio limit
+        const auto maxIntegral = limit * proportionalTime * rate;
+        integral = std::clamp(
+            integral + smoothedError * seconds / integralTime, -maxIntegral,
+            maxIntegral);
+
+        const auto deviation = std::clamp(
+            (smoothedError + integral) / (proportionalTime * rate), -limit,
+            limit);
+
+        ratio.store(1.0 + deviation, std::memory_order_relaxed);
+        driftPpm.store(integral / (proportionalTime * rate) * 1.0e6,
+                       std::memory_order_relaxed);
+
+        return 1.0 + deviation;
+    }
+
+    /** Ratio returned by the last update(). */
+    double getRatio() const { return ratio.load(std::memory_order_relaxed); }
+
+    /** Estimated rate mismatch, positive when the sender runs fast. */
+    double getDriftPpm() const {
+        return driftPpm.load(std::memory_order_relaxed);
+    }
+
+  private:
+    /** Seconds over which the delay error is smoothed. */
+    static constexpr double smoothingTime = 0.5;
+    /** Seconds the proportional term takes to remove an error. */
+    static constexpr double proportionalTime = 2.0;
+    /** Seconds the integral term takes to learn a drift. */
+    static constexpr double integralTime = 20.0;
+    /** Delay error in seconds left alone until the clocks are steered. */
+    static constexpr double deadbandTime = 0.001;
+
+    double rate{48000.0};
+    double limit{0.005};
+    double smoothedError{0.0};
+    double integral{0.0};
+    bool hasError{false};
+    bool isSteering{false};
+
+    std::atomic<double> ratio{1.0};
+    std::atomic<double> driftPpm{0.0};
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "StreamPacket.hpp"
+
+/**
+ * Frames lost out of those expected since the last report, in the 256ths of
+ * ReceiverReportHeader::fractionLost.
+ */
+inline uint8_t getFractionLost(uint64_t numLost, uint64_t numExpected) {
+    if (numExpected == 0) {
+        return 0;
+    }
+    return static_cast<uint8_t>(
+        std::min<uint64_t>(255, numLost * 256 / numExpected));
+}
+
+//==============================================================================
+/**
+ * @class RoundTripEstimator
+ * @brief Measures the round trip to the other end of a stream from the
+ * times it echoes in its reports.
+ *
+ * A report that echoes echoTime, after holding it for echoDelay, makes the
+ * round trip now - echoTime - echoDelay, all in microseconds of this end's
+ * clock but echoDelay, which is a duration. Measurements are smoothed as
+ * TCP does. Fed by one thread, read from any.
+ */
+class RoundTripEstimator {
+  public:
+    RoundTripEstimator() = default;
+
+    void reset() {
+        roundTrip.store(0.0, std::memory_order_relaxed);
+        hasMeasurement.store(false, std::memory_order_relaxed);
+    }
+
+    /** Feeds an echo. Reports that echo nothing, or nonsense, are ignored. */
+    void addEcho(uint64_t now, uint64_t echoTime, uint32_t echoDelay) {
+        if (echoTime == 0 || now < echoTime + echoDelay) {
+            return;
+        }
+
+        const auto sample = static_cast<double>(now - echoTime - echoDelay) *
+                            1.0e-6;
+        const auto previous = getRoundTripTime();
+        roundTrip.store(hasRoundTripTime()
+                            ? previous + (sample - previous) / 8.0
+                            : sample,
+                        std::memory_order_relaxed);
+        hasMeasurement.store(true, std::memory_order_relaxed);
+    }
+
+    /** Smoothed round trip in seconds, 0 until measured. */
+    double getRoundTripTime() const {
+        return roundTrip.load(std::memory_order_relaxed);
+    }
+    bool hasRoundTripTime() const {
+        return hasMeasurement.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Takes a time of the other end's clock to this end's, in seconds, from
+     * a report it sent at sendTime that arrived at arrival. The report left
+     * half a round trip ago, which tells how far ahead that clock is,
+     * assuming the path is as long both ways. Near 0 on one machine.
+     */
+    double toLocalTime(double remoteTime, double sendTime,
+                       double arrival) const {
+        const auto offset = sendTime - (arrival - getRoundTripTime() / 2.0);
+        return remoteTime - offset;
+    }
+
+  private:
+    std::atomic<double> roundTrip{0.0};
+    std::atomic<bool> hasMeasurement{false};
+};
+
+//==============================================================================
+/**
+ * @class ReceiverFeedback
+ * @brief What a sender knows about one receiver of its stream, from the
+ * ReceiverReportHeader packets it sent back.
+ *
+ * Everything is as of the last report, with durations in seconds. The
+ * application may read it from any thread, e.g. to raise the frame
+ * duration or buffer size when loss or jitter climb.
+ */
+class ReceiverFeedback {
+  public:
+    ReceiverFeedback() = default;
+
+    /** Forgets the receiver, before it is used for another one. */
+    void reset() {
+        roundTrip.reset();
+        numReports.store(0, std::memory_order_relaxed);
+        fractionLost.store(0.0, std::memory_order_relaxed);
+        numReceived.store(0, std::memory_order_relaxed);
+        numLost.store(0, std::memory_order_relaxed);
+        jitter.store(0.0, std::memory_order_relaxed);
+        bufferDelay.store(0.0, std::memory_order_relaxed);
+        targetDelay.store(0.0, std::memory_order_relaxed);
+    }
+
+    /** Takes in a report received at now, in microseconds. */
+    void addReport(const ReceiverReportHeader& report, uint64_t now) {
+        roundTrip.addEcho(now, report.echoTime, report.echoDelay);
+        fractionLost.store(report.fractionLost / 256.0,
+                           std::memory_order_relaxed);
+        numReceived.store(report.numReceived, std::memory_order_relaxed);
+        numLost.store(report.numLost, std::memory_order_relaxed);
+        jitter.store(report.jitter * 1.0e-6, std::memory_order_relaxed);
+        bufferDelay.store(report.bufferDelay * 1.0e-6,
+                          std::memory_order_relaxed);
+        targetDelay.store(report.targetDelay * 1.0e-6,
+                          std::memory_order_relaxed);
+        numReports.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const RoundTripEstimator& getRoundTrip() const { return roundTrip; }
+    uint64_t getNumReports() const {
+        return numReports.load(std::memory_order_relaxed);
+    }
+    /** Share of frames lost between the last two reports. */
+    double getFractionLost() const {
+        return fractionLost.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumReceived() const {
+        return numReceived.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumLost() const {
+        return numLost.load(std::memory_order_relaxed);
+    }
+    double getJitter() const { return jitter.load(std::memory_order_relaxed); }
+    /** Audio queued for playout at the receiver. */
+    double getBufferDelay() const {
+        return bufferDelay.load(std::memory_order_relaxed);
+    }
+    double getTargetDelay() const {
+        return targetDelay.load(std::memory_order_relaxed);
+    }
+
+  private:
+    RoundTripEstimator roundTrip;
+    std::atomic<uint64_t> numReports{0};
+    std::atomic<double> fractionLost{0.0};
+    std::atomic<uint64_t> numReceived{0};
+    std::atomic<uint64_t> numLost{0};
+    std::atomic<double> jitter{0.0};
+    std::atomic<double> bufferDelay{0.0};
+    std::atomic<double> targetDelay{0.0};
+};
@@ -0,0 +1,585 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "StreamPacket.hpp"
+
+//==============================================================================
+/** Arithmetic in GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1. */
+namespace galois {
+struct Tables {
+    std::array<uint8_t, 512> exp{};
+    std::array<uint8_t, 256> log{};
+
+    constexpr Tables() {
+        unsigned value = 1;
+        for (auto i = 0; i < 255; ++i) {
+            exp[static_cast<size_t>(i)] = static_cast<uint8_t>(value);
+            log[value] = static_cast<uint8_t>(i);
+            value <<= 1;
+            if (value & 0x100) {
+                value ^= 0x11d;
+            }
+        }
+        for (auto i = 255; i < 512; ++i) {
+            exp[static_cast<size_t>(i)] = exp[static_cast<size_t>(i - 255)];
+        }
+    }
+};
+
+inline constexpr Tables tables{};
+
+constexpr uint8_t multiply(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return tables.exp[static_cast<size_t>(tables.log[a]) + tables.log[b]];
+}
+
+/** a / b, b must not be 0. */
+constexpr uint8_t divide(uint8_t a, uint8_t b) {
+    if (a == 0) {
+        return 0;
+    }
+    return tables.exp[static_cast<size_t>(tables.log[a]) + 255 -
+                      tables.log[b]];
+}
+
+/** dest += coefficient * src over numBytes bytes. */
+inline void multiplyAdd(uint8_t* dest, const uint8_t* src, size_t numBytes,
+                        uint8_t coefficient) {
+    if (coefficient == 0) {
+        return;
+    }
+
+    if (coefficient == 1) {
+        for (size_t i = 0; i < numBytes; ++i) {
+            dest[i] ^= src[i];
+        }
+        return;
+    }
+
+    uint8_t row[256];
+    for (auto value = 0; value < 256; ++value) {
+        row[value] = multiply(static_cast<uint8_t>(value), coefficient);
+    }
+    for (size_t i = 0; i < numBytes; ++i) {
+        dest[i] ^= row[src[i]];
+    }
+}
+}  // namespace galois
+
+//==============================================================================
+/**
+ * Coefficient of data packet dataIndex in parity row parityIndex.
+ *
+ * The rows form a Cauchy matrix whose columns are scaled so the first row is
+ * all ones: one parity packet is a plain XOR, more rows make it Reed-Solomon.
+ * Any square submatrix is invertible, so any numParity losses in a group can
+ * be rebuilt.
+ */
+constexpr uint8_t getFecCoefficient(int parityIndex, int dataIndex,
+                                    int numParity) {
+    const auto y = static_cast<uint8_t>(numParity + dataIndex);
+    return galois::divide(y, static_cast<uint8_t>(parityIndex ^ y));
+}
+
+//==============================================================================
+/**
+ * @class FecEncoder
+ * @brief Emits parity packets over groups of numData consecutive stream
+ * packets.
+ *
+ * Packets are grouped per channelIndex. Each packet is coded as a unit of its
+ * 4 byte little-endian length followed by its bytes, zero padded to the
+ * longest unit of the group. Once numData packets of a group were added,
+ * numParity parity packets are handed to the send callback.
+ *
+ * Overhead is numParity / numData. A lost packet can be rebuilt once its
+ * group's parity arrived, which costs up to numData blocks of latency.
+ *
+ * Owned by the sending thread. Only prepare() allocates; packets larger
+ * than the maxPacketSize given to it are sent without protection.
+ */
+class FecEncoder {
+  public:
+    static constexpr int maxNumData = 32;
+    static constexpr int maxNumParity = 4;
+
+    FecEncoder() = default;
+
+    /**
+     * @brief Allocates the group buffers. numParity 0 disables FEC.
+     * @param maxChannels Largest channelIndex + 1 of the packets added.
+     * @param maxPacketSize Largest stream packet added, in bytes.
+     */
+    void prepare(int numData, int numParity, size_t maxChannels,
+                 size_t maxPacketSize) {
+        k = std::clamp(numData, 1, maxNumData);
+        m = std::clamp(numParity, 0, maxNumParity);
+        maxUnitSize = maxPacketSize + lengthSize;
+
+        groups.assign(m > 0 ? maxChannels : 0, Group{});
+        for (auto& group : groups) {
+            group.units.assign(static_cast<size_t>(k),
+                               std::vector<uint8_t>(maxUnitSize));
+            group.lengths.assign(static_cast<size_t>(k), 0);
+        }
+        parity.assign(m > 0 ? FecPacketHeader::size + maxUnitSize : 0, 0);
+    }
+
+    bool isEnabled() const { return m > 0; }
+
+    /**
+     * @brief Adds a stream packet that was just sent.
+     * @param send Called as send(const uint8_t* packet, size_t size) for
+     * every parity packet.
+     */
+    template <typename Send>
+    void addPacket(const uint8_t* packet, size_t size, uint32_t streamId,
+                   uint32_t sequence, uint16_t channelIndex, Send&& send) {
+        if (channelIndex >= groups.size() ||
+            size + lengthSize > maxUnitSize) {
+            return;
+        }
+
+        auto& group = groups[channelIndex];
+        if (group.count == 0 || group.streamId != streamId) {
+            group.count = 0;
+            group.streamId = streamId;
+            group.baseSequence = sequence;
+        }
+
+        auto& unit = group.units[static_cast<size_t>(group.count)];
+        wire::writeLE(unit.data(), static_cast<uint32_t>(size));
+        std::memcpy(unit.data() + lengthSize, packet, size);
+        group.lengths[static_cast<size_t>(group.count)] = size + lengthSize;
+
+        if (++group.count < k) {
+            return;
+        }
+
+        const auto unitSize = *std::max_element(group.lengths.begin(),
+                                                group.lengths.end());
+
+        FecPacketHeader header;
+        header.numData = static_cast<uint8_t>(k);
+        header.numParity = static_cast<uint8_t>(m);
+        header.streamId = streamId;
+        header.baseSequence = group.baseSequence;
+        header.channelIndex = channelIndex;
+        header.unitSize = static_cast<uint32_t>(unitSize);
+
+        for (auto row = 0; row < m; ++row) {
+            auto* payload = parity.data() + FecPacketHeader::size;
+            std::fill(payload, payload + unitSize, uint8_t{0});
+
+            for (auto i = 0; i < k; ++i) {
+                galois::multiplyAdd(
+                    payload, group.units[static_cast<size_t>(i)].data(),
+                    group.lengths[static_cast<size_t>(i)],
+                    getFecCoefficient(row, i, m));
+            }
+
+            header.parityIndex = static_cast<uint8_t>(row);
+            header.write(parity.data());
+            send(static_cast<const uint8_t*>(parity.data()),
+                 FecPacketHeader::size + unitSize);
+        }
+
+        group.count = 0;
+    }
+
+  private:
+    static constexpr size_t lengthSize = 4;
+
+    struct Group {
+        std::vector<std::vector<uint8_t>> units;
+        std::vector<size_t> lengths;
+        int count{0};
+        uint32_t streamId{0};
+        uint32_t baseSequence{0};
+    };
+
+    int k{1};
+    int m{0};
+    size_t maxUnitSize{0};
+    std::vector<Group> groups;
+    std::vector<uint8_t> parity;
+};
+
+//==============================================================================
+/**
+ * @class FecDecoder
+ * @brief Rebuilds lost stream packets from the parity packets of a
+ * FecEncoder.
+ *
+ * The last windowSize sequences of every channelIndex are kept. Whenever a
+ * stream or parity packet arrives, its group is checked: as soon as as many
+ * packets of the group arrived (stream or parity) as it has stream packets,
+ * the missing ones are solved for and handed to the deliver callback. A
+ * group whose packets still can't be rebuilt when a newer group replaces it
+ * adds its missing packets to the unrecoverable count.
+ *
+ * Owned by the network thread. Counters may be read from any thread.
+ * Only prepare() allocates; packets larger than the maxPacketSize given to
+ * it are ignored.
+ */
+class FecDecoder {
+  public:
+    FecDecoder() = default;
+
+    /**
+     * @brief Allocates the packet history. Must not be called while packets
+     * are being added.
+     * @param windowSize Number of sequences kept per channelIndex, at least
+     * twice the largest group.
+     * @param maxChannels Largest channelIndex + 1 of the packets.
+     * @param maxPacketSize Largest stream packet, in bytes.
+     */
+    void prepare(size_t windowSize, size_t maxChannels, size_t maxPacketSize) {
+        window = std::max<size_t>(windowSize, 2 * FecEncoder::maxNumData);
+        numChannels = maxChannels;
+        maxUnitSize = maxPacketSize + lengthSize;
+
+        entries.assign(window * numChannels, Entry{});
+        for (auto& entry : entries) {
+            entry.unit.assign(maxUnitSize, 0);
+        }
+        groups.assign(numGroupSlots * numChannels, Group{});
+        for (auto& group : groups) {
+            group.parity.assign(FecEncoder::maxNumParity,
+                                std::vector<uint8_t>(maxUnitSize));
+        }
+
+        syndromes.assign(FecEncoder::maxNumParity,
+                         std::vector<uint8_t>(maxUnitSize));
+        started = false;
+    }
+
+    /**
+     * @brief Adds a stream packet that arrived.
+     * @param deliver Called as deliver(const uint8_t* packet, size_t size)
+     * for every packet rebuilt.
+     */
+    template <typename Deliver>
+    void addData(const StreamPacketHeader& header, const uint8_t* packet,
+                 size_t size, Deliver&& deliver) {
+        if (entries.empty() || header.channelIndex >= numChannels ||
+            size + lengthSize > maxUnitSize) {
+            return;
+        }
+
+        checkStream(header.streamId);
+
+        auto& entry = getEntry(header.sequence, header.channelIndex);
+        storeEntry(entry, header.sequence, packet, size);
+
+        for (size_t slot = 0; slot < numGroupSlots; ++slot) {
+            auto& group = groups[slot * numChannels + header.channelIndex];
+            const auto offset =
+                sequenceDistance(header.sequence, group.baseSequence);
+
+            if (group.active && !group.resolved && offset >= 0 &&
+                offset < group.numData) {
+                recover(group, header.channelIndex, deliver);
+            }
+        }
+    }
+
+    /**
+     * @brief Adds a parity packet that arrived.
+     * @param payload The unitSize bytes following the header.
+     */
+    template <typename Deliver>
+    void addParity(const FecPacketHeader& header, const uint8_t* payload,
+                   Deliver&& deliver) {
+        if (entries.empty() || header.channelIndex >= numChannels ||
+            header.numParity > FecEncoder::maxNumParity ||
+            header.numData > FecEncoder::maxNumData ||
+            header.unitSize > maxUnitSize) {
+            numInvalid.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        checkStream(header.streamId);
+
+        const auto slot = (header.baseSequence / header.numData) %
+                          static_cast<uint32_t>(numGroupSlots);
+        auto& group = groups[slot * numChannels + header.channelIndex];
+
+        if (!group.active || group.baseSequence != header.baseSequence ||
+            group.numData != header.numData ||
+            group.numParity != header.numParity ||
+            group.unitSize != header.unitSize) {
+            if (group.active && !group.resolved) {
+                numUnrecoverable.fetch_add(
+                    static_cast<uint64_t>(countMissing(group,
+                                                       header.channelIndex)),
+                    std::memory_order_relaxed);
+            }
+
+            group.active = true;
+            group.resolved = false;
+            group.baseSequence = header.baseSequence;
+            group.numData = header.numData;
+            group.numParity = header.numParity;
+            group.unitSize = header.unitSize;
+            group.receivedParity = 0;
+        }
+
+        if (group.resolved ||
+            (group.receivedParity & (1u << header.parityIndex)) != 0) {
+            return;
+        }
+
+        std::memcpy(group.parity[header.parityIndex].data(), payload,
+                    header.unitSize);
+        group.receivedParity |= 1u << header.parityIndex;
+
+        recover(group, header.channelIndex, deliver);
+    }
+
+    /** Stream packets rebuilt from parity. */
+    uint64_t getNumRecovered() const {
+        return numRecovered.load(std::memory_order_relaxed);
+    }
+    /** Stream packets lost in groups with too few packets to rebuild them. */
+    uint64_t getNumUnrecoverable() const {
+        return numUnrecoverable.load(std::memory_order_relaxed);
+    }
+    /** Parity packets that don't fit the prepared limits. */
+    uint64_t getNumInvalid() const {
+        return numInvalid.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t lengthSize = 4;
+    static constexpr size_t numGroupSlots = 8;
+
+    struct Entry {
+        bool valid{false};
+        uint32_t sequence{0};
+        size_t length{0};
+        std::vector<uint8_t> unit;
+    };
+
+    struct Group {
+        bool active{false};
+        bool resolved{false};
+        uint32_t baseSequence{0};
+        int numData{0};
+        int numParity{0};
+        size_t unitSize{0};
+        uint32_t receivedParity{0};
+        std::vector<std::vector<uint8_t>> parity;
+    };
+
+    size_t window{0};
+    size_t numChannels{0};
+    size_t maxUnitSize{0};
+    std::vector<Entry> entries;
+    std::vector<Group> groups;
+    std::vector<std::vector<uint8_t>> syndromes;
+    bool started{false};
+    uint32_t streamId{0};
+
+    std::atomic<uint64_t> numRecovered{0};
+    std::atomic<uint64_t> numUnrecoverable{0};
+    std::atomic<uint64_t> numInvalid{0};
+
+    void checkStream(uint32_t newStreamId) {
+        if (started && newStreamId == streamId) {
+            return;
+        }
+
+        for (auto& entry : entries) {
+            entry.valid = false;
+        }
+        for (auto& group : groups) {
+            group.active = false;
+        }
+
+        started = true;
+        streamId = newStreamId;
+    }
+
+    Entry& getEntry(uint32_t sequence, size_t channelIndex) {
+        return entries[(sequence % window) * numChannels + channelIndex];
+    }
+
+    bool hasEntry(uint32_t sequence, size_t channelIndex) {
+        const auto& entry = getEntry(sequence, channelIndex);
+        return entry.valid && entry.sequence == sequence;
+    }
+
+    static void storeEntry(Entry& entry, uint32_t sequence,
+                           const uint8_t* packet, size_t size) {
+        entry.valid = true;
+        entry.sequence = sequence;
+        entry.length = size + lengthSize;
+        wire::writeLE(entry.unit.data(), static_cast<uint32_t>(size));
+        std::memcpy(entry.unit.data() + lengthSize, packet, size);
+    }
+
+    int countMissing(const Group& group, size_t channelIndex) {
+        auto missing = 0;
+        for (auto i = 0; i < group.numData; ++i) {
+            if (!hasEntry(group.baseSequence + static_cast<uint32_t>(i),
+                          channelIndex)) {
+                ++missing;
+            }
+        }
+        return missing;
+    }
+
+    template <typename Deliver>
+    void recover(Group& group, size_t channelIndex, Deliver&& deliver) {
+        int missing[FecEncoder::maxNumParity];
+        int rows[FecEncoder::maxNumParity];
+        auto numMissing = 0;
+        auto numRows = 0;
+
+        for (auto i = 0; i < group.numData; ++i) {
+            const auto sequence = group.baseSequence + static_cast<uint32_t>(i);
+            const auto& entry = getEntry(sequence, channelIndex);
+
+            if (entry.valid && sequenceDistance(entry.sequence, sequence) > 0) {
+                // The history moved past this group, it is too late for it
+                group.resolved = true;
+                return;
+            }
+
+            if (!hasEntry(sequence, channelIndex)) {
+                if (numMissing == FecEncoder::maxNumParity) {
+                    return;
+                }
+                missing[numMissing++] = i;
+            }
+        }
+
+        if (numMissing == 0) {
+            group.resolved = true;
+            return;
+        }
+
+        for (auto row = 0; row < group.numParity && numRows < numMissing;
+             ++row) {
+            if ((group.receivedParity & (1u << row)) != 0) {
+                rows[numRows++] = row;
+            }
+        }
+
+        if (numRows < numMissing) {
+            return;
+        }
+
+        // Remove the packets that arrived from the parity rows used
+        for (auto r = 0; r < numRows; ++r) {
+            auto* syndrome = syndromes[static_cast<size_t>(r)].data();
+            std::memcpy(syndrome,
+                        group.parity[static_cast<size_t>(rows[r])].data(),
+                        group.unitSize);
+
+            for (auto i = 0; i < group.numData; ++i) {
+                const auto sequence =
+                    group.baseSequence + static_cast<uint32_t>(i);
+                if (!hasEntry(sequence, channelIndex)) {
+                    continue;
+                }
+
+                const auto& entry = getEntry(sequence, channelIndex);
+                galois::multiplyAdd(
+                    syndrome, entry.unit.data(),
+                    std::min(entry.length, group.unitSize),
+                    getFecCoefficient(rows[r], i, group.numParity));
+            }
+        }
+
+        // Invert the coefficients of the missing packets by Gauss-Jordan
+        uint8_t matrix[FecEncoder::maxNumParity][FecEncoder::maxNumParity];
+        uint8_t inverse[FecEncoder::maxNumParity][FecEncoder::maxNumParity];
+        const auto n = numMissing;
+
+        for (auto r = 0; r < n; ++r) {
+            for (auto c = 0; c < n; ++c) {
+                matrix[r][c] =
+                    getFecCoefficient(rows[r], missing[c], group.numParity);
+                inverse[r][c] = r == c ? 1 : 0;
+            }
+        }
+
+        for (auto c = 0; c < n; ++c) {
+            auto pivot = c;
+            while (pivot < n && matrix[pivot][c] == 0) {
+                ++pivot;
+            }
+            if (pivot == n) {
+                return;
+            }
+
+            for (auto j = 0; j < n; ++j) {
+                std::swap(matrix[c][j], matrix[pivot][j]);
+                std::swap(inverse[c][j], inverse[pivot][j]);
+            }
+
+            const auto scale = galois::divide(1, matrix[c][c]);
+            for (auto j = 0; j < n; ++j) {
+                matrix[c][j] = galois::multiply(matrix[c][j], scale);
+                inverse[c][j] = galois::multiply(inverse[c][j], scale);
+            }
+
+            for (auto r = 0; r < n; ++r) {
+                const auto factor = matrix[r][c];
+                if (r == c || factor == 0) {
+                    continue;
+                }
+                for (auto j = 0; j < n; ++j) {
+                    matrix[r][j] ^= galois::multiply(factor, matrix[c][j]);
+                    inverse[r][j] ^= galois::multiply(factor, inverse[c][j]);
+                }
+            }
+        }
+
+        group.resolved = true;
+
+        for (auto m = 0; m < n; ++m) {
+            const auto sequence =
+                group.baseSequence + static_cast<uint32_t>(missing[m]);
+            auto& entry = getEntry(sequence, channelIndex);
+
+            std::fill(entry.unit.begin(),
+                      entry.unit.begin() +
+                          static_cast<std::ptrdiff_t>(group.unitSize),
+                      uint8_t{0});
+            for (auto r = 0; r < n; ++r) {
+                galois::multiplyAdd(
+                    entry.unit.data(),
+                    syndromes[static_cast<size_t>(r)].data(), group.unitSize,
+                    inverse[m][r]);
+            }
+
+            const auto size = wire::readLE<uint32_t>(entry.unit.data());
+            if (group.unitSize < lengthSize ||
+                size > group.unitSize - lengthSize) {
+                entry.valid = false;
+                numUnrecoverable.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            entry.valid = true;
+            entry.sequence = sequence;
+            entry.length = size + lengthSize;
+            numRecovered.fetch_add(1, std::memory_order_relaxed);
+
+            deliver(static_cast<const uint8_t*>(entry.unit.data()) +
+                        lengthSize,
+                    static_cast<size_t>(size));
+        }
+    }
+};
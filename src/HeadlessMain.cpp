@@ -0,0 +1,420 @@
+#include <JuceHeader.h>
+
+#include <csignal>
+#include <iostream>
+
+#include "CommandLineOptions.hpp"
+#include "MetricsExporter.hpp"
+#include "RealtimeChecker.hpp"
+#include "ReceiveEngine.hpp"
+#include "Recorder.hpp"
+#include "SendThread.hpp"
+
+namespace {
+std::atomic<bool> quitRequested{false};
+
+void requestQuit(int /* signal */) { quitRequested = true; }
+
+/**
+ * Starts recording into file, if one was asked for. An existing recording
+ * is never replaced, a number is added to the name instead.
+ */
+void startRecording(Recorder& recorder, const File& file) {
+    if (file == File()) {
+        return;
+    }
+
+    const auto target = file.getNonexistentSibling();
+    if (!recorder.start(target)) {
+        std::cerr << "Couldn't record to " << target.getFullPathName()
+                  << "\n";
+    }
+}
+
+//==============================================================================
+/** Feeds the device's inputs to a SendThread, and a Recorder if asked. */
+class HeadlessSender : public AudioIODeviceCallback {
+  public:
+    HeadlessSender(SendThread& thread, int channels, Recorder& audioRecorder,
+                   const File& file)
+        : sendThread(thread),
+          numChannels(channels),
+          recorder(audioRecorder),
+          recordFile(file) {}
+
+    void audioDeviceAboutToStart(AudioIODevice* device) override {
+        sendThread.stop();
+        sendThread.prepare(device->getCurrentSampleRate());
+        sendThread.start({});
+
+        recorder.prepare(device->getCurrentSampleRate(), numChannels);
+        startRecording(recorder, recordFile);
+    }
+
+    void audioDeviceStopped() override {
+        sendThread.stop();
+        recorder.stop();
+    }
+
+    void audioDeviceIOCallbackWithContext(
+        const float* const* inputChannelData, int numInputChannels,
+        float* const* outputChannelData, int numOutputChannels,
+        int numSamples,
+        const AudioIODeviceCallbackContext& /* context */) override {
+        const RealtimeChecker::ScopedCallback callback;
+
+        for (auto channel = 0; channel < numOutputChannels; ++channel) {
+            FloatVectorOperations::clear(outputChannelData[channel],
+                                         numSamples);
+        }
+
+        const auto numChannelsSent = jmin(numInputChannels, numChannels);
+        sendThread.pushBlock(inputChannelData, numChannelsSent, numSamples);
+        recorder.write(inputChannelData, numChannelsSent, numSamples);
+    }
+
+  private:
+    SendThread& sendThread;
+    const int numChannels;
+    Recorder& recorder;
+    const File recordFile;
+};
+
+//==============================================================================
+/**
+ * Plays a ReceiveEngine's stream on the device's outputs, and records it if
+ * asked.
+ */
+class HeadlessReceiver : public AudioIODeviceCallback {
+  public:
+    HeadlessReceiver(ReceiveEngine& receiveEngine, int depthMs,
+                     Recorder& audioRecorder, const File& file)
+        : engine(receiveEngine),
+          bufferMs(depthMs),
+          recorder(audioRecorder),
+          recordFile(file) {}
+
+    void audioDeviceAboutToStart(AudioIODevice* device) override {
+        engine.prepare(device->getCurrentBufferSizeSamples(),
+                       device->getCurrentSampleRate(), bufferMs);
+        engine.setDeviceLatency((device->getOutputLatencyInSamples() +
+                                 device->getInputLatencyInSamples()) /
+                                device->getCurrentSampleRate());
+
+        // Only start receiving once the jitter buffer has been sized
+        if (!started) {
+            started = engine.start({});
+        }
+
+        recorder.prepare(device->getCurrentSampleRate(),
+                         device->getActiveOutputChannels().getHighestBit() +
+                             1);
+        startRecording(recorder, recordFile);
+    }
+
+    void audioDeviceStopped() override { recorder.stop(); }
+
+    void audioDeviceIOCallbackWithContext(
+        const float* const* inputChannelData, int numInputChannels,
+        float* const* outputChannelData, int numOutputChannels,
+        int numSamples,
+        const AudioIODeviceCallbackContext& /* context */) override {
+        const RealtimeChecker::ScopedCallback callback;
+
+        // The input, opened for latency measurement only, comes first
+        if (numInputChannels > 0) {
+            engine.writeInput(inputChannelData[0], numSamples);
+        }
+
+        const auto numChannels =
+            jmin(numOutputChannels, AUDIO_STREAM_MAX_CHANNELS);
+        engine.read(outputChannelData, numChannels, numSamples);
+        recorder.write(outputChannelData, numChannels, numSamples);
+
+        for (auto channel = numChannels; channel < numOutputChannels;
+             ++channel) {
+            FloatVectorOperations::clear(outputChannelData[channel],
+                                         numSamples);
+        }
+    }
+
+  private:
+    ReceiveEngine& engine;
+    const int bufferMs;
+    Recorder& recorder;
+    const File recordFile;
+    bool started{false};
+};
+
+//==============================================================================
+void listDevices(AudioDeviceManager& deviceManager) {
+    for (auto* type : deviceManager.getAvailableDeviceTypes()) {
+        type->scanForDevices();
+        std::cout << type->getTypeName() << "\n";
+
+        for (const auto isInput : {true, false}) {
+            for (const auto& name : type->getDeviceNames(isInput)) {
+                std::cout << "  " << (isInput ? "input:  " : "output: ")
+                          << name << "\n";
+            }
+        }
+    }
+}
+
+void printLatency(const char* name, const LatencyStats& stats) {
+    std::cerr << name << ": ";
+    if (stats.getNumMeasurements() == 0) {
+        std::cerr << "not measured\n";
+        return;
+    }
+    std::cerr << "median " << stats.getMedian() * 1000.0
+              << " ms, 90%: " << stats.get90thPercentile() * 1000.0
+              << " ms, 99%: " << stats.get99thPercentile() * 1000.0
+              << " ms, min: " << stats.getMinimum() * 1000.0
+              << " ms, max: " << stats.getMaximum() * 1000.0 << " ms over "
+              << stats.getNumMeasurements() << " runs\n";
+}
+
+String openDevice(AudioDeviceManager& deviceManager,
+                  const CommandLineOptions& options) {
+    const auto isSender = options.mode == CommandLineOptions::Mode::send;
+    // A measuring receiver listens to its own output on the first input
+    const auto numInputs =
+        isSender ? options.numChannels : (options.measureLatency ? 1 : 0);
+    const auto numOutputs = isSender ? 0 : options.numChannels;
+
+    AudioDeviceManager::AudioDeviceSetup setup;
+    setup.inputDeviceName = isSender || options.measureLatency
+                                ? String(options.deviceName)
+                                : String();
+    setup.outputDeviceName = isSender ? String() : String(options.deviceName);
+    setup.sampleRate = options.sampleRate;
+    setup.bufferSize = options.blockSize;
+    setup.inputChannels.setRange(0, numInputs, true);
+    setup.outputChannels.setRange(0, numOutputs, true);
+    setup.useDefaultInputChannels = false;
+    setup.useDefaultOutputChannels = false;
+
+    return deviceManager.initialise(numInputs, numOutputs, nullptr, false,
+                                    String(), &setup);
+}
+}  // namespace
+
+//==============================================================================
+/**
+ * Runs a sender or receiver without a user interface, until interrupted.
+ * See CommandLineOptions::getUsage() for the command line.
+ */
+int main(int argc, char* argv[]) {
+    CommandLineOptions options;
+    std::string error;
+
+    if (!options.parse({argv + 1, argv + argc}, error)) {
+        std::cerr << error << "\n\n" << CommandLineOptions::getUsage();
+        return 1;
+    }
+
+    if (options.mode == CommandLineOptions::Mode::help) {
+        std::cout << CommandLineOptions::getUsage();
+        return 0;
+    }
+
+    // Sets up the message manager the device manager needs, no window
+    ScopedJuceInitialiser_GUI juceInitialiser;
+    AudioDeviceManager deviceManager;
+
+    if (options.mode == CommandLineOptions::Mode::listDevices) {
+        listDevices(deviceManager);
+        return 0;
+    }
+
+    const auto deviceError = openDevice(deviceManager, options);
+    if (deviceError.isNotEmpty()) {
+        std::cerr << "Couldn't open the audio device: " << deviceError
+                  << "\n";
+        return 1;
+    }
+
+    std::signal(SIGINT, requestQuit);
+    std::signal(SIGTERM, requestQuit);
+
+    SendThread sendThread;
+    ReceiveEngine engine;
+    Recorder recorder;
+    std::unique_ptr<AudioIODeviceCallback> callback;
+    const auto recordFile =
+        options.recordFile.empty()
+            ? File()
+            : File::getCurrentWorkingDirectory().getChildFile(
+                  options.recordFile);
+
+    if (options.mode == CommandLineOptions::Mode::send) {
+        const SharedResourcePointer<UdpSender> udpSender;
+        const SharedResourcePointer<OSCSender> oscSender;
+        udpSender->close();
+
+        // OSC only reaches the first destination
+        const auto& first = options.destinations.front();
+        if (options.osc && !oscSender->connect(first.host, first.port)) {
+            std::cerr << "Couldn't connect to " << first.host << ":"
+                      << first.port << "\n";
+            return 1;
+        }
+
+        for (const auto& destination : options.destinations) {
+            if (!udpSender->addDestination(destination.host,
+                                           destination.port)) {
+                std::cerr << "Couldn't connect to " << destination.host
+                          << ":" << destination.port << "\n";
+                return 1;
+            }
+        }
+
+        sendThread.setSampleFormat(options.sampleFormat);
+        sendThread.setCompressionEnabled(options.compress);
+        sendThread.setFrameDuration(options.frameDurationMs);
+        sendThread.setMtu(options.mtu);
+        sendThread.setRetransmissionEnabled(options.retransmit);
+        sendThread.setDiscontinuousTransmissionEnabled(options.dtx);
+        sendThread.setFecOptions(options.fecNumData, options.fecNumParity);
+        sendThread.setLatencyProbeEnabled(options.measureLatency);
+        sendThread.setTransport(options.osc ? SendThread::Transport::osc
+                                            : SendThread::Transport::raw);
+
+        callback = std::make_unique<HeadlessSender>(
+            sendThread, options.numChannels, recorder, recordFile);
+        std::cerr << "Sending to " << options.destinations.size()
+                  << " destination(s)";
+    } else {
+        if (!engine.connect(options.port, options.multicastGroup)) {
+            std::cerr << "Couldn't connect to port " << options.port << "\n";
+            return 1;
+        }
+
+        engine.setLatencyMeasurementEnabled(options.measureLatency);
+        callback = std::make_unique<HeadlessReceiver>(
+            engine, options.bufferMs, recorder, recordFile);
+        std::cerr << "Receiving on port " << options.port;
+    }
+
+    MetricsRegistry metrics;
+    MetricsExporter metricsExporter{metrics};
+    if (!options.metricsFile.empty()) {
+        if (options.mode == CommandLineOptions::Mode::send) {
+            sendThread.addMetrics(metrics);
+        } else {
+            engine.addMetrics(metrics);
+        }
+        recorder.addMetrics(metrics);
+
+        const auto file = File::getCurrentWorkingDirectory().getChildFile(
+            options.metricsFile);
+        metricsExporter.start(file, options.metricsIntervalMs);
+        std::cerr << ", metrics to " << file.getFullPathName();
+    }
+
+    if (recordFile != File()) {
+        std::cerr << ", recording to " << recordFile.getFullPathName();
+    }
+
+    std::cerr << ", press Ctrl+C to stop\n";
+    deviceManager.addAudioCallback(callback.get());
+
+    while (!quitRequested) {
+        Thread::sleep(100);
+    }
+
+    deviceManager.removeAudioCallback(callback.get());
+    deviceManager.closeAudioDevice();
+    metricsExporter.stop();
+    engine.disconnect();
+    sendThread.stop();
+    recorder.stop();
+
+    if (options.mode == CommandLineOptions::Mode::send) {
+        const auto& udpSender = sendThread.getUdpSender();
+        std::cerr << "Dropped blocks: " << sendThread.getNumDroppedBlocks()
+                  << "\n";
+
+        if (options.retransmit) {
+            std::cerr << "NACKs: " << sendThread.getNumNacksReceived()
+                      << ", retransmitted packets: "
+                      << sendThread.getNumRetransmits()
+                      << ", too late to resend: "
+                      << sendThread.getNumExpiredRequests() << "\n";
+        }
+
+        if (options.dtx) {
+            std::cerr << "Silent frames left out: "
+                      << sendThread.getNumSuppressedFrames()
+                      << ", comfort noise packets: "
+                      << sendThread.getNumComfortNoisePackets() << "\n";
+        }
+
+        if (options.measureLatency) {
+            std::cerr << "Latency probes sent: "
+                      << sendThread.getNumProbesSent() << "\n";
+        }
+
+        for (size_t i = 0; i < SendThread::maxReceivers; ++i) {
+            if (!sendThread.isReceiverActive(i)) {
+                continue;
+            }
+
+            const auto& feedback = sendThread.getReceiverFeedback(i);
+            std::cerr << "Receiver " << i
+                      << ": lost frames: " << feedback.getNumLost()
+                      << ", jitter: " << feedback.getJitter() * 1000.0
+                      << " ms, buffer: " << feedback.getBufferDelay() * 1000.0
+                      << " ms";
+            if (feedback.getRoundTrip().hasRoundTripTime()) {
+                std::cerr << ", round trip: "
+                          << feedback.getRoundTrip().getRoundTripTime() *
+                                 1000.0
+                          << " ms";
+            }
+            std::cerr << "\n";
+        }
+
+        for (size_t i = 0; i < udpSender.getNumDestinations(); ++i) {
+            std::cerr << udpSender.getDestinationName(i)
+                      << ": packets: " << udpSender.getNumSent(i)
+                      << ", bytes: " << udpSender.getNumBytesSent(i)
+                      << ", errors: " << udpSender.getNumErrors(i) << "\n";
+        }
+    } else {
+        std::cerr << "Underruns: " << engine.getNumUnderruns()
+                  << ", concealment events: "
+                  << engine.getNumConcealmentEvents()
+                  << ", comfort noise samples: "
+                  << engine.getNumComfortNoiseSamples()
+                  << ", streams turned away: "
+                  << engine.getStreamTable().getNumRejected() << "\n";
+
+        if (options.measureLatency) {
+            const auto& meter = engine.getLatencyMeter();
+            printLatency("Network and buffer latency",
+                         meter.getNetworkLatency());
+            printLatency("Acoustic and device latency",
+                         meter.getAcousticLatency());
+            std::cerr << "Probes detected: " << meter.getNumProbesDetected()
+                      << ", missed: " << meter.getNumProbesMissed()
+                      << ", device reported latency: "
+                      << meter.getDeviceLatency() * 1000.0 << " ms\n";
+        }
+    }
+
+    if (recordFile != File()) {
+        std::cerr << "Recorded: " << recorder.getFile().getFullPathName()
+                  << ", dropped blocks: " << recorder.getNumDroppedBlocks()
+                  << ", write errors: " << recorder.getNumWriteErrors()
+                  << "\n";
+    }
+
+    if (RealtimeChecker::isEnabled()) {
+        std::cerr << "Real-time violations: "
+                  << RealtimeChecker::getNumViolations() << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//==============================================================================
+/**
+ * @class JitterBuffer
+ * @brief A lock-free single-producer/single-consumer FIFO of variable-length
+ * audio frames.
+ *
+ * The network side pushes frames and the audio callback pops them. Each frame
+ * is stored contiguously as a small header followed by its planar samples.
+ * Frames never straddle the end of the storage: when a frame doesn't fit in
+ * the tail, a padding header is written and the frame starts over at offset 0.
+ *
+ * Both read and write positions are monotonic byte counters living on their
+ * own cache lines, so the producer and the consumer never share a line they
+ * write to.
+ */
+class JitterBuffer {
+  public:
+    struct FrameInfo {
+        uint32_t numChannels{1};
+        uint32_t numSamples{0};
+        uint32_t sequence{0};
+        uint64_t timestamp{0};
+        /** Noise standing in for a frame the sender left out as silent. */
+        bool isComfortNoise{false};
+    };
+
+    /** What push() does when the frame doesn't fit. */
+    enum class OverrunPolicy {
+        dropIncoming,  ///< Reject the new frame and keep the backlog.
+        dropBacklog    ///< Reject the new frame and ask the consumer to
+                       ///< discard everything queued so latency collapses.
+    };
+
+    /** What pop() writes when there is no frame to read. */
+    enum class UnderrunPolicy {
+        silence,         ///< Output zeros.
+        repeatLastFrame  ///< Repeat the last frame, halving its gain each time.
+    };
+
+    JitterBuffer() = default;
+
+    /**
+     * @brief Allocates the storage. Must not be called while either side is
+     * active.
+     * @param capacityInSamples Minimum number of samples (across all
+     * channels) the buffer can hold.
+     * @param maxFrameSize Largest accepted frame, in samples across all
+     * channels.
+     */
+    void prepare(size_t capacityInSamples, size_t maxFrameSize) {
+        const auto maxRecordSize = recordSize(maxFrameSize);
+        const auto numRecords = capacityInSamples / std::max<size_t>(
+                                                        maxFrameSize, 1) +
+                                2;
+
+        storage.assign(numRecords * maxRecordSize, std::byte{0});
+        lastFrame.assign(maxFrameSize, 0.0f);
+        lastFrameSize = 0;
+        maxValuesPerFrame = maxFrameSize;
+        repeatGain = 1.0f;
+
+        writePos.store(0, std::memory_order_relaxed);
+        readPos.store(0, std::memory_order_relaxed);
+        numSamplesPushed.store(0, std::memory_order_relaxed);
+        numSamplesPopped.store(0, std::memory_order_relaxed);
+        flushRequested.store(false, std::memory_order_release);
+    }
+
+    void setOverrunPolicy(OverrunPolicy policy) { overrunPolicy = policy; }
+    void setUnderrunPolicy(UnderrunPolicy policy) { underrunPolicy = policy; }
+
+    /**
+     * @brief Queues a frame. Producer side only.
+     * @param info Shape of the frame.
+     * @param samples numChannels * numSamples planar samples.
+     * @return false if the frame was rejected.
+     */
+    bool push(const FrameInfo& info, const float* samples) {
+        const auto numValues =
+            static_cast<size_t>(info.numChannels) * info.numSamples;
+
+        if (storage.empty() || numValues == 0 ||
+            numValues > maxValuesPerFrame) {
+            numRejectedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const auto capacity = storage.size();
+        const auto size = recordSize(numValues);
+        const auto write = writePos.load(std::memory_order_relaxed);
+        const auto read = readPos.load(std::memory_order_acquire);
+
+        auto offset = static_cast<size_t>(write % capacity);
+        const auto padding = capacity - offset < size ? capacity - offset : 0;
+
+        if (capacity - static_cast<size_t>(write - read) < padding + size) {
+            numOverruns.fetch_add(1, std::memory_order_relaxed);
+
+            if (overrunPolicy == OverrunPolicy::dropBacklog) {
+                flushRequested.store(true, std::memory_order_release);
+            }
+            return false;
+        }
+
+        if (padding > 0) {
+            // A tail too small for a header is skipped implicitly by pop()
+            if (padding >= headerSize) {
+                writeHeader(offset, FrameInfo{0, 0});
+            }
+            offset = 0;
+        }
+
+        writeHeader(offset, info);
+        std::memcpy(storage.data() + offset + headerSize, samples,
+                    numValues * sizeof(float));
+
+        writePos.store(write + padding + size, std::memory_order_release);
+        numSamplesPushed.fetch_add(info.numSamples, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Reads the next frame into dest. Consumer side only.
+     *
+     * Exactly numValues samples are written: a shorter frame is zero-padded,
+     * a longer one is truncated, and on underrun the underrun policy decides
+     * what is written. On underrun, info describes the repeated frame, or has
+     * numSamples set to 0 when silence was written.
+     *
+     * @return false on underrun.
+     */
+    bool pop(float* dest, size_t numValues, FrameInfo* info = nullptr) {
+        if (flushRequested.exchange(false, std::memory_order_acquire)) {
+            const auto write = writePos.load(std::memory_order_acquire);
+            while (readPos.load(std::memory_order_relaxed) != write) {
+                releaseRecord(peekRecord());
+            }
+        }
+
+        if (readPos.load(std::memory_order_relaxed) ==
+            writePos.load(std::memory_order_acquire)) {
+            numUnderruns.fetch_add(1, std::memory_order_relaxed);
+            fillUnderrun(dest, numValues, info);
+            return false;
+        }
+
+        const auto record = peekRecord();
+        const auto& header = record.header;
+        const auto frameSize =
+            static_cast<size_t>(header.numChannels) * header.numSamples;
+        const auto numToCopy = std::min(frameSize, numValues);
+
+        std::memcpy(dest, record.samples, numToCopy * sizeof(float));
+        std::fill(dest + numToCopy, dest + numValues, 0.0f);
+        releaseRecord(record);
+
+        if (underrunPolicy == UnderrunPolicy::repeatLastFrame) {
+            lastFrameSize = std::min(numToCopy, lastFrame.size());
+            std::memcpy(lastFrame.data(), dest, lastFrameSize * sizeof(float));
+            lastFrameInfo = header;
+            repeatGain = 1.0f;
+        }
+
+        if (info != nullptr) {
+            *info = header;
+        }
+
+        return true;
+    }
+
+    /**
+     * Discards every queued frame and the frame kept for repetition.
+     * Consumer side only, and only while the producer is idle.
+     */
+    void clear() {
+        const auto write = writePos.load(std::memory_order_acquire);
+        while (readPos.load(std::memory_order_relaxed) != write) {
+            releaseRecord(peekRecord());
+        }
+
+        flushRequested.store(false, std::memory_order_relaxed);
+        lastFrameSize = 0;
+        repeatGain = 1.0f;
+    }
+
+    /**
+     * Number of sample frames (samples per channel) queued, i.e. how much
+     * audio is waiting to be played.
+     */
+    uint64_t getNumSamplesQueued() const {
+        const auto popped = numSamplesPopped.load(std::memory_order_acquire);
+        const auto pushed = numSamplesPushed.load(std::memory_order_acquire);
+        return pushed > popped ? pushed - popped : 0;
+    }
+
+    /** Fraction of the storage currently holding unread frames. */
+    float getFillRatio() const {
+        if (storage.empty()) {
+            return 0.0f;
+        }
+
+        const auto used = writePos.load(std::memory_order_acquire) -
+                          readPos.load(std::memory_order_acquire);
+        return static_cast<float>(used) / static_cast<float>(storage.size());
+    }
+
+    uint64_t getNumOverruns() const {
+        return numOverruns.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumUnderruns() const {
+        return numUnderruns.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumRejectedFrames() const {
+        return numRejectedFrames.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t cacheLineSize = 64;
+    static constexpr size_t headerSize = sizeof(FrameInfo);
+
+    static constexpr size_t recordSize(size_t numValues) {
+        const auto size = headerSize + numValues * sizeof(float);
+        return (size + alignof(FrameInfo) - 1) & ~(alignof(FrameInfo) - 1);
+    }
+
+    void writeHeader(size_t offset, const FrameInfo& header) {
+        std::memcpy(storage.data() + offset, &header, headerSize);
+    }
+
+    FrameInfo readHeader(size_t offset) const {
+        FrameInfo header;
+        std::memcpy(&header, storage.data() + offset, headerSize);
+        return header;
+    }
+
+    struct Record {
+        FrameInfo header;
+        const float* samples;
+        uint64_t nextReadPos;
+    };
+
+    /** Locates the next record without releasing it to the producer. */
+    Record peekRecord() const {
+        const auto capacity = storage.size();
+        auto read = readPos.load(std::memory_order_relaxed);
+        auto offset = static_cast<size_t>(read % capacity);
+
+        if (capacity - offset < headerSize ||
+            readHeader(offset).numChannels == 0) {
+            read += capacity - offset;
+            offset = 0;
+        }
+
+        const auto header = readHeader(offset);
+        const auto frameSize =
+            static_cast<size_t>(header.numChannels) * header.numSamples;
+
+        return {header,
+                reinterpret_cast<const float*>(storage.data() + offset +
+                                               headerSize),
+                read + recordSize(frameSize)};
+    }
+
+    /** Hands the record's storage back to the producer. */
+    void releaseRecord(const Record& record) {
+        numSamplesPopped.fetch_add(record.header.numSamples,
+                                   std::memory_order_release);
+        readPos.store(record.nextReadPos, std::memory_order_release);
+    }
+
+    void fillUnderrun(float* dest, size_t numValues, FrameInfo* info) {
+        const auto numToCopy =
+            underrunPolicy == UnderrunPolicy::repeatLastFrame
+                ? std::min(numValues, lastFrameSize)
+                : 0;
+
+        if (info != nullptr) {
+            *info = numToCopy > 0 ? lastFrameInfo : FrameInfo{1, 0};
+        }
+
+        for (size_t i = 0; i < numToCopy; ++i) {
+            dest[i] = lastFrame[i] * repeatGain;
+        }
+        std::fill(dest + numToCopy, dest + numValues, 0.0f);
+
+        repeatGain *= 0.5f;
+    }
+
+    // Producer-owned
+    alignas(cacheLineSize) std::atomic<uint64_t> writePos{0};
+    std::atomic<uint64_t> numSamplesPushed{0};
+
+    // Consumer-owned
+    alignas(cacheLineSize) std::atomic<uint64_t> readPos{0};
+    std::atomic<uint64_t> numSamplesPopped{0};
+    std::vector<float> lastFrame;
+    FrameInfo lastFrameInfo;
+    size_t lastFrameSize{0};
+    float repeatGain{1.0f};
+
+    // Shared
+    alignas(cacheLineSize) std::atomic<bool> flushRequested{false};
+    std::atomic<uint64_t> numOverruns{0};
+    std::atomic<uint64_t> numUnderruns{0};
+    std::atomic<uint64_t> numRejectedFrames{0};
+
+    // Set up by prepare()
+    alignas(cacheLineSize) std::vector<std::byte> storage;
+    size_t maxValuesPerFrame{0};
+    OverrunPolicy overrunPolicy{OverrunPolicy::dropIncoming};
+    UnderrunPolicy underrunPolicy{UnderrunPolicy::silence};
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//==============================================================================
+/**
+ * @class JitterEstimator
+ * @brief Measures packet arrival jitter and derives the playout delay the
+ * receiver should aim for.
+ *
+ * For every frame, the transit time (arrival time minus media timestamp, both
+ * in samples) is recorded in a sliding history. The spread between the
+ * fastest transit and the given percentile of the history is the delay needed
+ * to absorb that share of the jitter. The target delay adds one frame,
+ * because audio arrives a frame at a time, plus a safety margin.
+ *
+ * addArrival() is called from the network thread, the getters may be called
+ * from any thread.
+ */
+class JitterEstimator {
+  public:
+    JitterEstimator() = default;
+
+    /**
+     * @brief Allocates the history. Must not be called while arrivals are
+     * being added.
+     * @param historySize Number of arrivals the percentile is taken over.
+     * @param sampleRate Rate of the media timestamps.
+     * @param marginSamples Safety margin added to the target delay.
+     * @param minDelaySamples Lower bound of the target delay.
+     * @param maxDelaySamples Upper bound of the target delay.
+     */
+    void prepare(size_t historySize, double sampleRate, uint32_t marginSamples,
+                 uint32_t minDelaySamples, uint32_t maxDelaySamples) {
+        history.assign(historySize, 0.0);
+        scratch.assign(historySize, 0.0);
+        historyIndex = 0;
+        historyCount = 0;
+        rate = sampleRate;
+        margin = marginSamples;
+        extraDelay = 0;
+        minDelay = minDelaySamples;
+        maxDelay = std::max(minDelaySamples, maxDelaySamples);
+        hasPrevious = false;
+        jitter = 0.0;
+
+        // Start low and let the first estimate raise the target
+        targetDelay.store(std::min(minDelay + margin, maxDelay),
+                          std::memory_order_relaxed);
+        interarrivalJitter.store(0.0f, std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets a delay added to the target on top of the jitter, e.g. the time
+     * taken to rebuild lost packets.
+     */
+    void setExtraDelay(uint32_t samples) { extraDelay = samples; }
+
+    /** Sets which share of arrivals the target delay absorbs, 0 to 1. */
+    void setPercentile(double newPercentile) {
+        percentile = std::clamp(newPercentile, 0.0, 1.0);
+    }
+
+    /**
+     * @brief Records the arrival of a frame.
+     * @param arrivalSeconds Local arrival time on a monotonic clock.
+     * @param timestamp Media timestamp of the frame, in samples.
+     * @param frameSamples Length of the frame, in samples.
+     */
+    void addArrival(double arrivalSeconds, uint64_t timestamp,
+                    uint32_t frameSamples) {
+        if (history.empty()) {
+            return;
+        }
+
+        const auto transit =
+            arrivalSeconds * rate - static_cast<double>(timestamp);
+
+        // RFC 3550 interarrival jitter, kept for reporting
+        if (hasPrevious) {
+            jitter += (std::abs(transit - previousTransit) - jitter) / 16.0;
+            interarrivalJitter.store(static_cast<float>(jitter),
+                                     std::memory_order_relaxed);
+        }
+        previousTransit = transit;
+        hasPrevious = true;
+
+        history[historyIndex] = transit;
+        historyIndex = (historyIndex + 1) % history.size();
+        historyCount = std::min(historyCount + 1, history.size());
+
+        if (historyIndex % updateInterval == 0) {
+            updateTargetDelay(frameSamples);
+        }
+    }
+
+    /** Playout delay to aim for, in samples. */
+    uint32_t getTargetDelay() const {
+        return targetDelay.load(std::memory_order_relaxed);
+    }
+
+    /** RFC 3550 interarrival jitter, in samples. */
+    float getInterarrivalJitter() const {
+        return interarrivalJitter.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t updateInterval = 16;
+
+    std::vector<double> history;
+    std::vector<double> scratch;
+    size_t historyIndex{0};
+    size_t historyCount{0};
+    double rate{48000.0};
+    double percentile{0.95};
+    uint32_t margin{0};
+    uint32_t extraDelay{0};
+    uint32_t minDelay{0};
+    uint32_t maxDelay{0};
+
+    bool hasPrevious{false};
+    double previousTransit{0.0};
+    double jitter{0.0};
+
+    std::atomic<uint32_t> targetDelay{0};
+    std::atomic<float> interarrivalJitter{0.0f};
+
+    void updateTargetDelay(uint32_t frameSamples) {
+        const auto first = scratch.begin();
+        const auto last = first + static_cast<std::ptrdiff_t>(historyCount);
+        std::copy_n(history.begin(), historyCount, first);
+
+        const auto fastest = *std::min_element(first, last);
+        const auto nth =
+            first + static_cast<std::ptrdiff_t>(
+                        percentile * static_cast<double>(historyCount - 1));
+        std::nth_element(first, nth, last);
+
+        const auto spread = std::max(*nth - fastest, 0.0);
+        const auto target = static_cast<uint32_t>(std::lround(spread)) +
+                            frameSamples + margin + extraDelay;
+
+        targetDelay.store(std::clamp(target, minDelay, maxDelay),
+                          std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,188 @@
+#include "LatencyMeter.hpp"
+
+//==============================================================================
+LatencyMeter::LatencyMeter(const StreamTable& table,
+                           const ReceiveThread& thread)
+    : Thread("AudioStream Latency Meter"),
+      streams(table),
+      receiveThread(thread) {}
+
+LatencyMeter::~LatencyMeter() { stop(); }
+
+void LatencyMeter::prepare(double sampleRate) {
+    const auto wasRunning = isThreadRunning();
+    stop();
+
+    rate = sampleRate;
+    const auto capacity = static_cast<size_t>(
+        sampleRate * AUDIO_STREAM_LATENCY_FIFO_SECONDS);
+    const auto reference = LatencyProbe::generate(AUDIO_STREAM_PROBE_ORDER);
+
+    for (auto* tap : {&output, &input}) {
+        tap->fifo.prepare(capacity, AUDIO_STREAM_MAX_BLOCK_SIZE);
+        tap->detector.prepare(reference, AUDIO_STREAM_PROBE_THRESHOLD);
+        tap->block.resize(AUDIO_STREAM_MAX_BLOCK_SIZE);
+    }
+
+    networkLatency.prepare(AUDIO_STREAM_LATENCY_HISTORY);
+    acousticLatency.prepare(AUDIO_STREAM_LATENCY_HISTORY);
+    matcher.prepare(AUDIO_STREAM_PROBE_INTERVAL_MS / 1000.0);
+    numProbesDetected = 0;
+    numProbesMissed = 0;
+    reset();
+    prepared = true;
+
+    if (wasRunning) {
+        start();
+    }
+}
+
+bool LatencyMeter::start() { return startThread(Thread::Priority::low); }
+
+void LatencyMeter::stop() {
+    stopThread(2 * AUDIO_STREAM_LATENCY_METER_INTERVAL_MS);
+}
+
+void LatencyMeter::reset() {
+    lastProbeTimestamp = 0;
+    matcher.reset();
+}
+
+void LatencyMeter::writeOutput(const float* samples, int numSamples) {
+    write(output, samples, numSamples);
+}
+
+void LatencyMeter::writeInput(const float* samples, int numSamples) {
+    write(input, samples, numSamples);
+}
+
+void LatencyMeter::write(Tap& tap, const float* samples, int numSamples) {
+    if (tap.block.empty()) {
+        return;
+    }
+
+    // Later pieces of a large block are later by their offset
+    const auto ticks = Time::getHighResolutionTicks();
+    const auto ticksPerSample =
+        static_cast<double>(Time::getHighResolutionTicksPerSecond()) / rate;
+
+    for (auto position = 0; position < numSamples;
+         position += AUDIO_STREAM_MAX_BLOCK_SIZE) {
+        const auto count =
+            jmin(AUDIO_STREAM_MAX_BLOCK_SIZE, numSamples - position);
+        const JitterBuffer::FrameInfo info{
+            1, static_cast<uint32>(count), 0,
+            static_cast<uint64>(ticks + roundToInt(position * ticksPerSample))};
+        tap.fifo.push(info, samples + position);
+    }
+}
+
+void LatencyMeter::setDeviceLatency(double seconds) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    deviceLatency = seconds;
+}
+
+void LatencyMeter::run() {
+    while (!threadShouldExit()) {
+        wait(AUDIO_STREAM_LATENCY_METER_INTERVAL_MS);
+
+        updateProbes();
+        drain(output, [this](double time) {
+            numProbesDetected.fetch_add(1, std::memory_order_relaxed);
+            matcher.addPlayed(time, networkLatency);
+        });
+        drain(input, [this](double time) {
+            matcher.addHeard(time, acousticLatency);
+        });
+    }
+}
+
+template <typename Callback>
+void LatencyMeter::drain(Tap& tap, Callback&& onDetection) {
+    JitterBuffer::FrameInfo info;
+    while (tap.fifo.getNumSamplesQueued() > 0 &&
+           tap.fifo.pop(tap.block.data(), tap.block.size(), &info)) {
+        // Detections are dated from the block they are reported in
+        const auto start = static_cast<double>(tap.detector.getPosition());
+        const auto time = Time::highResolutionTicksToSeconds(
+            static_cast<int64>(info.timestamp));
+
+        tap.detector.process(
+            tap.block.data(), info.numSamples, [&](uint64 position) {
+                onDetection(time +
+                            (static_cast<double>(position) - start) / rate);
+            });
+    }
+}
+
+void LatencyMeter::updateProbes() {
+    for (size_t slot = 0; slot < streams.getNumSlots(); ++slot) {
+        if (streams.getState(slot) != StreamTable::State::active) {
+            continue;
+        }
+
+        const auto probe = receiveThread.getLastProbe(slot);
+        if (probe.timestamp == 0) {
+            continue;
+        }
+
+        if (probe.timestamp != lastProbeTimestamp) {
+            lastProbeTimestamp = probe.timestamp;
+            if (!matcher.addSent(probe.time, networkLatency)) {
+                numProbesMissed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        return;
+    }
+}
+
+void LatencyMeter::addMetrics(MetricsRegistry& registry) const {
+    registry.addCounter("audio_stream_latency_probes_detected_total",
+                        "Latency probes found in what was played", [this] {
+                            return isPrepared() ? double(getNumProbesDetected())
+                                                : NAN;
+                        });
+    registry.addCounter("audio_stream_latency_probes_missed_total",
+                        "Latency probes sent that were never played", [this] {
+                            return isPrepared() ? double(getNumProbesMissed())
+                                                : NAN;
+                        });
+    registry.addGauge("audio_stream_device_latency_seconds",
+                      "Output plus input latency the device reports", [this] {
+                          return isPrepared() && getDeviceLatency() > 0.0
+                                     ? getDeviceLatency()
+                                     : NAN;
+                      });
+
+    // Percentiles are NaN until the path has been measured
+    for (const auto& [path, stats] :
+         {std::pair{"network", &networkLatency},
+          std::pair{"acoustic", &acousticLatency}}) {
+        registry.addCounter(
+            "audio_stream_latency_measurements_total",
+            "Latencies measured from probes",
+            [this, stats = stats] {
+                return isPrepared() ? double(stats->getNumMeasurements())
+                                    : NAN;
+            },
+            {{"path", path}});
+
+        const std::pair<const char*, double (LatencyStats::*)() const>
+            quantiles[] = {{"0", &LatencyStats::getMinimum},
+                           {"0.5", &LatencyStats::getMedian},
+                           {"0.9", &LatencyStats::get90thPercentile},
+                           {"0.99", &LatencyStats::get99thPercentile},
+                           {"1", &LatencyStats::getMaximum}};
+        for (const auto& [quantile, getter] : quantiles) {
+            registry.addGauge(
+                "audio_stream_measured_latency_seconds",
+                "Latency measured from probes, by path and quantile",
+                [stats = stats, getter = getter] {
+                    return stats->getNumMeasurements() > 0 ? (stats->*getter)()
+                                                           : NAN;
+                },
+                {{"path", path}, {"quantile", quantile}});
+        }
+    }
+}
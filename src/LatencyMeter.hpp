@@ -0,0 +1,132 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "JitterBuffer.hpp"
+#include "LatencyProbe.hpp"
+#include "Metrics.hpp"
+#include "ReceiveThread.hpp"
+#include "StreamConfig.hpp"
+#include "StreamTable.hpp"
+
+#define AUDIO_STREAM_LATENCY_METER_INTERVAL_MS 50
+#define AUDIO_STREAM_LATENCY_FIFO_SECONDS 2
+/** How far the correlation peak must stand out of the rest, as a ratio. */
+#define AUDIO_STREAM_PROBE_THRESHOLD 8.0
+/** Measurements the percentiles are taken over. */
+#define AUDIO_STREAM_LATENCY_HISTORY 1000
+
+//==============================================================================
+/**
+ * @class LatencyMeter
+ * @brief Finds the latency probes of a sender in latency measurement mode
+ * in what a receiver plays and hears, and measures the latency from them.
+ *
+ * The audio thread copies the first output channel, and the first input
+ * channel if the device has one, into lock-free FIFOs with the time of the
+ * callback. The meter's thread wakes every
+ * AUDIO_STREAM_LATENCY_METER_INTERVAL_MS and looks for the probe in both by
+ * FFT cross-correlation with a ProbeDetector, which dates each probe to the
+ * sample, and a ProbeMatcher pairs the probes up.
+ *
+ * Two latencies are measured, each kept as LatencyStats:
+ *
+ * - Network and buffer latency, from the sender's audio callback to the
+ *   receiver's: the time a probe is played, less the time the sender says
+ *   it handled it in its reports, taken to this end's clock by the
+ *   ReceiveThread. Both ends on one machine share a clock; across machines
+ *   the clock offset is estimated from the round trip, which assumes the
+ *   path is as long both ways.
+ * - Acoustic and device latency, from an output callback to the input
+ *   callback that hears it: the time a probe is heard, less the time it was
+ *   played. It covers the output and input buffers, the converters and the
+ *   air or cable between the receiver's output and input.
+ *
+ * Glass to glass is about their sum when both ends use similar interfaces.
+ * Without an input, the latency the device reports may stand in for the
+ * second.
+ *
+ * Probes are AUDIO_STREAM_PROBE_INTERVAL_MS apart, so latencies up to that
+ * are told apart. Both ends must run at the same sample rate, as a
+ * resampled probe no longer matches. Only the first stream whose sender
+ * probes is measured.
+ */
+class LatencyMeter : public Thread {
+  public:
+    LatencyMeter(const StreamTable& table, const ReceiveThread& thread);
+    ~LatencyMeter() override;
+
+    /**
+     * Sizes the FIFOs for sampleRate and forgets every measurement. The
+     * thread is stopped meanwhile. Must not be called while the audio
+     * thread writes.
+     */
+    void prepare(double sampleRate);
+    bool start();
+    void stop();
+    /** Whether prepare() was called, i.e. latency is being measured. */
+    bool isPrepared() const {
+        return prepared.load(std::memory_order_relaxed);
+    }
+
+    /** Queues what is played, one channel. Called from the audio thread. */
+    void writeOutput(const float* samples, int numSamples);
+    /** Queues what the input hears, one channel. Audio thread only. */
+    void writeInput(const float* samples, int numSamples);
+
+    /** Sets the output plus input latency the device reports, 0 if none. */
+    void setDeviceLatency(double seconds);
+    double getDeviceLatency() const {
+        return deviceLatency.load(std::memory_order_relaxed);
+    }
+
+    const LatencyStats& getNetworkLatency() const { return networkLatency; }
+    const LatencyStats& getAcousticLatency() const { return acousticLatency; }
+    /** Probes found in what was played. */
+    uint64 getNumProbesDetected() const {
+        return numProbesDetected.load(std::memory_order_relaxed);
+    }
+    /** Probes the sender told of that were never found in what was played. */
+    uint64 getNumProbesMissed() const {
+        return numProbesMissed.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Registers the measurements, by path and quantile, which read as NaN
+     * until the meter is prepared. The registry must not outlive the meter.
+     */
+    void addMetrics(MetricsRegistry& registry) const;
+
+  private:
+    /** One channel of audio the meter listens to. */
+    struct Tap {
+        JitterBuffer fifo;
+        ProbeDetector detector;
+        std::vector<float> block;
+    };
+
+    const StreamTable& streams;
+    const ReceiveThread& receiveThread;
+    Tap output;
+    Tap input;
+    double rate{0.0};
+    std::atomic<bool> prepared{false};
+    std::atomic<double> deviceLatency{0.0};
+    std::atomic<uint64> numProbesDetected{0};
+    std::atomic<uint64> numProbesMissed{0};
+    LatencyStats networkLatency;
+    LatencyStats acousticLatency;
+
+    // Meter thread
+    uint64 lastProbeTimestamp{0};
+    ProbeMatcher matcher;
+
+    void run() override;
+    void reset();
+    void write(Tap& tap, const float* samples, int numSamples);
+    template <typename Callback>
+    void drain(Tap& tap, Callback&& onDetection);
+    void updateProbes();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LatencyMeter)
+};
@@ -0,0 +1,522 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//==============================================================================
+/**
+ * @class Fft
+ * @brief A radix-2 complex FFT, in place, for sizes that are powers of two.
+ *
+ * The twiddle factors and bit reversal table are computed by prepare(), so
+ * perform() never allocates.
+ */
+class Fft {
+  public:
+    Fft() = default;
+
+    /** Sets the size to 2^order. */
+    void prepare(int order) {
+        size = size_t{1} << std::clamp(order, 1, 24);
+
+        constexpr auto pi = 3.14159265358979323846;
+        twiddles.resize(size / 2);
+        for (size_t k = 0; k < twiddles.size(); ++k) {
+            const auto angle = -2.0 * pi * static_cast<double>(k) /
+                               static_cast<double>(size);
+            twiddles[k] = {static_cast<float>(std::cos(angle)),
+                           static_cast<float>(std::sin(angle))};
+        }
+
+        reversed.resize(size);
+        for (size_t i = 0, j = 0; i < size; ++i) {
+            reversed[i] = j;
+            auto bit = size >> 1;
+            for (; (j & bit) != 0; bit >>= 1) {
+                j ^= bit;
+            }
+            j |= bit;
+        }
+    }
+
+    size_t getSize() const { return size; }
+
+    /** Transforms size values. The inverse is scaled by 1 / size. */
+    void perform(std::complex<float>* data, bool inverse) const {
+        for (size_t i = 0; i < size; ++i) {
+            if (i < reversed[i]) {
+                std::swap(data[i], data[reversed[i]]);
+            }
+        }
+
+        for (size_t length = 2; length <= size; length <<= 1) {
+            const auto half = length / 2;
+            const auto step = size / length;
+
+            for (size_t start = 0; start < size; start += length) {
+                for (size_t k = 0; k < half; ++k) {
+                    const auto twiddle = inverse ? std::conj(twiddles[k * step])
+                                                 : twiddles[k * step];
+                    const auto a = data[start + k];
+                    const auto b = data[start + k + half] * twiddle;
+                    data[start + k] = a + b;
+                    data[start + k + half] = a - b;
+                }
+            }
+        }
+
+        if (inverse) {
+            const auto scale = 1.0f / static_cast<float>(size);
+            for (size_t i = 0; i < size; ++i) {
+                data[i] *= scale;
+            }
+        }
+    }
+
+  private:
+    size_t size{0};
+    std::vector<std::complex<float>> twiddles;
+    std::vector<size_t> reversed;
+};
+
+//==============================================================================
+/**
+ * @class LatencyProbe
+ * @brief The test signal of the latency measurement mode: a maximum length
+ * sequence, repeated every interval samples of the stream.
+ *
+ * An MLS of order n is 2^n - 1 samples of +level or -level whose circular
+ * autocorrelation is a single peak, so it stands out of any other audio
+ * when cross-correlated, and sounds like a short burst of noise.
+ *
+ * Probes start at every multiple of the interval but the first, so a
+ * stream settles before it is measured. Where they go is a function of the
+ * stream position alone, which lets the sender tell when it sent each one.
+ * add() never allocates and is safe on the audio thread.
+ */
+class LatencyProbe {
+  public:
+    LatencyProbe() = default;
+
+    /**
+     * @brief Generates the probe.
+     * @param order Order of the sequence, from 2 to 16.
+     * @param intervalSamples Distance between probe starts, at least the
+     * length of the probe.
+     * @param level Amplitude of the probe, linear.
+     */
+    void prepare(int order, uint64_t intervalSamples, float level) {
+        signal = generate(order);
+        for (auto& sample : signal) {
+            sample *= level;
+        }
+        interval = std::max<uint64_t>(intervalSamples, signal.size());
+    }
+
+    /**
+     * The maximum length sequence of an order from 2 to 16, as +1 and -1.
+     * Allocates.
+     */
+    static std::vector<float> generate(int order) {
+        // Feedback taps of a maximal length Galois LFSR for each order
+        static constexpr std::array<uint32_t, 17> taps{
+            0,     0,     0x3,   0x6,   0xc,    0x14,   0x30,   0x60,  0xb8,
+            0x110, 0x240, 0x500, 0x829, 0x100d, 0x2015, 0x6000, 0xd008};
+        order = std::clamp(order, 2, 16);
+
+        std::vector<float> sequence((size_t{1} << order) - 1);
+        uint32_t state = 1;
+        for (auto& sample : sequence) {
+            const auto bit = state & 1u;
+            state >>= 1;
+            if (bit != 0) {
+                state ^= taps[static_cast<size_t>(order)];
+            }
+            sample = bit != 0 ? 1.0f : -1.0f;
+        }
+        return sequence;
+    }
+
+    const std::vector<float>& getSignal() const { return signal; }
+    uint64_t getInterval() const { return interval; }
+
+    /** Stream position of the first probe that starts at or after position. */
+    uint64_t getNextStart(uint64_t position) const {
+        if (interval == 0) {
+            return UINT64_MAX;
+        }
+        const auto index = std::max<uint64_t>(
+            1, position / interval + (position % interval != 0 ? 1 : 0));
+        return index * interval;
+    }
+
+    /**
+     * Adds the part of any probe that falls in numSamples samples, the first
+     * of which is at stream position position.
+     */
+    void add(float* dest, uint64_t position, size_t numSamples) const {
+        if (signal.empty()) {
+            return;
+        }
+
+        for (size_t i = 0; i < numSamples;) {
+            const auto offset = (position + i) % interval;
+            if (position + i < interval || offset >= signal.size()) {
+                // Skip to the next probe
+                i += static_cast<size_t>(interval - offset);
+                continue;
+            }
+
+            const auto count = std::min(
+                numSamples - i, signal.size() - static_cast<size_t>(offset));
+            for (size_t j = 0; j < count; ++j) {
+                dest[i + j] += signal[static_cast<size_t>(offset) + j];
+            }
+            i += count;
+        }
+    }
+
+  private:
+    std::vector<float> signal;
+    uint64_t interval{0};
+};
+
+//==============================================================================
+/**
+ * @class ProbeDetector
+ * @brief Finds a known signal in a stream of audio by FFT cross-correlation.
+ *
+ * The audio is correlated with the reference by overlap-save: every time
+ * enough audio has come in, the FFT of the last FFT-size samples is
+ * multiplied by the conjugate spectrum of the reference and transformed
+ * back, which gives the correlation at every lag that the block holds
+ * entirely. The strongest lag is a detection when it stands out of the
+ * rest of the block by threshold times their RMS.
+ *
+ * Positions count the samples given to process() since prepare() or
+ * reset(). Allocates in prepare() only. Meant for a background thread, as
+ * a block of correlation takes two FFTs of twice the reference's length.
+ */
+class ProbeDetector {
+  public:
+    ProbeDetector() = default;
+
+    void prepare(const std::vector<float>& reference, double peakToRms) {
+        length = std::max<size_t>(1, reference.size());
+        threshold = peakToRms;
+
+        auto order = 1;
+        while ((size_t{1} << order) < 2 * length) {
+            ++order;
+        }
+        fft.prepare(order);
+
+        const auto size = fft.getSize();
+        hop = size - length + 1;
+
+        referenceSpectrum.assign(size, {});
+        for (size_t i = 0; i < reference.size(); ++i) {
+            referenceSpectrum[i] = reference[i];
+        }
+        fft.perform(referenceSpectrum.data(), false);
+        for (auto& bin : referenceSpectrum) {
+            bin = std::conj(bin);
+        }
+
+        input.assign(size, 0.0f);
+        spectrum.assign(size, {});
+        reset();
+    }
+
+    /** Forgets the audio so far, positions start from 0 again. */
+    void reset() {
+        numBuffered = 0;
+        bufferPosition = 0;
+        lastDetection = 0;
+        hasDetection = false;
+    }
+
+    /**
+     * @brief Feeds numSamples samples.
+     * @param onDetection Called with the position at which each reference
+     * found starts. Lags are only complete once the reference fits behind
+     * them, so a detection comes up to one FFT size late.
+     */
+    template <typename Callback>
+    void process(const float* samples, size_t numSamples,
+                 Callback&& onDetection) {
+        const auto size = input.size();
+        while (numSamples > 0 && size > 0) {
+            const auto count = std::min(numSamples, size - numBuffered);
+            std::copy(samples, samples + count, input.begin() + numBuffered);
+            numBuffered += count;
+            samples += count;
+            numSamples -= count;
+
+            if (numBuffered == size) {
+                correlate(onDetection);
+
+                // The tail is the start of the lags of the next block
+                std::copy(input.begin() + hop, input.end(), input.begin());
+                numBuffered = size - hop;
+                bufferPosition += hop;
+            }
+        }
+    }
+
+    /** Samples given to process() so far. */
+    uint64_t getPosition() const { return bufferPosition + numBuffered; }
+    size_t getLength() const { return length; }
+
+  private:
+    Fft fft;
+    std::vector<std::complex<float>> referenceSpectrum;
+    std::vector<std::complex<float>> spectrum;
+    std::vector<float> input;
+    size_t length{1};
+    size_t hop{0};
+    double threshold{0.0};
+    size_t numBuffered{0};
+    uint64_t bufferPosition{0};
+    uint64_t lastDetection{0};
+    bool hasDetection{false};
+
+    template <typename Callback>
+    void correlate(Callback& onDetection) {
+        for (size_t i = 0; i < input.size(); ++i) {
+            spectrum[i] = input[i];
+        }
+        fft.perform(spectrum.data(), false);
+        for (size_t i = 0; i < spectrum.size(); ++i) {
+            spectrum[i] *= referenceSpectrum[i];
+        }
+        fft.perform(spectrum.data(), true);
+
+        // Lags from hop on would wrap around the end of the block
+        size_t peakLag = 0;
+        auto peak = 0.0;
+        auto sumOfSquares = 0.0;
+        for (size_t lag = 0; lag < hop; ++lag) {
+            const auto value = static_cast<double>(spectrum[lag].real());
+            sumOfSquares += value * value;
+            if (std::abs(value) > peak) {
+                peak = std::abs(value);
+                peakLag = lag;
+            }
+        }
+
+        const auto rms = std::sqrt(sumOfSquares / static_cast<double>(hop));
+        if (peak <= 0.0 || peak < threshold * rms) {
+            return;
+        }
+
+        // Echoes of a probe found a moment ago are not probes themselves
+        const auto position = bufferPosition + peakLag;
+        if (hasDetection && position < lastDetection + length) {
+            return;
+        }
+
+        lastDetection = position;
+        hasDetection = true;
+        onDetection(position);
+    }
+};
+
+//==============================================================================
+/**
+ * @class LatencyStats
+ * @brief Percentiles of the last capacity latencies measured.
+ *
+ * Fed by one thread, which sorts a copy of the measurements on every add(),
+ * and read from any. Allocates in prepare() only.
+ */
+class LatencyStats {
+  public:
+    LatencyStats() = default;
+
+    void prepare(size_t capacity) {
+        values.assign(std::max<size_t>(1, capacity), 0.0);
+        sorted.assign(values.size(), 0.0);
+        reset();
+    }
+
+    void reset() {
+        numValues = 0;
+        next = 0;
+        count.store(0, std::memory_order_relaxed);
+        for (auto* reading : {&minimum, &maximum, &median, &percentile90,
+                              &percentile99}) {
+            reading->store(0.0, std::memory_order_relaxed);
+        }
+    }
+
+    /** Adds a measurement, in seconds. */
+    void add(double latency) {
+        if (values.empty()) {
+            return;
+        }
+
+        values[next] = latency;
+        next = (next + 1) % values.size();
+        numValues = std::min(numValues + 1, values.size());
+
+        const auto end = sorted.begin() + static_cast<ptrdiff_t>(numValues);
+        std::copy(values.begin(),
+                  values.begin() + static_cast<ptrdiff_t>(numValues),
+                  sorted.begin());
+        std::sort(sorted.begin(), end);
+
+        auto at = [this](double fraction) {
+            return sorted[static_cast<size_t>(std::round(
+                fraction * static_cast<double>(numValues - 1)))];
+        };
+
+        minimum.store(sorted.front(), std::memory_order_relaxed);
+        maximum.store(sorted[numValues - 1], std::memory_order_relaxed);
+        median.store(at(0.5), std::memory_order_relaxed);
+        percentile90.store(at(0.9), std::memory_order_relaxed);
+        percentile99.store(at(0.99), std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Measurements made, including those no longer kept. */
+    uint64_t getNumMeasurements() const {
+        return count.load(std::memory_order_relaxed);
+    }
+    double getMinimum() const {
+        return minimum.load(std::memory_order_relaxed);
+    }
+    double getMaximum() const {
+        return maximum.load(std::memory_order_relaxed);
+    }
+    double getMedian() const { return median.load(std::memory_order_relaxed); }
+    double get90thPercentile() const {
+        return percentile90.load(std::memory_order_relaxed);
+    }
+    double get99thPercentile() const {
+        return percentile99.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::vector<double> values;
+    std::vector<double> sorted;
+    size_t numValues{0};
+    size_t next{0};
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> minimum{0.0};
+    std::atomic<double> maximum{0.0};
+    std::atomic<double> median{0.0};
+    std::atomic<double> percentile90{0.0};
+    std::atomic<double> percentile99{0.0};
+};
+
+//==============================================================================
+/**
+ * @class ProbeMatcher
+ * @brief Pairs the probes a sender told of, those found in what was played
+ * and those found in what was heard, and measures the latencies between.
+ *
+ * A probe played is paired with the latest unpaired probe sent less than an
+ * interval before it, and a probe heard with the latest probe played less
+ * than an interval before it, once. Senders tell of a probe up to a report
+ * interval after it is played, so pairs are made whichever arrives first.
+ * The last maxEvents of each are kept. All times are in seconds of one
+ * clock. Doesn't allocate; one thread only.
+ */
+class ProbeMatcher {
+  public:
+    static constexpr size_t maxEvents = 4;
+
+    ProbeMatcher() = default;
+
+    /** Sets the distance between probes and forgets every probe. */
+    void prepare(double intervalSeconds) {
+        interval = intervalSeconds;
+        reset();
+    }
+
+    void reset() {
+        numSent = 0;
+        numPlayed = 0;
+    }
+
+    /**
+     * @brief Adds a probe the sender told of, by the time it was sent.
+     * @return false if it pushed out a probe that was never played.
+     */
+    bool addSent(double time, LatencyStats& network) {
+        const auto dropped = push(sent, numSent, Event{time});
+        match(network);
+        return dropped.matched;
+    }
+
+    /** Adds a probe found in what was played. */
+    void addPlayed(double time, LatencyStats& network) {
+        push(played, numPlayed, Event{time});
+        match(network);
+    }
+
+    /** Adds a probe found in what the input heard. */
+    void addHeard(double time, LatencyStats& acoustic) {
+        for (auto i = numPlayed; i > 0; --i) {
+            auto& event = played[i - 1];
+            const auto latency = time - event.time;
+            if (latency >= 0.0 && latency < interval) {
+                if (!event.heard) {
+                    acoustic.add(latency);
+                    event.heard = true;
+                }
+                return;
+            }
+        }
+    }
+
+  private:
+    struct Event {
+        double time{0.0};
+        /** Paired with a probe that was played, or the other way round. */
+        bool matched{false};
+        /** Heard by the input, for probes played. */
+        bool heard{false};
+    };
+
+    double interval{1.0};
+    std::array<Event, maxEvents> sent;
+    std::array<Event, maxEvents> played;
+    size_t numSent{0};
+    size_t numPlayed{0};
+
+    /** Adds an event to a window of the latest ones, dropping the oldest. */
+    static Event push(std::array<Event, maxEvents>& events, size_t& numEvents,
+                      const Event& event) {
+        Event dropped{0.0, true, true};
+        if (numEvents == maxEvents) {
+            dropped = events.front();
+            std::move(events.begin() + 1, events.end(), events.begin());
+            --numEvents;
+        }
+        events[numEvents++] = event;
+        return dropped;
+    }
+
+    void match(LatencyStats& network) {
+        for (size_t i = 0; i < numPlayed; ++i) {
+            auto& event = played[i];
+            for (auto j = numSent; j > 0 && !event.matched; --j) {
+                auto& probe = sent[j - 1];
+                const auto latency = event.time - probe.time;
+                if (!probe.matched && latency >= 0.0 && latency < interval) {
+                    network.add(latency);
+                    probe.matched = true;
+                    event.matched = true;
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//==============================================================================
+/**
+ * @class LossConcealer
+ * @brief Synthesises audio for spans lost on the network from the audio
+ * played just before them.
+ *
+ * The concealer keeps a short history of every channel. When a gap starts it
+ * analyses the history once, then extrapolates it for as long as the gap
+ * lasts, fading out so a long outage ends in silence. When real audio
+ * resumes, the extrapolation is crossfaded into it.
+ *
+ * - repeatWithFade repeats the last 10 ms and fades it out over 20 ms.
+ * - pitchRepetition finds the pitch period by normalised autocorrelation and
+ *   repeats the last period, the waveform most similar to what comes next.
+ * - linearPrediction runs a 16th order LPC predictor fitted to the history.
+ *
+ * The analysis is decimated so a loss costs a few tens of thousands of
+ * multiply-adds per channel. Owned by the audio thread.
+ */
+class LossConcealer {
+  public:
+    enum class Mode {
+        silence,
+        repeatWithFade,
+        pitchRepetition,
+        linearPrediction
+    };
+
+    LossConcealer() = default;
+
+    /** Allocates the channel histories. Not realtime safe. */
+    void prepare(int maxChannels, double sampleRate) {
+        historySize = static_cast<int>(sampleRate * 0.04);
+        minPeriod = static_cast<int>(sampleRate / 400.0);
+        maxPeriod = std::min(static_cast<int>(sampleRate / 50.0),
+                             historySize / 2);
+        holdLength = static_cast<int>(sampleRate * 0.01);
+        fadeLength = static_cast<int>(sampleRate * 0.05);
+        crossfadeLength = static_cast<int>(sampleRate * 0.0025);
+
+        channels.assign(static_cast<size_t>(maxChannels), Channel{});
+        for (auto& channel : channels) {
+            channel.history.assign(static_cast<size_t>(historySize), 0.0f);
+            channel.scratch.assign(static_cast<size_t>(historySize), 0.0f);
+            channel.coefficients.assign(lpcOrder, 0.0f);
+            channel.memory.assign(lpcOrder, 0.0f);
+        }
+        crossfade.assign(static_cast<size_t>(crossfadeLength), 0.0f);
+
+        concealing = false;
+        concealedLength = 0;
+    }
+
+    /** Forgets the history, e.g. for a new stream. Realtime safe. */
+    void reset() {
+        for (auto& channel : channels) {
+            std::fill(channel.history.begin(), channel.history.end(), 0.0f);
+            std::fill(channel.memory.begin(), channel.memory.end(), 0.0f);
+        }
+
+        concealing = false;
+        concealedLength = 0;
+    }
+
+    void setMode(Mode newMode) { mode = newMode; }
+    bool isConcealing() const { return concealing; }
+
+    /** Records real audio that was just played. */
+    void addHistory(const float* const* outputs, int numChannels, int start,
+                    int numSamples) {
+        numChannels = std::min(numChannels, static_cast<int>(channels.size()));
+
+        for (auto c = 0; c < numChannels; ++c) {
+            auto& history = channels[static_cast<size_t>(c)].history;
+            const auto* src = outputs[c] + start;
+
+            if (numSamples >= historySize) {
+                std::copy(src + numSamples - historySize, src + numSamples,
+                          history.begin());
+            } else {
+                std::move(history.begin() + numSamples, history.end(),
+                          history.begin());
+                std::copy(src, src + numSamples,
+                          history.end() - numSamples);
+            }
+        }
+    }
+
+    /** Fills a lost span, continuing the current concealment if any. */
+    void conceal(float* const* outputs, int numChannels, int start,
+                 int numSamples) {
+        numChannels = std::min(numChannels, static_cast<int>(channels.size()));
+
+        if (!concealing) {
+            concealing = true;
+            concealedLength = 0;
+            numConcealmentEvents.fetch_add(1, std::memory_order_relaxed);
+
+            for (auto c = 0; c < numChannels; ++c) {
+                analyse(channels[static_cast<size_t>(c)]);
+            }
+        }
+
+        for (auto c = 0; c < numChannels; ++c) {
+            generate(channels[static_cast<size_t>(c)], outputs[c] + start,
+                     numSamples, concealedLength);
+        }
+
+        concealedLength += numSamples;
+        numConcealedSamples.fetch_add(static_cast<uint64_t>(numSamples),
+                                      std::memory_order_relaxed);
+    }
+
+    /**
+     * Crossfades from the concealment into the real audio already written
+     * at outputs[start], and ends the concealment.
+     */
+    void endConcealment(float* const* outputs, int numChannels, int start,
+                        int numSamples) {
+        numChannels = std::min(numChannels, static_cast<int>(channels.size()));
+        const auto length = std::min(numSamples, crossfadeLength);
+
+        for (auto c = 0; c < numChannels; ++c) {
+            generate(channels[static_cast<size_t>(c)], crossfade.data(),
+                     length, concealedLength);
+
+            auto* dest = outputs[c] + start;
+            for (auto i = 0; i < length; ++i) {
+                const auto fadeIn = static_cast<float>(i + 1) /
+                                    static_cast<float>(length + 1);
+                dest[i] = dest[i] * fadeIn +
+                          crossfade[static_cast<size_t>(i)] * (1.0f - fadeIn);
+            }
+        }
+
+        concealing = false;
+    }
+
+    uint64_t getNumConcealedSamples() const {
+        return numConcealedSamples.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumConcealmentEvents() const {
+        return numConcealmentEvents.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t lpcOrder = 16;
+    static constexpr int decimation = 4;
+
+    struct Channel {
+        std::vector<float> history;
+        std::vector<float> scratch;
+        std::vector<float> coefficients;
+        std::vector<float> memory;
+        int period{1};
+    };
+
+    Mode mode{Mode::pitchRepetition};
+    std::vector<Channel> channels;
+    std::vector<float> crossfade;
+    int historySize{0};
+    int minPeriod{1};
+    int maxPeriod{1};
+    int holdLength{0};
+    int fadeLength{1};
+    int crossfadeLength{0};
+    bool concealing{false};
+    int concealedLength{0};
+
+    std::atomic<uint64_t> numConcealedSamples{0};
+    std::atomic<uint64_t> numConcealmentEvents{0};
+
+    float getGain(int n) const {
+        if (mode == Mode::repeatWithFade) {
+            return std::max(0.0f, 1.0f - static_cast<float>(n) /
+                                             static_cast<float>(
+                                                 2 * holdLength));
+        }
+
+        if (n < holdLength) {
+            return 1.0f;
+        }
+        return std::max(0.0f, 1.0f - static_cast<float>(n - holdLength) /
+                                         static_cast<float>(fadeLength));
+    }
+
+    void analyse(Channel& channel) const {
+        switch (mode) {
+            case Mode::repeatWithFade:
+                channel.period = holdLength;
+                break;
+            case Mode::pitchRepetition:
+                channel.period = findPeriod(channel.history);
+                break;
+            case Mode::linearPrediction:
+                fitPredictor(channel);
+                break;
+            case Mode::silence:
+                break;
+        }
+    }
+
+    void generate(Channel& channel, float* dest, int numSamples,
+                  int offset) const {
+        const auto& history = channel.history;
+
+        for (auto i = 0; i < numSamples; ++i) {
+            const auto n = offset + i;
+            auto value = 0.0f;
+
+            switch (mode) {
+                case Mode::repeatWithFade:
+                case Mode::pitchRepetition: {
+                    const auto index =
+                        historySize - channel.period + n % channel.period;
+                    value = history[static_cast<size_t>(index)];
+                    break;
+                }
+                case Mode::linearPrediction: {
+                    auto& memory = channel.memory;
+                    for (size_t k = 0; k < lpcOrder; ++k) {
+                        value += channel.coefficients[k] * memory[k];
+                    }
+                    std::move_backward(memory.begin(), memory.end() - 1,
+                                       memory.end());
+                    memory[0] = value;
+                    break;
+                }
+                case Mode::silence:
+                    break;
+            }
+
+            dest[i] = value * getGain(n);
+        }
+    }
+
+    /** Pitch period at the end of the history, searched coarse to fine. */
+    int findPeriod(const std::vector<float>& history) const {
+        const auto window = historySize - maxPeriod;
+        const auto* end = history.data() + historySize;
+
+        auto correlation = [&](int lag, int step) {
+            auto xy = 0.0f, yy = 1.0e-9f;
+            for (auto i = 1; i <= window; i += step) {
+                const auto x = end[-i];
+                const auto y = end[-i - lag];
+                xy += x * y;
+                yy += y * y;
+            }
+            return xy / std::sqrt(yy);
+        };
+
+        auto best = minPeriod;
+        auto bestScore = -1.0e9f;
+        for (auto lag = minPeriod; lag <= maxPeriod; lag += decimation) {
+            const auto score = correlation(lag, decimation);
+            if (score > bestScore) {
+                bestScore = score;
+                best = lag;
+            }
+        }
+
+        const auto coarse = best;
+        bestScore = -1.0e9f;
+        for (auto lag = std::max(minPeriod, coarse - decimation);
+             lag <= std::min(maxPeriod, coarse + decimation); ++lag) {
+            const auto score = correlation(lag, 1);
+            if (score > bestScore) {
+                bestScore = score;
+                best = lag;
+            }
+        }
+
+        return best;
+    }
+
+    /** Fits the LPC predictor by autocorrelation and Levinson-Durbin. */
+    void fitPredictor(Channel& channel) const {
+        auto& windowed = channel.scratch;
+        const auto n = historySize;
+        constexpr auto twoPi = 6.28318530717958647692;
+
+        for (auto i = 0; i < n; ++i) {
+            const auto hann = 0.5 - 0.5 * std::cos(twoPi * i / (n - 1));
+            windowed[static_cast<size_t>(i)] =
+                channel.history[static_cast<size_t>(i)] *
+                static_cast<float>(hann);
+        }
+
+        double r[lpcOrder + 1];
+        for (size_t lag = 0; lag <= lpcOrder; ++lag) {
+            r[lag] = 0.0;
+            for (auto i = static_cast<int>(lag); i < n; ++i) {
+                const auto index = static_cast<size_t>(i);
+                r[lag] += static_cast<double>(windowed[index]) *
+                          windowed[index - lag];
+            }
+        }
+        r[0] *= 1.0001;  // White noise correction keeps the filter stable
+
+        double a[lpcOrder + 1] = {1.0};
+        auto error = r[0];
+        for (size_t i = 1; i <= lpcOrder && error > 1.0e-12; ++i) {
+            auto acc = r[i];
+            for (size_t j = 1; j < i; ++j) {
+                acc += a[j] * r[i - j];
+            }
+
+            const auto k = -acc / error;
+            double previous[lpcOrder + 1];
+            std::copy(a, a + lpcOrder + 1, previous);
+            for (size_t j = 1; j < i; ++j) {
+                a[j] = previous[j] + k * previous[i - j];
+            }
+            a[i] = k;
+            error *= 1.0 - k * k;
+        }
+
+        for (size_t k = 0; k < lpcOrder; ++k) {
+            channel.coefficients[k] = static_cast<float>(-a[k + 1]);
+            channel.memory[k] =
+                channel.history[static_cast<size_t>(historySize) - 1 - k];
+        }
+    }
+};
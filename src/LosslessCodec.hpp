@@ -0,0 +1,601 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "StreamPacket.hpp"
+
+//==============================================================================
+/**
+ * @class LosslessCodec
+ * @brief Compresses blocks of audio without loss, FLAC-style, with no framing
+ * delay beyond the block itself.
+ *
+ * Every channel is coded on its own as a subframe:
+ * - constant: every sample is the same, e.g. digital silence.
+ * - lpc: samples that are exact 24-bit values (which includes any 16 or 24
+ *   bit source at unity gain) are predicted by a quantised linear predictor
+ *   of order 0 to maxOrder, and the residual is Rice coded in partitions of
+ *   partitionSize samples, each with its own parameter. Low bits that are
+ *   zero in the whole block are shifted out first.
+ * - verbatim: anything else is sent as raw float32, so decoding is always
+ *   bit exact.
+ *
+ * The predictor order is chosen per block by the estimated size of the
+ * residual. Doesn't allocate after prepare(). One instance per thread.
+ */
+class LosslessCodec {
+  public:
+    static constexpr int maxOrder = 12;
+    static constexpr int partitionSize = 64;
+
+    LosslessCodec() = default;
+
+    /** Allocates the scratch space for blocks of up to maxSamples. */
+    void prepare(int maxSamples) {
+        const auto size = static_cast<size_t>(std::max(maxSamples, 1));
+        samples.assign(size, 0);
+        residual.assign(size, 0);
+        bestResidual.assign(size, 0);
+        windowed.assign(size, 0.0);
+        window.assign(size, 0.0);
+        windowLength = 0;
+    }
+
+    /** Largest number of bytes encode() may write for the given block. */
+    static size_t getMaxEncodedSize(int numChannels, int numSamples) {
+        return static_cast<size_t>(numChannels) *
+               (1 + static_cast<size_t>(numSamples) * sizeof(float));
+    }
+
+    /**
+     * @brief Encodes numChannels planar channels of numSamples samples.
+     * @return Bytes written, or 0 if dest is too small or the block larger
+     * than prepared for.
+     */
+    size_t encode(const float* planar, int numChannels, int numSamples,
+                  uint8_t* dest, size_t capacity) {
+        if (numSamples <= 0 ||
+            static_cast<size_t>(numSamples) > samples.size()) {
+            return 0;
+        }
+
+        size_t written = 0;
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            const auto size = encodeChannel(
+                planar + static_cast<size_t>(channel) * numSamples, numSamples,
+                dest + written, capacity - written);
+            if (size == 0) {
+                return 0;
+            }
+            written += size;
+        }
+        return written;
+    }
+
+    /**
+     * @brief Decodes what encode() wrote into numChannels planar channels.
+     * @return false if the data is malformed or truncated.
+     */
+    bool decode(const uint8_t* src, size_t size, int numChannels,
+                int numSamples, float* planar) {
+        if (numSamples <= 0 ||
+            static_cast<size_t>(numSamples) > samples.size()) {
+            return false;
+        }
+
+        size_t read = 0;
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            const auto used = decodeChannel(
+                src + read, size - read, numSamples,
+                planar + static_cast<size_t>(channel) * numSamples);
+            if (used == 0) {
+                return false;
+            }
+            read += used;
+        }
+        return true;
+    }
+
+  private:
+    enum Subframe : uint8_t {
+        verbatimSubframe = 0,
+        constantSubframe = 1,
+        lpcSubframe = 2
+    };
+
+    static constexpr double scale = 8388608.0;  // 2^23
+    static constexpr int precision = 12;
+    static constexpr int riceParameterBits = 5;
+    static constexpr int candidateOrders[] = {0, 1, 2, 4, 8, maxOrder};
+
+    std::vector<int32_t> samples;
+    std::vector<int32_t> residual;
+    std::vector<int32_t> bestResidual;
+    std::vector<double> windowed;
+    std::vector<double> window;
+    int windowLength{0};
+
+    //==========================================================================
+    class BitWriter {
+      public:
+        BitWriter(uint8_t* destination, size_t size)
+            : dest(destination), capacity(size) {}
+
+        /** Writes the low count bits of value, count at most 32. */
+        void write(uint32_t value, int count) {
+            accumulator = (accumulator << count) | value;
+            numBits += count;
+
+            while (numBits >= 8) {
+                numBits -= 8;
+                if (position < capacity) {
+                    dest[position++] =
+                        static_cast<uint8_t>(accumulator >> numBits);
+                } else {
+                    overflow = true;
+                }
+            }
+        }
+
+        void writeUnary(uint32_t zeros) {
+            for (; zeros >= 32; zeros -= 32) {
+                write(0, 32);
+            }
+            write(1, static_cast<int>(zeros) + 1);
+        }
+
+        /** Flushes the last partial byte, returns the bytes used or 0. */
+        size_t finish() {
+            if (numBits != 0) {
+                write(0, 8 - numBits);
+            }
+            return overflow ? 0 : position;
+        }
+
+      private:
+        uint8_t* dest;
+        size_t capacity;
+        size_t position{0};
+        uint64_t accumulator{0};
+        int numBits{0};
+        bool overflow{false};
+    };
+
+    class BitReader {
+      public:
+        BitReader(const uint8_t* source, size_t size)
+            : src(source), numBytes(size) {}
+
+        uint32_t read(int count) {
+            uint32_t value = 0;
+            while (count > 0) {
+                if (bitPosition >= numBytes * 8) {
+                    failed = true;
+                    return 0;
+                }
+
+                const auto available = 8 - static_cast<int>(bitPosition % 8);
+                const auto take = std::min(available, count);
+                const auto bits = (src[bitPosition / 8] >> (available - take)) &
+                                  ((1u << take) - 1);
+
+                value = (value << take) | bits;
+                bitPosition += static_cast<size_t>(take);
+                count -= take;
+            }
+            return value;
+        }
+
+        uint32_t readUnary() {
+            uint32_t zeros = 0;
+            while (bitPosition < numBytes * 8) {
+                const auto offset = static_cast<int>(bitPosition % 8);
+                const auto bits =
+                    static_cast<uint8_t>(src[bitPosition / 8] << offset);
+
+                if (bits == 0) {
+                    zeros += static_cast<uint32_t>(8 - offset);
+                    bitPosition += static_cast<size_t>(8 - offset);
+                    continue;
+                }
+
+                const auto leading = std::countl_zero(bits);
+                zeros += static_cast<uint32_t>(leading);
+                bitPosition += static_cast<size_t>(leading) + 1;
+                return zeros;
+            }
+
+            failed = true;
+            return zeros;
+        }
+
+        bool hasFailed() const { return failed; }
+        /** Bytes consumed, counting the last partial byte. */
+        size_t getBytesUsed() const { return (bitPosition + 7) / 8; }
+
+      private:
+        const uint8_t* src;
+        size_t numBytes;
+        size_t bitPosition{0};
+        bool failed{false};
+    };
+
+    //==========================================================================
+    static uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^
+               static_cast<uint32_t>(value >> 31);
+    }
+
+    static int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^
+               -static_cast<int32_t>(value & 1);
+    }
+
+    /**
+     * Bits taken by a partition at its best Rice parameter, estimated from
+     * the sum of the values like FLAC does.
+     */
+    static uint64_t getRiceBits(const int32_t* values, int count,
+                                int& parameter) {
+        uint64_t sum = 0;
+        for (auto i = 0; i < count; ++i) {
+            sum += zigzag(values[i]);
+        }
+
+        auto bestBits = UINT64_MAX;
+        for (auto k = 0; k <= 30; ++k) {
+            const auto bits = riceParameterBits +
+                              static_cast<uint64_t>(count) * (1 + k) +
+                              (sum >> k);
+            if (bits < bestBits) {
+                bestBits = bits;
+                parameter = k;
+            }
+        }
+        return bestBits;
+    }
+
+    static uint64_t getResidualBits(const int32_t* values, int count) {
+        uint64_t bits = 0;
+        for (auto start = 0; start < count; start += partitionSize) {
+            auto parameter = 0;
+            bits += getRiceBits(values + start,
+                                std::min(partitionSize, count - start),
+                                parameter);
+        }
+        return bits;
+    }
+
+    /** Residual of an order-n predictor, false if it would overflow. */
+    bool predict(const int32_t* x, int numSamples, const int16_t* coefficients,
+                 int order, int shift, int32_t* out) const {
+        for (auto n = order; n < numSamples; ++n) {
+            int64_t sum = 0;
+            for (auto j = 0; j < order; ++j) {
+                sum += static_cast<int64_t>(coefficients[j]) * x[n - 1 - j];
+            }
+            const auto value = x[n] - (sum >> shift);
+            if (value < -(int64_t{1} << 30) || value >= (int64_t{1} << 30)) {
+                return false;
+            }
+            out[n - order] = static_cast<int32_t>(value);
+        }
+        return true;
+    }
+
+    /** Fits predictors of every order by Levinson-Durbin. */
+    void fitPredictors(int numSamples, double (&lpc)[maxOrder + 1][maxOrder]) {
+        if (windowLength != numSamples) {
+            constexpr auto twoPi = 6.28318530717958647692;
+            for (auto i = 0; i < numSamples; ++i) {
+                window[static_cast<size_t>(i)] =
+                    numSamples > 1
+                        ? 0.5 - 0.5 * std::cos(twoPi * i / (numSamples - 1))
+                        : 1.0;
+            }
+            windowLength = numSamples;
+        }
+
+        for (auto i = 0; i < numSamples; ++i) {
+            const auto index = static_cast<size_t>(i);
+            windowed[index] = samples[index] * window[index];
+        }
+
+        double r[maxOrder + 1];
+        for (auto lag = 0; lag <= maxOrder; ++lag) {
+            r[lag] = 0.0;
+            for (auto i = lag; i < numSamples; ++i) {
+                r[lag] += windowed[static_cast<size_t>(i)] *
+                          windowed[static_cast<size_t>(i - lag)];
+            }
+        }
+        r[0] *= 1.0 + 1.0e-9;
+
+        double a[maxOrder + 1] = {1.0};
+        auto error = r[0];
+        for (auto order = 1; order <= maxOrder; ++order) {
+            if (error <= 0.0) {
+                std::copy(lpc[order - 1], lpc[order - 1] + maxOrder,
+                          lpc[order]);
+                continue;
+            }
+
+            auto acc = r[order];
+            for (auto j = 1; j < order; ++j) {
+                acc += a[j] * r[order - j];
+            }
+
+            const auto k = -acc / error;
+            double previous[maxOrder + 1];
+            std::copy(a, a + maxOrder + 1, previous);
+            for (auto j = 1; j < order; ++j) {
+                a[j] = previous[j] + k * previous[order - j];
+            }
+            a[order] = k;
+            error *= 1.0 - k * k;
+
+            for (auto j = 0; j < order; ++j) {
+                lpc[order][j] = -a[j + 1];
+            }
+        }
+    }
+
+    static int quantise(const double* lpc, int order, int16_t* coefficients) {
+        auto maxMagnitude = 0.0;
+        for (auto j = 0; j < order; ++j) {
+            maxMagnitude = std::max(maxMagnitude, std::abs(lpc[j]));
+        }
+
+        auto exponent = 0;
+        std::frexp(maxMagnitude, &exponent);
+        const auto shift = std::clamp(precision - 1 - exponent, 0, 15);
+        const auto limit = (1 << (precision - 1)) - 1;
+
+        auto error = 0.0;
+        for (auto j = 0; j < order; ++j) {
+            error += lpc[j] * (1 << shift);
+            const auto q = std::clamp(static_cast<int>(std::lround(error)),
+                                      -limit - 1, limit);
+            coefficients[j] = static_cast<int16_t>(q);
+            error -= q;
+        }
+        return shift;
+    }
+
+    size_t encodeChannel(const float* input, int numSamples, uint8_t* dest,
+                         size_t capacity) {
+        const auto verbatimSize =
+            1 + static_cast<size_t>(numSamples) * sizeof(float);
+
+        auto isInteger = true;
+        auto isConstant = true;
+        uint32_t allBits = 0;
+        for (auto i = 0; i < numSamples && isInteger; ++i) {
+            const auto value = static_cast<double>(input[i]) * scale;
+            isInteger = value == std::floor(value) && value >= -scale &&
+                        value < scale;
+            samples[static_cast<size_t>(i)] = static_cast<int32_t>(value);
+            allBits |= static_cast<uint32_t>(samples[static_cast<size_t>(i)]);
+            isConstant = isConstant && input[i] == input[0];
+        }
+
+        if (isInteger && isConstant) {
+            if (capacity < 5) {
+                return 0;
+            }
+            dest[0] = constantSubframe;
+            wire::writeLE(dest + 1, static_cast<uint32_t>(samples[0]));
+            return 5;
+        }
+
+        if (isInteger) {
+            const auto size =
+                encodeLpc(numSamples, allBits, dest, std::min(capacity,
+                                                              verbatimSize));
+            if (size != 0) {
+                return size;
+            }
+        }
+
+        if (capacity < verbatimSize) {
+            return 0;
+        }
+        dest[0] = verbatimSubframe;
+        for (auto i = 0; i < numSamples; ++i) {
+            uint32_t bits;
+            std::memcpy(&bits, input + i, sizeof(bits));
+            wire::writeLE(dest + 1 + static_cast<size_t>(i) * 4, bits);
+        }
+        return verbatimSize;
+    }
+
+    /** Writes an lpc subframe, or returns 0 if it wouldn't fit. */
+    size_t encodeLpc(int numSamples, uint32_t allBits, uint8_t* dest,
+                     size_t capacity) {
+        auto wasted = 0;
+        while (wasted < 24 && (allBits & (1u << wasted)) == 0) {
+            ++wasted;
+        }
+        for (auto i = 0; i < numSamples; ++i) {
+            samples[static_cast<size_t>(i)] >>= wasted;
+        }
+
+        double lpc[maxOrder + 1][maxOrder] = {};
+        fitPredictors(numSamples, lpc);
+
+        auto bestBits = UINT64_MAX;
+        auto bestOrder = 0;
+        auto bestShift = 0;
+        int16_t bestCoefficients[maxOrder] = {};
+
+        for (const auto order : candidateOrders) {
+            if (order >= numSamples) {
+                break;
+            }
+
+            int16_t coefficients[maxOrder] = {};
+            const auto shift = quantise(lpc[order], order, coefficients);
+            if (!predict(samples.data(), numSamples, coefficients, order,
+                         shift, residual.data())) {
+                continue;
+            }
+
+            const auto bits =
+                getResidualBits(residual.data(), numSamples - order) +
+                static_cast<uint64_t>(order) * (16 + 32);
+            if (bits < bestBits) {
+                bestBits = bits;
+                bestOrder = order;
+                bestShift = shift;
+                std::copy(coefficients, coefficients + maxOrder,
+                          bestCoefficients);
+                std::swap(residual, bestResidual);
+            }
+        }
+
+        const auto headerSize = 4 + static_cast<size_t>(bestOrder) * (2 + 4);
+        if (bestBits == UINT64_MAX ||
+            headerSize + bestBits / 8 + 1 > capacity) {
+            return 0;
+        }
+
+        dest[0] = lpcSubframe;
+        dest[1] = static_cast<uint8_t>(wasted);
+        dest[2] = static_cast<uint8_t>(bestOrder);
+        dest[3] = static_cast<uint8_t>(bestShift);
+        auto* field = dest + 4;
+        for (auto j = 0; j < bestOrder; ++j, field += 2) {
+            wire::writeLE(field, static_cast<uint16_t>(bestCoefficients[j]));
+        }
+        for (auto j = 0; j < bestOrder; ++j, field += 4) {
+            const auto warmup = samples[static_cast<size_t>(j)];
+            wire::writeLE(field, static_cast<uint32_t>(warmup));
+        }
+
+        BitWriter writer(field, capacity - headerSize);
+        const auto count = numSamples - bestOrder;
+        for (auto start = 0; start < count; start += partitionSize) {
+            const auto length = std::min(partitionSize, count - start);
+            auto parameter = 0;
+            getRiceBits(bestResidual.data() + start, length, parameter);
+
+            writer.write(static_cast<uint32_t>(parameter), riceParameterBits);
+            for (auto i = 0; i < length; ++i) {
+                const auto value =
+                    zigzag(bestResidual[static_cast<size_t>(start + i)]);
+                writer.writeUnary(value >> parameter);
+                writer.write(value & ((1u << parameter) - 1), parameter);
+            }
+        }
+
+        const auto bitsSize = writer.finish();
+        return bitsSize == 0 && count > 0 ? 0 : headerSize + bitsSize;
+    }
+
+    size_t decodeChannel(const uint8_t* src, size_t size, int numSamples,
+                         float* output) {
+        if (size == 0) {
+            return 0;
+        }
+
+        switch (src[0]) {
+            case verbatimSubframe: {
+                const auto needed =
+                    1 + static_cast<size_t>(numSamples) * sizeof(float);
+                if (size < needed) {
+                    return 0;
+                }
+                for (auto i = 0; i < numSamples; ++i) {
+                    const auto bits = wire::readLE<uint32_t>(
+                        src + 1 + static_cast<size_t>(i) * 4);
+                    std::memcpy(output + i, &bits, sizeof(bits));
+                }
+                return needed;
+            }
+            case constantSubframe: {
+                if (size < 5) {
+                    return 0;
+                }
+                const auto value = static_cast<float>(
+                    static_cast<int32_t>(wire::readLE<uint32_t>(src + 1)) /
+                    scale);
+                std::fill(output, output + numSamples, value);
+                return 5;
+            }
+            case lpcSubframe:
+                return decodeLpc(src, size, numSamples, output);
+            default:
+                return 0;
+        }
+    }
+
+    size_t decodeLpc(const uint8_t* src, size_t size, int numSamples,
+                     float* output) {
+        if (size < 4) {
+            return 0;
+        }
+
+        const auto wasted = static_cast<int>(src[1]);
+        const auto order = static_cast<int>(src[2]);
+        const auto shift = static_cast<int>(src[3]);
+        const auto headerSize = 4 + static_cast<size_t>(order) * (2 + 4);
+        if (wasted > 24 || order > maxOrder || order >= numSamples ||
+            shift > 15 || size < headerSize) {
+            return 0;
+        }
+
+        int16_t coefficients[maxOrder] = {};
+        const auto* field = src + 4;
+        for (auto j = 0; j < order; ++j, field += 2) {
+            coefficients[j] =
+                static_cast<int16_t>(wire::readLE<uint16_t>(field));
+        }
+        for (auto j = 0; j < order; ++j, field += 4) {
+            samples[static_cast<size_t>(j)] =
+                static_cast<int32_t>(wire::readLE<uint32_t>(field));
+        }
+
+        BitReader reader(field, size - headerSize);
+        for (auto start = order; start < numSamples; start += partitionSize) {
+            const auto end = std::min(start + partitionSize, numSamples);
+            const auto parameter =
+                static_cast<int>(reader.read(riceParameterBits));
+            if (parameter > 30) {
+                return 0;
+            }
+
+            for (auto n = start; n < end; ++n) {
+                const auto high = reader.readUnary();
+                if (reader.hasFailed() || high > (UINT32_MAX >> parameter)) {
+                    return 0;
+                }
+                const auto value = unzigzag((high << parameter) |
+                                            reader.read(parameter));
+
+                int64_t sum = 0;
+                for (auto j = 0; j < order; ++j) {
+                    sum += static_cast<int64_t>(coefficients[j]) *
+                           samples[static_cast<size_t>(n - 1 - j)];
+                }
+                samples[static_cast<size_t>(n)] =
+                    static_cast<int32_t>(value + (sum >> shift));
+            }
+        }
+
+        if (reader.hasFailed()) {
+            return 0;
+        }
+
+        for (auto i = 0; i < numSamples; ++i) {
+            output[i] = static_cast<float>(
+                static_cast<int64_t>(samples[static_cast<size_t>(i)])
+                    * (int64_t{1} << wasted) / scale);
+        }
+        return headerSize + reader.getBytesUsed();
+    }
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/**
+ * @class Histogram
+ * @brief Counts values into fixed buckets without locks.
+ *
+ * Bucket i holds the values up to firstBound * factor^i, and one more bucket
+ * holds everything larger. record() is a handful of relaxed atomic updates,
+ * cheap enough for the audio thread. Readers may see a count and a sum that
+ * are one value apart.
+ */
+class Histogram {
+  public:
+    Histogram(double firstBound, double factor, size_t numBuckets)
+        : bounds(numBuckets),
+          counts(std::make_unique<std::atomic<uint64_t>[]>(numBuckets + 1)) {
+        auto bound = firstBound;
+        for (auto& b : bounds) {
+            b = bound;
+            bound *= factor;
+        }
+    }
+
+    void record(double value) {
+        const auto bucket = static_cast<size_t>(
+            std::lower_bound(bounds.begin(), bounds.end(), value) -
+            bounds.begin());
+
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** Number of bounded buckets, not counting the overflow bucket. */
+    size_t getNumBuckets() const { return bounds.size(); }
+    double getUpperBound(size_t bucket) const { return bounds[bucket]; }
+    /** Values in one bucket; getNumBuckets() is the overflow bucket. */
+    uint64_t getBucketCount(size_t bucket) const {
+        return counts[bucket].load(std::memory_order_relaxed);
+    }
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    double getSum() const { return sum.load(std::memory_order_relaxed); }
+
+    /**
+     * Upper bound of the bucket holding the given fraction of the values,
+     * infinity if that is the overflow bucket, or 0 if there are none.
+     */
+    double getPercentile(double fraction) const {
+        const auto total = getCount();
+        if (total == 0) {
+            return 0.0;
+        }
+
+        const auto rank = static_cast<uint64_t>(
+            std::ceil(fraction * static_cast<double>(total)));
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            cumulative += getBucketCount(i);
+            if (cumulative >= std::max<uint64_t>(rank, 1)) {
+                return bounds[i];
+            }
+        }
+        return INFINITY;
+    }
+
+  private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0.0};
+};
+
+//==============================================================================
+/**
+ * @class ScopedTimer
+ * @brief Records the seconds spent in a scope into a Histogram.
+ */
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(Histogram& target)
+        : histogram(target), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        histogram.record(std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    Histogram& histogram;
+    const std::chrono::steady_clock::time_point start;
+};
+
+//==============================================================================
+/**
+ * @class MetricsRegistry
+ * @brief A list of named metrics that can be read without locks and
+ * rendered as Prometheus text or JSON.
+ *
+ * Counters and gauges are read through a function, normally a relaxed load
+ * of an atomic the owning thread updates anyway, so registering a metric
+ * adds no work to the audio or network threads. A reading that is NaN is
+ * skipped, e.g. for a stream slot that is not in use.
+ *
+ * Metrics are registered before anything reads the registry, and the
+ * objects read must outlive it.
+ */
+class MetricsRegistry {
+  public:
+    enum class Type { counter, gauge, histogram };
+
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    struct Metric {
+        std::string name;
+        std::string help;
+        Labels labels;
+        Type type;
+        std::function<double()> read;
+        const Histogram* histogram;
+    };
+
+    void addCounter(std::string name, std::string help,
+                    std::function<double()> read, Labels labels = {}) {
+        metrics.push_back({std::move(name), std::move(help),
+                           std::move(labels), Type::counter, std::move(read),
+                           nullptr});
+    }
+
+    void addGauge(std::string name, std::string help,
+                  std::function<double()> read, Labels labels = {}) {
+        metrics.push_back({std::move(name), std::move(help),
+                           std::move(labels), Type::gauge, std::move(read),
+                           nullptr});
+    }
+
+    void addHistogram(std::string name, std::string help,
+                      const Histogram& histogram, Labels labels = {}) {
+        metrics.push_back({std::move(name), std::move(help),
+                           std::move(labels), Type::histogram, nullptr,
+                           &histogram});
+    }
+
+    void clear() { metrics.clear(); }
+    size_t size() const { return metrics.size(); }
+
+    /**
+     * Calls visit(const Metric&, double value) for every metric with a
+     * reading. The value is NaN for histograms.
+     */
+    template <typename Visitor>
+    void forEach(Visitor&& visit) const {
+        for (const auto& metric : metrics) {
+            const auto value = metric.read ? metric.read() : NAN;
+            if (metric.type == Type::histogram || !std::isnan(value)) {
+                visit(metric, value);
+            }
+        }
+    }
+
+    /** Renders every metric in the Prometheus text exposition format. */
+    std::string toPrometheus() const {
+        std::ostringstream out;
+        out.precision(9);
+
+        // Samples of one name must be grouped under a single HELP and TYPE
+        for (const auto& name : getNames()) {
+            auto first = true;
+
+            forEach([&](const Metric& metric, double value) {
+                if (metric.name != name) {
+                    return;
+                }
+
+                if (first) {
+                    out << "# HELP " << name << " " << metric.help << "\n"
+                        << "# TYPE " << name << " "
+                        << getTypeName(metric.type) << "\n";
+                    first = false;
+                }
+
+                if (metric.type != Type::histogram) {
+                    out << name << formatLabels(metric.labels) << " "
+                        << value << "\n";
+                    return;
+                }
+
+                const auto& histogram = *metric.histogram;
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i <= histogram.getNumBuckets(); ++i) {
+                    cumulative += histogram.getBucketCount(i);
+
+                    auto labels = metric.labels;
+                    std::ostringstream bound;
+                    bound.precision(9);
+                    if (i < histogram.getNumBuckets()) {
+                        bound << histogram.getUpperBound(i);
+                    } else {
+                        bound << "+Inf";
+                    }
+                    labels.emplace_back("le", bound.str());
+
+                    out << name << "_bucket" << formatLabels(labels) << " "
+                        << cumulative << "\n";
+                }
+                out << name << "_sum" << formatLabels(metric.labels) << " "
+                    << histogram.getSum() << "\n"
+                    << name << "_count" << formatLabels(metric.labels) << " "
+                    << histogram.getCount() << "\n";
+            });
+        }
+
+        return out.str();
+    }
+
+    /**
+     * Renders every metric as one JSON object. Histograms carry their
+     * count, sum and per-bucket counts, the last bucket being unbounded.
+     */
+    std::string toJson() const {
+        std::ostringstream out;
+        out.precision(9);
+        out << "{\"metrics\":[";
+
+        auto first = true;
+        forEach([&](const Metric& metric, double value) {
+            out << (first ? "" : ",") << "{\"name\":\"" << metric.name
+                << "\",\"type\":\"" << getTypeName(metric.type)
+                << "\",\"labels\":{";
+            first = false;
+
+            for (size_t i = 0; i < metric.labels.size(); ++i) {
+                out << (i == 0 ? "" : ",") << "\"" << metric.labels[i].first
+                    << "\":\"" << escape(metric.labels[i].second) << "\"";
+            }
+            out << "}";
+
+            if (metric.type != Type::histogram) {
+                out << ",\"value\":" << value << "}";
+                return;
+            }
+
+            const auto& histogram = *metric.histogram;
+            out << ",\"count\":" << histogram.getCount()
+                << ",\"sum\":" << histogram.getSum() << ",\"buckets\":[";
+            for (size_t i = 0; i <= histogram.getNumBuckets(); ++i) {
+                out << (i == 0 ? "" : ",") << "{\"le\":";
+                if (i < histogram.getNumBuckets()) {
+                    out << histogram.getUpperBound(i);
+                } else {
+                    out << "null";
+                }
+                out << ",\"count\":" << histogram.getBucketCount(i) << "}";
+            }
+            out << "]}";
+        });
+
+        out << "]}\n";
+        return out.str();
+    }
+
+  private:
+    std::vector<Metric> metrics;
+
+    /** Distinct names, in the order they were first registered. */
+    std::vector<std::string> getNames() const {
+        std::vector<std::string> names;
+        for (const auto& metric : metrics) {
+            if (std::find(names.begin(), names.end(), metric.name) ==
+                names.end()) {
+                names.push_back(metric.name);
+            }
+        }
+        return names;
+    }
+
+    static const char* getTypeName(Type type) {
+        switch (type) {
+            case Type::counter:
+                return "counter";
+            case Type::gauge:
+                return "gauge";
+            case Type::histogram:
+                return "histogram";
+        }
+        return "untyped";
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (const auto c : text) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+            }
+            escaped += c == '\n' ? ' ' : c;
+        }
+        return escaped;
+    }
+
+    static std::string formatLabels(const Labels& labels) {
+        if (labels.empty()) {
+            return {};
+        }
+
+        std::string text = "{";
+        for (size_t i = 0; i < labels.size(); ++i) {
+            text += (i == 0 ? "" : ",") + labels[i].first + "=\"" +
+                    escape(labels[i].second) + "\"";
+        }
+        return text + "}";
+    }
+};
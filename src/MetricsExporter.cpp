@@ -0,0 +1,57 @@
+#include "MetricsExporter.hpp"
+
+//==============================================================================
+MetricsExporter::MetricsExporter(const MetricsRegistry& registry)
+    : Thread("AudioStream Metrics"),
+      metrics(registry) {}
+
+MetricsExporter::~MetricsExporter() { stop(); }
+
+bool MetricsExporter::start(const File& file, int intervalMs) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    stop();
+    outputFile = file;
+    interval = jmax(100, intervalMs);
+    return startThread(Thread::Priority::low);
+}
+
+bool MetricsExporter::startFromEnvironment() {
+    const auto path = SystemStats::getEnvironmentVariable(
+        AUDIO_STREAM_METRICS_FILE_VARIABLE, {});
+    if (path.isEmpty()) {
+        return false;
+    }
+
+    return start(File::getCurrentWorkingDirectory().getChildFile(path));
+}
+
+void MetricsExporter::stop() {
+    if (isThreadRunning()) {
+        signalThreadShouldExit();
+        notify();
+        stopThread(interval);
+        write();
+    }
+}
+
+bool MetricsExporter::write() {
+    const auto text = outputFile.hasFileExtension("json")
+                          ? metrics.toJson()
+                          : metrics.toPrometheus();
+
+    TemporaryFile temporary(outputFile);
+    if (!temporary.getFile().replaceWithText(text) ||
+        !temporary.overwriteTargetFileWithTemporary()) {
+        numErrors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::run() {
+    while (!threadShouldExit()) {
+        write();
+        wait(interval);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Metrics.hpp"
+#include "StreamConfig.hpp"
+
+#define AUDIO_STREAM_METRICS_FILE_VARIABLE "AUDIO_STREAM_METRICS_FILE"
+
+//==============================================================================
+/**
+ * @class MetricsExporter
+ * @brief Periodically writes a MetricsRegistry to a file on its own thread.
+ *
+ * Files ending in .json get JSON, anything else the Prometheus text format,
+ * which suits the node exporter's textfile collector. Each dump replaces the
+ * file in one move, so a reader never sees half of one.
+ */
+class MetricsExporter : public Thread {
+  public:
+    explicit MetricsExporter(const MetricsRegistry& registry);
+    ~MetricsExporter() override;
+
+    /** Starts writing to file every intervalMs milliseconds. */
+    bool start(const File& file,
+               int intervalMs = AUDIO_STREAM_METRICS_INTERVAL_MS);
+    /**
+     * Starts writing to the file named by the AUDIO_STREAM_METRICS_FILE
+     * environment variable, if it is set.
+     */
+    bool startFromEnvironment();
+    /** Writes one last dump and stops. */
+    void stop();
+
+    /** Dumps the registry to the file now. */
+    bool write();
+
+    /** Dumps that failed, e.g. because the directory isn't writable. */
+    uint64 getNumErrors() const {
+        return numErrors.load(std::memory_order_relaxed);
+    }
+
+  private:
+    const MetricsRegistry& metrics;
+    File outputFile;
+    int interval{AUDIO_STREAM_METRICS_INTERVAL_MS};
+    std::atomic<uint64> numErrors{0};
+
+    void run() override;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MetricsExporter)
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "JitterBuffer.hpp"
+
+//==============================================================================
+/**
+ * @class Packetizer
+ * @brief Re-blocks audio of any block size into network frames of a fixed
+ * number of samples.
+ *
+ * Blocks are added with the timestamp of their first sample. Every time a
+ * frame fills up it is passed on, with the next sequence number, so one
+ * large block can produce several frames and several small blocks one.
+ * Whatever is left waits for the next block. A jump in the timestamps, e.g.
+ * after blocks were dropped, ends the frame being filled early and skips
+ * as many sequence numbers as frames were missed, so receivers count them
+ * as lost. So does a change in the number of channels.
+ *
+ * Doesn't allocate after prepare().
+ */
+class Packetizer {
+  public:
+    Packetizer() = default;
+
+    /**
+     * @brief Allocates one frame and starts a new sequence at 0.
+     * @param maxChannels Largest number of channels added.
+     * @param frameSizeInSamples Samples per channel in a full frame.
+     */
+    void prepare(size_t maxChannels, size_t frameSizeInSamples) {
+        frameSize = std::max<size_t>(frameSizeInSamples, 1);
+        channelLimit = maxChannels;
+        frame.assign(maxChannels * frameSize, 0.0f);
+        numChannels = 0;
+        numPending = 0;
+        frameTimestamp = 0;
+        nextTimestamp = 0;
+        sequence = 0;
+        hasStarted = false;
+    }
+
+    size_t getFrameSize() const { return frameSize; }
+    /** Samples per channel waiting for the frame to fill up. */
+    size_t getNumPending() const { return numPending; }
+
+    /**
+     * @brief Adds one block and passes on every frame it completes.
+     * @param samples channels * numSamples planar samples.
+     * @param emit Called as emit(const float* samples, const
+     * JitterBuffer::FrameInfo& info), with info.numChannels *
+     * info.numSamples planar samples.
+     */
+    template <typename Emit>
+    void add(const float* samples, size_t channels, size_t numSamples,
+             uint64_t timestamp, Emit&& emit) {
+        channels = std::min(channels, channelLimit);
+        if (channels == 0 || numSamples == 0) {
+            return;
+        }
+
+        if (hasStarted && (timestamp != nextTimestamp ||
+                           channels != numChannels)) {
+            flush(emit);
+
+            if (timestamp > nextTimestamp) {
+                const auto gap = timestamp - nextTimestamp;
+                sequence += static_cast<uint32_t>((gap + frameSize - 1) /
+                                                  frameSize);
+            }
+        }
+
+        numChannels = channels;
+        hasStarted = true;
+
+        for (size_t position = 0; position < numSamples;) {
+            if (numPending == 0) {
+                frameTimestamp = timestamp + position;
+            }
+
+            const auto count =
+                std::min(frameSize - numPending, numSamples - position);
+            for (size_t channel = 0; channel < channels; ++channel) {
+                std::memcpy(frame.data() + channel * frameSize + numPending,
+                            samples + channel * numSamples + position,
+                            count * sizeof(float));
+            }
+
+            numPending += count;
+            position += count;
+
+            if (numPending == frameSize) {
+                emitFrame(emit);
+            }
+        }
+
+        nextTimestamp = timestamp + numSamples;
+    }
+
+    /** Passes on the frame being filled, however short. */
+    template <typename Emit>
+    void flush(Emit&& emit) {
+        if (numPending > 0) {
+            emitFrame(emit);
+        }
+    }
+
+  private:
+    std::vector<float> frame;
+    size_t frameSize{1};
+    size_t channelLimit{0};
+    size_t numChannels{0};
+    size_t numPending{0};
+    uint64_t frameTimestamp{0};
+    uint64_t nextTimestamp{0};
+    uint32_t sequence{0};
+    bool hasStarted{false};
+
+    template <typename Emit>
+    void emitFrame(Emit&& emit) {
+        // A short frame is packed so its channels are contiguous
+        if (numPending < frameSize) {
+            for (size_t channel = 1; channel < numChannels; ++channel) {
+                std::memmove(frame.data() + channel * numPending,
+                             frame.data() + channel * frameSize,
+                             numPending * sizeof(float));
+            }
+        }
+
+        emit(static_cast<const float*>(frame.data()),
+             JitterBuffer::FrameInfo{static_cast<uint32_t>(numChannels),
+                                     static_cast<uint32_t>(numPending),
+                                     sequence++, frameTimestamp});
+        numPending = 0;
+    }
+};
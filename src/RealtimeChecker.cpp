@@ -0,0 +1,243 @@
+#include "RealtimeChecker.hpp"
+
+#if AUDIO_STREAM_REALTIME_CHECKS && defined(__GLIBC__)
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+/** Set while reporting, whose own calls would otherwise be reported. */
+thread_local bool isReporting = false;
+
+void print(const char* text) {
+    // Straight to the descriptor, stdio could allocate
+    const auto result = ::syscall(SYS_write, STDERR_FILENO, text,
+                                  std::strlen(text));
+    static_cast<void>(result);
+}
+
+/** The next definition of a function, the one interposed on. */
+template <typename Function>
+Function* next(const char* name) {
+    return reinterpret_cast<Function*>(::dlsym(RTLD_NEXT, name));
+}
+
+/** Loads the unwinder up front, backtrace() allocates the first time. */
+const bool isUnwinderLoaded = [] {
+    void* frames[1];
+    return ::backtrace(frames, 1) > 0;
+}();
+}  // namespace
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+}
+#endif
+
+//==============================================================================
+void RealtimeChecker::check(const char* function) {
+#if AUDIO_STREAM_REALTIME_CHECKS && defined(__GLIBC__)
+    if (!isInCallback() || isReporting) {
+        return;
+    }
+
+    const auto count = numViolations.fetch_add(1, std::memory_order_relaxed);
+    if (count >= AUDIO_STREAM_REALTIME_MAX_REPORTS) {
+        return;
+    }
+
+    isReporting = true;
+    print("Real-time violation: ");
+    print(function);
+    print(" called from an audio callback\n");
+
+    void* frames[64];
+    const auto numFrames = ::backtrace(frames, 64);
+    // Skips this function and the interposer
+    ::backtrace_symbols_fd(frames + 2, numFrames - 2, STDERR_FILENO);
+
+    if (count + 1 == AUDIO_STREAM_REALTIME_MAX_REPORTS) {
+        print("Further real-time violations are counted, not reported\n");
+    }
+    isReporting = false;
+#else
+    static_cast<void>(function);
+#endif
+}
+
+//==============================================================================
+#if AUDIO_STREAM_REALTIME_CHECKS && defined(__GLIBC__)
+// Interposers. The executable's definitions take precedence over the C
+// library's, which they forward to after checking.
+
+extern "C" {
+void* malloc(size_t size) {
+    RealtimeChecker::check("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    RealtimeChecker::check("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    RealtimeChecker::check("realloc");
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) {
+    if (pointer != nullptr) {
+        RealtimeChecker::check("free");
+    }
+    __libc_free(pointer);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    RealtimeChecker::check("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    RealtimeChecker::check("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+    RealtimeChecker::check("posix_memalign");
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer != nullptr || size == 0 ? 0 : ENOMEM;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    static const auto real =
+        next<int(pthread_mutex_t*)>("pthread_mutex_lock");
+    RealtimeChecker::check("pthread_mutex_lock");
+    return real(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* lock) {
+    static const auto real =
+        next<int(pthread_rwlock_t*)>("pthread_rwlock_rdlock");
+    RealtimeChecker::check("pthread_rwlock_rdlock");
+    return real(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* lock) {
+    static const auto real =
+        next<int(pthread_rwlock_t*)>("pthread_rwlock_wrlock");
+    RealtimeChecker::check("pthread_rwlock_wrlock");
+    return real(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex) {
+    static const auto real = next<int(pthread_cond_t*, pthread_mutex_t*)>(
+        "pthread_cond_wait");
+    RealtimeChecker::check("pthread_cond_wait");
+    return real(condition, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex,
+                           const timespec* time) {
+    static const auto real =
+        next<int(pthread_cond_t*, pthread_mutex_t*, const timespec*)>(
+            "pthread_cond_timedwait");
+    RealtimeChecker::check("pthread_cond_timedwait");
+    return real(condition, mutex, time);
+}
+
+int sem_wait(sem_t* semaphore) {
+    static const auto real = next<int(sem_t*)>("sem_wait");
+    RealtimeChecker::check("sem_wait");
+    return real(semaphore);
+}
+
+int sem_timedwait(sem_t* semaphore, const timespec* time) {
+    static const auto real =
+        next<int(sem_t*, const timespec*)>("sem_timedwait");
+    RealtimeChecker::check("sem_timedwait");
+    return real(semaphore, time);
+}
+
+int nanosleep(const timespec* duration, timespec* remaining) {
+    static const auto real =
+        next<int(const timespec*, timespec*)>("nanosleep");
+    RealtimeChecker::check("nanosleep");
+    return real(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const timespec* time,
+                    timespec* remaining) {
+    static const auto real =
+        next<int(clockid_t, int, const timespec*, timespec*)>(
+            "clock_nanosleep");
+    RealtimeChecker::check("clock_nanosleep");
+    return real(clock, flags, time, remaining);
+}
+
+int usleep(useconds_t duration) {
+    static const auto real = next<int(useconds_t)>("usleep");
+    RealtimeChecker::check("usleep");
+    return real(duration);
+}
+
+ssize_t read(int descriptor, void* data, size_t size) {
+    static const auto real = next<ssize_t(int, void*, size_t)>("read");
+    RealtimeChecker::check("read");
+    return real(descriptor, data, size);
+}
+
+ssize_t write(int descriptor, const void* data, size_t size) {
+    static const auto real = next<ssize_t(int, const void*, size_t)>("write");
+    RealtimeChecker::check("write");
+    return real(descriptor, data, size);
+}
+
+ssize_t sendto(int descriptor, const void* data, size_t size, int flags,
+               const sockaddr* address, socklen_t addressSize) {
+    static const auto real = next<ssize_t(
+        int, const void*, size_t, int, const sockaddr*, socklen_t)>("sendto");
+    RealtimeChecker::check("sendto");
+    return real(descriptor, data, size, flags, address, addressSize);
+}
+
+ssize_t recvfrom(int descriptor, void* data, size_t size, int flags,
+                 sockaddr* address, socklen_t* addressSize) {
+    static const auto real =
+        next<ssize_t(int, void*, size_t, int, sockaddr*, socklen_t*)>(
+            "recvfrom");
+    RealtimeChecker::check("recvfrom");
+    return real(descriptor, data, size, flags, address, addressSize);
+}
+
+int poll(pollfd* descriptors, nfds_t count, int timeout) {
+    static const auto real = next<int(pollfd*, nfds_t, int)>("poll");
+    RealtimeChecker::check("poll");
+    return real(descriptors, count, timeout);
+}
+
+int select(int count, fd_set* readSet, fd_set* writeSet, fd_set* errorSet,
+           timeval* timeout) {
+    static const auto real =
+        next<int(int, fd_set*, fd_set*, fd_set*, timeval*)>("select");
+    RealtimeChecker::check("select");
+    return real(count, readSet, writeSet, errorSet, timeout);
+}
+}
+#endif
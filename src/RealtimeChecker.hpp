@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef AUDIO_STREAM_REALTIME_CHECKS
+#define AUDIO_STREAM_REALTIME_CHECKS 0
+#endif
+
+#define AUDIO_STREAM_REALTIME_MAX_REPORTS 16
+
+//==============================================================================
+/**
+ * @class RealtimeChecker
+ * @brief Catches calls that can block on the audio thread.
+ *
+ * Built with AUDIO_STREAM_REALTIME_CHECKS (the CMake option of the same
+ * name), memory allocation, mutex and semaphore waits, sleeps and blocking
+ * I/O are intercepted, and any made while a ScopedCallback is alive on the
+ * calling thread is counted as a violation. The first few are reported on
+ * stderr with a stack trace. Interception needs glibc; elsewhere, and in
+ * normal builds, a ScopedCallback costs nothing and nothing is counted.
+ */
+class RealtimeChecker {
+  public:
+    /** Marks the calling thread as inside an audio callback. */
+    class ScopedCallback {
+      public:
+        ScopedCallback() {
+#if AUDIO_STREAM_REALTIME_CHECKS
+            ++depth;
+#endif
+        }
+
+        ~ScopedCallback() {
+#if AUDIO_STREAM_REALTIME_CHECKS
+            --depth;
+#endif
+        }
+
+        ScopedCallback(const ScopedCallback&) = delete;
+        ScopedCallback& operator=(const ScopedCallback&) = delete;
+    };
+
+    static constexpr bool isEnabled() { return AUDIO_STREAM_REALTIME_CHECKS; }
+
+    /** Whether the calling thread is inside an audio callback. */
+    static bool isInCallback() {
+#if AUDIO_STREAM_REALTIME_CHECKS
+        return depth > 0;
+#else
+        return false;
+#endif
+    }
+
+    /** Calls that could block, made inside an audio callback. */
+    static uint64_t getNumViolations() {
+        return numViolations.load(std::memory_order_relaxed);
+    }
+
+    /** Counts and reports a violation if inside an audio callback. */
+    static void check(const char* function);
+
+  private:
+#if AUDIO_STREAM_REALTIME_CHECKS
+    static inline thread_local int depth{0};
+#endif
+    static inline std::atomic<uint64_t> numViolations{0};
+};
@@ -0,0 +1,391 @@
+#include "ReceiveEngine.hpp"
+
+//==============================================================================
+ReceiveEngine::ReceiveEngine() = default;
+
+ReceiveEngine::~ReceiveEngine() { disconnect(); }
+
+void ReceiveEngine::prepare(int samplesPerBlockExpected, double sampleRate,
+                            int bufferMs, int maxStreams) {
+    const auto maxFrameSize =
+        AUDIO_STREAM_MAX_CHANNELS * AUDIO_STREAM_MAX_FRAME_SIZE;
+    const auto numStreams = static_cast<size_t>(jmax(1, maxStreams));
+    rate = sampleRate;
+
+    // Room for bufferMs of audio on every output channel
+    const auto numChannels = 2;
+    const auto capacity = static_cast<size_t>(sampleRate * bufferMs /
+                                              1000.0 * numChannels);
+
+    streams.prepare(
+        numStreams,
+        jmax(capacity, static_cast<size_t>(samplesPerBlockExpected)),
+        maxFrameSize);
+
+    // Built once here, so a stream changing rate doesn't build a filter on
+    // the audio thread
+    playoutFilters.prepare(sampleRate, AUDIO_STREAM_MAX_SAMPLE_RATE);
+    playouts.resize(numStreams);
+    for (size_t slot = 0; slot < numStreams; ++slot) {
+        auto& buffer = streams.getBuffer(slot);
+        buffer.setOverrunPolicy(JitterBuffer::OverrunPolicy::dropBacklog);
+        buffer.setUnderrunPolicy(
+            JitterBuffer::UnderrunPolicy::repeatLastFrame);
+
+        if (playouts[slot] == nullptr) {
+            playouts[slot] = std::make_unique<StreamPlayout>();
+            playouts[slot]->setConcealmentMode(
+                LossConcealer::Mode::pitchRepetition);
+        }
+        playouts[slot]->prepare(
+            maxFrameSize, static_cast<uint64>(sampleRate),
+            AUDIO_STREAM_MAX_CHANNELS,
+            static_cast<size_t>(samplesPerBlockExpected), sampleRate,
+            AUDIO_STREAM_MAX_SAMPLE_RATE, &playoutFilters);
+    }
+
+    // Each stream is played into the mix buffer, then added to the output
+    mixer.prepare(numStreams);
+    gain.reset();
+    mixBlockSize = jmax(1, samplesPerBlockExpected);
+    mixBuffer.assign(static_cast<size_t>(AUDIO_STREAM_MAX_CHANNELS) *
+                         static_cast<size_t>(mixBlockSize),
+                     0.0f);
+    remixBuffer.assign(mixBuffer.size(), 0.0f);
+    mixChannels.resize(AUDIO_STREAM_MAX_CHANNELS);
+    remixChannels.resize(AUDIO_STREAM_MAX_CHANNELS);
+    for (size_t channel = 0; channel < mixChannels.size(); ++channel) {
+        const auto offset = channel * static_cast<size_t>(mixBlockSize);
+        mixChannels[channel] = mixBuffer.data() + offset;
+        remixChannels[channel] = remixBuffer.data() + offset;
+    }
+
+    // Leave headroom in the jitter buffer above the largest target delay
+    receiveThread.prepare(sampleRate,
+                          static_cast<uint32>(capacity / numChannels / 2));
+
+    measuringLatency = latencyMeasurementEnabled;
+    if (measuringLatency) {
+        latencyMeter.prepare(sampleRate);
+    }
+}
+
+bool ReceiveEngine::connect(int portNumber, const String& multicastGroup) {
+    return receiveThread.connect(portNumber, multicastGroup);
+}
+
+void ReceiveEngine::disconnect() {
+    latencyMeter.stop();
+    receiveThread.disconnect();
+}
+
+bool ReceiveEngine::start(const ReceiveThread::Options& options) {
+    if (measuringLatency && !latencyMeter.start()) {
+        return false;
+    }
+    return receiveThread.start(options);
+}
+
+void ReceiveEngine::setLatencyMeasurementEnabled(bool shouldMeasure) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    latencyMeasurementEnabled = shouldMeasure;
+}
+
+void ReceiveEngine::writeInput(const float* samples, int numSamples) {
+    if (measuringLatency) {
+        latencyMeter.writeInput(samples, numSamples);
+    }
+}
+
+void ReceiveEngine::read(float* const* outputs, int numChannels,
+                         int numSamples) {
+    const ScopedTimer timer(callbackTime);
+
+    for (auto channel = 0; channel < numChannels; ++channel) {
+        FloatVectorOperations::clear(outputs[channel], numSamples);
+    }
+
+    numChannels = jmin(numChannels, static_cast<int>(mixChannels.size()));
+
+    for (size_t slot = 0; slot < streams.getNumSlots(); ++slot) {
+        const auto state = streams.getState(slot);
+        auto& playout = *playouts[slot];
+
+        if (state == StreamTable::State::retiring) {
+            // The next stream in this slot starts from scratch
+            playout.reset();
+            mixer.resetGain(slot);
+            streams.release(slot);
+            continue;
+        }
+
+        if (state != StreamTable::State::active) {
+            continue;
+        }
+
+        const auto streamRate = getStreamRate(slot);
+        if (playout.getSourceRate() != streamRate) {
+            playout.setSourceRate(streamRate);
+        }
+
+        // Streams without a channel count are played as they come
+        const auto announced = static_cast<int>(streams.getNumChannels(slot));
+        const auto numStreamChannels =
+            announced > 0 ? jmin(announced, AUDIO_STREAM_MAX_CHANNELS)
+                          : numChannels;
+        const auto needsRemix = numStreamChannels != numChannels;
+
+        playout.setTargetDelay(
+            receiveThread.getJitterEstimator(slot).getTargetDelay());
+        latency.record(playout.getCurrentDelay() / streamRate +
+                       numSamples / rate);
+
+        // Blocks larger than prepared for are played in pieces
+        for (auto position = 0; position < numSamples;
+             position += mixBlockSize) {
+            const auto count = jmin(mixBlockSize, numSamples - position);
+
+            float* chunk[AUDIO_STREAM_MAX_CHANNELS];
+            for (auto channel = 0; channel < numChannels; ++channel) {
+                chunk[channel] = outputs[channel] + position;
+            }
+
+            if (!needsRemix) {
+                playout.read(streams.getBuffer(slot), mixChannels.data(),
+                             numChannels, count);
+                mixer.add(slot, mixChannels.data(), chunk, numChannels,
+                          count);
+                continue;
+            }
+
+            playout.read(streams.getBuffer(slot), mixChannels.data(),
+                         numStreamChannels, count);
+            ChannelMixer::process(mixChannels.data(), numStreamChannels,
+                                  remixChannels.data(), numChannels, count);
+            mixer.add(slot, remixChannels.data(), chunk, numChannels, count);
+        }
+    }
+
+    const auto count = static_cast<size_t>(numSamples);
+    const auto segment = gain.next(count);
+    if (segment.rampLength != 0 || segment.end != 1.0f) {
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            if (segment.rampLength == 0) {
+                FloatVectorOperations::multiply(outputs[channel], segment.end,
+                                                numSamples);
+            } else {
+                SmoothedGain::multiply(outputs[channel], segment, count);
+            }
+        }
+    }
+
+    // What is played, after the gain, as the device gets it
+    if (measuringLatency && numChannels > 0) {
+        latencyMeter.writeOutput(outputs[0], numSamples);
+    }
+}
+
+double ReceiveEngine::getStreamRate(size_t slot) const {
+    const auto announced = streams.getSampleRate(slot);
+    return announced > 0 ? static_cast<double>(announced) : rate;
+}
+
+void ReceiveEngine::setGain(float newGain) { gain.setTarget(newGain); }
+
+void ReceiveEngine::setStreamGain(size_t slot, float gain) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    mixer.setGain(slot, gain);
+}
+
+uint64 ReceiveEngine::getNumUnderruns() const {
+    uint64 total = 0;
+    for (size_t slot = 0; slot < streams.getNumSlots(); ++slot) {
+        total += streams.getBuffer(slot).getNumUnderruns();
+    }
+    return total;
+}
+
+uint64 ReceiveEngine::getNumOverruns() const {
+    uint64 total = 0;
+    for (size_t slot = 0; slot < streams.getNumSlots(); ++slot) {
+        total += streams.getBuffer(slot).getNumOverruns();
+    }
+    return total;
+}
+
+uint64 ReceiveEngine::getNumConcealmentEvents() const {
+    uint64 total = 0;
+    for (const auto& playout : playouts) {
+        total += playout->getNumConcealmentEvents();
+    }
+    return total;
+}
+
+uint64 ReceiveEngine::getNumComfortNoiseSamples() const {
+    uint64 total = 0;
+    for (const auto& playout : playouts) {
+        total += playout->getNumComfortNoiseSamples();
+    }
+    return total;
+}
+
+void ReceiveEngine::addMetrics(MetricsRegistry& registry) const {
+    registry.addHistogram("audio_stream_receive_callback_seconds",
+                          "Time spent mixing a block on the audio thread",
+                          callbackTime);
+    registry.addHistogram("audio_stream_latency_seconds",
+                          "Audio queued ahead of the output plus one block",
+                          latency);
+    registry.addCounter("audio_stream_decode_errors_total",
+                        "Packets that couldn't be decoded", [this] {
+                            return double(receiveThread.getNumDecodeErrors());
+                        });
+    registry.addCounter("audio_stream_reports_sent_total",
+                        "Reports sent back to senders", [this] {
+                            return double(receiveThread.getNumReportsSent());
+                        });
+    registry.addCounter("audio_stream_rejected_streams_total",
+                        "Streams that found no free slot",
+                        [this] { return double(streams.getNumRejected()); });
+    registry.addGauge("audio_stream_active_streams",
+                      "Streams being received",
+                      [this] { return double(streams.getNumActive()); });
+    latencyMeter.addMetrics(registry);
+
+    // Slots without a stream read as NaN and are left out
+    for (size_t slot = 0; slot < AUDIO_STREAM_MAX_STREAMS; ++slot) {
+        const MetricsRegistry::Labels labels{{"stream",
+                                              std::to_string(slot)}};
+        auto add = [&](bool isCounter, const char* name, const char* help,
+                       auto read) {
+            auto guarded = [this, slot, read] {
+                return slot < streams.getNumSlots() &&
+                               streams.getState(slot) ==
+                                   StreamTable::State::active
+                           ? double(read(slot))
+                           : NAN;
+            };
+            if (isCounter) {
+                registry.addCounter(name, help, guarded, labels);
+            } else {
+                registry.addGauge(name, help, guarded, labels);
+            }
+        };
+
+        add(true, "audio_stream_received_frames_total", "Frames received",
+            [this](size_t s) {
+                return receiveThread.getReorderBuffer(s).getNumReceived();
+            });
+        add(true, "audio_stream_lost_frames_total", "Frames never received",
+            [this](size_t s) {
+                return receiveThread.getReorderBuffer(s).getNumLost();
+            });
+        add(true, "audio_stream_late_packets_total",
+            "Packets that arrived after their frame was played",
+            [this](size_t s) {
+                return receiveThread.getReorderBuffer(s).getNumLate();
+            });
+        add(true, "audio_stream_duplicate_packets_total",
+            "Packets received more than once", [this](size_t s) {
+                return receiveThread.getReorderBuffer(s).getNumDuplicates();
+            });
+        add(true, "audio_stream_reordered_packets_total",
+            "Packets that arrived out of order", [this](size_t s) {
+                return receiveThread.getReorderBuffer(s).getNumReordered();
+            });
+        add(true, "audio_stream_fec_recovered_packets_total",
+            "Packets rebuilt from parity", [this](size_t s) {
+                return receiveThread.getFecDecoder(s).getNumRecovered();
+            });
+        // Only streams whose sender retransmits have NACK readings
+        auto addNack = [&](bool isCounter, const char* name,
+                           const char* help, auto read) {
+            add(isCounter, name, help, [this, read](size_t s) {
+                const auto& tracker = receiveThread.getNackTracker(s);
+                return receiveThread.isRetransmittable(s)
+                           ? double(read(tracker))
+                           : NAN;
+            });
+        };
+
+        addNack(true, "audio_stream_nacks_sent_total",
+                "NACKs sent to the stream's sender",
+                [](const NackTracker& t) { return t.getNumNacks(); });
+        addNack(true, "audio_stream_retransmit_requests_total",
+                "Frames asked for again, repeats included",
+                [](const NackTracker& t) { return t.getNumRequests(); });
+        addNack(true, "audio_stream_retransmit_recovered_packets_total",
+                "Retransmitted packets that arrived in time",
+                [](const NackTracker& t) { return t.getNumRecovered(); });
+        addNack(true, "audio_stream_retransmit_late_packets_total",
+                "Retransmitted packets that arrived too late",
+                [](const NackTracker& t) { return t.getNumLate(); });
+        addNack(true, "audio_stream_retransmit_expired_total",
+                "Frames not asked for as the answer would come too late",
+                [](const NackTracker& t) { return t.getNumExpired(); });
+        addNack(false, "audio_stream_nack_round_trip_seconds",
+                "Time from sending a NACK to receiving its answer",
+                [](const NackTracker& t) {
+                    return t.hasRoundTripTime() ? t.getRoundTripTime() : NAN;
+                });
+        add(false, "audio_stream_report_round_trip_seconds",
+            "Round trip to the sender, from its answers to reports",
+            [this](size_t s) {
+                const auto& roundTrip = receiveThread.getRoundTrip(s);
+                return receiveThread.isReporting(s) &&
+                               roundTrip.hasRoundTripTime()
+                           ? roundTrip.getRoundTripTime()
+                           : NAN;
+            });
+        add(true, "audio_stream_underruns_total",
+            "Reads from an empty jitter buffer", [this](size_t s) {
+                return streams.getBuffer(s).getNumUnderruns();
+            });
+        add(true, "audio_stream_overruns_total",
+            "Frames that didn't fit in the jitter buffer", [this](size_t s) {
+                return streams.getBuffer(s).getNumOverruns();
+            });
+        add(true, "audio_stream_concealment_events_total",
+            "Gaps filled in by loss concealment", [this](size_t s) {
+                return playouts[s]->getNumConcealmentEvents();
+            });
+        add(true, "audio_stream_comfort_noise_seconds_total",
+            "Comfort noise played while the sender was silent",
+            [this](size_t s) {
+                return playouts[s]->getNumComfortNoiseSamples() /
+                       getStreamRate(s);
+            });
+        add(false, "audio_stream_comfort_noise_active",
+            "1 while the sender is silent", [this](size_t s) {
+                return playouts[s]->isPlayingComfortNoise() ? 1.0 : 0.0;
+            });
+        add(false, "audio_stream_buffer_fill_ratio",
+            "Fraction of the jitter buffer in use", [this](size_t s) {
+                return streams.getBuffer(s).getFillRatio();
+            });
+        add(false, "audio_stream_jitter_seconds", "Interarrival jitter",
+            [this](size_t s) {
+                const auto& estimator = receiveThread.getJitterEstimator(s);
+                return estimator.getInterarrivalJitter() / getStreamRate(s);
+            });
+        add(false, "audio_stream_playout_delay_seconds",
+            "Audio queued ahead of the output", [this](size_t s) {
+                return playouts[s]->getCurrentDelay() / getStreamRate(s);
+            });
+        add(false, "audio_stream_target_delay_seconds",
+            "Playout delay aimed for", [this](size_t s) {
+                const auto& estimator = receiveThread.getJitterEstimator(s);
+                return estimator.getTargetDelay() / getStreamRate(s);
+            });
+        add(false, "audio_stream_sample_rate_hz",
+            "Sample rate announced by the sender",
+            [this](size_t s) { return getStreamRate(s); });
+        add(false, "audio_stream_channels", "Channels in the stream",
+            [this](size_t s) { return streams.getNumChannels(s); });
+        add(false, "audio_stream_resample_ratio",
+            "Stream samples played per output sample",
+            [this](size_t s) { return playouts[s]->getResampleRatio(); });
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ChannelMixer.hpp"
+#include "LatencyMeter.hpp"
+#include "Metrics.hpp"
+#include "ReceiveThread.hpp"
+#include "SmoothedGain.hpp"
+#include "StreamConfig.hpp"
+#include "StreamMixer.hpp"
+#include "StreamPlayout.hpp"
+#include "StreamTable.hpp"
+
+//==============================================================================
+/**
+ * @class ReceiveEngine
+ * @brief The receiving side of one or more streams, without any user
+ * interface.
+ *
+ * A ReceiveThread fills one JitterBuffer per incoming stream from the
+ * network. read() plays each of them out on the audio thread at the delay
+ * its JitterEstimator asks for, and a StreamMixer sums them with per-stream
+ * gains before the output gain is applied. Streams are referred to by their
+ * slot in the StreamTable.
+ *
+ * Each stream is played in the format its sender announces. One at another
+ * sample rate is converted by its StreamPlayout, and one with a different
+ * number of channels goes through a ChannelMixer; streams that match the
+ * device skip both.
+ *
+ * In latency measurement mode, a LatencyMeter listens to what is played,
+ * and to the device's input if it is given one, for the probes of a sender
+ * in that mode.
+ */
+class ReceiveEngine {
+  public:
+    ReceiveEngine();
+    ~ReceiveEngine();
+
+    /**
+     * Sizes the buffers for the device and up to maxStreams streams at once.
+     * bufferMs is the jitter buffer depth per channel. Must be called
+     * before start().
+     */
+    void prepare(int samplesPerBlockExpected, double sampleRate,
+                 int bufferMs = AUDIO_STREAM_JITTER_BUFFER_MS,
+                 int maxStreams = AUDIO_STREAM_MAX_STREAMS);
+    /** Binds to the given local port and optional multicast group. */
+    bool connect(int portNumber, const String& multicastGroup = {});
+    /** The port bound to, useful after connecting to port 0. */
+    int getLocalPort() const { return receiveThread.getLocalPort(); }
+    /** Stops receiving and closes the socket. */
+    void disconnect();
+    /** Starts receiving with the given scheduling options. */
+    bool start(const ReceiveThread::Options& options);
+
+    /**
+     * Writes numSamples samples of the mix of every stream into each
+     * output. Called from the audio thread.
+     */
+    void read(float* const* outputs, int numChannels, int numSamples);
+
+    /**
+     * Listens for latency probes in the audio played, and in what
+     * writeInput() is given. Takes effect on the next prepare().
+     */
+    void setLatencyMeasurementEnabled(bool shouldMeasure);
+    /**
+     * Gives the latency meter what the device's input hears, one channel,
+     * before read() on the same callback. Called from the audio thread.
+     */
+    void writeInput(const float* samples, int numSamples);
+    /** Sets the output plus input latency the device reports. */
+    void setDeviceLatency(double seconds) {
+        latencyMeter.setDeviceLatency(seconds);
+    }
+    const LatencyMeter& getLatencyMeter() const { return latencyMeter; }
+
+    /** Sets the gain of the stream in a slot, from any thread. */
+    void setStreamGain(size_t slot, float gain);
+    float getStreamGain(size_t slot) const { return mixer.getGain(slot); }
+
+    /**
+     * Sets the gain of the whole mix, reached through a short ramp. May be
+     * called from any thread.
+     */
+    void setGain(float newGain);
+    float getGain() const { return gain.getTarget(); }
+
+    /** Underruns summed over every stream. */
+    uint64 getNumUnderruns() const;
+    /** Jitter buffer overruns summed over every stream. */
+    uint64 getNumOverruns() const;
+    /** Concealment events summed over every stream. */
+    uint64 getNumConcealmentEvents() const;
+    /**
+     * Samples of comfort noise played during silence, summed over every
+     * stream.
+     */
+    uint64 getNumComfortNoiseSamples() const;
+
+    /** Seconds spent in read(), on the audio thread. */
+    const Histogram& getCallbackTime() const { return callbackTime; }
+    /**
+     * Audio queued ahead of the output plus one device block, in seconds,
+     * recorded for every stream at every read().
+     */
+    const Histogram& getLatency() const { return latency; }
+
+    /**
+     * Registers the engine's counters and timings, per stream slot where
+     * they are kept per stream. The registry must not outlive the engine.
+     */
+    void addMetrics(MetricsRegistry& registry) const;
+
+    const StreamTable& getStreamTable() const { return streams; }
+    const StreamPlayout& getPlayout(size_t slot) const {
+        return *playouts[slot];
+    }
+    const ReceiveThread& getReceiveThread() const { return receiveThread; }
+
+    /** Rate of the stream in a slot, the device's if it didn't say. */
+    double getStreamRate(size_t slot) const;
+
+  private:
+    StreamTable streams;
+    StreamPlayout::Filters playoutFilters;
+    std::vector<std::unique_ptr<StreamPlayout>> playouts;
+    StreamMixer mixer;
+    SmoothedGain gain;
+    std::vector<float> mixBuffer;
+    std::vector<float*> mixChannels;
+    std::vector<float> remixBuffer;
+    std::vector<float*> remixChannels;
+    int mixBlockSize{0};
+    double rate{0.0};
+    Histogram callbackTime{1.0e-6, 2.0, 20};
+    Histogram latency{0.5e-3, 2.0, 12};
+    ReceiveThread receiveThread{streams};
+    LatencyMeter latencyMeter{streams, receiveThread};
+    bool latencyMeasurementEnabled{false};
+    bool measuringLatency{false};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReceiveEngine)
+};
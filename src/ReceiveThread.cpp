@@ -0,0 +1,531 @@
+#include "ReceiveThread.hpp"
+
+#include "StreamConfig.hpp"
+
+namespace {
+/** Returns the size of an OSC string including its padding, or 0. */
+int paddedStringSize(const char* data, int size) {
+    const auto* end = static_cast<const char*>(std::memchr(data, 0, size));
+    if (end == nullptr) {
+        return 0;
+    }
+
+    const auto length = static_cast<int>(end - data) + 1;
+    const auto padded = (length + 3) & ~3;
+    return padded <= size ? padded : 0;
+}
+
+int32 readBigEndianInt(const char* data) {
+    return static_cast<int32>(
+        (static_cast<uint32>(static_cast<uint8>(data[0])) << 24) |
+        (static_cast<uint32>(static_cast<uint8>(data[1])) << 16) |
+        (static_cast<uint32>(static_cast<uint8>(data[2])) << 8) |
+        static_cast<uint32>(static_cast<uint8>(data[3])));
+}
+}  // namespace
+
+//==============================================================================
+ReceiveThread::ReceiveThread(StreamTable& streamTable)
+    : Thread("AudioStream Receiver"),
+      table(streamTable) {}
+
+ReceiveThread::~ReceiveThread() { disconnect(); }
+
+void ReceiveThread::prepare(double sampleRate, uint32 maxDelaySamples) {
+    rate = sampleRate;
+    maxDelay = maxDelaySamples;
+
+    // Streams are only sized once a slot is claimed, so memory grows with
+    // the number of senders actually heard
+    streams.resize(table.getNumSlots());
+    for (auto& stream : streams) {
+        if (stream == nullptr) {
+            stream = std::make_unique<Stream>();
+        }
+    }
+
+    codec.prepare(AUDIO_STREAM_MAX_FRAME_SIZE);
+    comfortNoise.prepare(AUDIO_STREAM_MAX_CHANNELS);
+    decoded.resize(AUDIO_STREAM_MAX_CHANNELS *
+                   AUDIO_STREAM_MAX_FRAME_SIZE);
+    nack.resize(NackPacketHeader::size +
+                AUDIO_STREAM_REORDER_WINDOW * NackEntry::size);
+}
+
+bool ReceiveThread::connect(int portNumber, const String& multicastGroup) {
+    disconnect();
+
+    return socket.bind(portNumber, AUDIO_STREAM_MAX_PACKET_SIZE,
+                       multicastGroup.toStdString());
+}
+
+void ReceiveThread::disconnect() {
+    // The thread notices within one receive timeout
+    signalThreadShouldExit();
+    stopThread(2 * AUDIO_STREAM_RECEIVE_TIMEOUT_MS);
+    socket.close();
+}
+
+bool ReceiveThread::start(const Options& options) {
+    if (!socket.isBound()) {
+        return false;
+    }
+
+    setAffinityMask(options.affinityMask);
+
+    if (options.realtimePriority >= 0 &&
+        startRealtimeThread(RealtimeOptions{}.withPriority(
+            jlimit(0, 10, options.realtimePriority)))) {
+        return true;
+    }
+
+    return startThread(options.priority);
+}
+
+void ReceiveThread::run() {
+    while (!threadShouldExit()) {
+        const auto ready =
+            socket.waitUntilReady(AUDIO_STREAM_RECEIVE_TIMEOUT_MS);
+
+        if (ready < 0) {
+            break;
+        }
+
+        now =
+            Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
+        retireIdleStreams();
+        sendReports();
+
+        if (ready == 0) {
+            continue;
+        }
+
+        socket.receive([this](const uint8* data, size_t size,
+                              const udp::Address& source) {
+            handlePacket(data, size, source);
+        });
+
+        requestRetransmissions();
+    }
+}
+
+void ReceiveThread::retireIdleStreams() {
+    const auto timeout = AUDIO_STREAM_STREAM_TIMEOUT_MS / 1000.0;
+
+    for (size_t slot = 0; slot < streams.size(); ++slot) {
+        if (table.getState(slot) == StreamTable::State::active &&
+            now - streams[slot]->lastArrival > timeout) {
+            table.retire(slot);
+        }
+    }
+}
+
+int ReceiveThread::claimStream(const StreamPacketHeader& header) {
+    const auto slot = table.claim(header.streamId, header.sampleRate,
+                                  header.totalChannels);
+    if (slot < 0) {
+        return slot;
+    }
+
+    // Reuses the allocations of the slot's previous stream, if any
+    auto& stream = *streams[static_cast<size_t>(slot)];
+    stream.sampleRate = header.sampleRate;
+    const auto streamRate = getStreamRate(stream);
+    const auto samplesPerMs = streamRate / 1000.0;
+
+    stream.reorderDelay = static_cast<uint64>(samplesPerMs *
+                                              AUDIO_STREAM_REORDER_DELAY_MS);
+    stream.reorderBuffer.prepare(AUDIO_STREAM_REORDER_WINDOW,
+                                 AUDIO_STREAM_MAX_CHANNELS,
+                                 AUDIO_STREAM_MAX_FRAME_SIZE,
+                                 stream.reorderDelay);
+    stream.fecDecoder.prepare(AUDIO_STREAM_REORDER_WINDOW,
+                              AUDIO_STREAM_MAX_CHANNELS,
+                              AUDIO_STREAM_FEC_MAX_PACKET_SIZE);
+    stream.jitterEstimator.prepare(
+        AUDIO_STREAM_JITTER_HISTORY_SIZE, streamRate,
+        static_cast<uint32>(samplesPerMs * AUDIO_STREAM_PLAYOUT_MARGIN_MS),
+        static_cast<uint32>(samplesPerMs * AUDIO_STREAM_MIN_PLAYOUT_DELAY_MS),
+        maxDelay);
+    stream.nackTracker.prepare(AUDIO_STREAM_REORDER_WINDOW,
+                               AUDIO_STREAM_NACK_MAX_REQUESTS,
+                               AUDIO_STREAM_NACK_INITIAL_RTT_MS / 1000.0,
+                               AUDIO_STREAM_NACK_REORDER_MS / 1000.0);
+    stream.retransmittable = header.isRetransmittable();
+    stream.reporting = header.wantsReports();
+    stream.roundTrip.reset();
+    stream.lastReport = now;
+    stream.lastSenderReport = 0;
+    stream.probeTimestamp = 0;
+    stream.probeTime = 0.0;
+    stream.receivedBase = stream.reorderBuffer.getNumReceived();
+    stream.lostBase = stream.reorderBuffer.getNumLost();
+    stream.receivedAtReport = 0;
+    stream.lostAtReport = 0;
+    stream.fecLatency = 0;
+    stream.nackLatency =
+        header.isRetransmittable()
+            ? static_cast<uint32>(samplesPerMs * AUDIO_STREAM_NACK_DELAY_MS)
+            : 0;
+    stream.lastNumSamples = 0;
+    stream.lastArrival = now;
+    updateDelays(stream);
+
+    return slot;
+}
+
+double ReceiveThread::getStreamRate(const Stream& stream) const {
+    return stream.sampleRate > 0 ? static_cast<double>(stream.sampleRate)
+                                 : rate;
+}
+
+void ReceiveThread::updateDelays(Stream& stream) {
+    const auto extraDelay = stream.fecLatency + stream.nackLatency;
+    stream.reorderBuffer.setMaxDelay(stream.reorderDelay + extraDelay);
+    stream.jitterEstimator.setExtraDelay(extraDelay);
+}
+
+void ReceiveThread::requestRetransmissions() {
+    const auto maxEntries = (nack.size() - NackPacketHeader::size) /
+                            NackEntry::size;
+
+    for (size_t slot = 0; slot < streams.size(); ++slot) {
+        auto& stream = *streams[slot];
+        if (table.getState(slot) != StreamTable::State::active ||
+            !stream.retransmittable.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        auto& tracker = stream.nackTracker;
+        const auto streamRate = getStreamRate(stream);
+        size_t numEntries = 0;
+
+        stream.reorderBuffer.forEachMissing(
+            [&](uint32 sequence, uint32 channelMask, int64 samplesLeft) {
+                const auto timeLeft =
+                    static_cast<double>(samplesLeft) / streamRate;
+                if (numEntries == maxEntries ||
+                    !tracker.shouldRequest(sequence, now, timeLeft)) {
+                    return;
+                }
+
+                NackEntry entry;
+                entry.sequence = sequence;
+                entry.channelMask = channelMask;
+                entry.deadline = static_cast<uint32>(
+                    jmin(timeLeft * 1.0e6, double(0xffffffffu)));
+                entry.write(nack.data() + NackPacketHeader::size +
+                            numEntries * NackEntry::size);
+                ++numEntries;
+            });
+
+        if (numEntries == 0) {
+            continue;
+        }
+
+        NackPacketHeader header;
+        header.streamId = table.getStreamId(slot);
+        header.numEntries = static_cast<uint8>(numEntries);
+        header.roundTripTime =
+            tracker.hasRoundTripTime()
+                ? static_cast<uint32>(tracker.getRoundTripTime() * 1.0e6)
+                : 0;
+        header.write(nack.data());
+
+        if (socket.sendTo(nack.data(),
+                          NackPacketHeader::size +
+                              numEntries * NackEntry::size,
+                          stream.source)) {
+            tracker.addNack();
+        }
+    }
+}
+
+void ReceiveThread::sendReports() {
+    const auto interval = AUDIO_STREAM_REPORT_INTERVAL_MS / 1000.0;
+
+    for (size_t slot = 0; slot < streams.size(); ++slot) {
+        auto& stream = *streams[slot];
+        if (table.getState(slot) != StreamTable::State::active ||
+            !stream.reporting.load(std::memory_order_relaxed) ||
+            now - stream.lastReport < interval) {
+            continue;
+        }
+
+        stream.lastReport = now;
+
+        const auto streamRate = getStreamRate(stream);
+        auto toMicroseconds = [streamRate](double samples) {
+            return static_cast<uint32>(
+                jlimit(0.0, double(0xffffffffu), samples / streamRate * 1.0e6));
+        };
+
+        const auto& reorderBuffer = stream.reorderBuffer;
+        const auto numReceived =
+            reorderBuffer.getNumReceived() - stream.receivedBase;
+        const auto numLost = reorderBuffer.getNumLost() - stream.lostBase;
+        const auto lostSince = numLost - stream.lostAtReport;
+
+        ReceiverReportHeader report;
+        report.streamId = table.getStreamId(slot);
+        report.sendTime = static_cast<uint64>(now * 1.0e6);
+        report.fractionLost = getFractionLost(
+            lostSince, numReceived - stream.receivedAtReport + lostSince);
+        report.numReceived = static_cast<uint32>(numReceived);
+        report.numLost = static_cast<uint32>(numLost);
+        report.jitter = toMicroseconds(
+            stream.jitterEstimator.getInterarrivalJitter());
+        report.bufferDelay = toMicroseconds(
+            static_cast<double>(table.getBuffer(slot).getNumSamplesQueued()));
+        report.targetDelay =
+            toMicroseconds(stream.jitterEstimator.getTargetDelay());
+
+        if (stream.lastSenderReport != 0) {
+            report.echoTime = stream.lastSenderReport;
+            report.echoDelay = static_cast<uint32>(
+                (now - stream.lastSenderReportArrival) * 1.0e6);
+        }
+
+        stream.receivedAtReport = numReceived;
+        stream.lostAtReport = numLost;
+
+        uint8 data[ReceiverReportHeader::size];
+        report.write(data);
+        if (socket.sendTo(data, sizeof(data), stream.source)) {
+            numReportsSent.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ReceiveThread::handleSenderReport(const SenderReportHeader& report) {
+    const auto slot = table.find(report.streamId);
+    if (slot < 0) {
+        return;
+    }
+
+    auto& stream = *streams[static_cast<size_t>(slot)];
+    stream.lastSenderReport = report.sendTime;
+    stream.lastSenderReportArrival = now;
+    stream.roundTrip.addEcho(static_cast<uint64>(now * 1.0e6),
+                             report.echoTime, report.echoDelay);
+
+    // The probe time is taken to this end's clock over the round trip
+    if (report.probeTimestamp == 0 || !stream.roundTrip.hasRoundTripTime() ||
+        report.probeTimestamp ==
+            stream.probeTimestamp.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    stream.probeTime.store(
+        stream.roundTrip.toLocalTime(report.probeTime * 1.0e-6,
+                                     report.sendTime * 1.0e-6, now),
+        std::memory_order_relaxed);
+    stream.probeTimestamp.store(report.probeTimestamp,
+                                std::memory_order_release);
+}
+
+void ReceiveThread::handlePacket(const uint8* data, size_t size,
+                                 const udp::Address& source) {
+    // OSC messages start with their address, raw packets with a magic number
+    if (size > 0 && data[0] == '/') {
+        handleOscMessage(reinterpret_cast<const char*>(data),
+                         static_cast<int>(size), source);
+    } else {
+        handleStreamPacket(data, size, source);
+    }
+}
+
+void ReceiveThread::handleOscMessage(const char* data, int size,
+                                     const udp::Address& source) {
+    // Decodes the OSC messages sent by SendingState in place. Only the
+    // address and blob arguments are of interest here.
+    const auto addressSize = paddedStringSize(data, size);
+    if (addressSize == 0 ||
+        std::strcmp(data, AUDIO_STREAM_ADDRESS_PATTERN) != 0) {
+        return;
+    }
+
+    const auto* typeTags = data + addressSize;
+    const auto typeTagsSize = paddedStringSize(typeTags, size - addressSize);
+    if (typeTagsSize == 0 || typeTags[0] != ',') {
+        return;
+    }
+
+    auto offset = addressSize + typeTagsSize;
+
+    for (const auto* tag = typeTags + 1; *tag != 0; ++tag) {
+        if (*tag == 'i' || *tag == 'f') {
+            offset += 4;
+            continue;
+        }
+
+        if (*tag != 'b' || offset + 4 > size) {
+            return;
+        }
+
+        const auto blobSize = readBigEndianInt(data + offset);
+        offset += 4;
+
+        if (blobSize < 0 || blobSize > size - offset) {
+            return;
+        }
+
+        handleStreamPacket(reinterpret_cast<const uint8*>(data + offset),
+                           static_cast<size_t>(blobSize), source);
+        offset += (blobSize + 3) & ~3;
+    }
+}
+
+void ReceiveThread::handleStreamPacket(const uint8* data, size_t size,
+                                       const udp::Address& source) {
+    if (FecPacketHeader fecHeader; fecHeader.read(data, size)) {
+        // Parity alone doesn't start a stream
+        if (const auto slot = table.find(fecHeader.streamId); slot >= 0) {
+            handleParityPacket(static_cast<size_t>(slot), fecHeader,
+                               data + fecHeader.headerSize);
+        }
+        return;
+    }
+
+    if (SenderReportHeader report; report.read(data, size)) {
+        handleSenderReport(report);
+        return;
+    }
+
+    StreamPacketHeader header;
+    if (!header.read(data, size)) {
+        return;
+    }
+
+    auto slot = table.find(header.streamId);
+
+    // Delays already measured are in the old rate's samples
+    if (slot >= 0 && header.sampleRate !=
+                         streams[static_cast<size_t>(slot)]->sampleRate) {
+        table.retire(static_cast<size_t>(slot));
+        slot = -1;
+    }
+
+    if (slot < 0 && (slot = claimStream(header)) < 0) {
+        return;
+    }
+
+    const auto index = static_cast<size_t>(slot);
+    auto& stream = *streams[index];
+    stream.lastArrival = now;
+
+    if (header.totalChannels != table.getNumChannels(index)) {
+        table.setNumChannels(index, header.totalChannels);
+    }
+
+    if (header.isRetransmittable() || header.wantsReports()) {
+        stream.source = source;
+    }
+
+    // One arrival per block is enough, its other channels arrive with it.
+    // Retransmissions are late by design and would only inflate the jitter.
+    if (header.channelIndex == 0 && !header.isRetransmitted()) {
+        stream.jitterEstimator.addArrival(
+            Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks()),
+            header.timestamp, header.numSamples);
+    }
+
+    stream.lastNumSamples = header.numSamples;
+    const auto result = addToReorderBuffer(index, header, data, size);
+
+    if (header.isRetransmitted()) {
+        stream.nackTracker.addRetransmission(header.sequence, now, result);
+    }
+
+    stream.fecDecoder.addData(
+        header, data, size,
+        [this, index](const uint8* packet, size_t packetSize) {
+            addRecoveredPacket(index, packet, packetSize);
+        });
+}
+
+void ReceiveThread::handleParityPacket(size_t slot,
+                                       const FecPacketHeader& header,
+                                       const uint8* data) {
+    auto& stream = *streams[slot];
+
+    // A lost packet is rebuilt at the latest when its group's parity
+    // arrives, numData blocks after the group started
+    const auto latency =
+        static_cast<uint32>(header.numData) * stream.lastNumSamples;
+    if (latency != stream.fecLatency) {
+        stream.fecLatency = latency;
+        updateDelays(stream);
+    }
+
+    stream.fecDecoder.addParity(
+        header, data, [this, slot](const uint8* packet, size_t packetSize) {
+            addRecoveredPacket(slot, packet, packetSize);
+        });
+}
+
+void ReceiveThread::addRecoveredPacket(size_t slot, const uint8* data,
+                                       size_t size) {
+    StreamPacketHeader header;
+    if (header.read(data, size)) {
+        addToReorderBuffer(slot, header, data, size);
+    }
+}
+
+ReorderBuffer::Result ReceiveThread::addToReorderBuffer(
+    size_t slot, const StreamPacketHeader& header, const uint8* data,
+    size_t size) {
+    auto& reorderBuffer = streams[slot]->reorderBuffer;
+    auto& jitterBuffer = table.getBuffer(slot);
+
+    const auto numSamples =
+        static_cast<size_t>(header.numChannels) * header.numSamples;
+
+    if (header.isComfortNoise()) {
+        if (numSamples > decoded.size()) {
+            numDecodeErrors.fetch_add(1, std::memory_order_relaxed);
+            return ReorderBuffer::Result::invalid;
+        }
+
+        // Noise at the levels the sender measured stands in for the frame
+        for (auto channel = 0; channel < header.numChannels; ++channel) {
+            float level = 0.0f;
+            SampleConverter::fromWire(
+                SampleFormat::float32,
+                data + header.headerSize + channel * sizeof(float), &level, 1);
+            comfortNoise.setLevel(channel, level);
+            comfortNoise.generate(
+                channel,
+                decoded.data() + static_cast<size_t>(channel) *
+                                     header.numSamples,
+                header.numSamples);
+        }
+        return reorderBuffer.addPacket(header, decoded.data(), jitterBuffer);
+    }
+
+    if (!header.isCompressed() &&
+        header.sampleFormat == SampleFormat::float32) {
+        return reorderBuffer.addPacket(
+            header, reinterpret_cast<const float*>(data + header.headerSize),
+            jitterBuffer);
+    }
+
+    if (numSamples > decoded.size()) {
+        numDecodeErrors.fetch_add(1, std::memory_order_relaxed);
+        return ReorderBuffer::Result::invalid;
+    }
+
+    if (!header.isCompressed()) {
+        // Integer formats are converted back to float here
+        SampleConverter::fromWire(header.sampleFormat,
+                                  data + header.headerSize, decoded.data(),
+                                  numSamples);
+    } else if (!codec.decode(data + header.headerSize,
+                             size - header.headerSize, header.numChannels,
+                             header.numSamples, decoded.data())) {
+        numDecodeErrors.fetch_add(1, std::memory_order_relaxed);
+        return ReorderBuffer::Result::invalid;
+    }
+
+    return reorderBuffer.addPacket(header, decoded.data(), jitterBuffer);
+}
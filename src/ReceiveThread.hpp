@@ -0,0 +1,228 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "DiscontinuousTransmission.hpp"
+#include "Feedback.hpp"
+#include "ForwardErrorCorrection.hpp"
+#include "JitterBuffer.hpp"
+#include "JitterEstimator.hpp"
+#include "LosslessCodec.hpp"
+#include "ReorderBuffer.hpp"
+#include "Retransmission.hpp"
+#include "SampleConversion.hpp"
+#include "StreamTable.hpp"
+#include "UdpSocket.hpp"
+
+#define AUDIO_STREAM_RECEIVE_THREAD_PRIORITY 8
+#define AUDIO_STREAM_RECEIVE_THREAD_AFFINITY 0
+#define AUDIO_STREAM_RECEIVE_TIMEOUT_MS 100
+#define AUDIO_STREAM_MAX_PACKET_SIZE 65536
+#define AUDIO_STREAM_REORDER_WINDOW 64
+#define AUDIO_STREAM_REORDER_DELAY_MS 20
+#define AUDIO_STREAM_JITTER_HISTORY_SIZE 512
+#define AUDIO_STREAM_PLAYOUT_MARGIN_MS 2
+#define AUDIO_STREAM_MIN_PLAYOUT_DELAY_MS 1
+#define AUDIO_STREAM_STREAM_TIMEOUT_MS 2000
+/** Extra wait for packets of streams that can be retransmitted. */
+#define AUDIO_STREAM_NACK_DELAY_MS 10
+#define AUDIO_STREAM_NACK_MAX_REQUESTS 2
+/**
+ * How long a frame older than the newest must have been missing before it
+ * is asked for, as its packets may only have been reordered.
+ */
+#define AUDIO_STREAM_NACK_REORDER_MS 2
+/** Round trip of a NACK assumed until one is measured. */
+#define AUDIO_STREAM_NACK_INITIAL_RTT_MS 5
+/** How often each stream's sender is sent a report, if it reads them. */
+#define AUDIO_STREAM_REPORT_INTERVAL_MS 500
+
+//==============================================================================
+/**
+ * @class ReceiveThread
+ * @brief Reads stream packets from a UDP socket on its own thread, puts them
+ * back in order and writes them straight into the JitterBuffer of their
+ * stream.
+ *
+ * Datagrams are read in batches into preallocated buffers. Both raw stream
+ * packets and the OSC messages of the compatibility transport are accepted.
+ *
+ * Packets are told apart by their streamId, so several senders can share
+ * one port. Each stream gets a slot of the StreamTable when its first packet
+ * arrives, and gives it back after AUDIO_STREAM_STREAM_TIMEOUT_MS without
+ * packets. The reorder window, FEC history and jitter estimate are kept per
+ * slot, and allocated the first time the slot is used.
+ *
+ * Arrival times are fed to each stream's JitterEstimator, whose target delay
+ * the audio thread follows. Delays are counted at the rate the stream
+ * announces, falling back on the device's for senders that don't, and a
+ * stream that changes its rate starts over in a new slot.
+ *
+ * Packets lost on the way are rebuilt from parity packets by a FecDecoder
+ * when the sender emits them, and the reorder and playout delays are raised
+ * by the time that takes. Compressed and integer payloads are decoded to
+ * float here, off the audio thread, and comfort noise descriptors become
+ * frames of noise at the levels they carry.
+ *
+ * Streams whose sender retransmits wait AUDIO_STREAM_NACK_DELAY_MS longer
+ * for missing packets. After each batch of datagrams, the frames older
+ * than the newest that have missed packets for AUDIO_STREAM_NACK_REORDER_MS
+ * and can be resent in time are asked for, in one NACK per stream sent
+ * back to the address the stream comes from.
+ *
+ * Senders that read reports are sent a ReceiverReportHeader every
+ * AUDIO_STREAM_REPORT_INTERVAL_MS with the stream's loss, jitter and
+ * buffer depth. Their SenderReportHeader answers give the round trip, and
+ * the clock offset of senders that send latency probes, whose probe times
+ * are kept in this end's clock for a LatencyMeter.
+ *
+ * Packets never pass through the message loop, so their arrival times don't
+ * depend on what the GUI is doing.
+ */
+class ReceiveThread : public Thread {
+  public:
+    struct Options {
+        /** Realtime priority from 0 to 10, or -1 for a normal thread. */
+        int realtimePriority{AUDIO_STREAM_RECEIVE_THREAD_PRIORITY};
+        /** Priority used when realtimePriority is -1 or not permitted. */
+        Thread::Priority priority{Thread::Priority::highest};
+        /** CPU affinity mask, 0 leaves the thread free to run anywhere. */
+        uint32 affinityMask{AUDIO_STREAM_RECEIVE_THREAD_AFFINITY};
+    };
+
+    explicit ReceiveThread(StreamTable& table);
+    ~ReceiveThread() override;
+
+    /**
+     * Sets up the per-stream state for every slot of the table. Must be
+     * called before start(), after the table was prepared.
+     */
+    void prepare(double sampleRate, uint32 maxDelaySamples);
+    /**
+     * Binds the socket to the given local port, joining multicastGroup too
+     * unless it is empty.
+     */
+    bool connect(int portNumber, const String& multicastGroup = {});
+    /** The port the socket is bound to, or -1. */
+    int getLocalPort() const { return socket.getLocalPort(); }
+    /** Stops the thread and closes the socket. */
+    void disconnect();
+    /** Starts receiving with the given scheduling options. */
+    bool start(const Options& options);
+
+    const ReorderBuffer& getReorderBuffer(size_t slot) const {
+        return streams[slot]->reorderBuffer;
+    }
+    const JitterEstimator& getJitterEstimator(size_t slot) const {
+        return streams[slot]->jitterEstimator;
+    }
+    const FecDecoder& getFecDecoder(size_t slot) const {
+        return streams[slot]->fecDecoder;
+    }
+    const NackTracker& getNackTracker(size_t slot) const {
+        return streams[slot]->nackTracker;
+    }
+    /** Whether the slot's stream can ask its sender for lost packets. */
+    bool isRetransmittable(size_t slot) const {
+        return streams[slot]->retransmittable.load(std::memory_order_relaxed);
+    }
+    /** Whether the slot's stream reports back to its sender. */
+    bool isReporting(size_t slot) const {
+        return streams[slot]->reporting.load(std::memory_order_relaxed);
+    }
+    /** Round trip to the slot's sender, from its answers to reports. */
+    const RoundTripEstimator& getRoundTrip(size_t slot) const {
+        return streams[slot]->roundTrip;
+    }
+    /** The last latency probe a stream's sender told of. */
+    struct Probe {
+        /** Stream position of the probe, 0 for none yet. */
+        uint64 timestamp{0};
+        /** When the sender's audio callback handled it, in seconds of the
+            high resolution clock here. */
+        double time{0.0};
+    };
+    Probe getLastProbe(size_t slot) const {
+        const auto& stream = *streams[slot];
+        Probe probe;
+        probe.timestamp = stream.probeTimestamp.load(std::memory_order_acquire);
+        probe.time = stream.probeTime.load(std::memory_order_relaxed);
+        return probe;
+    }
+    uint64 getNumReportsSent() const {
+        return numReportsSent.load(std::memory_order_relaxed);
+    }
+    /** Compressed packets that couldn't be decoded. */
+    uint64 getNumDecodeErrors() const {
+        return numDecodeErrors.load(std::memory_order_relaxed);
+    }
+
+  private:
+    /** Network side state of one stream. */
+    struct Stream {
+        ReorderBuffer reorderBuffer;
+        JitterEstimator jitterEstimator;
+        FecDecoder fecDecoder;
+        NackTracker nackTracker;
+        /** Where the stream's packets come from, and NACKs go. */
+        udp::Address source;
+        std::atomic<bool> retransmittable{false};
+        std::atomic<bool> reporting{false};
+        RoundTripEstimator roundTrip;
+        double lastReport{0.0};
+        /** sendTime of the last sender report, 0 for none yet. */
+        uint64 lastSenderReport{0};
+        double lastSenderReportArrival{0.0};
+        std::atomic<uint64> probeTimestamp{0};
+        std::atomic<double> probeTime{0.0};
+        /** Reorder buffer counts when the stream started, and reported. */
+        uint64 receivedBase{0};
+        uint64 lostBase{0};
+        uint64 receivedAtReport{0};
+        uint64 lostAtReport{0};
+        /** Announced rate, 0 if unknown. */
+        uint32 sampleRate{0};
+        uint64 reorderDelay{0};
+        uint32 fecLatency{0};
+        uint32 nackLatency{0};
+        uint16 lastNumSamples{0};
+        double lastArrival{0.0};
+    };
+
+    StreamTable& table;
+    std::vector<std::unique_ptr<Stream>> streams;
+    LosslessCodec codec;
+    ComfortNoise comfortNoise;
+    UdpReceiver socket;
+    std::vector<float> decoded;
+    std::vector<uint8> nack;
+    std::atomic<uint64> numDecodeErrors{0};
+    std::atomic<uint64> numReportsSent{0};
+
+    double rate{0.0};
+    uint32 maxDelay{0};
+    double now{0.0};
+
+    void run() override;
+    void retireIdleStreams();
+    int claimStream(const StreamPacketHeader& header);
+    double getStreamRate(const Stream& stream) const;
+    void updateDelays(Stream& stream);
+    void requestRetransmissions();
+    void sendReports();
+    void handleSenderReport(const SenderReportHeader& report);
+    void handlePacket(const uint8* data, size_t size,
+                      const udp::Address& source);
+    void handleOscMessage(const char* data, int size,
+                          const udp::Address& source);
+    void handleStreamPacket(const uint8* data, size_t size,
+                            const udp::Address& source);
+    void handleParityPacket(size_t slot, const FecPacketHeader& header,
+                            const uint8* data);
+    void addRecoveredPacket(size_t slot, const uint8* data, size_t size);
+    ReorderBuffer::Result addToReorderBuffer(size_t slot,
+                                             const StreamPacketHeader& header,
+                                             const uint8* data, size_t size);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReceiveThread)
+};
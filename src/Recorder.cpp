@@ -0,0 +1,262 @@
+#include "Recorder.hpp"
+
+#if JUCE_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+/**
+ * Reserves disk space for file up to size bytes without changing its
+ * length, so appending doesn't wait for the filesystem to find free blocks.
+ * Linux only; elsewhere the file grows as it is written.
+ */
+void reserve(const File& file, int64 size) {
+#if JUCE_LINUX
+    const auto fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY);
+    if (fd >= 0) {
+        ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+        ::close(fd);
+    }
+#else
+    ignoreUnused(file, size);
+#endif
+}
+
+/** Gives back the space reserved beyond the end of file. */
+bool releaseReserved(const File& file) {
+#if JUCE_LINUX
+    return ::truncate(file.getFullPathName().toRawUTF8(),
+                      static_cast<off_t>(file.getSize())) == 0;
+#else
+    ignoreUnused(file);
+    return true;
+#endif
+}
+}  // namespace
+
+//==============================================================================
+Recorder::Recorder() : Thread("AudioStream Recorder") {}
+
+Recorder::~Recorder() { stop(); }
+
+void Recorder::prepare(double sampleRate, int numChannels) {
+    stop();
+
+    rate = sampleRate;
+    const auto capacity =
+        jmax(1, roundToInt(sampleRate * AUDIO_STREAM_RECORD_FIFO_SECONDS));
+    buffer.setSize(jlimit(1, AUDIO_STREAM_MAX_CHANNELS, numChannels),
+                   capacity);
+    fifo.setTotalSize(capacity);
+}
+
+bool Recorder::start(const File& file) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    stop();
+    if (rate <= 0.0) {
+        return false;
+    }
+
+    std::unique_ptr<AudioFormat> format;
+    if (file.hasFileExtension("flac")) {
+        format = std::make_unique<FlacAudioFormat>();
+    } else {
+        format = std::make_unique<WavAudioFormat>();
+    }
+
+    file.getParentDirectory().createDirectory();
+    file.deleteFile();
+
+    auto stream = std::make_unique<FileOutputStream>(
+        file, AUDIO_STREAM_RECORD_FILE_BUFFER_SIZE);
+    if (stream->failedToOpen()) {
+        return false;
+    }
+
+    bytesReserved = AUDIO_STREAM_RECORD_PREALLOCATE_BYTES;
+    reserve(file, bytesReserved);
+
+    writer.reset(format->createWriterFor(
+        stream.get(), rate, static_cast<unsigned int>(buffer.getNumChannels()),
+        AUDIO_STREAM_RECORD_BITS_PER_SAMPLE, {}, 0));
+    if (writer == nullptr) {
+        stream.reset();
+        file.deleteFile();
+        return false;
+    }
+
+    // The writer owns the stream from here on
+    stream.release();
+    outputFile = file;
+    numSamplesInFile = 0;
+
+    // Whatever is left from an earlier recording belongs to no file
+    fifo.finishedRead(fifo.getNumReady());
+    maxBacklog.store(0, std::memory_order_relaxed);
+    recording.store(true, std::memory_order_release);
+
+    if (!startThread(Thread::Priority::normal)) {
+        recording.store(false, std::memory_order_release);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Recorder::stop() {
+    recording.store(false, std::memory_order_release);
+
+    if (isThreadRunning()) {
+        signalThreadShouldExit();
+        notify();
+        stopThread(AUDIO_STREAM_RECORD_STOP_TIMEOUT_MS);
+        writePending();
+    }
+
+    close();
+}
+
+File Recorder::getDefaultFile(const String& prefix) {
+    const auto directory = SystemStats::getEnvironmentVariable(
+        AUDIO_STREAM_RECORD_DIRECTORY_VARIABLE, {});
+    const auto folder =
+        directory.isNotEmpty()
+            ? File::getCurrentWorkingDirectory().getChildFile(directory)
+            : File::getSpecialLocation(File::userMusicDirectory)
+                  .getChildFile("AudioStream");
+
+    return folder
+        .getChildFile(prefix + "-" +
+                      Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") +
+                      ".wav")
+        .getNonexistentSibling();
+}
+
+void Recorder::write(const float* const* channels, int numChannels,
+                     int numSamples) {
+    if (!recording.load(std::memory_order_acquire) || numSamples <= 0) {
+        return;
+    }
+
+    // A partial block would leave a hole nobody could see, a dropped one
+    // is at least counted
+    if (fifo.getFreeSpace() < numSamples) {
+        numDroppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    for (auto channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        const auto* source = channel < numChannels ? channels[channel]
+                                                   : nullptr;
+        auto* dest = buffer.getWritePointer(channel);
+
+        if (source == nullptr) {
+            FloatVectorOperations::clear(dest + start1, size1);
+            FloatVectorOperations::clear(dest + start2, size2);
+        } else {
+            FloatVectorOperations::copy(dest + start1, source, size1);
+            FloatVectorOperations::copy(dest + start2, source + size1,
+                                        size2);
+        }
+    }
+
+    fifo.finishedWrite(size1 + size2);
+
+    const auto backlog = fifo.getNumReady();
+    if (backlog > maxBacklog.load(std::memory_order_relaxed)) {
+        maxBacklog.store(backlog, std::memory_order_relaxed);
+    }
+}
+
+void Recorder::run() {
+    while (!threadShouldExit()) {
+        wait(AUDIO_STREAM_RECORD_WRITE_INTERVAL_MS);
+        writePending();
+    }
+}
+
+void Recorder::writePending() {
+    const auto numReady = fifo.getNumReady();
+    if (numReady == 0 || writer == nullptr) {
+        return;
+    }
+
+    // Stays a chunk ahead of the data, an upper bound for FLAC too
+    const auto bytesPerSample = static_cast<int64>(
+        buffer.getNumChannels() * AUDIO_STREAM_RECORD_BITS_PER_SAMPLE / 8);
+    const auto bytesNeeded = (numSamplesInFile + numReady) * bytesPerSample;
+    if (bytesNeeded + AUDIO_STREAM_RECORD_PREALLOCATE_BYTES / 2 >
+        bytesReserved) {
+        bytesReserved += AUDIO_STREAM_RECORD_PREALLOCATE_BYTES;
+        reserve(outputFile, bytesReserved);
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+    auto ok = size1 == 0 ||
+              writer->writeFromAudioSampleBuffer(buffer, start1, size1);
+    ok = (size2 == 0 ||
+          writer->writeFromAudioSampleBuffer(buffer, start2, size2)) &&
+         ok;
+
+    fifo.finishedRead(size1 + size2);
+    numSamplesInFile += size1 + size2;
+    numSamplesWritten.fetch_add(static_cast<uint64>(size1 + size2),
+                                std::memory_order_relaxed);
+    if (!ok) {
+        numWriteErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Recorder::close() {
+    if (writer == nullptr) {
+        return;
+    }
+
+    // Deleting the writer completes the file's header
+    writer.reset();
+    if (!releaseReserved(outputFile)) {
+        Logger::writeToLog("Couldn't release the space reserved for " +
+                           outputFile.getFullPathName());
+    }
+    bytesReserved = 0;
+}
+
+void Recorder::addMetrics(MetricsRegistry& registry) const {
+    // Left out until something has been recorded
+    auto add = [&](bool isCounter, const char* name, const char* help,
+                   auto read) {
+        auto guarded = [this, read] {
+            return isRecording() || getNumSamplesWritten() > 0
+                       ? double(read())
+                       : NAN;
+        };
+        if (isCounter) {
+            registry.addCounter(name, help, guarded);
+        } else {
+            registry.addGauge(name, help, guarded);
+        }
+    };
+
+    add(false, "audio_stream_record_backlog_seconds",
+        "Audio queued for the recording file",
+        [this] { return getBacklog() / rate; });
+    add(false, "audio_stream_record_max_backlog_seconds",
+        "Largest backlog of the recording",
+        [this] { return getMaxBacklog() / rate; });
+    add(true, "audio_stream_record_dropped_blocks_total",
+        "Blocks not recorded because the backlog was full",
+        [this] { return getNumDroppedBlocks(); });
+    add(true, "audio_stream_record_samples_total",
+        "Samples per channel written to the recording file",
+        [this] { return getNumSamplesWritten(); });
+    add(true, "audio_stream_record_write_errors_total",
+        "Writes to the recording file that failed",
+        [this] { return getNumWriteErrors(); });
+}
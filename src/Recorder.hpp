@@ -0,0 +1,116 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Metrics.hpp"
+#include "StreamConfig.hpp"
+
+#define AUDIO_STREAM_RECORD_DIRECTORY_VARIABLE "AUDIO_STREAM_RECORD_DIR"
+#define AUDIO_STREAM_RECORD_FIFO_SECONDS 4
+#define AUDIO_STREAM_RECORD_WRITE_INTERVAL_MS 100
+#define AUDIO_STREAM_RECORD_BITS_PER_SAMPLE 24
+#define AUDIO_STREAM_RECORD_FILE_BUFFER_SIZE (1 << 20)
+#define AUDIO_STREAM_RECORD_PREALLOCATE_BYTES (64 << 20)
+#define AUDIO_STREAM_RECORD_STOP_TIMEOUT_MS 10000
+
+//==============================================================================
+/**
+ * @class Recorder
+ * @brief Writes the audio passing through the audio callback to a WAV or
+ * FLAC file on its own thread.
+ *
+ * The audio thread copies each block into a lock-free FIFO of
+ * AUDIO_STREAM_RECORD_FIFO_SECONDS and returns. The writer thread wakes
+ * every AUDIO_STREAM_RECORD_WRITE_INTERVAL_MS and writes everything queued
+ * in one go, through a large file buffer, so the disk sees few large
+ * sequential writes. On Linux the file's disk space is reserved ahead of
+ * the data, and the unused part released when the file is closed.
+ *
+ * A disk that stalls only fills the FIFO. Once it is full, whole blocks are
+ * dropped and counted rather than waited for, so the audio callback never
+ * waits on the disk.
+ */
+class Recorder : public Thread {
+  public:
+    Recorder();
+    ~Recorder() override;
+
+    /**
+     * Sizes the FIFO for numChannels channels at sampleRate, stopping any
+     * recording. Must not be called while the audio thread writes.
+     */
+    void prepare(double sampleRate, int numChannels);
+    /**
+     * Starts recording into file, replacing it. Files ending in .flac are
+     * written as FLAC, anything else as WAV. Not from the audio thread.
+     */
+    bool start(const File& file);
+    /** Writes what is still queued, closes the file and stops. */
+    void stop();
+    bool isRecording() const {
+        return recording.load(std::memory_order_acquire);
+    }
+    /** The file being or last recorded. */
+    const File& getFile() const { return outputFile; }
+
+    /**
+     * A file named after prefix and the current time, in the directory
+     * named by the AUDIO_STREAM_RECORD_DIR environment variable or else in
+     * the user's music folder.
+     */
+    static File getDefaultFile(const String& prefix);
+
+    /**
+     * @brief Queues a block for writing. Called from the audio thread.
+     * @param channels numChannels channels of numSamples samples; a null
+     * channel, or one beyond those given, is recorded as silence.
+     */
+    void write(const float* const* channels, int numChannels, int numSamples);
+
+    /** Samples per channel queued but not yet written. */
+    int getBacklog() const { return fifo.getNumReady(); }
+    /** The largest backlog since recording started. */
+    int getMaxBacklog() const {
+        return maxBacklog.load(std::memory_order_relaxed);
+    }
+    /** Samples per channel the FIFO holds. */
+    int getCapacity() const { return fifo.getTotalSize(); }
+    /** Blocks dropped because the FIFO was full. */
+    uint64 getNumDroppedBlocks() const {
+        return numDroppedBlocks.load(std::memory_order_relaxed);
+    }
+    /** Samples per channel written, over every recording. */
+    uint64 getNumSamplesWritten() const {
+        return numSamplesWritten.load(std::memory_order_relaxed);
+    }
+    /** Writes the file refused, e.g. because the disk is full. */
+    uint64 getNumWriteErrors() const {
+        return numWriteErrors.load(std::memory_order_relaxed);
+    }
+
+    /** Registers the recorder's counters. */
+    void addMetrics(MetricsRegistry& registry) const;
+
+  private:
+    AbstractFifo fifo{1};
+    AudioBuffer<float> buffer;
+    double rate{0.0};
+    std::atomic<bool> recording{false};
+    std::atomic<int> maxBacklog{0};
+    std::atomic<uint64> numDroppedBlocks{0};
+    std::atomic<uint64> numSamplesWritten{0};
+    std::atomic<uint64> numWriteErrors{0};
+
+    // Writer thread, and the caller of start() and stop() while it's not
+    // running
+    File outputFile;
+    std::unique_ptr<AudioFormatWriter> writer;
+    int64 bytesReserved{0};
+    int64 numSamplesInFile{0};
+
+    void run() override;
+    void writePending();
+    void close();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Recorder)
+};
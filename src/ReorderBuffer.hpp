@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "JitterBuffer.hpp"
+#include "StreamPacket.hpp"
+
+//==============================================================================
+/**
+ * @class ReorderBuffer
+ * @brief Puts stream packets back in sequence order before they reach the
+ * JitterBuffer.
+ *
+ * Packets sharing a sequence number are assembled into one planar frame. A
+ * frame is released once all of its channels arrived and every earlier
+ * sequence was released. When the head of the window is still incomplete
+ * after maxDelay samples of newer audio arrived (or the window is full), it
+ * is released as is, or counted as lost if nothing of it arrived. Frames
+ * made from comfort noise descriptors keep that mark in their FrameInfo.
+ *
+ * Owned by the network thread. Counters may be read from any thread. The
+ * received, lost and incomplete counters count frames (sequence numbers),
+ * the others count packets.
+ */
+class ReorderBuffer {
+  public:
+    /** What became of a packet given to addPacket(). */
+    enum class Result { added, late, duplicate, invalid };
+
+    ReorderBuffer() = default;
+
+    /**
+     * @brief Allocates the window. Must not be called while packets are being
+     * added.
+     * @param windowSize Number of sequences that can be pending at once.
+     * @param maxChannels Largest accepted totalChannels.
+     * @param maxSamples Largest accepted numSamples.
+     * @param maxDelaySamples How long an incomplete frame may hold back the
+     * frames behind it, in samples.
+     */
+    void prepare(size_t windowSize, size_t maxChannels, size_t maxSamples,
+                 uint64_t maxDelaySamples) {
+        slots.assign(windowSize, Slot{});
+        for (auto& slot : slots) {
+            slot.receivedChannels.assign(maxChannels, false);
+        }
+
+        samples.assign(windowSize * maxChannels * maxSamples, 0.0f);
+        frameSize = maxChannels * maxSamples;
+        maxNumChannels = maxChannels;
+        maxNumSamples = maxSamples;
+        maxDelay = maxDelaySamples;
+        started = false;
+    }
+
+    /** Changes how long an incomplete frame may hold back the others. */
+    void setMaxDelay(uint64_t maxDelaySamples) { maxDelay = maxDelaySamples; }
+
+    /**
+     * @brief Adds a packet and pushes every frame that became playable.
+     * @param header The packet's parsed header.
+     * @param payload The packet's samples converted to float, planar.
+     * @param output Where released frames are pushed.
+     */
+    Result addPacket(const StreamPacketHeader& header, const float* payload,
+                     JitterBuffer& output) {
+        if (slots.empty() || header.totalChannels > maxNumChannels ||
+            header.numSamples > maxNumSamples || header.numSamples == 0) {
+            numInvalid.fetch_add(1, std::memory_order_relaxed);
+            return Result::invalid;
+        }
+
+        if (!started || header.streamId != streamId) {
+            reset(header);
+        }
+
+        auto distance = sequenceDistance(header.sequence, nextSequence);
+        if (distance < 0) {
+            numLate.fetch_add(1, std::memory_order_relaxed);
+            return Result::late;
+        }
+
+        if (sequenceDistance(header.sequence, highestSequence) > 0) {
+            highestSequence = header.sequence;
+            highestTimestamp = header.timestamp + header.numSamples;
+        } else if (header.sequence != highestSequence) {
+            numReordered.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        while (distance >= static_cast<int32_t>(slots.size())) {
+            releaseHead(output, true);
+            distance = sequenceDistance(header.sequence, nextSequence);
+        }
+
+        auto& slot = getSlot(header.sequence);
+        if (!slot.used) {
+            slot.used = true;
+            slot.sequence = header.sequence;
+            slot.timestamp = header.timestamp;
+            slot.totalChannels = header.totalChannels;
+            slot.numSamples = header.numSamples;
+            slot.isComfortNoise = header.isComfortNoise();
+            slot.numReceived = 0;
+            std::fill(slot.receivedChannels.begin(),
+                      slot.receivedChannels.end(), false);
+        } else if (slot.totalChannels != header.totalChannels ||
+                   slot.numSamples != header.numSamples) {
+            numInvalid.fetch_add(1, std::memory_order_relaxed);
+            return Result::invalid;
+        }
+
+        auto* dest = getSlotSamples(header.sequence);
+        for (auto i = 0u; i < header.numChannels; ++i) {
+            const auto channel = header.channelIndex + i;
+            if (slot.receivedChannels[channel]) {
+                numDuplicates.fetch_add(1, std::memory_order_relaxed);
+                return Result::duplicate;
+            }
+        }
+
+        for (auto i = 0u; i < header.numChannels; ++i) {
+            const auto channel = header.channelIndex + i;
+            std::copy(payload + i * header.numSamples,
+                      payload + (i + 1) * header.numSamples,
+                      dest + channel * header.numSamples);
+            slot.receivedChannels[channel] = true;
+            ++slot.numReceived;
+        }
+
+        frameChannels = header.totalChannels;
+        frameLength = header.numSamples;
+        releaseReady(output);
+        return Result::added;
+    }
+
+    /**
+     * @brief Calls visit(sequence, channelMask, samplesLeft) for every frame
+     * older than the newest one that still misses packets.
+     *
+     * channelMask has the NackEntry bits of the missing channels. samplesLeft
+     * is how much newer audio may still arrive before the frame is given up,
+     * always positive. The timestamps of frames missing altogether are
+     * guessed from the length of the last frame.
+     */
+    template <typename Visitor>
+    void forEachMissing(Visitor&& visit) const {
+        if (!started) {
+            return;
+        }
+
+        for (auto sequence = nextSequence;
+             sequenceDistance(highestSequence, sequence) > 0; ++sequence) {
+            const auto& slot = slots[sequence % slots.size()];
+            uint32_t channelMask = 0;
+            uint64_t frameTimestamp = 0;
+
+            if (slot.used && slot.sequence == sequence) {
+                for (uint32_t channel = 0; channel < slot.totalChannels;
+                     ++channel) {
+                    if (!slot.receivedChannels[channel]) {
+                        channelMask |= NackEntry::getChannelMask(channel, 1);
+                    }
+                }
+                frameTimestamp = slot.timestamp;
+            } else {
+                channelMask = NackEntry::getChannelMask(0, frameChannels);
+                frameTimestamp =
+                    nextTimestamp +
+                    static_cast<uint64_t>(
+                        sequenceDistance(sequence, nextSequence)) *
+                        frameLength;
+            }
+
+            // The frame is forced out once the newest audio is maxDelay
+            // past its start
+            const auto samplesLeft = static_cast<int64_t>(
+                frameTimestamp + maxDelay - highestTimestamp);
+            if (channelMask != 0 && samplesLeft > 0) {
+                visit(sequence, channelMask, samplesLeft);
+            }
+        }
+    }
+
+    uint64_t getNumReceived() const {
+        return numReceived.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumLost() const {
+        return numLost.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumIncomplete() const {
+        return numIncomplete.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumLate() const {
+        return numLate.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumDuplicates() const {
+        return numDuplicates.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumReordered() const {
+        return numReordered.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumInvalid() const {
+        return numInvalid.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Slot {
+        bool used{false};
+        uint32_t sequence{0};
+        uint64_t timestamp{0};
+        uint16_t totalChannels{0};
+        uint16_t numSamples{0};
+        bool isComfortNoise{false};
+        size_t numReceived{0};
+        std::vector<bool> receivedChannels;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<float> samples;
+    size_t frameSize{0};
+    size_t maxNumChannels{0};
+    size_t maxNumSamples{0};
+    uint64_t maxDelay{0};
+
+    bool started{false};
+    uint32_t streamId{0};
+    uint32_t nextSequence{0};
+    uint32_t highestSequence{0};
+    uint64_t nextTimestamp{0};
+    uint64_t highestTimestamp{0};
+    uint32_t frameChannels{0};
+    uint32_t frameLength{0};
+
+    std::atomic<uint64_t> numReceived{0};
+    std::atomic<uint64_t> numLost{0};
+    std::atomic<uint64_t> numIncomplete{0};
+    std::atomic<uint64_t> numLate{0};
+    std::atomic<uint64_t> numDuplicates{0};
+    std::atomic<uint64_t> numReordered{0};
+    std::atomic<uint64_t> numInvalid{0};
+
+    Slot& getSlot(uint32_t sequence) {
+        return slots[sequence % slots.size()];
+    }
+
+    float* getSlotSamples(uint32_t sequence) {
+        return samples.data() + (sequence % slots.size()) * frameSize;
+    }
+
+    void reset(const StreamPacketHeader& header) {
+        for (auto& slot : slots) {
+            slot.used = false;
+        }
+
+        started = true;
+        streamId = header.streamId;
+        nextSequence = header.sequence;
+        highestSequence = header.sequence;
+        nextTimestamp = header.timestamp;
+        highestTimestamp = header.timestamp + header.numSamples;
+        frameChannels = header.totalChannels;
+        frameLength = header.numSamples;
+    }
+
+    bool isHeadOverdue() const {
+        return sequenceDistance(highestSequence, nextSequence) >= 0 &&
+               highestTimestamp > nextTimestamp + maxDelay;
+    }
+
+    void releaseReady(JitterBuffer& output) {
+        while (sequenceDistance(highestSequence, nextSequence) >= 0) {
+            const auto& head = getSlot(nextSequence);
+            const auto isComplete = head.used &&
+                                    head.sequence == nextSequence &&
+                                    head.numReceived == head.totalChannels;
+
+            if (!isComplete && !isHeadOverdue()) {
+                break;
+            }
+
+            releaseHead(output, !isComplete);
+        }
+    }
+
+    void releaseHead(JitterBuffer& output, bool isForced) {
+        auto& head = getSlot(nextSequence);
+
+        if (head.used && head.sequence == nextSequence) {
+            if (isForced && head.numReceived < head.totalChannels) {
+                // Missing channels play back as silence
+                auto* frame = getSlotSamples(nextSequence);
+                for (size_t channel = 0; channel < head.totalChannels;
+                     ++channel) {
+                    if (!head.receivedChannels[channel]) {
+                        std::fill_n(frame + channel * head.numSamples,
+                                    head.numSamples, 0.0f);
+                    }
+                }
+                numIncomplete.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            output.push({head.totalChannels, head.numSamples, head.sequence,
+                         head.timestamp, head.isComfortNoise},
+                        getSlotSamples(nextSequence));
+
+            nextTimestamp = head.timestamp + head.numSamples;
+            head.used = false;
+            numReceived.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            numLost.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ++nextSequence;
+    }
+};
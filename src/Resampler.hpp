@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define AUDIO_STREAM_RESAMPLER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AUDIO_STREAM_RESAMPLER_NEON 1
+#endif
+
+//==============================================================================
+/**
+ * @class Resampler
+ * @brief A variable-ratio windowed-sinc resampler.
+ *
+ * The filter is a Kaiser-windowed sinc of numTaps taps tabulated at
+ * numPhases fractional positions, with linear interpolation between adjacent
+ * phases. The inner product is vectorised with SSE or NEON where available.
+ *
+ * The ratio is input samples consumed per output sample and may change on
+ * every block. At a ratio of exactly 1 the input is copied through
+ * unfiltered. The filter's lookahead of numTaps / 2 samples is read ahead
+ * from the input rather than delaying the output, so the signal isn't
+ * delayed and switching between copying and filtering is seamless. A
+ * resampler that starts filtering fills its history with the first sample
+ * instead of fading in from silence.
+ */
+class Resampler {
+  public:
+    static constexpr int numTaps = 32;
+    static constexpr int numPhases = 256;
+
+    /**
+     * @class Filter
+     * @brief The tabulated filter for one cutoff. Building one computes
+     * every tap, so it is done ahead of time, and any number of resamplers
+     * may share it.
+     */
+    class Filter {
+      public:
+        /**
+         * @param newCutoff Cutoff relative to the input Nyquist frequency.
+         * Lower it below 1 when downsampling.
+         */
+        explicit Filter(double newCutoff = 0.95)
+            : cutoff(std::clamp(newCutoff, 0.01, 1.0)) {
+            constexpr auto beta = 8.6;
+            constexpr auto pi = 3.14159265358979323846;
+            const auto halfLength = numTaps / 2.0;
+
+            table.assign(static_cast<size_t>((numPhases + 1) * numTaps),
+                         0.0f);
+
+            for (auto phase = 0; phase <= numPhases; ++phase) {
+                const auto fraction = static_cast<double>(phase) / numPhases;
+
+                for (auto k = 0; k < numTaps; ++k) {
+                    // Distance of tap k from the interpolated position
+                    const auto x = k + 1 - halfLength - fraction;
+                    const auto sinc =
+                        x == 0.0
+                            ? 1.0
+                            : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+                    const auto w = x / halfLength;
+                    const auto window =
+                        std::abs(w) >= 1.0
+                            ? 0.0
+                            : bessel0(beta * std::sqrt(1.0 - w * w)) /
+                                  bessel0(beta);
+
+                    table[static_cast<size_t>(phase * numTaps + k)] =
+                        static_cast<float>(cutoff * sinc * window);
+                }
+            }
+        }
+
+        double getCutoff() const { return cutoff; }
+
+      private:
+        friend class Resampler;
+
+        double cutoff;
+        std::vector<float> table;
+
+        /** Zeroth order modified Bessel function of the first kind. */
+        static double bessel0(double x) {
+            auto sum = 1.0;
+            auto term = 1.0;
+            for (auto k = 1; k < 32; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        }
+    };
+
+    Resampler() = default;
+
+    /**
+     * @brief Builds the resampler's own filter and allocates the channel
+     * histories.
+     * @param maxChannels Largest number of channels processed at once.
+     * @param maxInputSamples Largest number of input samples per block.
+     * @param cutoff Cutoff of the resampler's own filter, relative to the
+     * input Nyquist frequency.
+     */
+    void prepare(int maxChannels, int maxInputSamples, double cutoff = 0.95) {
+        ownFilter = Filter(cutoff);
+        filter = nullptr;
+
+        historySize = static_cast<size_t>(numTaps + maxInputSamples);
+        history.assign(static_cast<size_t>(maxChannels) * historySize, 0.0f);
+        numChannelsPrepared = maxChannels;
+        maxInput = maxInputSamples;
+        reset();
+    }
+
+    /**
+     * Switches to a filter built ahead of time, which must outlive its use
+     * here, or back to the resampler's own with nullptr. Realtime safe.
+     */
+    void setFilter(const Filter* newFilter) { filter = newFilter; }
+    double getCutoff() const { return getFilter().getCutoff(); }
+
+    /** Clears the channel histories and the fractional position. */
+    void reset() {
+        std::fill(history.begin(), history.end(), 0.0f);
+        position = 0.0;
+        filtering = false;
+        hasHistory = false;
+        numPending = 0;
+    }
+
+    /**
+     * Number of input samples process() will consume to produce numOutput
+     * samples at the given ratio.
+     */
+    int getNumInputNeeded(int numOutput, double ratio) const {
+        if (ratio == 1.0) {
+            return std::max(0, numOutput - getNumPending());
+        }
+
+        const auto start =
+            filtering ? position : static_cast<double>(lookahead - numPending);
+        return static_cast<int>(std::floor(start + (numOutput - 1) * ratio)) +
+               1;
+    }
+
+    /** Largest number of input samples accepted by process(). */
+    int getMaxInputSamples() const { return maxInput; }
+
+    /**
+     * @brief Resamples one block.
+     * @param inputs numChannels channels of numInput samples, where numInput
+     * must be getNumInputNeeded(numOutput, ratio).
+     * @param outputs numChannels channels of numOutput samples.
+     */
+    void process(const float* const* inputs, int numInput,
+                 float* const* outputs, int numChannels, int numOutput,
+                 double ratio) {
+        numChannels = std::min(numChannels, numChannelsPrepared);
+
+        if (ratio == 1.0) {
+            copy(inputs, numInput, outputs, numChannels, numOutput);
+            return;
+        }
+
+        if (!filtering) {
+            // The next output is the first sample not yet copied out
+            position = static_cast<double>(lookahead - numPending);
+            filtering = true;
+
+            if (!hasHistory && numInput > 0) {
+                for (auto channel = 0; channel < numChannels; ++channel) {
+                    std::fill_n(history.data() + static_cast<size_t>(channel) *
+                                                     historySize,
+                                numTaps, inputs[channel][0]);
+                }
+            }
+        }
+        hasHistory = true;
+
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            auto* buffer = history.data() +
+                           static_cast<size_t>(channel) * historySize;
+            std::copy(inputs[channel], inputs[channel] + numInput,
+                      buffer + numTaps);
+
+            auto t = position;
+            for (auto i = 0; i < numOutput; ++i, t += ratio) {
+                const auto index = static_cast<int>(std::floor(t));
+                const auto fraction = t - index;
+                outputs[channel][i] =
+                    interpolate(buffer + index + 1, fraction);
+            }
+
+            // Keep the last numTaps samples for the next block
+            std::copy(buffer + numInput, buffer + numInput + numTaps, buffer);
+        }
+
+        position += numOutput * ratio - numInput;
+    }
+
+  private:
+    /** Samples the filter reads ahead of the one it outputs. */
+    static constexpr int lookahead = numTaps / 2;
+
+    Filter ownFilter;
+    const Filter* filter{nullptr};
+    std::vector<float> history;
+    size_t historySize{0};
+    int numChannelsPrepared{0};
+    int maxInput{0};
+    double position{0.0};
+    /** Whether the last block was filtered rather than copied. */
+    bool filtering{false};
+    /** Whether the history holds input since the last reset(). */
+    bool hasHistory{false};
+    /** Samples at the end of the history not copied out yet. */
+    int numPending{0};
+
+    /** Samples at the end of the history the next output starts with. */
+    int getNumPending() const {
+        if (!filtering) {
+            return numPending;
+        }
+        // Drops the fraction of a sample the filter was between
+        return std::clamp(lookahead - static_cast<int>(std::floor(position)),
+                          0, numTaps);
+    }
+
+    void copy(const float* const* inputs, int numInput, float* const* outputs,
+              int numChannels, int numOutput) {
+        const auto pending = getNumPending();
+
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            auto* buffer = history.data() +
+                           static_cast<size_t>(channel) * historySize;
+            std::copy(inputs[channel], inputs[channel] + numInput,
+                      buffer + numTaps);
+
+            const auto* start = buffer + numTaps - pending;
+            std::copy(start, start + numOutput, outputs[channel]);
+
+            std::copy(buffer + numInput, buffer + numInput + numTaps, buffer);
+        }
+
+        numPending = pending + numInput - numOutput;
+        filtering = false;
+        hasHistory = true;
+    }
+
+    const Filter& getFilter() const {
+        return filter != nullptr ? *filter : ownFilter;
+    }
+
+    float interpolate(const float* samples, double fraction) const {
+        const auto scaled = fraction * numPhases;
+        const auto phase = std::min(static_cast<int>(scaled), numPhases - 1);
+        const auto mix = static_cast<float>(scaled - phase);
+
+        const auto* h0 = getFilter().table.data() + phase * numTaps;
+        const auto* h1 = h0 + numTaps;
+
+#if AUDIO_STREAM_RESAMPLER_SSE
+        auto sum = _mm_setzero_ps();
+        const auto mixVector = _mm_set1_ps(mix);
+        for (auto k = 0; k < numTaps; k += 4) {
+            const auto a = _mm_loadu_ps(h0 + k);
+            const auto b = _mm_loadu_ps(h1 + k);
+            const auto h =
+                _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), mixVector));
+            sum = _mm_add_ps(sum, _mm_mul_ps(h, _mm_loadu_ps(samples + k)));
+        }
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+#elif AUDIO_STREAM_RESAMPLER_NEON
+        auto sum = vdupq_n_f32(0.0f);
+        for (auto k = 0; k < numTaps; k += 4) {
+            const auto a = vld1q_f32(h0 + k);
+            const auto b = vld1q_f32(h1 + k);
+            const auto h = vmlaq_n_f32(a, vsubq_f32(b, a), mix);
+            sum = vmlaq_f32(sum, h, vld1q_f32(samples + k));
+        }
+        const auto pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+        return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+        auto sum = 0.0f;
+        for (auto k = 0; k < numTaps; ++k) {
+            sum += (h0[k] + (h1[k] - h0[k]) * mix) * samples[k];
+        }
+        return sum;
+#endif
+    }
+};
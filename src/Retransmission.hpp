@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "ReorderBuffer.hpp"
+#include "StreamPacket.hpp"
+
+//==============================================================================
+/**
+ * @class RetransmitHistory
+ * @brief Keeps copies of the stream packets sent lately, so they can be sent
+ * again when a receiver asks for them with a NACK.
+ *
+ * The packets of the last numSequences sequences are kept, up to
+ * maxPacketsPerSequence per sequence, in storage allocated by prepare().
+ * Adding a packet of a newer sequence overwrites the oldest one's. Owned by
+ * the send thread.
+ */
+class RetransmitHistory {
+  public:
+    RetransmitHistory() = default;
+
+    /** Allocates the history. An empty history keeps nothing. */
+    void prepare(size_t numSequences, size_t maxPacketsPerSequence,
+                 size_t maxPacketSize) {
+        groups.assign(numSequences, Group{});
+        for (auto& group : groups) {
+            group.packets.assign(maxPacketsPerSequence, Packet{});
+        }
+
+        storage.assign(numSequences * maxPacketsPerSequence * maxPacketSize,
+                       0);
+        packetsPerSequence = maxPacketsPerSequence;
+        packetSize = maxPacketSize;
+    }
+
+    /** Keeps a copy of a packet just sent, whose header is given. */
+    void add(const StreamPacketHeader& header, const uint8_t* data,
+             size_t size) {
+        if (groups.empty() || size > packetSize) {
+            return;
+        }
+
+        const auto index = header.sequence % groups.size();
+        auto& group = groups[index];
+        if (!group.used || group.sequence != header.sequence) {
+            group.used = true;
+            group.sequence = header.sequence;
+            group.count = 0;
+        }
+
+        if (group.count == packetsPerSequence) {
+            return;
+        }
+
+        const auto packetIndex = index * packetsPerSequence + group.count;
+        std::memcpy(storage.data() + packetIndex * packetSize, data, size);
+        group.packets[group.count++] = {
+            NackEntry::getChannelMask(header.channelIndex,
+                                      header.numChannels),
+            size};
+    }
+
+    /**
+     * @brief Calls visit(data, size) for every packet kept of sequence that
+     * carries a channel in channelMask. visit may change the packet.
+     * @return The number of packets visited.
+     */
+    template <typename Visitor>
+    size_t forEach(uint32_t sequence, uint32_t channelMask, Visitor&& visit) {
+        if (groups.empty()) {
+            return 0;
+        }
+
+        const auto index = sequence % groups.size();
+        const auto& group = groups[index];
+        if (!group.used || group.sequence != sequence) {
+            return 0;
+        }
+
+        size_t numVisited = 0;
+        for (size_t i = 0; i < group.count; ++i) {
+            if ((group.packets[i].channelMask & channelMask) != 0) {
+                visit(storage.data() +
+                          (index * packetsPerSequence + i) * packetSize,
+                      group.packets[i].size);
+                ++numVisited;
+            }
+        }
+        return numVisited;
+    }
+
+  private:
+    struct Packet {
+        uint32_t channelMask{0};
+        size_t size{0};
+    };
+
+    struct Group {
+        bool used{false};
+        uint32_t sequence{0};
+        size_t count{0};
+        std::vector<Packet> packets;
+    };
+
+    std::vector<Group> groups;
+    std::vector<uint8_t> storage;
+    size_t packetsPerSequence{0};
+    size_t packetSize{0};
+};
+
+//==============================================================================
+/**
+ * @class NackTracker
+ * @brief Decides which missing packets of a stream a receiver asks for, and
+ * when, and keeps the counters of the exchange.
+ *
+ * A frame is asked for only once it has been missing for reorderTolerance,
+ * so packets that were merely reordered aren't, and only while the time
+ * left before it is given up is longer than the round trip of a NACK, so a
+ * retransmission that would arrive too late isn't requested at all. A frame
+ * with no answer is asked for again after twice the round trip, at most
+ * maxRequests times.
+ *
+ * The round trip is measured from sending a NACK to receiving the packet,
+ * smoothed as TCP does. Frames asked for more than once aren't measured, as
+ * their answer can't be matched to one request. Until there is a
+ * measurement, initialRoundTrip is assumed.
+ *
+ * Owned by the network thread. Counters may be read from any thread.
+ */
+class NackTracker {
+  public:
+    NackTracker() = default;
+
+    /**
+     * Tracks up to windowSize frames at once, forgetting any earlier
+     * requests and measurements.
+     */
+    void prepare(size_t windowSize, int maxRequestsPerFrame,
+                 double initialRoundTrip, double reorderTolerance) {
+        requests.assign(windowSize, Request{});
+        maxRequests = maxRequestsPerFrame;
+        tolerance = reorderTolerance;
+        roundTrip.store(initialRoundTrip, std::memory_order_relaxed);
+        hasMeasurement.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Called for each frame that misses packets.
+     * @param timeLeft Seconds until the frame is given up.
+     * @return true if the frame should be asked for now.
+     */
+    bool shouldRequest(uint32_t sequence, double now, double timeLeft) {
+        if (requests.empty()) {
+            return false;
+        }
+
+        auto& request = requests[sequence % requests.size()];
+        if (!request.used || request.sequence != sequence) {
+            request = {true, sequence, 0,
+                       -std::numeric_limits<double>::infinity(), false, now};
+        }
+
+        const auto expected = getRoundTripTime();
+        if (request.numRequests >= maxRequests ||
+            now - request.lastRequest < 2.0 * expected) {
+            return false;
+        }
+
+        if (timeLeft <= expected) {
+            if (!request.expired) {
+                request.expired = true;
+                numExpired.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+
+        if (now - request.firstMissing < tolerance) {
+            return false;
+        }
+
+        request.lastRequest = now;
+        ++request.numRequests;
+        numRequests.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Counts a NACK sent. */
+    void addNack() { numNacks.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Counts a retransmitted packet and what the ReorderBuffer made of it,
+     * and measures the round trip from it when that is unambiguous.
+     */
+    void addRetransmission(uint32_t sequence, double now,
+                           ReorderBuffer::Result result) {
+        if (result == ReorderBuffer::Result::added) {
+            numRecovered.fetch_add(1, std::memory_order_relaxed);
+        } else if (result == ReorderBuffer::Result::late) {
+            numLate.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (requests.empty()) {
+            return;
+        }
+
+        const auto& request = requests[sequence % requests.size()];
+        if (!request.used || request.sequence != sequence ||
+            request.numRequests != 1) {
+            return;
+        }
+
+        const auto sample = now - request.lastRequest;
+        const auto previous = getRoundTripTime();
+        roundTrip.store(hasRoundTripTime()
+                            ? previous + (sample - previous) / 8.0
+                            : sample,
+                        std::memory_order_relaxed);
+        hasMeasurement.store(true, std::memory_order_relaxed);
+    }
+
+    /** Seconds from sending a NACK to receiving its answer. */
+    double getRoundTripTime() const {
+        return roundTrip.load(std::memory_order_relaxed);
+    }
+    /** Whether getRoundTripTime() was measured rather than assumed. */
+    bool hasRoundTripTime() const {
+        return hasMeasurement.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getNumNacks() const {
+        return numNacks.load(std::memory_order_relaxed);
+    }
+    /** Frames asked for, counting repeated requests. */
+    uint64_t getNumRequests() const {
+        return numRequests.load(std::memory_order_relaxed);
+    }
+    /** Retransmitted packets that arrived in time to be played. */
+    uint64_t getNumRecovered() const {
+        return numRecovered.load(std::memory_order_relaxed);
+    }
+    /** Retransmitted packets that arrived after their frame was played. */
+    uint64_t getNumLate() const {
+        return numLate.load(std::memory_order_relaxed);
+    }
+    /** Frames not asked for because the answer would come too late. */
+    uint64_t getNumExpired() const {
+        return numExpired.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Request {
+        bool used{false};
+        uint32_t sequence{0};
+        int numRequests{0};
+        double lastRequest{0.0};
+        bool expired{false};
+        /** When the frame was first seen missing. */
+        double firstMissing{0.0};
+    };
+
+    std::vector<Request> requests;
+    int maxRequests{0};
+    double tolerance{0.0};
+    std::atomic<double> roundTrip{0.0};
+    std::atomic<bool> hasMeasurement{false};
+
+    std::atomic<uint64_t> numNacks{0};
+    std::atomic<uint64_t> numRequests{0};
+    std::atomic<uint64_t> numRecovered{0};
+    std::atomic<uint64_t> numLate{0};
+    std::atomic<uint64_t> numExpired{0};
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "StreamPacket.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define AUDIO_STREAM_CONVERSION_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIO_STREAM_CONVERSION_NEON 1
+#endif
+
+//==============================================================================
+/**
+ * @class SampleConverter
+ * @brief Converts float samples to and from the wire sample formats.
+ *
+ * Integer formats are scaled so that full scale is 1.0: int16 steps are
+ * 1 / 32768 and int24 steps 1 / 8388608, which makes the conversion back to
+ * float exact. Out of range samples are clipped. Before rounding to an
+ * integer format, triangular (TPDF) dither of +-1 step is added unless
+ * disabled.
+ *
+ * Scaling, dither, rounding and saturation are vectorised with SSE2 or NEON
+ * where available, with a scalar fallback. All formats are little-endian,
+ * int24 packs 3 bytes per sample.
+ */
+class SampleConverter {
+  public:
+    SampleConverter() = default;
+
+    void setDitherEnabled(bool shouldDither) { ditherEnabled = shouldDither; }
+
+    /** Converts numSamples samples to the wire format, into dest. */
+    void toWire(SampleFormat format, const float* src, uint8_t* dest,
+                size_t numSamples) {
+        switch (format) {
+            case SampleFormat::float32:
+                std::memcpy(dest, src, numSamples * sizeof(float));
+                break;
+            case SampleFormat::int16:
+                toInt16(src, dest, numSamples);
+                break;
+            case SampleFormat::int24:
+                toInt24(src, dest, numSamples);
+                break;
+        }
+    }
+
+    /** Converts numSamples samples from the wire format, into dest. */
+    static void fromWire(SampleFormat format, const uint8_t* src, float* dest,
+                         size_t numSamples) {
+        switch (format) {
+            case SampleFormat::float32:
+                std::memcpy(dest, src, numSamples * sizeof(float));
+                break;
+            case SampleFormat::int16:
+                fromInt16(src, dest, numSamples);
+                break;
+            case SampleFormat::int24:
+                fromInt24(src, dest, numSamples);
+                break;
+        }
+    }
+
+  private:
+    static constexpr float int16Scale = 32768.0f;
+    static constexpr float int24Scale = 8388608.0f;
+    /** Samples converted at once through the int24 staging buffer. */
+    static constexpr size_t chunkSize = 64;
+
+    bool ditherEnabled{true};
+    uint32_t state[4] = {0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u};
+
+#if AUDIO_STREAM_CONVERSION_SSE2
+    /** Four lanes of xorshift32 turned into TPDF noise of +-1 step. */
+    __m128 nextDither() {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+        const auto one = _mm_set1_epi32(0x3f800000);
+
+        auto uniform = [&] {
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+            // Mantissa bits give [1, 2)
+            return _mm_castsi128_ps(
+                _mm_or_si128(_mm_srli_epi32(x, 9), one));
+        };
+
+        const auto a = uniform();
+        const auto b = uniform();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), x);
+        return ditherEnabled ? _mm_sub_ps(a, b) : _mm_setzero_ps();
+    }
+
+    /** Scales, dithers, rounds and clips four samples. */
+    __m128i quantise(const float* src, float scale) {
+        auto value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src),
+                                           _mm_set1_ps(scale)),
+                                nextDither());
+        value = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-scale)),
+                           _mm_set1_ps(scale - 1.0f));
+        return _mm_cvtps_epi32(value);
+    }
+#elif AUDIO_STREAM_CONVERSION_NEON
+    float32x4_t nextDither() {
+        auto x = vld1q_u32(state);
+        const auto one = vdupq_n_u32(0x3f800000);
+
+        auto uniform = [&] {
+            x = veorq_u32(x, vshlq_n_u32(x, 13));
+            x = veorq_u32(x, vshrq_n_u32(x, 17));
+            x = veorq_u32(x, vshlq_n_u32(x, 5));
+            return vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(x, 9), one));
+        };
+
+        const auto a = uniform();
+        const auto b = uniform();
+        vst1q_u32(state, x);
+        return ditherEnabled ? vsubq_f32(a, b) : vdupq_n_f32(0.0f);
+    }
+
+    int32x4_t quantise(const float* src, float scale) {
+        auto value = vmlaq_n_f32(nextDither(), vld1q_f32(src), scale);
+        value = vminq_f32(vmaxq_f32(value, vdupq_n_f32(-scale)),
+                          vdupq_n_f32(scale - 1.0f));
+        return vcvtnq_s32_f32(value);
+    }
+#endif
+
+    float nextScalarDither() {
+        auto uniform = [this] {
+            auto& x = state[0];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return static_cast<float>(x >> 8) / 16777216.0f;
+        };
+        const auto a = uniform();
+        const auto b = uniform();
+        return ditherEnabled ? a - b : 0.0f;
+    }
+
+    int32_t quantiseScalar(float sample, float scale) {
+        const auto value = std::clamp(sample * scale + nextScalarDither(),
+                                      -scale, scale - 1.0f);
+        return static_cast<int32_t>(std::lrint(value));
+    }
+
+    void toInt16(const float* src, uint8_t* dest, size_t numSamples) {
+        size_t i = 0;
+#if AUDIO_STREAM_CONVERSION_SSE2
+        for (; i + 8 <= numSamples; i += 8) {
+            const auto low = quantise(src + i, int16Scale);
+            const auto high = quantise(src + i + 4, int16Scale);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + 2 * i),
+                             _mm_packs_epi32(low, high));
+        }
+#elif AUDIO_STREAM_CONVERSION_NEON
+        for (; i + 8 <= numSamples; i += 8) {
+            const auto low = vqmovn_s32(quantise(src + i, int16Scale));
+            const auto high = vqmovn_s32(quantise(src + i + 4, int16Scale));
+            vst1q_s16(reinterpret_cast<int16_t*>(dest + 2 * i),
+                      vcombine_s16(low, high));
+        }
+#endif
+        for (; i < numSamples; ++i) {
+            const auto value = quantiseScalar(src[i], int16Scale);
+            wire::writeLE(dest + 2 * i, static_cast<uint16_t>(value));
+        }
+    }
+
+    static void fromInt16(const uint8_t* src, float* dest,
+                          size_t numSamples) {
+        size_t i = 0;
+#if AUDIO_STREAM_CONVERSION_SSE2
+        const auto scale = _mm_set1_ps(1.0f / int16Scale);
+        for (; i + 8 <= numSamples; i += 8) {
+            const auto packed =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+            // Sign extend by moving each sample to the top half of a lane
+            const auto low =
+                _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+            const auto high =
+                _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+            _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+            _mm_storeu_ps(dest + i + 4,
+                          _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+        }
+#elif AUDIO_STREAM_CONVERSION_NEON
+        for (; i + 8 <= numSamples; i += 8) {
+            const auto packed =
+                vld1q_s16(reinterpret_cast<const int16_t*>(src + 2 * i));
+            vst1q_f32(dest + i,
+                      vmulq_n_f32(
+                          vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed))),
+                          1.0f / int16Scale));
+            vst1q_f32(dest + i + 4,
+                      vmulq_n_f32(
+                          vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed))),
+                          1.0f / int16Scale));
+        }
+#endif
+        for (; i < numSamples; ++i) {
+            dest[i] = static_cast<float>(static_cast<int16_t>(
+                          wire::readLE<uint16_t>(src + 2 * i))) /
+                      int16Scale;
+        }
+    }
+
+    void toInt24(const float* src, uint8_t* dest, size_t numSamples) {
+        int32_t staging[chunkSize];
+
+        for (size_t start = 0; start < numSamples; start += chunkSize) {
+            const auto count = std::min(chunkSize, numSamples - start);
+            size_t i = 0;
+#if AUDIO_STREAM_CONVERSION_SSE2
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(staging + i),
+                                 quantise(src + start + i, int24Scale));
+            }
+#elif AUDIO_STREAM_CONVERSION_NEON
+            for (; i + 4 <= count; i += 4) {
+                vst1q_s32(staging + i, quantise(src + start + i, int24Scale));
+            }
+#endif
+            for (; i < count; ++i) {
+                staging[i] = quantiseScalar(src[start + i], int24Scale);
+            }
+
+            auto* out = dest + 3 * start;
+            for (i = 0; i < count; ++i, out += 3) {
+                const auto value = static_cast<uint32_t>(staging[i]);
+                out[0] = static_cast<uint8_t>(value);
+                out[1] = static_cast<uint8_t>(value >> 8);
+                out[2] = static_cast<uint8_t>(value >> 16);
+            }
+        }
+    }
+
+    static void fromInt24(const uint8_t* src, float* dest,
+                          size_t numSamples) {
+        int32_t staging[chunkSize];
+
+        for (size_t start = 0; start < numSamples; start += chunkSize) {
+            const auto count = std::min(chunkSize, numSamples - start);
+
+            const auto* in = src + 3 * start;
+            for (size_t i = 0; i < count; ++i, in += 3) {
+                // Assemble in the top 24 bits, then sign extend
+                const auto value = static_cast<uint32_t>(in[0]) << 8 |
+                                   static_cast<uint32_t>(in[1]) << 16 |
+                                   static_cast<uint32_t>(in[2]) << 24;
+                staging[i] = static_cast<int32_t>(value) >> 8;
+            }
+
+            size_t i = 0;
+#if AUDIO_STREAM_CONVERSION_SSE2
+            const auto scale = _mm_set1_ps(1.0f / int24Scale);
+            for (; i + 4 <= count; i += 4) {
+                const auto value = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(staging + i));
+                _mm_storeu_ps(dest + start + i,
+                              _mm_mul_ps(_mm_cvtepi32_ps(value), scale));
+            }
+#elif AUDIO_STREAM_CONVERSION_NEON
+            for (; i + 4 <= count; i += 4) {
+                vst1q_f32(dest + start + i,
+                          vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(staging + i)),
+                                      1.0f / int24Scale));
+            }
+#endif
+            for (; i < count; ++i) {
+                dest[start + i] = static_cast<float>(staging[i]) / int24Scale;
+            }
+        }
+    }
+};
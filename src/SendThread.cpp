@@ -0,0 +1,665 @@
+#include "SendThread.hpp"
+
+#include "StreamConfig.hpp"
+
+//==============================================================================
+SendThread::SendThread()
+    : Thread("AudioStream Sender"),
+      fecNumData(AUDIO_STREAM_FEC_NUM_DATA),
+      fecNumParity(AUDIO_STREAM_FEC_NUM_PARITY) {}
+
+SendThread::~SendThread() { stop(); }
+
+void SendThread::prepare(double sampleRate) {
+    // Every start is a new stream as far as receivers are concerned
+    streamId = static_cast<uint32>(Random::getSystemRandom().nextInt());
+    timestamp = 0;
+    streamRate = static_cast<uint32>(jmax(0, roundToInt(sampleRate)));
+
+    // Samples are what's left of the MTU after every header. A compressed
+    // channel takes at most one byte more than a raw float32 one, so a
+    // frame sized for that fits in any format.
+    const auto maxPacketSize =
+        jlimit(AUDIO_STREAM_MIN_MTU, AUDIO_STREAM_MAX_DATAGRAM_SIZE, mtu);
+    maxPayloadSize = static_cast<size_t>(maxPacketSize -
+                                         AUDIO_STREAM_PACKET_OVERHEAD) -
+                     StreamPacketHeader::size;
+    const auto maxFitting = (maxPayloadSize - 1) / sizeof(float);
+
+    // A frame too long for a datagram is split into equal shorter ones
+    const auto requested = static_cast<size_t>(jlimit(
+        1, AUDIO_STREAM_MAX_FRAME_SIZE,
+        roundToInt(sampleRate * frameDurationMs / 1000.0)));
+    const auto numParts = (requested + maxFitting - 1) / maxFitting;
+    frameSize = (requested + numParts - 1) / numParts;
+
+    const auto maxBlockSize =
+        AUDIO_STREAM_MAX_CHANNELS * AUDIO_STREAM_MAX_FRAME_SIZE;
+    fifo.prepare(maxBlockSize * AUDIO_STREAM_SEND_FIFO_BLOCKS, maxBlockSize);
+    fifoHighWaterMark = 0;
+    while (blocksReady.try_acquire()) {
+    }
+
+    inputBlock.resize(maxBlockSize);
+    gain.reset();
+    block.resize(maxBlockSize);
+    packetizer.prepare(AUDIO_STREAM_MAX_CHANNELS, frameSize);
+    scratch.resize(AUDIO_STREAM_MAX_CHANNELS * frameSize);
+    packet.resize(StreamPacketHeader::size + maxPayloadSize);
+    codec.prepare(static_cast<int>(frameSize));
+    fecEncoder.prepare(fecNumData, fecNumParity, AUDIO_STREAM_MAX_CHANNELS,
+                       std::min<size_t>(packet.size(),
+                                        AUDIO_STREAM_FEC_MAX_PACKET_SIZE));
+    udpSender->prepare(static_cast<size_t>(maxPacketSize));
+
+    // Every channel may need a packet of its own
+    retransmit = retransmissionEnabled;
+    const auto historySize =
+        retransmit ? static_cast<size_t>(
+                         sampleRate * AUDIO_STREAM_RETRANSMIT_HISTORY_MS /
+                         1000.0 / static_cast<double>(frameSize)) +
+                         1
+                   : 0;
+    history.prepare(historySize, AUDIO_STREAM_MAX_CHANNELS, packet.size());
+
+    dtx = dtxEnabled;
+    sequenceOffset = 0;
+    lastTimestamp = 0;
+    for (auto& receiver : receivers) {
+        receiver.active = false;
+        receiver.feedback.reset();
+    }
+
+    probing = latencyProbeEnabled;
+    latencyProbe.prepare(
+        AUDIO_STREAM_PROBE_ORDER,
+        static_cast<uint64>(sampleRate * AUDIO_STREAM_PROBE_INTERVAL_MS /
+                            1000.0),
+        Decibels::decibelsToGain(float(AUDIO_STREAM_PROBE_LEVEL_DB)));
+    probeTimestamp = 0;
+    probeTime = 0;
+
+    suppressingSilence = false;
+    silenceDetector.prepare(AUDIO_STREAM_MAX_CHANNELS, sampleRate,
+                            AUDIO_STREAM_DTX_THRESHOLD_DB,
+                            AUDIO_STREAM_DTX_PEAK_THRESHOLD_DB,
+                            AUDIO_STREAM_DTX_HANGOVER_MS / 1000.0,
+                            AUDIO_STREAM_DTX_KEEPALIVE_MS / 1000.0);
+}
+
+bool SendThread::start(const Options& options) {
+    setAffinityMask(options.affinityMask);
+
+    if (options.realtimePriority >= 0 &&
+        startRealtimeThread(RealtimeOptions{}.withPriority(
+            jlimit(0, 10, options.realtimePriority)))) {
+        return true;
+    }
+
+    return startThread(options.priority);
+}
+
+void SendThread::stop() {
+    signalThreadShouldExit();
+    blocksReady.release();
+    stopThread(2 * AUDIO_STREAM_SEND_TIMEOUT_MS);
+}
+
+bool SendThread::pushBlock(const float* samples, int numChannels,
+                           int numSamples) {
+    const JitterBuffer::FrameInfo info{static_cast<uint32>(numChannels),
+                                       static_cast<uint32>(numSamples), 0,
+                                       timestamp};
+    timestamp += static_cast<uint64>(numSamples);
+
+    if (!fifo.push(info, samples)) {
+        return false;
+    }
+
+    const auto numQueued = fifo.getNumSamplesQueued();
+    if (numQueued > fifoHighWaterMark.load(std::memory_order_relaxed)) {
+        fifoHighWaterMark.store(numQueued, std::memory_order_relaxed);
+    }
+
+    // Never blocks, at worst it wakes the send thread up
+    blocksReady.release();
+    return true;
+}
+
+bool SendThread::pushBlock(const float* const* channels, int numChannels,
+                           int numSamples) {
+    const ScopedTimer timer(callbackTime);
+
+    if (numChannels <= 0 || numChannels > AUDIO_STREAM_MAX_CHANNELS ||
+        numSamples <= 0 || inputBlock.empty()) {
+        return false;
+    }
+
+    // The callback's own time, which the probes are timed by
+    const auto callbackTicks = probing ? Time::getHighResolutionTicks() : 0;
+
+    // Blocks larger than a FIFO frame are queued in pieces
+    auto pushed = true;
+    for (auto position = 0; position < numSamples;
+         position += AUDIO_STREAM_MAX_FRAME_SIZE) {
+        const auto count =
+            jmin(AUDIO_STREAM_MAX_FRAME_SIZE, numSamples - position);
+        const auto segment = gain.next(static_cast<size_t>(count));
+
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            auto* dest = inputBlock.data() +
+                         static_cast<size_t>(channel) * count;
+
+            // Every channel follows the same ramp
+            if (channels[channel] == nullptr) {
+                FloatVectorOperations::clear(dest, count);
+            } else if (segment.rampLength == 0) {
+                FloatVectorOperations::copyWithMultiply(
+                    dest, channels[channel] + position, segment.end, count);
+            } else {
+                SmoothedGain::copy(dest, channels[channel] + position,
+                                   segment, static_cast<size_t>(count));
+            }
+
+            // Receivers look for it in their first output only
+            if (probing && channel == 0) {
+                latencyProbe.add(dest, timestamp, static_cast<size_t>(count));
+            }
+        }
+
+        // A probe is timed by its first sample's place in the callback
+        const auto probeStart = latencyProbe.getNextStart(timestamp);
+        if (probing && probeStart - timestamp < static_cast<uint64>(count)) {
+            const auto offset =
+                static_cast<int>(probeStart - timestamp) + position;
+            const auto seconds =
+                Time::highResolutionTicksToSeconds(callbackTicks) +
+                offset / static_cast<double>(streamRate);
+            probeTime.store(static_cast<uint64>(seconds * 1.0e6),
+                            std::memory_order_relaxed);
+            probeTimestamp.store(probeStart, std::memory_order_release);
+            numProbesSent.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        pushed = pushBlock(inputBlock.data(), numChannels, count) && pushed;
+    }
+
+    return pushed;
+}
+
+void SendThread::setGain(float newGain) { gain.setTarget(newGain); }
+
+void SendThread::setFecOptions(int numData, int numParity) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    fecNumData = numData;
+    fecNumParity = numParity;
+}
+
+void SendThread::setCompressionEnabled(bool shouldCompress) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    compressionEnabled = shouldCompress;
+}
+
+void SendThread::setSampleFormat(SampleFormat format) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    sampleFormat = format;
+}
+
+void SendThread::setTransport(Transport newTransport) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    transport = newTransport;
+}
+
+void SendThread::setRetransmissionEnabled(bool shouldRetransmit) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    retransmissionEnabled = shouldRetransmit;
+}
+
+void SendThread::setDiscontinuousTransmissionEnabled(
+    bool shouldSuppressSilence) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    dtxEnabled = shouldSuppressSilence;
+}
+
+void SendThread::setLatencyProbeEnabled(bool shouldProbe) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    latencyProbeEnabled = shouldProbe;
+}
+
+void SendThread::setFrameDuration(double milliseconds) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    frameDurationMs = milliseconds;
+}
+
+void SendThread::setMtu(int bytes) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    mtu = bytes;
+}
+
+void SendThread::addMetrics(MetricsRegistry& registry) const {
+    registry.addCounter("audio_stream_dropped_blocks_total",
+                        "Blocks dropped before sending",
+                        [this] { return double(getNumDroppedBlocks()); });
+    registry.addGauge("audio_stream_send_queue_samples",
+                      "Samples per channel waiting to be sent", [this] {
+                          return double(fifo.getNumSamplesQueued());
+                      });
+    registry.addGauge("audio_stream_send_queue_high_water_samples",
+                      "Most samples per channel ever waiting to be sent",
+                      [this] { return double(getFifoHighWaterMark()); });
+    registry.addGauge("audio_stream_frame_samples",
+                      "Samples per channel in a network frame",
+                      [this] { return double(getFrameSize()); });
+    registry.addCounter("audio_stream_nacks_received_total",
+                        "NACKs received from receivers",
+                        [this] { return double(getNumNacksReceived()); });
+    registry.addCounter("audio_stream_retransmitted_packets_total",
+                        "Packets sent again in answer to NACKs",
+                        [this] { return double(getNumRetransmits()); });
+    registry.addCounter(
+        "audio_stream_expired_requests_total",
+        "Packets asked for but not sent, as they would arrive too late",
+        [this] { return double(getNumExpiredRequests()); });
+    registry.addCounter("audio_stream_unavailable_requests_total",
+                        "Packets asked for that were no longer kept",
+                        [this] { return double(getNumUnavailableRequests()); });
+    registry.addCounter("audio_stream_dtx_suppressed_frames_total",
+                        "Frames left out because they were silent",
+                        [this] { return double(getNumSuppressedFrames()); });
+    registry.addCounter("audio_stream_comfort_noise_packets_total",
+                        "Comfort noise descriptors sent during silence",
+                        [this] { return double(getNumComfortNoisePackets()); });
+    registry.addGauge("audio_stream_dtx_active",
+                      "1 while silent frames are being left out",
+                      [this] { return isSuppressingSilence() ? 1.0 : 0.0; });
+    registry.addCounter("audio_stream_latency_probes_sent_total",
+                        "Latency probes added to the stream",
+                        [this] { return double(getNumProbesSent()); });
+    registry.addCounter("audio_stream_receiver_reports_received_total",
+                        "Reports received from receivers",
+                        [this] { return double(getNumReportsReceived()); });
+    registry.addHistogram("audio_stream_send_callback_seconds",
+                          "Time spent queueing a block on the audio thread",
+                          callbackTime);
+    registry.addHistogram("audio_stream_send_block_seconds",
+                          "Time spent packetizing and sending a block",
+                          sendTime);
+
+    // What each receiver reported, NaN while nobody reports there
+    for (size_t i = 0; i < maxReceivers; ++i) {
+        auto add = [this, &registry, i](const char* name, const char* help,
+                                        auto read) {
+            registry.addGauge(
+                name, help,
+                [this, i, read] {
+                    return isReceiverActive(i)
+                               ? double(read(getReceiverFeedback(i)))
+                               : NAN;
+                },
+                {{"receiver", std::to_string(i)}});
+        };
+
+        add("audio_stream_receiver_round_trip_seconds",
+            "Round trip to the receiver, from its reports",
+            [](const ReceiverFeedback& f) {
+                return f.getRoundTrip().hasRoundTripTime()
+                           ? f.getRoundTrip().getRoundTripTime()
+                           : NAN;
+            });
+        add("audio_stream_receiver_fraction_lost",
+            "Share of frames the receiver lost since its previous report",
+            [](const ReceiverFeedback& f) { return f.getFractionLost(); });
+        add("audio_stream_receiver_lost_frames",
+            "Frames the receiver lost in all",
+            [](const ReceiverFeedback& f) { return f.getNumLost(); });
+        add("audio_stream_receiver_jitter_seconds",
+            "Interarrival jitter the receiver measures",
+            [](const ReceiverFeedback& f) { return f.getJitter(); });
+        add("audio_stream_receiver_buffer_seconds",
+            "Audio queued for playout at the receiver",
+            [](const ReceiverFeedback& f) { return f.getBufferDelay(); });
+        add("audio_stream_receiver_target_delay_seconds",
+            "Playout delay the receiver aims for",
+            [](const ReceiverFeedback& f) { return f.getTargetDelay(); });
+    }
+
+    // Destinations may be added later, unused ones read as NaN
+    const auto* sender = &*udpSender;
+    for (size_t i = 0; i < UdpSender::maxDestinations; ++i) {
+        auto read = [sender, i](auto getter) {
+            return [sender, i, getter] {
+                return i < sender->getNumDestinations()
+                           ? double((sender->*getter)(i))
+                           : NAN;
+            };
+        };
+        const MetricsRegistry::Labels labels{{"destination",
+                                              std::to_string(i)}};
+
+        registry.addCounter(
+            "audio_stream_sent_packets_total", "Packets sent",
+            read(static_cast<uint64_t (UdpSender::*)(size_t) const>(
+                &UdpSender::getNumSent)),
+            labels);
+        registry.addCounter("audio_stream_sent_bytes_total", "Bytes sent",
+                            read(&UdpSender::getNumBytesSent), labels);
+        registry.addCounter(
+            "audio_stream_send_errors_total", "Packets that failed to send",
+            read(static_cast<uint64_t (UdpSender::*)(size_t) const>(
+                &UdpSender::getNumErrors)),
+            labels);
+    }
+}
+
+void SendThread::run() {
+    // NACKs and reports arrive whether audio does or not
+    const auto timeout = retransmit ? AUDIO_STREAM_NACK_POLL_MS
+                                    : AUDIO_STREAM_SEND_TIMEOUT_MS;
+    lastNackPoll =
+        Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
+
+    while (!threadShouldExit()) {
+        const auto woken = blocksReady.try_acquire_for(
+            std::chrono::milliseconds(timeout));
+
+        handleFeedback();
+
+        if (!woken) {
+            continue;
+        }
+
+        JitterBuffer::FrameInfo info;
+        while (!threadShouldExit() && fifo.getNumSamplesQueued() > 0 &&
+               fifo.pop(block.data(), block.size(), &info)) {
+            const ScopedTimer timer(sendTime);
+            packetizer.add(block.data(), info.numChannels, info.numSamples,
+                           info.timestamp,
+                           [this](const float* samples,
+                                  const JitterBuffer::FrameInfo& frame) {
+                               sendFrame(samples, frame);
+                           });
+
+            // The block's frames leave in one system call where batching
+            // is supported
+            udpSender->flush();
+        }
+    }
+}
+
+void SendThread::sendFrame(const float* samples,
+                           const JitterBuffer::FrameInfo& info) {
+    const auto numChannels = static_cast<int>(info.numChannels);
+    const auto numSamples = static_cast<size_t>(info.numSamples);
+    auto* payload = packet.data() + StreamPacketHeader::size;
+    const auto payloadCapacity = maxPayloadSize;
+    const auto compress = compressionEnabled.load(std::memory_order_relaxed);
+    const auto format = sampleFormat.load(std::memory_order_relaxed);
+    lastTimestamp = info.timestamp + info.numSamples;
+
+    if (dtx) {
+        const auto decision = silenceDetector.process(
+            samples, numChannels, static_cast<int>(numSamples));
+        suppressingSilence.store(silenceDetector.isSilent(),
+                                 std::memory_order_relaxed);
+
+        if (decision == SilenceDetector::Decision::suppress) {
+            // Receivers shouldn't see a gap in the sequence numbers
+            ++sequenceOffset;
+            numSuppressedFrames.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (decision != SilenceDetector::Decision::send) {
+            sendComfortNoise(info);
+            return;
+        }
+    }
+
+    // As many channels as fit go into one datagram, planar. A compressed
+    // channel takes at most one byte more than a raw float32 one.
+    const auto bytesPerChannel =
+        compress ? numSamples * sizeof(float) + 1
+                 : numSamples * getBytesPerSample(format);
+    if (bytesPerChannel > payloadCapacity) {
+        return;
+    }
+    const auto channelsPerPacket =
+        static_cast<int>(payloadCapacity / bytesPerChannel);
+
+    const auto useOsc =
+        transport.load(std::memory_order_relaxed) == Transport::osc;
+
+    StreamPacketHeader header;
+    header.streamId = streamId;
+    header.sequence = info.sequence - sequenceOffset;
+    header.timestamp = info.timestamp;
+    header.totalChannels = static_cast<uint16>(numChannels);
+    header.numSamples = static_cast<uint16>(numSamples);
+    header.sampleRate = streamRate;
+
+    for (auto first = 0; first < numChannels; first += channelsPerPacket) {
+        const auto count = jmin(channelsPerPacket, numChannels - first);
+        const auto numPacketSamples = static_cast<size_t>(count) * numSamples;
+        header.channelIndex = static_cast<uint16>(first);
+        header.numChannels = static_cast<uint16>(count);
+        header.sampleFormat = format;
+        header.flags = getFlags(useOsc);
+
+        // Copied, as quantising works in place
+        auto* planar = scratch.data();
+        std::copy_n(samples + static_cast<size_t>(first) * numSamples,
+                    numPacketSamples, planar);
+        size_t encodedSize = 0;
+
+        if (compress) {
+            if (format != SampleFormat::float32) {
+                // Quantise first so the codec sees exact integer steps. The
+                // payload is free until the encoder writes into it.
+                converter.toWire(format, planar, payload, numPacketSamples);
+                SampleConverter::fromWire(format, payload, planar,
+                                          numPacketSamples);
+            }
+
+            encodedSize = codec.encode(planar, count,
+                                       static_cast<int>(numSamples), payload,
+                                       payloadCapacity);
+
+            if (encodedSize > 0) {
+                header.flags |= StreamPacketHeader::compressed;
+            } else {
+                // Larger than the codec was prepared for: send it raw. The
+                // samples are already quantised, so float32 keeps them exact.
+                header.sampleFormat = SampleFormat::float32;
+                std::memcpy(payload, planar, numPacketSamples * sizeof(float));
+            }
+        } else {
+            converter.toWire(format, planar, payload, numPacketSamples);
+        }
+
+        sendPacket(header,
+                   header.isCompressed() ? encodedSize
+                                         : header.getPayloadSize(),
+                   useOsc);
+    }
+}
+
+void SendThread::sendComfortNoise(const JitterBuffer::FrameInfo& info) {
+    const auto numChannels =
+        jmin(static_cast<int>(info.numChannels), AUDIO_STREAM_MAX_CHANNELS);
+    const auto useOsc =
+        transport.load(std::memory_order_relaxed) == Transport::osc;
+
+    StreamPacketHeader header;
+    header.streamId = streamId;
+    header.sequence = info.sequence - sequenceOffset;
+    header.timestamp = info.timestamp;
+    header.channelIndex = 0;
+    header.numChannels = static_cast<uint16>(numChannels);
+    header.totalChannels = static_cast<uint16>(numChannels);
+    header.numSamples = static_cast<uint16>(info.numSamples);
+    header.sampleRate = streamRate;
+    header.flags = StreamPacketHeader::comfortNoise | getFlags(useOsc);
+
+    // One level per channel, far smaller than a frame of samples
+    auto* levels = scratch.data();
+    for (auto channel = 0; channel < numChannels; ++channel) {
+        levels[channel] = silenceDetector.getNoiseLevel(channel);
+    }
+    converter.toWire(SampleFormat::float32, levels,
+                     packet.data() + StreamPacketHeader::size,
+                     static_cast<size_t>(numChannels));
+
+    sendPacket(header, header.getPayloadSize(), useOsc);
+    numComfortNoisePackets.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SendThread::sendPacket(const StreamPacketHeader& header,
+                            size_t payloadSize, bool useOsc) {
+    auto send = [&](const uint8* data, size_t size) {
+        if (useOsc) {
+            oscSender->send(AUDIO_STREAM_ADDRESS_PATTERN,
+                            MemoryBlock(data, size));
+        } else {
+            udpSender->queue(data, size);
+        }
+    };
+
+    header.write(packet.data());
+
+    const auto packetSize = StreamPacketHeader::size + payloadSize;
+    send(packet.data(), packetSize);
+
+    if (header.isRetransmittable()) {
+        history.add(header, packet.data(), packetSize);
+    }
+
+    fecEncoder.addPacket(packet.data(), packetSize, header.streamId,
+                         header.sequence, header.channelIndex, send);
+}
+
+uint8 SendThread::getFlags(bool useOsc) const {
+    // NACKs and reports only come back to the raw transport's socket
+    if (useOsc) {
+        return 0;
+    }
+    return retransmit ? StreamPacketHeader::reports |
+                            StreamPacketHeader::retransmittable
+                      : StreamPacketHeader::reports;
+}
+
+void SendThread::handleFeedback() {
+    const auto now =
+        Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks());
+    const auto waited = now - lastNackPoll;
+    lastNackPoll = now;
+    const auto nowUs = static_cast<uint64>(now * 1.0e6);
+
+    udpSender->receive([this, waited, nowUs](const uint8* data, size_t size,
+                                             const udp::Address& source) {
+        if (NackPacketHeader nack; nack.read(data, size)) {
+            if (retransmit && nack.streamId == streamId) {
+                // The NACK may have waited since the last poll, and the
+                // answer takes about half a round trip to get there
+                handleNack(nack, data, source,
+                           waited + nack.roundTripTime * 0.5e-6);
+            }
+        } else if (ReceiverReportHeader report; report.read(data, size)) {
+            if (report.streamId == streamId) {
+                handleReport(report, source, nowUs);
+            }
+        }
+    });
+
+    // Receivers that went quiet are forgotten
+    const auto timeout =
+        static_cast<uint64>(AUDIO_STREAM_RECEIVER_TIMEOUT_MS) * 1000;
+    for (auto& receiver : receivers) {
+        if (receiver.active.load(std::memory_order_relaxed) &&
+            nowUs - receiver.lastArrival > timeout) {
+            receiver.active.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+void SendThread::handleNack(const NackPacketHeader& nack, const uint8* data,
+                            const udp::Address& source, double delay) {
+    numNacksReceived.fetch_add(1, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < nack.numEntries; ++i) {
+        const auto entry = nack.getEntry(data, i);
+        if (entry.deadline * 1.0e-6 <= delay) {
+            numExpiredRequests.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        const auto numSent = history.forEach(
+            entry.sequence, entry.channelMask,
+            [this, &source](uint8* packetData, size_t packetSize) {
+                StreamPacketHeader::addFlags(
+                    packetData, StreamPacketHeader::retransmitted);
+                udpSender->sendTo(packetData, packetSize, source);
+            });
+
+        if (numSent > 0) {
+            numRetransmits.fetch_add(numSent, std::memory_order_relaxed);
+        } else {
+            numUnavailableRequests.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void SendThread::handleReport(const ReceiverReportHeader& report,
+                              const udp::Address& source, uint64 now) {
+    numReportsReceived.fetch_add(1, std::memory_order_relaxed);
+
+    // A new receiver takes a free entry, or the one heard from longest ago
+    Receiver* found = nullptr;
+    Receiver* oldest = &receivers[0];
+    for (auto& receiver : receivers) {
+        const auto active = receiver.active.load(std::memory_order_relaxed);
+        if (active && receiver.address == source) {
+            found = &receiver;
+            break;
+        }
+        if (!active || (oldest->active.load(std::memory_order_relaxed) &&
+                        receiver.lastArrival < oldest->lastArrival)) {
+            oldest = &receiver;
+        }
+    }
+
+    if (found == nullptr) {
+        found = oldest;
+        found->address = source;
+        found->feedback.reset();
+        found->active.store(true, std::memory_order_relaxed);
+    }
+
+    found->lastArrival = now;
+    found->lastReport = report.sendTime;
+    found->feedback.addReport(report, now);
+
+    // Answered right away, so the receiver can time its round trip
+    SenderReportHeader answer;
+    answer.streamId = streamId;
+    answer.timestamp = lastTimestamp;
+    answer.echoTime = report.sendTime;
+    answer.sendTime = static_cast<uint64>(
+        Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks()) *
+        1.0e6);
+    answer.echoDelay = static_cast<uint32>(
+        answer.sendTime > now ? answer.sendTime - now : 0);
+    answer.probeTimestamp = probeTimestamp.load(std::memory_order_acquire);
+    answer.probeTime = probeTime.load(std::memory_order_relaxed);
+
+    uint8 data[SenderReportHeader::size];
+    answer.write(data);
+    udpSender->sendTo(data, sizeof(data), source);
+}
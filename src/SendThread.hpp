@@ -0,0 +1,346 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <semaphore>
+
+#include "DiscontinuousTransmission.hpp"
+#include "Feedback.hpp"
+#include "ForwardErrorCorrection.hpp"
+#include "JitterBuffer.hpp"
+#include "LatencyProbe.hpp"
+#include "LosslessCodec.hpp"
+#include "Metrics.hpp"
+#include "Packetizer.hpp"
+#include "Retransmission.hpp"
+#include "SampleConversion.hpp"
+#include "SmoothedGain.hpp"
+#include "StreamConfig.hpp"
+#include "StreamPacket.hpp"
+#include "UdpSocket.hpp"
+
+#define AUDIO_STREAM_SEND_THREAD_PRIORITY 8
+#define AUDIO_STREAM_SEND_THREAD_AFFINITY 0
+#define AUDIO_STREAM_SEND_TIMEOUT_MS 100
+#define AUDIO_STREAM_SEND_FIFO_BLOCKS 8
+/** IPv6 and UDP headers plus FEC and OSC framing, all taken from the MTU. */
+#define AUDIO_STREAM_PACKET_OVERHEAD 112
+/** How often NACKs are read while retransmission is enabled. */
+#define AUDIO_STREAM_NACK_POLL_MS 1
+/** How far back packets are kept for retransmission. */
+#define AUDIO_STREAM_RETRANSMIT_HISTORY_MS 100
+/** RMS level and peak in dBFS below which a frame counts as silent. */
+#define AUDIO_STREAM_DTX_THRESHOLD_DB -60.0
+#define AUDIO_STREAM_DTX_PEAK_THRESHOLD_DB -50.0
+/** How long silence lasts before frames are left out. */
+#define AUDIO_STREAM_DTX_HANGOVER_MS 200
+/** How often a comfort noise descriptor goes out during silence. */
+#define AUDIO_STREAM_DTX_KEEPALIVE_MS 200
+/** Most receivers whose reports are kept at once. */
+#define AUDIO_STREAM_MAX_RECEIVERS 8
+/** How long a receiver that stopped reporting is kept. */
+#define AUDIO_STREAM_RECEIVER_TIMEOUT_MS 2000
+/**
+ * Amplitude of the latency probe added to the first channel, in dBFS. The
+ * correlation over its 4095 samples still finds it under music some 20 dB
+ * louder.
+ */
+#define AUDIO_STREAM_PROBE_LEVEL_DB -30.0
+
+//==============================================================================
+/**
+ * @class SendThread
+ * @brief Packetizes and sends audio blocks on its own thread.
+ *
+ * The audio callback only copies each block into a lock-free FIFO with
+ * pushBlock() and wakes the thread, which then converts, compresses and
+ * protects the block and puts it on the wire. Each block is encoded once,
+ * however many destinations the UdpSender has. A slow send can no longer
+ * cause an xrun; when the thread falls behind and the FIFO fills up, blocks
+ * are dropped and counted instead.
+ *
+ * Device blocks of any size are re-blocked by a Packetizer into network
+ * frames of a set duration, small enough that a channel of a frame fits in
+ * one MTU-sized datagram. Timestamps are assigned on push and sequence
+ * numbers per frame, so receivers see dropped blocks as losses.
+ *
+ * With retransmission enabled, the packets of the last
+ * AUDIO_STREAM_RETRANSMIT_HISTORY_MS are kept, and the NACKs receivers send
+ * back are read every AUDIO_STREAM_NACK_POLL_MS. A packet asked for is sent
+ * again to that receiver only, unless it would arrive after the deadline
+ * the receiver gave.
+ *
+ * With discontinuous transmission enabled, a SilenceDetector looks at each
+ * frame, and frames of silence are left out once it has lasted
+ * AUDIO_STREAM_DTX_HANGOVER_MS. In their place a comfort noise descriptor
+ * goes out when the silence starts and every AUDIO_STREAM_DTX_KEEPALIVE_MS
+ * after. Frames left out take no sequence number, so receivers don't count
+ * them as lost.
+ *
+ * Receivers of the raw transport report back periodically. Each report is
+ * kept per receiver as ReceiverFeedback, answered at once with a
+ * SenderReportHeader so the receiver can measure the round trip too, and
+ * forgotten after AUDIO_STREAM_RECEIVER_TIMEOUT_MS of silence.
+ *
+ * In latency measurement mode, a LatencyProbe is added to the first channel
+ * every AUDIO_STREAM_PROBE_INTERVAL_MS by the gathering pushBlock(), and
+ * the time of the audio callback that carried the last one goes to
+ * receivers in the sender reports.
+ */
+class SendThread : public Thread {
+  public:
+    struct Options {
+        /** Realtime priority from 0 to 10, or -1 for a normal thread. */
+        int realtimePriority{AUDIO_STREAM_SEND_THREAD_PRIORITY};
+        /** Priority used when realtimePriority is -1 or not permitted. */
+        Thread::Priority priority{Thread::Priority::highest};
+        /** CPU affinity mask, 0 leaves the thread free to run anywhere. */
+        uint32 affinityMask{AUDIO_STREAM_SEND_THREAD_AFFINITY};
+    };
+
+    enum class Transport {
+        /** Stream packets sent as they are, batched per block. */
+        raw,
+        /** Stream packets wrapped in OSC messages, for older receivers. */
+        osc
+    };
+
+    SendThread();
+    ~SendThread() override;
+
+    /**
+     * Starts a new stream at the device's sample rate and allocates
+     * everything the thread needs. Must not be called while the thread runs.
+     * The rate is announced in every packet, so receivers running at
+     * another rate can convert.
+     */
+    void prepare(double sampleRate);
+    /** Starts sending with the given scheduling options. */
+    bool start(const Options& options);
+    /** Stops the thread, dropping any blocks still queued. */
+    void stop();
+
+    /**
+     * @brief Queues a block for sending. Called from the audio thread.
+     * @param samples numChannels * numSamples planar samples, at most
+     * AUDIO_STREAM_MAX_FRAME_SIZE samples per channel.
+     * @return false if the block was dropped.
+     */
+    bool pushBlock(const float* samples, int numChannels, int numSamples);
+    /**
+     * @brief Gathers one block from separate channels, scaled by the gain,
+     * and queues it, in pieces if it is large. Called from the audio thread.
+     * @param channels numChannels pointers to numSamples samples, or
+     * nullptr for channels to send as silence.
+     * @return false if any of the block was dropped.
+     */
+    bool pushBlock(const float* const* channels, int numChannels,
+                   int numSamples);
+
+    /**
+     * Sets the gain applied by the gathering pushBlock(), reached through a
+     * short ramp. May be called from any thread.
+     */
+    void setGain(float newGain);
+    float getGain() const { return gain.getTarget(); }
+
+    /**
+     * Sends numParity parity packets per numData audio packets, 0 parity
+     * packets disables FEC. Takes effect on the next prepare().
+     */
+    void setFecOptions(int numData, int numParity);
+    /** Compresses the audio losslessly before sending it. */
+    void setCompressionEnabled(bool shouldCompress);
+    /** Selects the sample format sent on the wire. */
+    void setSampleFormat(SampleFormat format);
+    /** Selects how packets are put on the wire. */
+    void setTransport(Transport newTransport);
+    /**
+     * Keeps recent packets and sends them again when receivers ask for
+     * them. Only the raw transport carries NACKs. Takes effect on the next
+     * prepare().
+     */
+    void setRetransmissionEnabled(bool shouldRetransmit);
+    /**
+     * Leaves silent frames out and sends comfort noise descriptors instead.
+     * Takes effect on the next prepare().
+     */
+    void setDiscontinuousTransmissionEnabled(bool shouldSuppressSilence);
+    /**
+     * Adds a latency probe to the audio sent, for receivers to measure the
+     * latency with. Takes effect on the next prepare().
+     */
+    void setLatencyProbeEnabled(bool shouldProbe);
+    /**
+     * Sets the duration of a network frame, e.g. 1, 2.5, 5 or 10 ms. Longer
+     * frames mean fewer packets and less header overhead, shorter ones less
+     * latency. Takes effect on the next prepare().
+     */
+    void setFrameDuration(double milliseconds);
+    /**
+     * Sets the largest IP packet the path carries, from which the largest
+     * frame that fits in a datagram follows. Takes effect on the next
+     * prepare().
+     */
+    void setMtu(int bytes);
+
+    /** Samples per channel in a network frame, as last prepared. */
+    int getFrameSize() const { return static_cast<int>(frameSize); }
+
+    /** Blocks dropped because the FIFO was full or they were too large. */
+    uint64 getNumDroppedBlocks() const {
+        return fifo.getNumOverruns() + fifo.getNumRejectedFrames();
+    }
+    /** Most samples per channel ever waiting in the FIFO. */
+    uint64 getFifoHighWaterMark() const {
+        return fifoHighWaterMark.load(std::memory_order_relaxed);
+    }
+    const UdpSender& getUdpSender() const { return *udpSender; }
+    uint64 getNumNacksReceived() const {
+        return numNacksReceived.load(std::memory_order_relaxed);
+    }
+    /** Packets sent again in answer to NACKs. */
+    uint64 getNumRetransmits() const {
+        return numRetransmits.load(std::memory_order_relaxed);
+    }
+    /** Packets asked for but not sent, as they would arrive too late. */
+    uint64 getNumExpiredRequests() const {
+        return numExpiredRequests.load(std::memory_order_relaxed);
+    }
+    /** Packets asked for that were no longer kept. */
+    uint64 getNumUnavailableRequests() const {
+        return numUnavailableRequests.load(std::memory_order_relaxed);
+    }
+    /** Frames left out because they were silent. */
+    uint64 getNumSuppressedFrames() const {
+        return numSuppressedFrames.load(std::memory_order_relaxed);
+    }
+    uint64 getNumComfortNoisePackets() const {
+        return numComfortNoisePackets.load(std::memory_order_relaxed);
+    }
+    /** Whether silent frames are being left out right now. */
+    bool isSuppressingSilence() const {
+        return suppressingSilence.load(std::memory_order_relaxed);
+    }
+    /** Latency probes added to the stream. */
+    uint64 getNumProbesSent() const {
+        return numProbesSent.load(std::memory_order_relaxed);
+    }
+    /** Receiver reports received, from every receiver. */
+    uint64 getNumReportsReceived() const {
+        return numReportsReceived.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t maxReceivers = AUDIO_STREAM_MAX_RECEIVERS;
+    /** Whether the receiver at index is reporting on the stream. */
+    bool isReceiverActive(size_t index) const {
+        return receivers[index].active.load(std::memory_order_relaxed);
+    }
+    /**
+     * What the receiver at index last reported, for 0 <= index <
+     * maxReceivers. Only meaningful while isReceiverActive(index).
+     */
+    const ReceiverFeedback& getReceiverFeedback(size_t index) const {
+        return receivers[index].feedback;
+    }
+
+    /** Seconds spent in pushBlock(), on the audio thread. */
+    const Histogram& getCallbackTime() const { return callbackTime; }
+    /** Seconds spent packetizing and sending each block. */
+    const Histogram& getSendTime() const { return sendTime; }
+
+    /**
+     * Registers the sender's counters and timings. The registry must not
+     * outlive this thread.
+     */
+    void addMetrics(MetricsRegistry& registry) const;
+
+  private:
+    JitterBuffer fifo;
+    std::counting_semaphore<> blocksReady{0};
+    std::atomic<uint64> fifoHighWaterMark{0};
+    std::atomic<uint64> numNacksReceived{0};
+    std::atomic<uint64> numRetransmits{0};
+    std::atomic<uint64> numExpiredRequests{0};
+    std::atomic<uint64> numUnavailableRequests{0};
+    std::atomic<uint64> numSuppressedFrames{0};
+    std::atomic<uint64> numComfortNoisePackets{0};
+    std::atomic<bool> suppressingSilence{false};
+    std::atomic<uint64> numReportsReceived{0};
+    std::atomic<uint64> numProbesSent{0};
+    /** Stream position and callback time of the last probe, for reports. */
+    std::atomic<uint64> probeTimestamp{0};
+    std::atomic<uint64> probeTime{0};
+    Histogram callbackTime{1.0e-6, 2.0, 20};
+    Histogram sendTime{1.0e-6, 2.0, 20};
+
+    // Audio thread
+    std::vector<float> inputBlock;
+    SmoothedGain gain;
+    uint64 timestamp{0};
+    LatencyProbe latencyProbe;
+    bool probing{false};
+
+    // Send thread
+    SharedResourcePointer<UdpSender> udpSender;
+    SharedResourcePointer<OSCSender> oscSender;
+    uint32 streamId{0};
+    uint32 streamRate{0};
+    std::vector<float> block;
+    Packetizer packetizer;
+    std::vector<float> scratch;
+    std::vector<uint8> packet;
+    size_t maxPayloadSize{0};
+    SampleConverter converter;
+    LosslessCodec codec;
+    FecEncoder fecEncoder;
+    RetransmitHistory history;
+    bool retransmit{false};
+    double lastNackPoll{0.0};
+    SilenceDetector silenceDetector;
+    bool dtx{false};
+    /** Frames left out so far, taken off every sequence number. */
+    uint32 sequenceOffset{0};
+    /** Stream position sent last, for sender reports. */
+    uint64 lastTimestamp{0};
+
+    /** A receiver heard from lately. */
+    struct Receiver {
+        udp::Address address;
+        /** When its last report arrived, in microseconds. */
+        uint64 lastArrival{0};
+        /** sendTime of its last report, echoed back. */
+        uint64 lastReport{0};
+        std::atomic<bool> active{false};
+        ReceiverFeedback feedback;
+    };
+    std::array<Receiver, AUDIO_STREAM_MAX_RECEIVERS> receivers;
+
+    // Settings
+    std::atomic<bool> compressionEnabled{false};
+    std::atomic<SampleFormat> sampleFormat{SampleFormat::float32};
+    std::atomic<Transport> transport{Transport::raw};
+    int fecNumData;
+    int fecNumParity;
+    bool retransmissionEnabled{false};
+    bool dtxEnabled{false};
+    bool latencyProbeEnabled{false};
+    double frameDurationMs{AUDIO_STREAM_FRAME_DURATION_MS};
+    int mtu{AUDIO_STREAM_MTU};
+    std::atomic<size_t> frameSize{0};
+
+    void run() override;
+    void sendFrame(const float* samples, const JitterBuffer::FrameInfo& info);
+    void sendComfortNoise(const JitterBuffer::FrameInfo& info);
+    /** Sends the packet whose payload is in place, behind header. */
+    void sendPacket(const StreamPacketHeader& header, size_t payloadSize,
+                    bool useOsc);
+    uint8 getFlags(bool useOsc) const;
+    void handleFeedback();
+    void handleNack(const NackPacketHeader& nack, const uint8* data,
+                    const udp::Address& source, double delay);
+    void handleReport(const ReceiverReportHeader& report,
+                      const udp::Address& source, uint64 now);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SendThread)
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include "StreamConfig.hpp"
+
+//==============================================================================
+/**
+ * @class SmoothedGain
+ * @brief A gain that can be set from any thread and is applied on the audio
+ * thread through a linear ramp, so a moving fader doesn't click.
+ *
+ * The target is a single atomic, so setting it never blocks either side. A
+ * new target is reached rampLength samples after the audio thread first
+ * sees it, however those samples are split into blocks.
+ */
+class SmoothedGain {
+  public:
+    /** The gains over one block: a ramp for rampLength samples, then end. */
+    struct Segment {
+        float start;
+        float step;
+        size_t rampLength;
+        float end;
+    };
+
+    explicit SmoothedGain(float initialGain = 1.0f,
+                          size_t rampLengthInSamples =
+                              AUDIO_STREAM_GAIN_RAMP_LENGTH)
+        : target(initialGain),
+          rampLength(std::max<size_t>(1, rampLengthInSamples)),
+          current(initialGain),
+          rampTarget(initialGain) {}
+
+    /** Sets the gain to ramp to. May be called from any thread. */
+    void setTarget(float gain) {
+        target.store(gain, std::memory_order_relaxed);
+    }
+    float getTarget() const { return target.load(std::memory_order_relaxed); }
+
+    /** Jumps straight to the target without a ramp. Audio thread only. */
+    void reset() {
+        current = rampTarget = getTarget();
+        remaining = 0;
+    }
+
+    /**
+     * The gains for the next numSamples samples, advancing the ramp past
+     * them. Audio thread only.
+     */
+    Segment next(size_t numSamples) {
+        const auto newTarget = getTarget();
+        if (newTarget != rampTarget) {
+            rampTarget = newTarget;
+            step = (rampTarget - current) / static_cast<float>(rampLength);
+            remaining = rampLength;
+        }
+
+        const auto count = std::min(numSamples, remaining);
+        const Segment segment{current, step, count, rampTarget};
+
+        remaining -= count;
+        current = remaining > 0
+                      ? current + step * static_cast<float>(count)
+                      : rampTarget;
+        return segment;
+    }
+
+    /** dest[i] = src[i] * gain[i] */
+    static void copy(float* dest, const float* src, const Segment& segment,
+                     size_t numSamples) {
+        const auto rampLength = std::min(segment.rampLength, numSamples);
+        for (size_t i = 0; i < rampLength; ++i) {
+            dest[i] = src[i] * (segment.start +
+                                segment.step * static_cast<float>(i));
+        }
+        for (size_t i = rampLength; i < numSamples; ++i) {
+            dest[i] = src[i] * segment.end;
+        }
+    }
+
+    /** data[i] *= gain[i] */
+    static void multiply(float* data, const Segment& segment,
+                         size_t numSamples) {
+        copy(data, data, segment, numSamples);
+    }
+
+  private:
+    std::atomic<float> target;
+    const size_t rampLength;
+
+    // Audio thread only
+    float current;
+    float rampTarget;
+    float step{0.0f};
+    size_t remaining{0};
+};
@@ -1,9 +1,5 @@
 #include "State.hpp"
 
-#ifdef _MSC_VER
-#define __PRETTY_FUNCTION__ __FUNCSIG__
-#endif
-
 //==============================================================================
 void StoppedState::resized() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
@@ -79,6 +75,7 @@ void ConnectingState::resized() {
     portEditor.setBounds(rect.removeFromTop(rectHeight));
     errorLabel.setBounds(rect.removeFromBottom(rectHeight));
     connectButton.setBounds(rect.removeFromBottom(rectHeight * 2));
+    latencyButton.setBounds(rect.removeFromBottom(rectHeight));
 
     ipLabel.setFont(fontHeight);
     portLabel.setFont(fontHeight);
@@ -116,6 +113,12 @@ ConnectingState::ConnectingState()
     addAndMakeVisible(portEditor);
     portEditor.setTextToShowWhenEmpty("1234", Colours::grey);
 
+    // Probes the stream for receivers that measure latency
+    addAndMakeVisible(latencyButton);
+    latencyButton.setLookAndFeel(buttonLookAndFeel.get());
+    latencyButton.setButtonText("Send latency probes");
+    latencyButton.setClickingTogglesState(true);
+
     addAndMakeVisible(connectButton);
     connectButton.setLookAndFeel(buttonLookAndFeel.get());
     connectButton.setButtonText("Connect");
@@ -145,10 +148,25 @@ void ConnectingState::connectButtonClicked() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
 
     const auto& senderPtr = SharedResourcePointer<OSCSender>();
+    const auto& udpSenderPtr = SharedResourcePointer<UdpSender>();
+
+    // Several hosts may be given, separated by commas. Every one of them
+    // gets the same packets; OSC, for older receivers, reaches the first.
+    auto hosts = StringArray::fromTokens(ipEditor.getText(), ",", "");
+    hosts.trim();
+    hosts.removeEmptyStrings();
+    const auto port = portEditor.getText().getIntValue();
 
     errorLabel.setText("", dontSendNotification);
-    if (!senderPtr->connect(ipEditor.getText(),
-                            portEditor.getText().getIntValue())) {
+    udpSenderPtr->close();
+
+    auto connected = !hosts.isEmpty() && senderPtr->connect(hosts[0], port);
+    for (const auto& host : hosts) {
+        connected = connected &&
+                    udpSenderPtr->addDestination(host.toStdString(), port);
+    }
+
+    if (!connected) {
         const auto& errorMsg = "Couldn't connect to " + ipEditor.getText() +
                                ":" + portEditor.getText();
         Logger::writeToLog(errorMsg);
@@ -159,12 +177,19 @@ void ConnectingState::connectButtonClicked() {
     Logger::writeToLog("Connected to " + ipEditor.getText() + ":" +
                        portEditor.getText());
 
-    addChangeListener(SharedResourcePointer<SendingState>());
+    const auto& senderStatePtr = SharedResourcePointer<SendingState>();
+    senderStatePtr->setLatencyProbeEnabled(latencyButton.getToggleState());
+    addChangeListener(senderStatePtr);
     sendChangeMessage();
 }
 
 //==============================================================================
-SendingState::~SendingState() { shutdownAudio(); }
+SendingState::~SendingState() {
+    shutdownAudio();
+    recorder.stop();
+    metricsExporter.stop();
+    sendThread.stop();
+}
 
 void SendingState::paint(Graphics& g) {
     auto rect = getLocalBounds();
@@ -184,14 +209,18 @@ void SendingState::resized() {
     auto rect = getLocalBounds();
     const auto height = static_cast<int>(rect.getHeight() / 2.5);
 
-    auto topRect = rect.removeFromTop(height);
+    // Each component takes its own strip, so none overlaps another: the
+    // buttons at the bottom, the stats above them, the level at the top
     auto bottomRect = rect.removeFromBottom(height);
+    statsPanel.setBounds(rect.removeFromBottom(rect.getHeight() - height));
 
-    levelSlider.setBounds(topRect.removeFromBottom(height / 2));
+    levelSlider.setBounds(rect.removeFromBottom(height / 2));
     levelSlider.setTextBoxStyle(levelSlider.getTextBoxPosition(),
                                 !levelSlider.isTextBoxEditable(),
                                 rect.getWidth() / 5, height / 2);
 
+    recordButton.setBounds(
+        bottomRect.removeFromRight(bottomRect.getWidth() / 3));
     stopButton.setBounds(bottomRect);
 }
 
@@ -204,11 +233,25 @@ SendingState::SendingState()
     levelSlider.setRange(0, 100, 1);
     levelSlider.setValue(100);
     levelSlider.setLookAndFeel(sliderTextBoxLookAndFeel.get());
+    levelSlider.onValueChange = [this] {
+        sendThread.setGain(static_cast<float>(levelSlider.getValue()) /
+                           100.0f);
+    };
 
     addAndMakeVisible(stopButton);
     stopButton.setLookAndFeel(buttonLookAndFeel.get());
     stopButton.setButtonText("Stop");
     stopButton.onClick = [this] { stopButtonClicked(); };
+
+    addAndMakeVisible(recordButton);
+    recordButton.setLookAndFeel(buttonLookAndFeel.get());
+    recordButton.setButtonText("Record");
+    recordButton.setClickingTogglesState(true);
+    recordButton.onClick = [this] { recordButtonClicked(); };
+
+    addAndMakeVisible(statsPanel);
+    sendThread.addMetrics(metrics);
+    recorder.addMetrics(metrics);
 }
 
 void SendingState::changeListenerCallback(ChangeBroadcaster* source) {
@@ -219,6 +262,7 @@ void SendingState::changeListenerCallback(ChangeBroadcaster* source) {
     if (const auto& broadcaster = dynamic_cast<Component*>(source)) {
         if (const auto& parent = broadcaster->getParentComponent()) {
             setAudioChannels(2, 0);
+            metricsExporter.startFromEnvironment();
 
             parent->removeChildComponent(broadcaster);
             parent->addAndMakeVisible(this);
@@ -227,48 +271,136 @@ void SendingState::changeListenerCallback(ChangeBroadcaster* source) {
     }
 }
 
-void SendingState::getNextAudioBlock(
-    const AudioSourceChannelInfo& bufferToFill) {
-    auto* device = deviceManager.getCurrentAudioDevice();
-    auto activeInputChannels = device->getActiveInputChannels();
-    auto maxInputChannels = activeInputChannels.getHighestBit() + 1;
+void SendingState::prepareToPlay(int /* samplesPerBlockExpected */,
+                                 double sampleRate) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
 
-    auto level = static_cast<float>(levelSlider.getValue());
-    auto numSamples = static_cast<size_t>(bufferToFill.numSamples);
-    float outBuffer[AUDIO_STREAM_AUDIO_BUFFER_SIZE];
+    // Read here once, the device must not be queried from the callback
+    const auto* device = deviceManager.getCurrentAudioDevice();
+    const auto activeChannels = device != nullptr
+                                    ? device->getActiveInputChannels()
+                                    : BigInteger();
+    numInputChannels = jmin(activeChannels.getHighestBit() + 1,
+                            AUDIO_STREAM_MAX_CHANNELS);
+    activeInputChannels = 0;
+    for (auto channel = 0; channel < numInputChannels; ++channel) {
+        activeInputChannels |= activeChannels[channel] ? 1u << channel : 0u;
+    }
 
-    const auto& senderPtr = SharedResourcePointer<OSCSender>();
+    sendThread.stop();
+    sendThread.prepare(sampleRate);
+    sendThread.start(sendThreadOptions);
 
-    for (auto channel = 0; channel < maxInputChannels; ++channel) {
-        if (!activeInputChannels[channel]) {
-            // Clear the buffer
-            bufferToFill.buffer->clear(channel, bufferToFill.startSample,
-                                       bufferToFill.numSamples);
-            return;
-        }
+    // A new rate or channel count goes to a new file
+    const auto wasRecording = recorder.isRecording();
+    recorder.prepare(sampleRate, numInputChannels);
+    if (wasRecording) {
+        recorder.start(recorder.getFile().getNonexistentSibling());
+    }
+}
 
-        auto actualInputChannel = channel % maxInputChannels;
-        auto* inBuffer = bufferToFill.buffer->getReadPointer(
-            actualInputChannel, bufferToFill.startSample);
+void SendingState::setCompressionEnabled(bool shouldCompress) {
+    sendThread.setCompressionEnabled(shouldCompress);
+}
 
-        for (size_t sample = 0; sample < numSamples; ++sample) {
-            outBuffer[sample] = inBuffer[sample] * level / 100.0f;
-        }
+void SendingState::setSampleFormat(SampleFormat format) {
+    sendThread.setSampleFormat(format);
+}
+
+void SendingState::setTransport(Transport newTransport) {
+    sendThread.setTransport(newTransport);
+}
 
-        senderPtr->send(AUDIO_STREAM_ADDRESS_PATTERN,
-                        MemoryBlock(outBuffer, numSamples * sizeof(float)));
+void SendingState::setFecOptions(int numData, int numParity) {
+    sendThread.setFecOptions(numData, numParity);
+}
+
+void SendingState::setFrameDuration(double milliseconds) {
+    sendThread.setFrameDuration(milliseconds);
+}
+
+void SendingState::setMtu(int bytes) { sendThread.setMtu(bytes); }
+
+void SendingState::setRetransmissionEnabled(bool shouldRetransmit) {
+    sendThread.setRetransmissionEnabled(shouldRetransmit);
+}
+
+void SendingState::setDiscontinuousTransmissionEnabled(
+    bool shouldSuppressSilence) {
+    sendThread.setDiscontinuousTransmissionEnabled(shouldSuppressSilence);
+}
+
+void SendingState::setLatencyProbeEnabled(bool shouldProbe) {
+    sendThread.setLatencyProbeEnabled(shouldProbe);
+}
+
+void SendingState::setSendThreadOptions(const SendThread::Options& options) {
+    sendThreadOptions = options;
+}
+
+bool SendingState::startRecording(const File& file) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    const auto started = recorder.start(file);
+    recordButton.setToggleState(started, dontSendNotification);
+    return started;
+}
+
+void SendingState::stopRecording() {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    recorder.stop();
+    recordButton.setToggleState(false, dontSendNotification);
+}
+
+void SendingState::getNextAudioBlock(
+    const AudioSourceChannelInfo& bufferToFill) {
+    const RealtimeChecker::ScopedCallback callback;
+
+    const auto maxInputChannels =
+        jmin(numInputChannels, bufferToFill.buffer->getNumChannels());
+
+    // Inactive channels are sent as silence to keep blocks complete
+    const float* inBuffers[AUDIO_STREAM_MAX_CHANNELS];
+    for (auto channel = 0; channel < maxInputChannels; ++channel) {
+        inBuffers[channel] = (activeInputChannels >> channel) & 1u
+                                 ? bufferToFill.buffer->getReadPointer(
+                                       channel, bufferToFill.startSample)
+                                 : nullptr;
     }
+
+    // Sending and writing to disk happen on their own threads, never here
+    sendThread.pushBlock(inBuffers, maxInputChannels,
+                         bufferToFill.numSamples);
+    recorder.write(inBuffers, maxInputChannels, bufferToFill.numSamples);
 }
 
 void SendingState::stopButtonClicked() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
 
     shutdownAudio();
+    stopRecording();
+    metricsExporter.stop();
+    sendThread.stop();
 
     addChangeListener(SharedResourcePointer<StoppedState>());
     sendChangeMessage();
 }
 
+void SendingState::recordButtonClicked() {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    if (!recordButton.getToggleState()) {
+        stopRecording();
+        return;
+    }
+
+    const auto file = Recorder::getDefaultFile("sent");
+    if (!startRecording(file)) {
+        Logger::writeToLog("Couldn't record to " + file.getFullPathName());
+    }
+}
+
 //==============================================================================
 void ListeningState::resized() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
@@ -284,6 +416,7 @@ void ListeningState::resized() {
     portEditor.setBounds(rect.removeFromTop(rectHeight));
     errorLabel.setBounds(rect.removeFromBottom(rectHeight));
     connectButton.setBounds(rect.removeFromBottom(rectHeight * 2));
+    latencyButton.setBounds(rect.removeFromBottom(rectHeight));
 
     portLabel.setFont(fontHeight);
 
@@ -306,6 +439,12 @@ ListeningState::ListeningState()
     addAndMakeVisible(portEditor);
     portEditor.setTextToShowWhenEmpty("1234", Colours::grey);
 
+    // Opens the first input too, to hear the output through
+    addAndMakeVisible(latencyButton);
+    latencyButton.setLookAndFeel(buttonLookAndFeel.get());
+    latencyButton.setButtonText("Measure latency");
+    latencyButton.setClickingTogglesState(true);
+
     addAndMakeVisible(connectButton);
     connectButton.setLookAndFeel(buttonLookAndFeel.get());
     connectButton.setButtonText("Connect");
@@ -346,15 +485,19 @@ void ListeningState::connectButtonClicked() {
     }
     Logger::writeToLog("Connected to port: " + portEditor.getText());
 
-    // Tell the component to listen for OSC messages matching this address:
-    receiverPtr->addListener(receiverPtr, AUDIO_STREAM_ADDRESS_PATTERN);
+    receiverPtr->setLatencyMeasurementEnabled(latencyButton.getToggleState());
 
     addChangeListener(receiverPtr);
     sendChangeMessage();
 }
 
 //==============================================================================
-ReceivingState::~ReceivingState() { shutdownAudio(); }
+ReceivingState::~ReceivingState() {
+    metricsExporter.stop();
+    engine.disconnect();
+    shutdownAudio();
+    recorder.stop();
+}
 
 void ReceivingState::paint(Graphics& g) {
     auto rect = getLocalBounds();
@@ -366,6 +509,37 @@ void ReceivingState::paint(Graphics& g) {
     g.drawText("Audio Level:", rect, juce::Justification::centredLeft, true);
 }
 
+bool ReceivingState::connect(int portNumber) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    return engine.connect(portNumber);
+}
+
+void ReceivingState::setReceiveThreadOptions(
+    const ReceiveThread::Options& options) {
+    receiveThreadOptions = options;
+}
+
+void ReceivingState::setLatencyMeasurementEnabled(bool shouldMeasure) {
+    measuringLatency = shouldMeasure;
+    engine.setLatencyMeasurementEnabled(shouldMeasure);
+}
+
+bool ReceivingState::startRecording(const File& file) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    const auto started = recorder.start(file);
+    recordButton.setToggleState(started, dontSendNotification);
+    return started;
+}
+
+void ReceivingState::stopRecording() {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    recorder.stop();
+    recordButton.setToggleState(false, dontSendNotification);
+}
+
 void ReceivingState::resized() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
 
@@ -374,14 +548,18 @@ void ReceivingState::resized() {
     auto rect = getLocalBounds();
     const auto height = static_cast<int>(rect.getHeight() / 2.5);
 
-    auto topRect = rect.removeFromTop(height);
+    // Each component takes its own strip, so none overlaps another: the
+    // buttons at the bottom, the stats above them, the level at the top
     auto bottomRect = rect.removeFromBottom(height);
+    statsPanel.setBounds(rect.removeFromBottom(rect.getHeight() - height));
 
-    levelSlider.setBounds(topRect.removeFromBottom(height / 2));
+    levelSlider.setBounds(rect.removeFromBottom(height / 2));
     levelSlider.setTextBoxStyle(levelSlider.getTextBoxPosition(),
                                 !levelSlider.isTextBoxEditable(),
                                 rect.getWidth() / 5, height / 2);
 
+    recordButton.setBounds(
+        bottomRect.removeFromRight(bottomRect.getWidth() / 3));
     stopButton.setBounds(bottomRect);
 }
 
@@ -394,11 +572,24 @@ ReceivingState::ReceivingState()
     levelSlider.setRange(0, 100, 1);
     levelSlider.setValue(100);
     levelSlider.setLookAndFeel(sliderTextBoxLookAndFeel.get());
+    levelSlider.onValueChange = [this] {
+        engine.setGain(static_cast<float>(levelSlider.getValue()) / 100.0f);
+    };
 
     addAndMakeVisible(stopButton);
     stopButton.setLookAndFeel(buttonLookAndFeel.get());
     stopButton.setButtonText("Stop");
     stopButton.onClick = [this] { stopButtonClicked(); };
+
+    addAndMakeVisible(recordButton);
+    recordButton.setLookAndFeel(buttonLookAndFeel.get());
+    recordButton.setButtonText("Record");
+    recordButton.setClickingTogglesState(true);
+    recordButton.onClick = [this] { recordButtonClicked(); };
+
+    addAndMakeVisible(statsPanel);
+    engine.addMetrics(metrics);
+    recorder.addMetrics(metrics);
 }
 
 void ReceivingState::changeListenerCallback(ChangeBroadcaster* source) {
@@ -408,7 +599,14 @@ void ReceivingState::changeListenerCallback(ChangeBroadcaster* source) {
 
     if (const auto& broadcaster = dynamic_cast<Component*>(source)) {
         if (const auto& parent = broadcaster->getParentComponent()) {
-            setAudioChannels(0, 2);
+            setAudioChannels(measuringLatency ? 1 : 0, 2);
+
+            // Only start receiving once prepareToPlay() has sized the
+            // jitter buffer
+            if (!engine.start(receiveThreadOptions)) {
+                Logger::writeToLog("Couldn't start the receive thread");
+            }
+            metricsExporter.startFromEnvironment();
 
             parent->removeChildComponent(broadcaster);
             parent->addAndMakeVisible(this);
@@ -417,53 +615,98 @@ void ReceivingState::changeListenerCallback(ChangeBroadcaster* source) {
     }
 }
 
-void ReceivingState::oscMessageReceived(const OSCMessage& message) {
-    for (const auto& item : message) {
-        if (item.isBlob()) {
-            auto& blob = item.getBlob();
-            blob.copyTo(receivedBuffers[writeIndex++ %
-                                        AUDIO_STREAM_CIRCULAR_BUFFER_SIZE],
-                        0, blob.getSize());
-        }
+void ReceivingState::prepareToPlay(int samplesPerBlockExpected,
+                                   double sampleRate) {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    // Read here once, the device must not be queried from the callback
+    auto* device = deviceManager.getCurrentAudioDevice();
+    const auto activeChannels = device != nullptr
+                                    ? device->getActiveOutputChannels()
+                                    : BigInteger();
+    numOutputChannels = jmin(activeChannels.getHighestBit() + 1,
+                             AUDIO_STREAM_MAX_CHANNELS);
+    activeOutputChannels = 0;
+    for (auto channel = 0; channel < numOutputChannels; ++channel) {
+        activeOutputChannels |= activeChannels[channel] ? 1u << channel : 0u;
+    }
+
+    // The input, when open, only feeds the latency meter
+    hasInput = device != nullptr &&
+               !device->getActiveInputChannels().isZero();
+    if (device != nullptr) {
+        engine.setDeviceLatency(
+            (device->getOutputLatencyInSamples() +
+             device->getInputLatencyInSamples()) /
+            sampleRate);
+    }
+
+    engine.prepare(samplesPerBlockExpected, sampleRate);
+
+    // A new rate or channel count goes to a new file
+    const auto wasRecording = recorder.isRecording();
+    recorder.prepare(sampleRate, numOutputChannels);
+    if (wasRecording) {
+        recorder.start(recorder.getFile().getNonexistentSibling());
     }
 }
 
 void ReceivingState::getNextAudioBlock(
     const AudioSourceChannelInfo& bufferToFill) {
-    auto* device = deviceManager.getCurrentAudioDevice();
-    auto activeOutputChannels = device->getActiveOutputChannels();
-    auto maxOutputChannels = activeOutputChannels.getHighestBit() + 1;
+    const RealtimeChecker::ScopedCallback callback;
 
-    auto level = static_cast<float>(levelSlider.getValue());
-    auto numSamples = static_cast<size_t>(bufferToFill.numSamples);
+    const auto maxOutputChannels =
+        jmin(numOutputChannels, bufferToFill.buffer->getNumChannels());
 
-    float* inBuffer;
+    // The input arrives in the buffer the output is written to
+    if (hasInput) {
+        engine.writeInput(bufferToFill.buffer->getReadPointer(
+                              0, bufferToFill.startSample),
+                          bufferToFill.numSamples);
+    }
 
+    float* outBuffers[AUDIO_STREAM_MAX_CHANNELS];
     for (auto channel = 0; channel < maxOutputChannels; ++channel) {
-        if (!activeOutputChannels[channel] || readIndex >= writeIndex) {
+        outBuffers[channel] = bufferToFill.buffer->getWritePointer(
+            channel, bufferToFill.startSample);
+    }
+
+    engine.read(outBuffers, maxOutputChannels, bufferToFill.numSamples);
+
+    for (auto channel = 0; channel < maxOutputChannels; ++channel) {
+        if (((activeOutputChannels >> channel) & 1u) == 0) {
             // Clear the buffer
             bufferToFill.buffer->clear(channel, bufferToFill.startSample,
                                        bufferToFill.numSamples);
-            return;
-        }
-
-        auto* outBuffer = bufferToFill.buffer->getWritePointer(
-            channel, bufferToFill.startSample);
-        inBuffer =
-            receivedBuffers[readIndex++ % AUDIO_STREAM_CIRCULAR_BUFFER_SIZE];
-
-        for (size_t sample = 0; sample < numSamples; ++sample) {
-            outBuffer[sample] = inBuffer[sample] * level / 100.0f;
         }
     }
+
+    recorder.write(outBuffers, maxOutputChannels, bufferToFill.numSamples);
 }
 
 void ReceivingState::stopButtonClicked() {
     Logger::writeToLog(__PRETTY_FUNCTION__);
 
+    metricsExporter.stop();
+    engine.disconnect();
     shutdownAudio();
+    stopRecording();
 
     addChangeListener(SharedResourcePointer<StoppedState>());
     sendChangeMessage();
 }
 
+void ReceivingState::recordButtonClicked() {
+    Logger::writeToLog(__PRETTY_FUNCTION__);
+
+    if (!recordButton.getToggleState()) {
+        stopRecording();
+        return;
+    }
+
+    const auto file = Recorder::getDefaultFile("received");
+    if (!startRecording(file)) {
+        Logger::writeToLog("Couldn't record to " + file.getFullPathName());
+    }
+}
+
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "LookAndFeel.hpp"
-
-#define AUDIO_STREAM_ADDRESS_PATTERN "/AudioStream"
-#define AUDIO_STREAM_CIRCULAR_BUFFER_SIZE 1024
-#define AUDIO_STREAM_AUDIO_BUFFER_SIZE 1024
+#include "MetricsExporter.hpp"
+#include "RealtimeChecker.hpp"
+#include "ReceiveEngine.hpp"
+#include "Recorder.hpp"
+#include "SendThread.hpp"
+#include "StatsPanel.hpp"
+#include "StreamConfig.hpp"
+#include "StreamPacket.hpp"
 
 //==============================================================================
 /**
@@ -57,6 +61,7 @@ class ConnectingState : public Component,
     Label errorLabel;
     TextEditor ipEditor;
     TextEditor portEditor;
+    TextButton latencyButton;
     TextButton connectButton;
 
     void changeListenerCallback(ChangeBroadcaster* source) override;
@@ -80,6 +85,55 @@ class SendingState : public AudioAppComponent,
     void paint(Graphics& g) override;
     void resized() override;
 
+    using Transport = SendThread::Transport;
+
+    /** Selects how packets are put on the wire. */
+    void setTransport(Transport newTransport);
+    /**
+     * Sends numParity parity packets per numData audio packets, 0 parity
+     * packets disables FEC. Takes effect on the next start.
+     */
+    void setFecOptions(int numData, int numParity);
+    /**
+     * Duration of the frames the audio is sent in, whatever the device
+     * block size. Takes effect on the next start.
+     */
+    void setFrameDuration(double milliseconds);
+    /** Largest IP packet the path carries. Takes effect on the next start. */
+    void setMtu(int bytes);
+    /**
+     * Sends lost packets again when receivers ask for them, raw transport
+     * only. Takes effect on the next start.
+     */
+    void setRetransmissionEnabled(bool shouldRetransmit);
+    /**
+     * Stops sending during silence, sending comfort noise descriptors
+     * instead. Takes effect on the next start.
+     */
+    void setDiscontinuousTransmissionEnabled(bool shouldSuppressSilence);
+    /**
+     * Adds a latency probe to the audio sent every second, for receivers in
+     * latency measurement mode. Takes effect on the next start.
+     */
+    void setLatencyProbeEnabled(bool shouldProbe);
+    /** Compresses the audio losslessly before sending it. */
+    void setCompressionEnabled(bool shouldCompress);
+    /**
+     * Selects the sample format sent on the wire. Integer formats are
+     * dithered; receivers convert back to float from the packet header.
+     */
+    void setSampleFormat(SampleFormat format);
+    /** Scheduling of the network thread, used from the next start. */
+    void setSendThreadOptions(const SendThread::Options& options);
+    /**
+     * Records the device input to file, WAV or FLAC by its extension, until
+     * stopRecording() or the end of sending.
+     */
+    bool startRecording(const File& file);
+    void stopRecording();
+
+    const SendThread& getSendThread() const { return sendThread; }
+
   protected:
     SendingState();
 
@@ -88,14 +142,26 @@ class SendingState : public AudioAppComponent,
     std::shared_ptr<ButtonLookAndFeel> buttonLookAndFeel;
 
     TextButton stopButton;
+    TextButton recordButton;
     Slider levelSlider{Slider::LinearHorizontal, Slider::TextBoxRight};
 
-    void prepareToPlay(int /* samplesPerBlockExpected */,
-                       double /* sampleRate */) override {}
+    SendThread sendThread;
+    SendThread::Options sendThreadOptions;
+    /** Device inputs in use, read in prepareToPlay(). One bit each. */
+    uint32 activeInputChannels{0};
+    int numInputChannels{0};
+
+    Recorder recorder;
+    MetricsRegistry metrics;
+    StatsPanel statsPanel{metrics};
+    MetricsExporter metricsExporter{metrics};
+
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
     void releaseResources() override {}
     void changeListenerCallback(ChangeBroadcaster* source) override;
     void getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill) override;
     void stopButtonClicked();
+    void recordButtonClicked();
 
     friend class SharedResourcePointer<SendingState>;
 
@@ -123,6 +189,7 @@ class ListeningState : public Component,
     Label portLabel;
     Label errorLabel;
     TextEditor portEditor;
+    TextButton latencyButton;
     TextButton connectButton;
 
     void changeListenerCallback(ChangeBroadcaster* source) override;
@@ -140,37 +207,58 @@ class ListeningState : public Component,
  */
 class ReceivingState : public AudioAppComponent,
                        public ChangeListener,
-                       public ChangeBroadcaster,
-                       public OSCReceiver,
-                       public OSCReceiver::ListenerWithOSCAddress<
-                           OSCReceiver::MessageLoopCallback> {
+                       public ChangeBroadcaster {
   public:
     ~ReceivingState();
     void paint(Graphics& g) override;
     void resized() override;
 
+    bool connect(int portNumber);
+    void setReceiveThreadOptions(const ReceiveThread::Options& options);
+    /**
+     * Measures the latency from the probes of a sender in latency
+     * measurement mode, opening the first device input to hear the output
+     * too. Must be called before receiving starts.
+     */
+    void setLatencyMeasurementEnabled(bool shouldMeasure);
+    /**
+     * Records what is played to file, WAV or FLAC by its extension, until
+     * stopRecording() or the end of receiving.
+     */
+    bool startRecording(const File& file);
+    void stopRecording();
+
   protected:
     ReceivingState();
 
   private:
-    float receivedBuffers[AUDIO_STREAM_CIRCULAR_BUFFER_SIZE]
-                         [AUDIO_STREAM_AUDIO_BUFFER_SIZE];
-    size_t readIndex{0};
-    size_t writeIndex{0};
+    ReceiveEngine engine;
+    ReceiveThread::Options receiveThreadOptions;
+    /** Device outputs in use, read in prepareToPlay(). One bit each. */
+    uint32 activeOutputChannels{0};
+    int numOutputChannels{0};
+    /** Whether the device input is open for the latency meter. */
+    bool measuringLatency{false};
+    bool hasInput{false};
+
+    Recorder recorder;
+    MetricsRegistry metrics;
+    StatsPanel statsPanel{metrics};
+    MetricsExporter metricsExporter{metrics};
 
     std::shared_ptr<SliderTextBoxLookAndFeel> sliderTextBoxLookAndFeel;
     std::shared_ptr<ButtonLookAndFeel> buttonLookAndFeel;
 
     TextButton stopButton;
+    TextButton recordButton;
     Slider levelSlider{Slider::LinearHorizontal, Slider::TextBoxRight};
 
-    void prepareToPlay(int /* samplesPerBlockExpected */,
-                       double /* sampleRate */) override {}
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
     void releaseResources() override {}
     void changeListenerCallback(ChangeBroadcaster* source) override;
-    void oscMessageReceived(const OSCMessage& message) override;
     void getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill) override;
     void stopButtonClicked();
+    void recordButtonClicked();
 
     friend class SharedResourcePointer<ReceivingState>;
 
@@ -0,0 +1,46 @@
+#include "StatsPanel.hpp"
+
+//==============================================================================
+StatsPanel::StatsPanel(const MetricsRegistry& registry) : metrics(registry) {
+    startTimerHz(AUDIO_STREAM_STATS_REFRESH_HZ);
+}
+
+StatsPanel::~StatsPanel() { stopTimer(); }
+
+void StatsPanel::paint(Graphics& g) {
+    const auto lineHeight =
+        jlimit(10.0f, 16.0f, static_cast<float>(getHeight()) / 16.0f);
+
+    g.setFont(lineHeight);
+    g.setColour(Colours::white);
+    g.drawMultiLineText(text, 10, static_cast<int>(lineHeight),
+                        getWidth() - 20);
+}
+
+void StatsPanel::timerCallback() {
+    String newText;
+
+    metrics.forEach([&newText](const MetricsRegistry::Metric& metric,
+                               double value) {
+        auto line = String(metric.name);
+        for (const auto& [key, labelValue] : metric.labels) {
+            line << " " << String(key) << "=" << String(labelValue);
+        }
+
+        if (metric.histogram != nullptr) {
+            const auto& histogram = *metric.histogram;
+            line << ": p50 " << String(histogram.getPercentile(0.5), 6)
+                 << ", p99 " << String(histogram.getPercentile(0.99), 6)
+                 << ", n " << String(histogram.getCount());
+        } else {
+            line << ": " << String(value);
+        }
+
+        newText << line << "\n";
+    });
+
+    if (newText != text) {
+        text = newText;
+        repaint();
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Metrics.hpp"
+
+#define AUDIO_STREAM_STATS_REFRESH_HZ 4
+
+//==============================================================================
+/**
+ * @class StatsPanel
+ * @brief Shows the metrics of a MetricsRegistry as text, refreshed a few
+ * times a second on the message thread.
+ *
+ * Counters and gauges show their value, histograms their median, 99th
+ * percentile and count. Reading the registry takes no locks, so the panel
+ * never holds up the audio or network threads.
+ */
+class StatsPanel : public Component, private Timer {
+  public:
+    explicit StatsPanel(const MetricsRegistry& registry);
+    ~StatsPanel() override;
+
+    void paint(Graphics& g) override;
+
+  private:
+    const MetricsRegistry& metrics;
+    String text;
+
+    void timerCallback() override;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StatsPanel)
+};
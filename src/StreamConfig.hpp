@@ -0,0 +1,30 @@
+#pragma once
+
+// Settings shared by the sending and receiving engines, with and without
+// the user interface
+#define AUDIO_STREAM_ADDRESS_PATTERN "/AudioStream"
+#define AUDIO_STREAM_MAX_FRAME_SIZE 1024
+#define AUDIO_STREAM_FRAME_DURATION_MS 5.0
+#define AUDIO_STREAM_MTU 1500
+#define AUDIO_STREAM_MIN_MTU 576
+#define AUDIO_STREAM_MAX_BLOCK_SIZE 8192
+#define AUDIO_STREAM_MAX_CHANNELS 16
+#define AUDIO_STREAM_MAX_SAMPLE_RATE 192000
+#define AUDIO_STREAM_MAX_DATAGRAM_SIZE 65000
+#define AUDIO_STREAM_JITTER_BUFFER_MS 200
+#define AUDIO_STREAM_MAX_STREAMS 32
+#define AUDIO_STREAM_FEC_NUM_DATA 8
+#define AUDIO_STREAM_FEC_NUM_PARITY 0
+/** Largest packet FEC protects; both ends allocate for it up front. */
+#define AUDIO_STREAM_FEC_MAX_PACKET_SIZE AUDIO_STREAM_MTU
+#define AUDIO_STREAM_METRICS_INTERVAL_MS 10000
+#define AUDIO_STREAM_GAIN_RAMP_LENGTH 1024
+/** Order of the latency probe's MLS, 4095 samples long. */
+#define AUDIO_STREAM_PROBE_ORDER 12
+#define AUDIO_STREAM_PROBE_INTERVAL_MS 1000
+
+// The setters trace themselves with __PRETTY_FUNCTION__, MSVC's is named
+// differently
+#ifdef _MSC_VER
+#define __PRETTY_FUNCTION__ __FUNCSIG__
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define AUDIO_STREAM_MIXER_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIO_STREAM_MIXER_NEON 1
+#endif
+
+//==============================================================================
+/**
+ * @class StreamMixer
+ * @brief Sums several streams into one output, each with its own gain.
+ *
+ * Gains can be changed from any thread and are reached by the end of the
+ * next block through a linear ramp, so a moving fader doesn't click. The
+ * gain-and-add loops are vectorised with SSE2 or NEON where available, with
+ * a scalar fallback. The sum is not limited: streams mixed at unity gain
+ * can exceed full scale.
+ *
+ * add() is called from the audio thread and doesn't allocate.
+ */
+class StreamMixer {
+  public:
+    StreamMixer() = default;
+
+    /** Allocates the gains of maxStreams streams, all at unity. */
+    void prepare(size_t maxStreams) {
+        gains = std::make_unique<Gain[]>(maxStreams);
+        numStreams = maxStreams;
+    }
+
+    size_t getNumStreams() const { return numStreams; }
+
+    /** Sets the gain a stream ramps to. May be called from any thread. */
+    void setGain(size_t stream, float gain) {
+        gains[stream].target.store(gain, std::memory_order_relaxed);
+    }
+    float getGain(size_t stream) const {
+        return gains[stream].target.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Jumps straight to unity gain without a ramp, for a new stream. Audio
+     * thread only.
+     */
+    void resetGain(size_t stream) {
+        gains[stream].target.store(1.0f, std::memory_order_relaxed);
+        gains[stream].current = 1.0f;
+    }
+
+    /** Adds numChannels channels of a stream into outputs. */
+    void add(size_t stream, const float* const* inputs, float* const* outputs,
+             int numChannels, int numSamples) {
+        auto& gain = gains[stream];
+        const auto target = gain.target.load(std::memory_order_relaxed);
+        const auto count = static_cast<size_t>(numSamples);
+
+        if (target == gain.current || numSamples <= 0) {
+            for (auto channel = 0; channel < numChannels; ++channel) {
+                addWithGain(outputs[channel], inputs[channel], target, count);
+            }
+        } else {
+            const auto step =
+                (target - gain.current) / static_cast<float>(numSamples);
+            for (auto channel = 0; channel < numChannels; ++channel) {
+                addWithRamp(outputs[channel], inputs[channel], gain.current,
+                            step, count);
+            }
+        }
+
+        gain.current = target;
+    }
+
+    /** dest[i] += src[i] * gain */
+    static void addWithGain(float* dest, const float* src, float gain,
+                            size_t numSamples) {
+        size_t i = 0;
+
+#if AUDIO_STREAM_MIXER_SSE2
+        const auto g = _mm_set1_ps(gain);
+        for (; i + 8 <= numSamples; i += 8) {
+            const auto a = _mm_add_ps(_mm_loadu_ps(dest + i),
+                                      _mm_mul_ps(_mm_loadu_ps(src + i), g));
+            const auto b =
+                _mm_add_ps(_mm_loadu_ps(dest + i + 4),
+                           _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+            _mm_storeu_ps(dest + i, a);
+            _mm_storeu_ps(dest + i + 4, b);
+        }
+#elif AUDIO_STREAM_MIXER_NEON
+        for (; i + 8 <= numSamples; i += 8) {
+            vst1q_f32(dest + i,
+                      vmlaq_n_f32(vld1q_f32(dest + i), vld1q_f32(src + i),
+                                  gain));
+            vst1q_f32(dest + i + 4,
+                      vmlaq_n_f32(vld1q_f32(dest + i + 4),
+                                  vld1q_f32(src + i + 4), gain));
+        }
+#endif
+
+        for (; i < numSamples; ++i) {
+            dest[i] += src[i] * gain;
+        }
+    }
+
+    /** dest[i] += src[i] * (startGain + i * step) */
+    static void addWithRamp(float* dest, const float* src, float startGain,
+                            float step, size_t numSamples) {
+        size_t i = 0;
+
+#if AUDIO_STREAM_MIXER_SSE2
+        auto g = _mm_add_ps(_mm_set1_ps(startGain),
+                            _mm_mul_ps(_mm_set1_ps(step),
+                                       _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+        const auto increment = _mm_set1_ps(4.0f * step);
+        for (; i + 4 <= numSamples; i += 4) {
+            _mm_storeu_ps(dest + i,
+                          _mm_add_ps(_mm_loadu_ps(dest + i),
+                                     _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+            g = _mm_add_ps(g, increment);
+        }
+#elif AUDIO_STREAM_MIXER_NEON
+        const float offsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+        auto g = vmlaq_n_f32(vdupq_n_f32(startGain), vld1q_f32(offsets), step);
+        const auto increment = vdupq_n_f32(4.0f * step);
+        for (; i + 4 <= numSamples; i += 4) {
+            vst1q_f32(dest + i,
+                      vmlaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), g));
+            g = vaddq_f32(g, increment);
+        }
+#endif
+
+        for (; i < numSamples; ++i) {
+            dest[i] += src[i] * (startGain + static_cast<float>(i) * step);
+        }
+    }
+
+  private:
+    struct Gain {
+        std::atomic<float> target{1.0f};
+        /** Audio thread only. */
+        float current{1.0f};
+    };
+
+    std::unique_ptr<Gain[]> gains;
+    size_t numStreams{0};
+};
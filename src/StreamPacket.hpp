@@ -0,0 +1,613 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Little-endian field access shared by the packet headers. */
+namespace wire {
+template <typename T>
+void writeLE(uint8_t* dest, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        dest[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template <typename T>
+T readLE(const uint8_t* src) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<T>(src[i]) << (8 * i));
+    }
+    return value;
+}
+}  // namespace wire
+
+//==============================================================================
+/**
+ * Encoding of the samples carried after a StreamPacketHeader. Integer formats
+ * are little-endian, int24 is packed in 3 bytes.
+ */
+enum class SampleFormat : uint8_t { float32 = 0, int16 = 1, int24 = 2 };
+
+/** Size in bytes of a single sample in the given format, or 0 if unknown. */
+constexpr size_t getBytesPerSample(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::float32:
+            return 4;
+        case SampleFormat::int16:
+            return 2;
+        case SampleFormat::int24:
+            return 3;
+    }
+    return 0;
+}
+
+//==============================================================================
+/**
+ * @struct StreamPacketHeader
+ * @brief The header in front of every audio payload sent on the wire.
+ *
+ * All fields are little-endian. A receiver skips headerSize bytes to get to
+ * the payload, so later versions can append fields without breaking older
+ * receivers.
+ *
+ * Every packet announces the stream's format: sampleRate, totalChannels and
+ * sampleFormat. Senders that predate sampleRate send a headerSize of
+ * minSize, and their rate reads as 0, unknown.
+ *
+ * When the compressed flag is set, the payload is LosslessCodec data of
+ * variable length that decodes straight to float samples, already quantised
+ * to sampleFormat. The retransmittable flag tells receivers they may ask
+ * for lost packets with a NackPacketHeader, and the retransmitted flag marks
+ * the copies sent in answer.
+ *
+ * A comfortNoise packet stands in for frames the sender left out because
+ * they were silent. It covers all channels of one frame of numSamples
+ * samples, and its payload is one little-endian float32 per channel: the
+ * RMS level of the background noise the receiver plays in their place.
+ *
+ * The reports flag tells receivers the sender reads ReceiverReportHeader
+ * packets sent back to the address its packets come from.
+ *
+ * | Offset | Size | Field         |
+ * |--------|------|---------------|
+ * | 0      | 4    | magic         |
+ * | 4      | 1    | version       |
+ * | 5      | 1    | headerSize    |
+ * | 6      | 1    | sampleFormat  |
+ * | 7      | 1    | flags         |
+ * | 8      | 4    | streamId      |
+ * | 12     | 4    | sequence      |
+ * | 16     | 8    | timestamp     |
+ * | 24     | 2    | channelIndex  |
+ * | 26     | 2    | numChannels   |
+ * | 28     | 2    | totalChannels |
+ * | 30     | 2    | numSamples    |
+ * | 32     | 4    | sampleRate    |
+ */
+struct StreamPacketHeader {
+    static constexpr uint32_t magic = 0x50545341;  // "ASTP"
+    static constexpr uint8_t currentVersion = 1;
+    static constexpr size_t size = 36;
+    /** Size of the header before sampleRate was added. */
+    static constexpr size_t minSize = 32;
+
+    /** Set in flags when the payload is LosslessCodec data. */
+    static constexpr uint8_t compressed = 0x01;
+    /** Set in flags when the sender answers NACKs for the stream. */
+    static constexpr uint8_t retransmittable = 0x02;
+    /** Set in flags on a packet sent again in answer to a NACK. */
+    static constexpr uint8_t retransmitted = 0x04;
+    /** Set in flags on a comfort noise descriptor. */
+    static constexpr uint8_t comfortNoise = 0x08;
+    /** Set in flags when the sender reads receiver reports. */
+    static constexpr uint8_t reports = 0x10;
+
+    uint8_t version{currentVersion};
+    uint8_t headerSize{size};
+    SampleFormat sampleFormat{SampleFormat::float32};
+    uint8_t flags{0};
+    /** Identifies one sender session. */
+    uint32_t streamId{0};
+    /** Incremented once per block, shared by all packets of that block. */
+    uint32_t sequence{0};
+    /** Position of the first sample of the block, in sample frames. */
+    uint64_t timestamp{0};
+    /** Index of the first channel carried by this packet. */
+    uint16_t channelIndex{0};
+    /** Number of channels carried by this packet. */
+    uint16_t numChannels{1};
+    /** Number of channels in the stream. */
+    uint16_t totalChannels{1};
+    /** Number of samples per channel. */
+    uint16_t numSamples{0};
+    /** Sample rate of the stream in Hz, or 0 if the sender didn't say. */
+    uint32_t sampleRate{0};
+
+    bool isCompressed() const { return (flags & compressed) != 0; }
+    bool isRetransmittable() const {
+        return (flags & retransmittable) != 0;
+    }
+    bool isRetransmitted() const { return (flags & retransmitted) != 0; }
+    bool isComfortNoise() const { return (flags & comfortNoise) != 0; }
+    bool wantsReports() const { return (flags & reports) != 0; }
+
+    /** Sets flags in a packet already written, without parsing it. */
+    static void addFlags(uint8_t* packet, uint8_t newFlags) {
+        packet[7] |= newFlags;
+    }
+
+    /**
+     * Bytes of samples carried, before any compression, or of the levels of
+     * a comfort noise descriptor.
+     */
+    size_t getPayloadSize() const {
+        if (isComfortNoise()) {
+            return static_cast<size_t>(numChannels) * sizeof(float);
+        }
+        return static_cast<size_t>(numChannels) * numSamples *
+               getBytesPerSample(sampleFormat);
+    }
+
+    /**
+     * Largest compressed payload for the samples carried, that of
+     * LosslessCodec::getMaxEncodedSize(): every channel sent verbatim as
+     * float32 after a byte naming its coding.
+     */
+    size_t getMaxCompressedSize() const {
+        return static_cast<size_t>(numChannels) *
+               (1 + static_cast<size_t>(numSamples) * sizeof(float));
+    }
+
+    /** Writes the header into dest, which must hold at least size bytes. */
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, magic);
+        dest[4] = version;
+        dest[5] = static_cast<uint8_t>(size);
+        dest[6] = static_cast<uint8_t>(sampleFormat);
+        dest[7] = flags;
+        wire::writeLE(dest + 8, streamId);
+        wire::writeLE(dest + 12, sequence);
+        wire::writeLE(dest + 16, timestamp);
+        wire::writeLE(dest + 24, channelIndex);
+        wire::writeLE(dest + 26, numChannels);
+        wire::writeLE(dest + 28, totalChannels);
+        wire::writeLE(dest + 30, numSamples);
+        wire::writeLE(dest + 32, sampleRate);
+    }
+
+    /**
+     * @brief Parses a header from a packet.
+     * @return false if the packet is not an AudioStream packet, is from an
+     * incompatible version, or is truncated.
+     */
+    bool read(const uint8_t* src, size_t packetSize) {
+        if (packetSize < minSize || wire::readLE<uint32_t>(src) != magic ||
+            src[4] == 0 || src[4] > currentVersion || src[5] < minSize ||
+            src[5] > packetSize) {
+            return false;
+        }
+
+        version = src[4];
+        headerSize = src[5];
+        sampleFormat = static_cast<SampleFormat>(src[6]);
+        flags = src[7];
+        streamId = wire::readLE<uint32_t>(src + 8);
+        sequence = wire::readLE<uint32_t>(src + 12);
+        timestamp = wire::readLE<uint64_t>(src + 16);
+        channelIndex = wire::readLE<uint16_t>(src + 24);
+        numChannels = wire::readLE<uint16_t>(src + 26);
+        totalChannels = wire::readLE<uint16_t>(src + 28);
+        numSamples = wire::readLE<uint16_t>(src + 30);
+        sampleRate =
+            headerSize >= size ? wire::readLE<uint32_t>(src + 32) : 0;
+
+        if (getBytesPerSample(sampleFormat) == 0 ||
+            channelIndex + numChannels > totalChannels) {
+            return false;
+        }
+
+        // A compressed payload's size is only known once decoded, but it
+        // can't be empty or larger than coding every sample verbatim
+        const auto payloadSize = packetSize - headerSize;
+        return isCompressed() ? payloadSize > 0 &&
+                                    payloadSize <= getMaxCompressedSize()
+                              : getPayloadSize() <= payloadSize;
+    }
+};
+
+//==============================================================================
+/**
+ * @struct FecPacketHeader
+ * @brief The header in front of every parity payload sent on the wire.
+ *
+ * A parity packet protects the numData stream packets of one channelIndex
+ * starting at baseSequence. Its payload is parity row parityIndex of a
+ * systematic erasure code over those packets, see FecEncoder. The different
+ * magic makes receivers without FEC support ignore parity packets.
+ *
+ * | Offset | Size | Field         |
+ * |--------|------|---------------|
+ * | 0      | 4    | magic         |
+ * | 4      | 1    | version       |
+ * | 5      | 1    | headerSize    |
+ * | 6      | 1    | numData       |
+ * | 7      | 1    | numParity     |
+ * | 8      | 4    | streamId      |
+ * | 12     | 4    | baseSequence  |
+ * | 16     | 2    | channelIndex  |
+ * | 18     | 1    | parityIndex   |
+ * | 19     | 1    | reserved      |
+ * | 20     | 4    | unitSize      |
+ */
+struct FecPacketHeader {
+    static constexpr uint32_t magic = 0x46545341;  // "ASTF"
+    static constexpr uint8_t currentVersion = 1;
+    static constexpr size_t size = 24;
+
+    uint8_t version{currentVersion};
+    uint8_t headerSize{size};
+    /** Number of stream packets in the group. */
+    uint8_t numData{0};
+    /** Number of parity packets sent for the group. */
+    uint8_t numParity{0};
+    uint32_t streamId{0};
+    /** Sequence of the first stream packet in the group. */
+    uint32_t baseSequence{0};
+    /** channelIndex of the stream packets in the group. */
+    uint16_t channelIndex{0};
+    /** Row of the code carried by this packet. */
+    uint8_t parityIndex{0};
+    /** Bytes of payload following the header. */
+    uint32_t unitSize{0};
+
+    /** Writes the header into dest, which must hold at least size bytes. */
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, magic);
+        dest[4] = version;
+        dest[5] = static_cast<uint8_t>(size);
+        dest[6] = numData;
+        dest[7] = numParity;
+        wire::writeLE(dest + 8, streamId);
+        wire::writeLE(dest + 12, baseSequence);
+        wire::writeLE(dest + 16, channelIndex);
+        dest[18] = parityIndex;
+        dest[19] = 0;
+        wire::writeLE(dest + 20, unitSize);
+    }
+
+    /**
+     * @brief Parses a header from a packet.
+     * @return false if the packet is not a parity packet, is from an
+     * incompatible version, or is truncated.
+     */
+    bool read(const uint8_t* src, size_t packetSize) {
+        if (packetSize < size || wire::readLE<uint32_t>(src) != magic ||
+            src[4] == 0 || src[4] > currentVersion || src[5] < size ||
+            src[5] > packetSize) {
+            return false;
+        }
+
+        version = src[4];
+        headerSize = src[5];
+        numData = src[6];
+        numParity = src[7];
+        streamId = wire::readLE<uint32_t>(src + 8);
+        baseSequence = wire::readLE<uint32_t>(src + 12);
+        channelIndex = wire::readLE<uint16_t>(src + 16);
+        parityIndex = src[18];
+        unitSize = wire::readLE<uint32_t>(src + 20);
+
+        return numData > 0 && parityIndex < numParity &&
+               numData + numParity <= 256 &&
+               unitSize <= packetSize - headerSize;
+    }
+};
+
+//==============================================================================
+/**
+ * @struct NackEntry
+ * @brief One packet asked for again, as listed after a NackPacketHeader.
+ *
+ * Bit i of channelMask asks for the packet carrying channel i; channels from
+ * 31 up share the last bit. deadline is how long, from when the NACK was
+ * sent, the receiver still waits for the packet, in microseconds.
+ *
+ * | Offset | Size | Field       |
+ * |--------|------|-------------|
+ * | 0      | 4    | sequence    |
+ * | 4      | 4    | channelMask |
+ * | 8      | 4    | deadline    |
+ */
+struct NackEntry {
+    static constexpr size_t size = 12;
+
+    uint32_t sequence{0};
+    uint32_t channelMask{0};
+    uint32_t deadline{0};
+
+    /** The channelMask bits of count channels from first on. */
+    static constexpr uint32_t getChannelMask(uint32_t first, uint32_t count) {
+        uint32_t mask = 0;
+        for (auto channel = first; channel < first + count; ++channel) {
+            mask |= 1u << (channel < 31 ? channel : 31);
+        }
+        return mask;
+    }
+
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, sequence);
+        wire::writeLE(dest + 4, channelMask);
+        wire::writeLE(dest + 8, deadline);
+    }
+
+    void read(const uint8_t* src) {
+        sequence = wire::readLE<uint32_t>(src);
+        channelMask = wire::readLE<uint32_t>(src + 4);
+        deadline = wire::readLE<uint32_t>(src + 8);
+    }
+};
+
+//==============================================================================
+/**
+ * @struct NackPacketHeader
+ * @brief The header of a negative acknowledgement, sent by a receiver back
+ * to the sender of a stream to ask for lost packets again.
+ *
+ * numEntries NackEntry follow the header. roundTripTime is the receiver's
+ * estimate of the time from sending a NACK to receiving the answer, in
+ * microseconds, 0 until it has one. Senders that don't retransmit never set
+ * the retransmittable flag, so they are never sent NACKs.
+ *
+ * | Offset | Size | Field         |
+ * |--------|------|---------------|
+ * | 0      | 4    | magic         |
+ * | 4      | 1    | version       |
+ * | 5      | 1    | headerSize    |
+ * | 6      | 1    | numEntries    |
+ * | 7      | 1    | reserved      |
+ * | 8      | 4    | streamId      |
+ * | 12     | 4    | roundTripTime |
+ */
+struct NackPacketHeader {
+    static constexpr uint32_t magic = 0x4e545341;  // "ASTN"
+    static constexpr uint8_t currentVersion = 1;
+    static constexpr size_t size = 16;
+    static constexpr size_t maxEntries = 255;
+
+    uint8_t version{currentVersion};
+    uint8_t headerSize{size};
+    uint8_t numEntries{0};
+    uint32_t streamId{0};
+    uint32_t roundTripTime{0};
+
+    /** Writes the header into dest, which must hold at least size bytes. */
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, magic);
+        dest[4] = version;
+        dest[5] = static_cast<uint8_t>(size);
+        dest[6] = numEntries;
+        dest[7] = 0;
+        wire::writeLE(dest + 8, streamId);
+        wire::writeLE(dest + 12, roundTripTime);
+    }
+
+    /**
+     * @brief Parses a header from a packet.
+     * @return false if the packet is not a NACK, is from an incompatible
+     * version, or is too short for its entries.
+     */
+    bool read(const uint8_t* src, size_t packetSize) {
+        if (packetSize < size || wire::readLE<uint32_t>(src) != magic ||
+            src[4] == 0 || src[4] > currentVersion || src[5] < size ||
+            src[5] > packetSize) {
+            return false;
+        }
+
+        version = src[4];
+        headerSize = src[5];
+        numEntries = src[6];
+        streamId = wire::readLE<uint32_t>(src + 8);
+        roundTripTime = wire::readLE<uint32_t>(src + 12);
+
+        return headerSize + numEntries * NackEntry::size <= packetSize;
+    }
+
+    /** Reads entry index of a packet whose header was read. */
+    NackEntry getEntry(const uint8_t* packet, size_t index) const {
+        NackEntry entry;
+        entry.read(packet + headerSize + index * NackEntry::size);
+        return entry;
+    }
+};
+
+//==============================================================================
+/**
+ * @struct ReceiverReportHeader
+ * @brief A receiver's periodic report on a stream, sent back to its sender.
+ *
+ * Counts are cumulative, in frames, so a lost report costs nothing but
+ * freshness. fractionLost is the share of frames lost since the previous
+ * report, in 256ths. Durations are in microseconds: jitter is the
+ * interarrival jitter, bufferDelay the audio queued for playout and
+ * targetDelay the playout delay aimed for.
+ *
+ * Times are read from each end's own clock in microseconds, so only
+ * differences taken on one end mean anything. sendTime is when the report
+ * left, echoTime the sendTime of the last SenderReportHeader received, 0 if
+ * none, and echoDelay how long that one was held. The sender takes the
+ * round trip from the echo, as RTCP does.
+ *
+ * | Offset | Size | Field        |
+ * |--------|------|--------------|
+ * | 0      | 4    | magic        |
+ * | 4      | 1    | version      |
+ * | 5      | 1    | headerSize   |
+ * | 6      | 1    | fractionLost |
+ * | 7      | 1    | reserved     |
+ * | 8      | 4    | streamId     |
+ * | 12     | 8    | sendTime     |
+ * | 20     | 8    | echoTime     |
+ * | 28     | 4    | echoDelay    |
+ * | 32     | 4    | numReceived  |
+ * | 36     | 4    | numLost      |
+ * | 40     | 4    | jitter       |
+ * | 44     | 4    | bufferDelay  |
+ * | 48     | 4    | targetDelay  |
+ */
+struct ReceiverReportHeader {
+    static constexpr uint32_t magic = 0x52545341;  // "ASTR"
+    static constexpr uint8_t currentVersion = 1;
+    static constexpr size_t size = 52;
+
+    uint8_t version{currentVersion};
+    uint8_t headerSize{size};
+    uint8_t fractionLost{0};
+    uint32_t streamId{0};
+    uint64_t sendTime{0};
+    uint64_t echoTime{0};
+    uint32_t echoDelay{0};
+    uint32_t numReceived{0};
+    uint32_t numLost{0};
+    uint32_t jitter{0};
+    uint32_t bufferDelay{0};
+    uint32_t targetDelay{0};
+
+    /** Writes the header into dest, which must hold at least size bytes. */
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, magic);
+        dest[4] = version;
+        dest[5] = static_cast<uint8_t>(size);
+        dest[6] = fractionLost;
+        dest[7] = 0;
+        wire::writeLE(dest + 8, streamId);
+        wire::writeLE(dest + 12, sendTime);
+        wire::writeLE(dest + 20, echoTime);
+        wire::writeLE(dest + 28, echoDelay);
+        wire::writeLE(dest + 32, numReceived);
+        wire::writeLE(dest + 36, numLost);
+        wire::writeLE(dest + 40, jitter);
+        wire::writeLE(dest + 44, bufferDelay);
+        wire::writeLE(dest + 48, targetDelay);
+    }
+
+    /**
+     * @brief Parses a header from a packet.
+     * @return false if the packet is not a receiver report or is from an
+     * incompatible version.
+     */
+    bool read(const uint8_t* src, size_t packetSize) {
+        if (packetSize < size || wire::readLE<uint32_t>(src) != magic ||
+            src[4] == 0 || src[4] > currentVersion || src[5] < size ||
+            src[5] > packetSize) {
+            return false;
+        }
+
+        version = src[4];
+        headerSize = src[5];
+        fractionLost = src[6];
+        streamId = wire::readLE<uint32_t>(src + 8);
+        sendTime = wire::readLE<uint64_t>(src + 12);
+        echoTime = wire::readLE<uint64_t>(src + 20);
+        echoDelay = wire::readLE<uint32_t>(src + 28);
+        numReceived = wire::readLE<uint32_t>(src + 32);
+        numLost = wire::readLE<uint32_t>(src + 36);
+        jitter = wire::readLE<uint32_t>(src + 40);
+        bufferDelay = wire::readLE<uint32_t>(src + 44);
+        targetDelay = wire::readLE<uint32_t>(src + 48);
+        return true;
+    }
+};
+
+//==============================================================================
+/**
+ * @struct SenderReportHeader
+ * @brief A sender's answer to a ReceiverReportHeader, which lets the
+ * receiver measure the round trip too.
+ *
+ * sendTime, echoTime and echoDelay work as in ReceiverReportHeader, the
+ * other way round. timestamp is the stream position sent last when the
+ * report left.
+ *
+ * A sender in latency measurement mode gives the stream position of the
+ * last probe it sent in probeTimestamp, and when its audio callback
+ * handled it in probeTime, in microseconds of its clock. Both are 0 before
+ * the first probe. Senders that don't measure may send a headerSize of
+ * minSize, without them.
+ *
+ * | Offset | Size | Field          |
+ * |--------|------|----------------|
+ * | 0      | 4    | magic          |
+ * | 4      | 1    | version        |
+ * | 5      | 1    | headerSize     |
+ * | 6      | 2    | reserved       |
+ * | 8      | 4    | streamId       |
+ * | 12     | 8    | sendTime       |
+ * | 20     | 8    | timestamp      |
+ * | 28     | 8    | echoTime       |
+ * | 36     | 4    | echoDelay      |
+ * | 40     | 8    | probeTimestamp |
+ * | 48     | 8    | probeTime      |
+ */
+struct SenderReportHeader {
+    static constexpr uint32_t magic = 0x53545341;  // "ASTS"
+    static constexpr uint8_t currentVersion = 1;
+    static constexpr size_t size = 56;
+    /** Size of a header without the probe fields. */
+    static constexpr size_t minSize = 40;
+
+    uint8_t version{currentVersion};
+    uint8_t headerSize{size};
+    uint32_t streamId{0};
+    uint64_t sendTime{0};
+    uint64_t timestamp{0};
+    uint64_t echoTime{0};
+    uint32_t echoDelay{0};
+    uint64_t probeTimestamp{0};
+    uint64_t probeTime{0};
+
+    /** Writes the header into dest, which must hold at least size bytes. */
+    void write(uint8_t* dest) const {
+        wire::writeLE(dest, magic);
+        dest[4] = version;
+        dest[5] = static_cast<uint8_t>(size);
+        wire::writeLE(dest + 6, uint16_t{0});
+        wire::writeLE(dest + 8, streamId);
+        wire::writeLE(dest + 12, sendTime);
+        wire::writeLE(dest + 20, timestamp);
+        wire::writeLE(dest + 28, echoTime);
+        wire::writeLE(dest + 36, echoDelay);
+        wire::writeLE(dest + 40, probeTimestamp);
+        wire::writeLE(dest + 48, probeTime);
+    }
+
+    /**
+     * @brief Parses a header from a packet.
+     * @return false if the packet is not a sender report or is from an
+     * incompatible version.
+     */
+    bool read(const uint8_t* src, size_t packetSize) {
+        if (packetSize < minSize || wire::readLE<uint32_t>(src) != magic ||
+            src[4] == 0 || src[4] > currentVersion || src[5] < minSize ||
+            src[5] > packetSize) {
+            return false;
+        }
+
+        version = src[4];
+        headerSize = src[5];
+        streamId = wire::readLE<uint32_t>(src + 8);
+        sendTime = wire::readLE<uint64_t>(src + 12);
+        timestamp = wire::readLE<uint64_t>(src + 20);
+        echoTime = wire::readLE<uint64_t>(src + 28);
+        echoDelay = wire::readLE<uint32_t>(src + 36);
+        probeTimestamp =
+            headerSize >= size ? wire::readLE<uint64_t>(src + 40) : 0;
+        probeTime = headerSize >= size ? wire::readLE<uint64_t>(src + 48) : 0;
+        return true;
+    }
+};
+
+/** Signed distance from sequence number b to a, robust to wrap-around. */
+constexpr int32_t sequenceDistance(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b);
+}
@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "DiscontinuousTransmission.hpp"
+#include "DriftEstimator.hpp"
+#include "JitterBuffer.hpp"
+#include "LossConcealer.hpp"
+#include "Resampler.hpp"
+
+//==============================================================================
+/**
+ * @class StreamPlayout
+ * @brief Turns the frames queued in a JitterBuffer into device-sized blocks,
+ * placing each frame at its timestamp.
+ *
+ * A frame whose timestamp is ahead of the playout position is preceded by
+ * the missing span, filled in by a LossConcealer. A frame overlapping audio
+ * already played is trimmed. Jumps larger than maxGap samples are treated as
+ * a new timeline.
+ *
+ * The playout delay (audio queued ahead of the output) is steered towards a
+ * target. Playback waits until the target is reached after a start or an
+ * underrun. From then on every block goes through a variable-ratio Resampler
+ * whose ratio comes from a DriftEstimator, which compensates the clock drift
+ * between sender and receiver and moves the delay smoothly to a new target.
+ * At a ratio of exactly 1 the resampler copies the audio unfiltered.
+ * A stream recorded at another rate than the device's is converted by the
+ * same resampler, its ratio scaled by the two rates.
+ *
+ * A comfort noise frame means the sender went silent and stopped sending.
+ * Until a frame of audio comes, the gaps between comfort noise frames and
+ * any time the buffer runs dry are filled with noise at the frame's level,
+ * moving the timeline on without counting gaps or underruns. The drift
+ * estimate is held meanwhile, as the delay says nothing about the clocks.
+ *
+ * Owned by the audio thread. Counters may be read from any thread.
+ */
+class StreamPlayout {
+  public:
+    /**
+     * @class Filters
+     * @brief The anti-aliasing filters for playing each standard rate above
+     * the device's, built ahead of time so that a stream changing rate only
+     * switches filters on the audio thread. One set may be shared by every
+     * playout of an engine.
+     */
+    class Filters {
+      public:
+        /** Builds the filters. Must not be called while any playout reads. */
+        void prepare(double sampleRate, double maxSourceRate) {
+            deviceRate = sampleRate;
+            rates.clear();
+            filters.clear();
+
+            for (const auto rate : standardRates) {
+                if (rate > sampleRate && rate <= maxSourceRate) {
+                    rates.push_back(rate);
+                    filters.emplace_back(cutoff * sampleRate / rate);
+                }
+            }
+        }
+
+        /**
+         * The filter for a stream at sourceRate, or nullptr when it isn't
+         * downsampled. A rate between the standard ones gets the filter of
+         * the next one up, which cuts a little lower but never aliases.
+         */
+        const Resampler::Filter* find(double sourceRate) const {
+            if (sourceRate <= deviceRate || filters.empty()) {
+                return nullptr;
+            }
+
+            for (size_t i = 0; i < rates.size(); ++i) {
+                if (rates[i] >= sourceRate) {
+                    return &filters[i];
+                }
+            }
+            return &filters.back();
+        }
+
+      private:
+        static constexpr double standardRates[] = {
+            8000.0,  11025.0, 16000.0, 22050.0, 24000.0,  32000.0,
+            44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0};
+
+        double deviceRate{48000.0};
+        std::vector<double> rates;
+        std::vector<Resampler::Filter> filters;
+    };
+
+    StreamPlayout() = default;
+
+    /**
+     * @brief Allocates the scratch space. Must not be called while the audio
+     * thread is reading.
+     * @param maxFrameSize Largest frame, in samples across all channels.
+     * @param maxGapSamples Largest gap that is concealed.
+     * @param maxChannels Largest number of output channels.
+     * @param maxBlockSize Largest expected output block.
+     * @param sampleRate Rate of the output device.
+     * @param maxSourceRate Highest stream rate to convert from, 0 for the
+     * device's rate.
+     * @param sharedFilters Filters prepared for the same rates, which must
+     * outlive the playout, or nullptr to build its own.
+     */
+    void prepare(size_t maxFrameSize, uint64_t maxGapSamples,
+                 size_t maxChannels, size_t maxBlockSize, double sampleRate,
+                 double maxSourceRate = 0.0,
+                 const Filters* sharedFilters = nullptr) {
+        frame.assign(maxFrameSize, 0.0f);
+        frameInfo = JitterBuffer::FrameInfo{1, 0};
+        frameOffset = 0;
+        pendingGap = 0;
+        maxGap = maxGapSamples;
+        hasTimestamp = false;
+
+        deviceRate = sampleRate;
+        sourceRate = sampleRate;
+        conversionRatio.store(1.0, std::memory_order_relaxed);
+
+        const auto maxConversion = std::max(1.0, maxSourceRate / sampleRate);
+        // Switching from copying to filtering reads the filter's lookahead
+        const auto maxInput =
+            static_cast<int>(std::ceil(static_cast<double>(maxBlockSize) *
+                                       maxConversion * (1.0 + maxRatio))) +
+            1 + Resampler::numTaps / 2;
+        resampler.prepare(static_cast<int>(maxChannels), maxInput, cutoff);
+        filters = sharedFilters;
+        if (filters == nullptr) {
+            ownFilters.prepare(sampleRate, maxSourceRate);
+        }
+        driftEstimator.prepare(sampleRate, maxRatio);
+        concealer.prepare(static_cast<int>(maxChannels), sampleRate);
+        comfortNoise.prepare(static_cast<int>(maxChannels));
+        isSilent = false;
+        isGapSilent = false;
+
+        resamplerInput.assign(maxChannels * static_cast<size_t>(maxInput),
+                              0.0f);
+        resamplerInputPointers.assign(maxChannels, nullptr);
+        for (size_t channel = 0; channel < maxChannels; ++channel) {
+            resamplerInputPointers[channel] =
+                resamplerInput.data() +
+                channel * static_cast<size_t>(maxInput);
+        }
+
+        isBuffering = true;
+    }
+
+    /**
+     * Forgets the current frame and timeline so the next read starts a new
+     * stream, buffering up to the target first. Realtime safe.
+     */
+    void reset() {
+        frameInfo = JitterBuffer::FrameInfo{1, 0};
+        frameOffset = 0;
+        pendingGap = 0;
+        hasTimestamp = false;
+        isBuffering = true;
+        isSilent = false;
+        isGapSilent = false;
+        playingComfortNoise.store(false, std::memory_order_relaxed);
+        resampler.reset();
+        concealer.reset();
+        currentDelay.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Sets the rate the stream was recorded at, or 0 if unknown, which plays
+     * it at the device's rate. Downsampling switches to a filter with a
+     * lower cutoff, built in prepare(). Audio thread only.
+     */
+    void setSourceRate(double newRate) {
+        sourceRate = newRate > 0.0 ? newRate : deviceRate;
+        conversionRatio.store(sourceRate / deviceRate,
+                              std::memory_order_relaxed);
+        resampler.setFilter(
+            (filters != nullptr ? *filters : ownFilters).find(sourceRate));
+        resampler.reset();
+    }
+    /** Rate of the stream as last set. Audio thread only. */
+    double getSourceRate() const { return sourceRate; }
+
+    /** Sets the playout delay to aim for, in stream samples. */
+    void setTargetDelay(uint32_t samples) { targetDelay = samples; }
+
+    /** Sets how lost audio is filled in. */
+    void setConcealmentMode(LossConcealer::Mode mode) {
+        concealer.setMode(mode);
+    }
+
+    /**
+     * @brief Fills numChannels output channels with numSamples samples.
+     *
+     * Output channels beyond those present in the stream are cleared.
+     */
+    void read(JitterBuffer& buffer, float* const* outputs, int numChannels,
+              int numSamples) {
+        const auto delay = getQueuedSamples(buffer);
+        currentDelay.store(static_cast<uint32_t>(delay),
+                           std::memory_order_relaxed);
+
+        if (isBuffering) {
+            if (delay < targetDelay) {
+                clear(outputs, numChannels, 0, numSamples);
+                return;
+            }
+
+            isBuffering = false;
+            driftEstimator.restart();
+        }
+
+        // Drift is steered in output samples, then scaled to the stream's rate
+        const auto conversion = conversionRatio.load(std::memory_order_relaxed);
+        const auto ratio =
+            conversion *
+            (isSilent ? driftEstimator.getRatio()
+                      : driftEstimator.update(
+                            static_cast<double>(delay) / conversion,
+                            targetDelay / conversion, numSamples));
+        const auto numInput = resampler.getNumInputNeeded(numSamples, ratio);
+
+        if (numInput > resampler.getMaxInputSamples() ||
+            static_cast<size_t>(numChannels) > resamplerInputPointers.size()) {
+            // Larger than prepared for: play the block unresampled
+            readFrames(buffer, outputs, numChannels, numSamples);
+            resampler.reset();
+            return;
+        }
+
+        readFrames(buffer, resamplerInputPointers.data(), numChannels,
+                   numInput);
+        resampler.process(resamplerInputPointers.data(), numInput, outputs,
+                          numChannels, numSamples, ratio);
+    }
+
+    /** Audio queued ahead of the output at the last read, in stream samples. */
+    uint32_t getCurrentDelay() const {
+        return currentDelay.load(std::memory_order_relaxed);
+    }
+    /** Input samples consumed per output sample at the last read. */
+    double getResampleRatio() const {
+        return driftEstimator.getRatio() *
+               conversionRatio.load(std::memory_order_relaxed);
+    }
+    /** Estimated clock drift between sender and receiver. */
+    double getDriftPpm() const { return driftEstimator.getDriftPpm(); }
+    uint64_t getNumRebuffers() const {
+        return numRebuffers.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumGapSamples() const {
+        return numGapSamples.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumTrimmedSamples() const {
+        return numTrimmedSamples.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumConcealmentEvents() const {
+        return concealer.getNumConcealmentEvents();
+    }
+    /** Samples of comfort noise played while the sender was silent. */
+    uint64_t getNumComfortNoiseSamples() const {
+        return numComfortNoiseSamples.load(std::memory_order_relaxed);
+    }
+    /** Whether the sender is silent and comfort noise is playing. */
+    bool isPlayingComfortNoise() const {
+        return playingComfortNoise.load(std::memory_order_relaxed);
+    }
+
+  private:
+    /** Largest deviation of the resampling ratio from 1. */
+    static constexpr double maxRatio = 0.005;
+    /** Filter cutoff relative to the Nyquist frequency of the lower rate. */
+    static constexpr double cutoff = 0.95;
+
+    std::vector<float> frame;
+    JitterBuffer::FrameInfo frameInfo;
+    uint32_t frameOffset{0};
+    uint64_t pendingGap{0};
+    uint64_t nextTimestamp{0};
+    uint64_t maxGap{0};
+    bool hasTimestamp{false};
+
+    Resampler resampler;
+    Filters ownFilters;
+    const Filters* filters{nullptr};
+    double deviceRate{48000.0};
+    double sourceRate{48000.0};
+    std::atomic<double> conversionRatio{1.0};
+    DriftEstimator driftEstimator;
+    LossConcealer concealer;
+    ComfortNoise comfortNoise;
+    bool isSilent{false};
+    bool isGapSilent{false};
+    std::vector<float> resamplerInput;
+    std::vector<float*> resamplerInputPointers;
+    uint32_t targetDelay{0};
+    bool isBuffering{true};
+
+    std::atomic<uint32_t> currentDelay{0};
+    std::atomic<uint64_t> numRebuffers{0};
+    std::atomic<uint64_t> numGapSamples{0};
+    std::atomic<uint64_t> numTrimmedSamples{0};
+    std::atomic<uint64_t> numComfortNoiseSamples{0};
+    std::atomic<bool> playingComfortNoise{false};
+
+    uint64_t getQueuedSamples(const JitterBuffer& buffer) const {
+        const auto remaining = frameOffset < frameInfo.numSamples
+                                   ? frameInfo.numSamples - frameOffset
+                                   : 0;
+        return buffer.getNumSamplesQueued() + remaining + pendingGap;
+    }
+
+    void readFrames(JitterBuffer& buffer, float* const* outputs,
+                    int numChannels, int numSamples) {
+        auto position = 0;
+
+        while (position < numSamples) {
+            const auto remaining = static_cast<uint64_t>(numSamples - position);
+
+            if (pendingGap == 0 && frameOffset >= frameInfo.numSamples) {
+                if (isSilent && buffer.getNumSamplesQueued() == 0) {
+                    // Nothing is sent during silence: the noise goes on and
+                    // so does the timeline
+                    const auto count = static_cast<int>(remaining);
+                    playComfortNoise(outputs, numChannels, position, count);
+                    nextTimestamp += remaining;
+                    position += count;
+                    continue;
+                }
+
+                if (!fetchFrame(buffer)) {
+                    clear(outputs, numChannels, position,
+                          numSamples - position);
+                    return;
+                }
+            }
+
+            if (pendingGap > 0) {
+                const auto count =
+                    static_cast<int>(std::min(pendingGap, remaining));
+                if (isGapSilent) {
+                    playComfortNoise(outputs, numChannels, position, count);
+                } else {
+                    concealer.conceal(outputs, numChannels, position, count);
+                }
+                pendingGap -= static_cast<uint64_t>(count);
+                position += count;
+                continue;
+            }
+
+            const auto count = static_cast<int>(std::min<uint64_t>(
+                frameInfo.numSamples - frameOffset, remaining));
+
+            for (auto channel = 0; channel < numChannels; ++channel) {
+                auto* dest = outputs[channel] + position;
+
+                if (static_cast<uint32_t>(channel) < frameInfo.numChannels) {
+                    const auto* src = frame.data() +
+                                      channel * frameInfo.numSamples +
+                                      frameOffset;
+                    std::copy(src, src + count, dest);
+                } else {
+                    std::fill(dest, dest + count, 0.0f);
+                }
+            }
+
+            if (concealer.isConcealing()) {
+                concealer.endConcealment(outputs, numChannels, position,
+                                         count);
+            }
+            concealer.addHistory(outputs, numChannels, position, count);
+
+            frameOffset += static_cast<uint32_t>(count);
+            position += count;
+        }
+    }
+
+    bool fetchFrame(JitterBuffer& buffer) {
+        if (!buffer.pop(frame.data(), frame.size(), &frameInfo)) {
+            // A repeated frame fills in but doesn't move the timeline, and
+            // playback still rebuilds its delay afterwards
+            frameOffset = 0;
+            isBuffering = true;
+            numRebuffers.fetch_add(1, std::memory_order_relaxed);
+            return frameInfo.numSamples > 0;
+        }
+
+        frameOffset = 0;
+
+        // A gap after comfort noise is the sender being silent, not loss
+        isGapSilent = isSilent;
+        if (isSilent && !frameInfo.isComfortNoise) {
+            driftEstimator.restart();
+        }
+        isSilent = frameInfo.isComfortNoise;
+        playingComfortNoise.store(isSilent, std::memory_order_relaxed);
+        if (isSilent) {
+            comfortNoise.setLevels(frame.data(),
+                                   static_cast<int>(frameInfo.numChannels),
+                                   static_cast<int>(frameInfo.numSamples));
+        }
+
+        const auto frameEnd = frameInfo.timestamp + frameInfo.numSamples;
+        const auto delta =
+            static_cast<int64_t>(frameInfo.timestamp - nextTimestamp);
+        const auto magnitude = static_cast<uint64_t>(std::llabs(delta));
+
+        if (!hasTimestamp || magnitude > maxGap) {
+            nextTimestamp = frameEnd;
+            hasTimestamp = true;
+        } else if (delta > 0) {
+            pendingGap = magnitude;
+            nextTimestamp = frameEnd;
+            if (!isGapSilent) {
+                numGapSamples.fetch_add(magnitude, std::memory_order_relaxed);
+            }
+        } else if (delta < 0) {
+            const auto trim =
+                std::min<uint64_t>(magnitude, frameInfo.numSamples);
+            frameOffset = static_cast<uint32_t>(trim);
+            nextTimestamp = std::max(nextTimestamp, frameEnd);
+            numTrimmedSamples.fetch_add(trim, std::memory_order_relaxed);
+        } else {
+            nextTimestamp = frameEnd;
+        }
+
+        return true;
+    }
+
+    void playComfortNoise(float* const* outputs, int numChannels, int start,
+                          int count) {
+        const auto numNoisy =
+            std::min(numChannels, static_cast<int>(frameInfo.numChannels));
+        comfortNoise.generate(outputs, numNoisy, start, count);
+        clear(outputs + numNoisy, numChannels - numNoisy, start, count);
+        concealer.addHistory(outputs, numChannels, start, count);
+        numComfortNoiseSamples.fetch_add(static_cast<uint64_t>(count),
+                                         std::memory_order_relaxed);
+    }
+
+    static void clear(float* const* outputs, int numChannels, int start,
+                      int count) {
+        for (auto channel = 0; channel < numChannels; ++channel) {
+            std::fill(outputs[channel] + start,
+                      outputs[channel] + start + count, 0.0f);
+        }
+    }
+};
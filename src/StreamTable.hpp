@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "JitterBuffer.hpp"
+
+//==============================================================================
+/**
+ * @class StreamTable
+ * @brief Fixed set of slots, one per incoming stream, each with its own
+ * JitterBuffer.
+ *
+ * The network thread looks a stream up by its streamId and claims a free
+ * slot for a new one. When a stream goes quiet, the network thread retires
+ * its slot. The audio thread then resets its side of the slot and releases
+ * it, and only after that can the network thread claim it again. Neither
+ * thread ever waits for the other, and a slot's JitterBuffer keeps exactly
+ * one producer and one consumer throughout.
+ *
+ * Slots are numbered from 0, so either thread can keep its own per-stream
+ * state in arrays of the same size.
+ *
+ * Each slot also holds the format its stream announces, written by the
+ * network thread and read by the audio thread to decide whether the stream
+ * needs converting to the device's rate and channels.
+ *
+ * Every packet of a stream without a slot tries to claim one. The last
+ * maxRejectedIds streamIds turned away are remembered, so each such stream
+ * is counted once rather than once per packet.
+ */
+class StreamTable {
+  public:
+    static constexpr size_t maxRejectedIds = 32;
+
+    enum class State : uint8_t {
+        /** Unused, the network thread may claim it. */
+        free,
+        /** Receiving a stream, read by the audio thread. */
+        active,
+        /** Ended by the network thread, to be released by the audio thread. */
+        retiring
+    };
+
+    StreamTable() = default;
+
+    /**
+     * @brief Allocates numSlots slots and their jitter buffers, all free.
+     * Must not be called while either side is active.
+     */
+    void prepare(size_t numSlots, size_t capacityInSamples,
+                 size_t maxFrameSize) {
+        if (numSlots != size) {
+            slots = std::make_unique<Slot[]>(numSlots);
+            size = numSlots;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].state.store(State::free, std::memory_order_relaxed);
+            slots[i].streamId.store(0, std::memory_order_relaxed);
+            slots[i].sampleRate.store(0, std::memory_order_relaxed);
+            slots[i].numChannels.store(0, std::memory_order_relaxed);
+            slots[i].buffer.prepare(capacityInSamples, maxFrameSize);
+        }
+        numRejectedIds = 0;
+        nextRejectedId = 0;
+    }
+
+    size_t getNumSlots() const { return size; }
+
+    State getState(size_t slot) const {
+        return slots[slot].state.load(std::memory_order_acquire);
+    }
+    uint32_t getStreamId(size_t slot) const {
+        return slots[slot].streamId.load(std::memory_order_relaxed);
+    }
+    /** Rate announced by the slot's stream in Hz, or 0 if unknown. */
+    uint32_t getSampleRate(size_t slot) const {
+        return slots[slot].sampleRate.load(std::memory_order_relaxed);
+    }
+    /** Channels in the slot's stream, as last announced. */
+    uint32_t getNumChannels(size_t slot) const {
+        return slots[slot].numChannels.load(std::memory_order_relaxed);
+    }
+    JitterBuffer& getBuffer(size_t slot) { return slots[slot].buffer; }
+    const JitterBuffer& getBuffer(size_t slot) const {
+        return slots[slot].buffer;
+    }
+
+    /** Active slots. */
+    size_t getNumActive() const {
+        size_t count = 0;
+        for (size_t i = 0; i < size; ++i) {
+            count += getState(i) == State::active ? 1 : 0;
+        }
+        return count;
+    }
+
+    /** Streams that found no free slot, each counted once. */
+    uint64_t getNumRejected() const {
+        return numRejected.load(std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    /** The active slot receiving streamId, or -1. Network thread only. */
+    int find(uint32_t streamId) const {
+        for (size_t i = 0; i < size; ++i) {
+            if (slots[i].state.load(std::memory_order_relaxed) ==
+                    State::active &&
+                slots[i].streamId.load(std::memory_order_relaxed) ==
+                    streamId) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Activates a free slot for streamId, announced at sampleRate
+     * with numChannels channels. Network thread only.
+     * @return The slot, or -1 if none is free.
+     */
+    int claim(uint32_t streamId, uint32_t sampleRate = 0,
+              uint32_t numChannels = 0) {
+        for (size_t i = 0; i < size; ++i) {
+            auto& slot = slots[i];
+            if (slot.state.load(std::memory_order_acquire) == State::free) {
+                slot.streamId.store(streamId, std::memory_order_relaxed);
+                slot.sampleRate.store(sampleRate, std::memory_order_relaxed);
+                slot.numChannels.store(numChannels,
+                                       std::memory_order_relaxed);
+                // Publishes the ID, format and released buffer together
+                slot.state.store(State::active, std::memory_order_release);
+
+                // Turned away again later, it counts again
+                if (const auto index = findRejected(streamId); index >= 0) {
+                    rejectedIds[static_cast<size_t>(index)] =
+                        rejectedIds[--numRejectedIds];
+                }
+                return static_cast<int>(i);
+            }
+        }
+
+        if (findRejected(streamId) < 0) {
+            if (numRejectedIds < maxRejectedIds) {
+                rejectedIds[numRejectedIds++] = streamId;
+            } else {
+                rejectedIds[nextRejectedId] = streamId;
+                nextRejectedId = (nextRejectedId + 1) % maxRejectedIds;
+            }
+            numRejected.fetch_add(1, std::memory_order_relaxed);
+        }
+        return -1;
+    }
+
+    /** Updates the channels of an active slot's stream. Network thread only. */
+    void setNumChannels(size_t slot, uint32_t numChannels) {
+        slots[slot].numChannels.store(numChannels, std::memory_order_relaxed);
+    }
+
+    /** Ends an active slot's stream. Network thread only. */
+    void retire(size_t slot) {
+        slots[slot].state.store(State::retiring, std::memory_order_release);
+    }
+
+    /**
+     * Empties a retiring slot's buffer and frees the slot. Audio thread
+     * only, after resetting its own state for the slot.
+     */
+    void release(size_t slot) {
+        slots[slot].buffer.clear();
+        slots[slot].state.store(State::free, std::memory_order_release);
+    }
+
+  private:
+    struct Slot {
+        std::atomic<State> state{State::free};
+        std::atomic<uint32_t> streamId{0};
+        std::atomic<uint32_t> sampleRate{0};
+        std::atomic<uint32_t> numChannels{0};
+        JitterBuffer buffer;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t size{0};
+    std::atomic<uint64_t> numRejected{0};
+
+    // Network thread
+    std::array<uint32_t, maxRejectedIds> rejectedIds{};
+    size_t numRejectedIds{0};
+    size_t nextRejectedId{0};
+
+    int findRejected(uint32_t streamId) const {
+        for (size_t i = 0; i < numRejectedIds; ++i) {
+            if (rejectedIds[i] == streamId) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+};
@@ -0,0 +1,725 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+// Keeps <windows.h> from defining min() and max() over std::min and std::max
+// in every header parsed after this one
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define AUDIO_STREAM_UDP_RECEIVE_BUFFER_SIZE (1 << 20)
+#define AUDIO_STREAM_MULTICAST_TTL 1
+
+//==============================================================================
+/** Thin portability layer over BSD sockets and Winsock. */
+namespace udp {
+#if defined(_WIN32)
+using Handle = SOCKET;
+inline const Handle invalidHandle = INVALID_SOCKET;
+
+inline bool initialise() {
+    static const bool initialised = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return initialised;
+}
+
+inline void closeHandle(Handle handle) { closesocket(handle); }
+
+inline bool setNonBlocking(Handle handle) {
+    u_long enabled = 1;
+    return ioctlsocket(handle, FIONBIO, &enabled) == 0;
+}
+
+inline int pollHandle(pollfd* fds, int timeoutMs) {
+    return WSAPoll(fds, 1, timeoutMs);
+}
+#else
+using Handle = int;
+inline const Handle invalidHandle = -1;
+
+inline bool initialise() { return true; }
+
+inline void closeHandle(Handle handle) { ::close(handle); }
+
+inline bool setNonBlocking(Handle handle) {
+    const auto flags = fcntl(handle, F_GETFL, 0);
+    return flags >= 0 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+inline int pollHandle(pollfd* fds, int timeoutMs) {
+    return ::poll(fds, 1, timeoutMs);
+}
+#endif
+
+/** The address a datagram came from, to answer it. */
+struct Address {
+    sockaddr_storage storage{};
+    socklen_t size{0};
+
+    bool operator==(const Address& other) const {
+        return size == other.size &&
+               std::memcmp(&storage, &other.storage, size) == 0;
+    }
+};
+}  // namespace udp
+
+//==============================================================================
+/**
+ * @class UdpSender
+ * @brief Sends datagrams to a list of destinations without allocating per
+ * packet.
+ *
+ * Every packet goes to every destination from the same buffer, so the cost
+ * of producing it doesn't grow with the number of receivers. Destinations
+ * may be IPv4 or IPv6 unicast addresses or multicast groups.
+ *
+ * Packets can be sent straight away with send(), or queued into
+ * preallocated slots and sent together with flush(). On Linux a flush is a
+ * single sendmmsg() call per address family, elsewhere it is one sendto()
+ * per packet and destination.
+ *
+ * Whatever the destinations send back to the sending sockets, such as
+ * NACKs, can be read with receive() and answered with sendTo().
+ *
+ * Resolving a destination may block. prepare(), connect(), addDestination()
+ * and close() must not be called while another thread sends.
+ */
+class UdpSender {
+  public:
+    static constexpr size_t maxBatchSize = 16;
+    static constexpr size_t maxDestinations = 16;
+
+    UdpSender() = default;
+    ~UdpSender() { close(); }
+
+    UdpSender(const UdpSender&) = delete;
+    UdpSender& operator=(const UdpSender&) = delete;
+
+    /** Allocates the queue for packets of up to maxPacketSize bytes. */
+    void prepare(size_t maxPacketSize) {
+        slotSize = maxPacketSize;
+        slots.assign(maxBatchSize * slotSize, 0);
+        sizes.fill(0);
+        numQueued = 0;
+        receiveBuffer.assign(maxPacketSize, 0);
+    }
+
+    /** Replaces every destination with the given host and port. */
+    bool connect(const std::string& host, int port) {
+        close();
+        return addDestination(host, port);
+    }
+
+    /**
+     * Adds a destination that every packet is sent to. Multicast groups
+     * are sent to with a TTL of AUDIO_STREAM_MULTICAST_TTL.
+     */
+    bool addDestination(const std::string& host, int port) {
+        if (!udp::initialise() || port <= 0 || port > 65535 ||
+            numDestinations == maxDestinations) {
+            return false;
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+        const auto service = std::to_string(port);
+        if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+            return false;
+        }
+
+        auto added = false;
+        for (auto* info = result; info != nullptr && !added;
+             info = info->ai_next) {
+            const auto familyIndex = info->ai_family == AF_INET6 ? 1 : 0;
+            if (!openSocket(familyIndex, info->ai_family)) {
+                continue;
+            }
+
+            auto& destination = destinations[numDestinations];
+            std::memcpy(&destination.address, info->ai_addr,
+                        info->ai_addrlen);
+            destination.addressSize = static_cast<socklen_t>(info->ai_addrlen);
+            destination.familyIndex = familyIndex;
+            destination.name = host + ":" + service;
+            destination.numSent.store(0, std::memory_order_relaxed);
+            destination.numErrors.store(0, std::memory_order_relaxed);
+            destination.numBytesSent.store(0, std::memory_order_relaxed);
+
+            if (isMulticast(destination.address)) {
+                setMulticastTtl(familyIndex);
+            }
+
+            ++numDestinations;
+            added = true;
+        }
+
+        freeaddrinfo(result);
+        return added;
+    }
+
+    /** Removes every destination and closes the sockets. */
+    void close() {
+        for (auto& handle : handles) {
+            if (handle != udp::invalidHandle) {
+                udp::closeHandle(handle);
+                handle = udp::invalidHandle;
+            }
+        }
+        numDestinations = 0;
+        numQueued = 0;
+    }
+
+    bool isConnected() const { return numDestinations > 0; }
+    size_t getNumDestinations() const { return numDestinations; }
+    /** The destination as it was added, in host:port form. */
+    const std::string& getDestinationName(size_t index) const {
+        return destinations[index].name;
+    }
+
+    /** Sends a packet to every destination right away. */
+    bool send(const uint8_t* data, size_t size) {
+        auto succeeded = numDestinations > 0;
+
+        for (size_t i = 0; i < numDestinations; ++i) {
+            auto& destination = destinations[i];
+            const auto sent = sendto(
+                handles[destination.familyIndex],
+                reinterpret_cast<const char*>(data), static_cast<int>(size),
+                0, reinterpret_cast<const sockaddr*>(&destination.address),
+                destination.addressSize);
+
+            if (sent >= 0) {
+                countSent(destination, size);
+            } else {
+                destination.numErrors.fetch_add(1, std::memory_order_relaxed);
+                succeeded = false;
+            }
+        }
+
+        return succeeded;
+    }
+
+    /** Sends a packet to one address only, e.g. the sender of a NACK. */
+    bool sendTo(const uint8_t* data, size_t size,
+                const udp::Address& address) {
+        const auto familyIndex = address.storage.ss_family == AF_INET6 ? 1
+                                                                       : 0;
+        return handles[familyIndex] != udp::invalidHandle &&
+               sendto(handles[familyIndex],
+                      reinterpret_cast<const char*>(data),
+                      static_cast<int>(size), 0,
+                      reinterpret_cast<const sockaddr*>(&address.storage),
+                      address.size) >= 0;
+    }
+
+    /**
+     * @brief Calls handler(data, size, source) for each datagram waiting on
+     * the sending sockets, without blocking.
+     * @return The number of datagrams handled.
+     */
+    template <typename Handler>
+    int receive(Handler&& handler) {
+        auto numReceived = 0;
+
+        for (auto handle : handles) {
+            if (handle == udp::invalidHandle || receiveBuffer.empty()) {
+                continue;
+            }
+
+            for (size_t i = 0; i < maxBatchSize; ++i) {
+                pollfd fd{};
+                fd.fd = handle;
+                fd.events = POLLIN;
+                if (udp::pollHandle(&fd, 0) <= 0 ||
+                    (fd.revents & POLLIN) == 0) {
+                    break;
+                }
+
+                udp::Address source;
+                source.size = sizeof(source.storage);
+                const auto received = recvfrom(
+                    handle, reinterpret_cast<char*>(receiveBuffer.data()),
+                    static_cast<int>(receiveBuffer.size()), 0,
+                    reinterpret_cast<sockaddr*>(&source.storage),
+                    &source.size);
+                if (received < 0) {
+                    break;
+                }
+
+                handler(static_cast<const uint8_t*>(receiveBuffer.data()),
+                        static_cast<size_t>(received), source);
+                ++numReceived;
+            }
+        }
+
+        return numReceived;
+    }
+
+    /**
+     * Copies a packet into the queue, flushing first if the queue is full.
+     * Packets larger than prepare() allowed for are sent right away.
+     */
+    bool queue(const uint8_t* data, size_t size) {
+        if (size > slotSize) {
+            return send(data, size);
+        }
+
+        if (numQueued == maxBatchSize) {
+            flush();
+        }
+
+        std::memcpy(slots.data() + numQueued * slotSize, data, size);
+        sizes[numQueued++] = size;
+        return true;
+    }
+
+    /** Sends every queued packet to every destination. */
+    void flush() {
+        if (numQueued == 0) {
+            return;
+        }
+
+#if defined(__linux__)
+        mmsghdr messages[maxBatchSize * maxDestinations];
+        uint8_t owners[maxBatchSize * maxDestinations];
+        iovec vectors[maxBatchSize];
+
+        for (size_t i = 0; i < numQueued; ++i) {
+            vectors[i] = {slots.data() + i * slotSize, sizes[i]};
+        }
+
+        for (auto familyIndex = 0; familyIndex < 2; ++familyIndex) {
+            // Packet by packet, so each destination gets them in order
+            size_t numMessages = 0;
+            for (size_t i = 0; i < numQueued; ++i) {
+                for (size_t d = 0; d < numDestinations; ++d) {
+                    auto& destination = destinations[d];
+                    if (destination.familyIndex != familyIndex) {
+                        continue;
+                    }
+
+                    auto& message = messages[numMessages];
+                    message = {};
+                    message.msg_hdr.msg_name = &destination.address;
+                    message.msg_hdr.msg_namelen = destination.addressSize;
+                    message.msg_hdr.msg_iov = &vectors[i];
+                    message.msg_hdr.msg_iovlen = 1;
+                    owners[numMessages++] = static_cast<uint8_t>(d);
+                }
+            }
+
+            size_t first = 0;
+            while (first < numMessages) {
+                const auto sent = sendmmsg(
+                    handles[familyIndex], messages + first,
+                    static_cast<unsigned>(numMessages - first), 0);
+                if (sent <= 0) {
+                    // Skip the message that failed and carry on
+                    destinations[owners[first]].numErrors.fetch_add(
+                        1, std::memory_order_relaxed);
+                    ++first;
+                    continue;
+                }
+
+                for (auto i = 0; i < sent; ++i, ++first) {
+                    countSent(destinations[owners[first]],
+                              messages[first].msg_len);
+                }
+            }
+        }
+#else
+        for (size_t i = 0; i < numQueued; ++i) {
+            send(slots.data() + i * slotSize, sizes[i]);
+        }
+#endif
+        numQueued = 0;
+    }
+
+    /** Packets sent, summed over every destination. */
+    uint64_t getNumSent() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < numDestinations; ++i) {
+            total += getNumSent(i);
+        }
+        return total;
+    }
+    /** Packets that failed to send, summed over every destination. */
+    uint64_t getNumErrors() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < numDestinations; ++i) {
+            total += getNumErrors(i);
+        }
+        return total;
+    }
+
+    uint64_t getNumSent(size_t destination) const {
+        return destinations[destination].numSent.load(
+            std::memory_order_relaxed);
+    }
+    uint64_t getNumErrors(size_t destination) const {
+        return destinations[destination].numErrors.load(
+            std::memory_order_relaxed);
+    }
+    uint64_t getNumBytesSent(size_t destination) const {
+        return destinations[destination].numBytesSent.load(
+            std::memory_order_relaxed);
+    }
+
+  private:
+    struct Destination {
+        sockaddr_storage address{};
+        socklen_t addressSize{0};
+        /** 0 for IPv4, 1 for IPv6. */
+        int familyIndex{0};
+        std::string name;
+
+        std::atomic<uint64_t> numSent{0};
+        std::atomic<uint64_t> numErrors{0};
+        std::atomic<uint64_t> numBytesSent{0};
+    };
+
+    /** One socket per address family, opened on demand. */
+    udp::Handle handles[2]{udp::invalidHandle, udp::invalidHandle};
+    std::array<Destination, maxDestinations> destinations;
+    size_t numDestinations{0};
+
+    std::vector<uint8_t> slots;
+    std::array<size_t, maxBatchSize> sizes{};
+    size_t slotSize{0};
+    size_t numQueued{0};
+    std::vector<uint8_t> receiveBuffer;
+
+    bool openSocket(int familyIndex, int family) {
+        if (handles[familyIndex] == udp::invalidHandle) {
+            handles[familyIndex] = socket(family, SOCK_DGRAM, 0);
+        }
+        return handles[familyIndex] != udp::invalidHandle;
+    }
+
+    static bool isMulticast(const sockaddr_storage& address) {
+        if (address.ss_family == AF_INET6) {
+            return IN6_IS_ADDR_MULTICAST(
+                &reinterpret_cast<const sockaddr_in6*>(&address)->sin6_addr);
+        }
+
+        const auto ip = ntohl(
+            reinterpret_cast<const sockaddr_in*>(&address)->sin_addr.s_addr);
+        return (ip & 0xf0000000u) == 0xe0000000u;
+    }
+
+    void setMulticastTtl(int familyIndex) {
+        const int ttl = AUDIO_STREAM_MULTICAST_TTL;
+        if (familyIndex == 1) {
+            setsockopt(handles[familyIndex], IPPROTO_IPV6,
+                       IPV6_MULTICAST_HOPS,
+                       reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+        } else {
+            setsockopt(handles[familyIndex], IPPROTO_IP, IP_MULTICAST_TTL,
+                       reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+        }
+    }
+
+    static void countSent(Destination& destination, size_t size) {
+        destination.numSent.fetch_add(1, std::memory_order_relaxed);
+        destination.numBytesSent.fetch_add(size, std::memory_order_relaxed);
+    }
+};
+
+//==============================================================================
+/**
+ * @class UdpReceiver
+ * @brief Receives datagrams into preallocated buffers.
+ *
+ * receive() drains up to maxBatchSize waiting datagrams without blocking. On
+ * Linux that is a single recvmmsg() call, elsewhere one recvfrom() per
+ * datagram. Datagrams can be answered from the bound port with sendTo().
+ */
+class UdpReceiver {
+  public:
+    static constexpr size_t maxBatchSize = 16;
+
+    UdpReceiver() = default;
+    ~UdpReceiver() { close(); }
+
+    UdpReceiver(const UdpReceiver&) = delete;
+    UdpReceiver& operator=(const UdpReceiver&) = delete;
+
+    /**
+     * Binds to the given local port, or to any free port if it is 0, for
+     * datagrams of up to maxPacketSize bytes. With a multicastGroup, the
+     * group is joined on the default interface as well.
+     */
+    bool bind(int port, size_t maxPacketSize,
+              const std::string& multicastGroup = {}) {
+        close();
+
+        if (!udp::initialise() || port < 0 || port > 65535) {
+            return false;
+        }
+
+        if (multicastGroup.empty()) {
+            // A dual-stack socket takes IPv4 and IPv6 senders alike
+            if (!open(AF_INET6, port, false) && !open(AF_INET, port, false)) {
+                return false;
+            }
+        } else {
+            sockaddr_storage group{};
+            if (!resolve(multicastGroup, group) ||
+                !open(group.ss_family, port, true) || !join(group)) {
+                close();
+                return false;
+            }
+        }
+
+        if (!udp::setNonBlocking(handle)) {
+            close();
+            return false;
+        }
+
+        slotSize = maxPacketSize;
+        slots.assign(maxBatchSize * slotSize, 0);
+        return true;
+    }
+
+    void close() {
+        if (handle != udp::invalidHandle) {
+            udp::closeHandle(handle);
+            handle = udp::invalidHandle;
+        }
+    }
+
+    bool isBound() const { return handle != udp::invalidHandle; }
+
+    /** The port actually bound, useful after binding to port 0. */
+    int getLocalPort() const {
+        sockaddr_storage address{};
+        socklen_t size = sizeof(address);
+        if (handle == udp::invalidHandle ||
+            getsockname(handle, reinterpret_cast<sockaddr*>(&address),
+                        &size) != 0) {
+            return -1;
+        }
+
+        if (address.ss_family == AF_INET6) {
+            return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+        }
+        return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+    }
+
+    /**
+     * Waits for a datagram to arrive. Returns 1 when one is waiting, 0 on
+     * timeout and -1 on error.
+     */
+    int waitUntilReady(int timeoutMs) {
+        if (handle == udp::invalidHandle) {
+            return -1;
+        }
+
+        pollfd fd{};
+        fd.fd = handle;
+        fd.events = POLLIN;
+
+        const auto result = udp::pollHandle(&fd, timeoutMs);
+        if (result < 0) {
+            return -1;
+        }
+        return result > 0 && (fd.revents & POLLIN) != 0 ? 1 : 0;
+    }
+
+    /**
+     * @brief Calls handler(data, size) for each waiting datagram, or
+     * handler(data, size, source) if the handler takes the source address.
+     * @return The number of datagrams handled, or -1 on error.
+     */
+    template <typename Handler>
+    int receive(Handler&& handler) {
+        if (handle == udp::invalidHandle) {
+            return -1;
+        }
+
+#if defined(__linux__)
+        mmsghdr messages[maxBatchSize];
+        iovec vectors[maxBatchSize];
+
+        for (size_t i = 0; i < maxBatchSize; ++i) {
+            vectors[i] = {slots.data() + i * slotSize, slotSize};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_name = &sources[i].storage;
+            messages[i].msg_hdr.msg_namelen = sizeof(sources[i].storage);
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const auto received =
+            recvmmsg(handle, messages, maxBatchSize, MSG_DONTWAIT, nullptr);
+        if (received < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+
+        for (auto i = 0; i < received; ++i) {
+            const auto index = static_cast<size_t>(i);
+            sources[index].size = messages[i].msg_hdr.msg_namelen;
+            dispatch(handler, slots.data() + index * slotSize,
+                     static_cast<size_t>(messages[i].msg_len),
+                     sources[index]);
+        }
+        return received;
+#else
+        auto numReceived = 0;
+
+        for (size_t i = 0; i < maxBatchSize; ++i) {
+            auto& source = sources[0];
+            source.size = sizeof(source.storage);
+            const auto received = recvfrom(
+                handle, reinterpret_cast<char*>(slots.data()),
+                static_cast<int>(slotSize), 0,
+                reinterpret_cast<sockaddr*>(&source.storage), &source.size);
+            if (received < 0) {
+                break;
+            }
+
+            dispatch(handler, slots.data(), static_cast<size_t>(received),
+                     source);
+            ++numReceived;
+        }
+        return numReceived;
+#endif
+    }
+
+    /** Sends a datagram from the bound port, e.g. an answer to source. */
+    bool sendTo(const uint8_t* data, size_t size,
+                const udp::Address& address) {
+        return handle != udp::invalidHandle &&
+               sendto(handle, reinterpret_cast<const char*>(data),
+                      static_cast<int>(size), 0,
+                      reinterpret_cast<const sockaddr*>(&address.storage),
+                      address.size) >= 0;
+    }
+
+  private:
+    udp::Handle handle{udp::invalidHandle};
+    std::vector<uint8_t> slots;
+    size_t slotSize{0};
+    std::array<udp::Address, maxBatchSize> sources{};
+
+    template <typename Handler>
+    static void dispatch(Handler& handler, const uint8_t* data,
+                         size_t size, const udp::Address& source) {
+        if constexpr (std::is_invocable_v<Handler&, const uint8_t*, size_t,
+                                          const udp::Address&>) {
+            handler(data, size, source);
+        } else {
+            handler(data, size);
+        }
+    }
+
+    bool open(int family, int port, bool shareAddress) {
+        handle = socket(family, SOCK_DGRAM, 0);
+        if (handle == udp::invalidHandle) {
+            return false;
+        }
+
+        const int enabled = 1;
+        const int disabled = 0;
+        const int bufferSize = AUDIO_STREAM_UDP_RECEIVE_BUFFER_SIZE;
+        setsockopt(handle, SOL_SOCKET, SO_RCVBUF,
+                   reinterpret_cast<const char*>(&bufferSize),
+                   sizeof(bufferSize));
+
+        if (shareAddress) {
+            // Several receivers on one machine can join the same group
+            setsockopt(handle, SOL_SOCKET, SO_REUSEADDR,
+                       reinterpret_cast<const char*>(&enabled),
+                       sizeof(enabled));
+        }
+
+        sockaddr_storage address{};
+        socklen_t addressSize = 0;
+
+        if (family == AF_INET6) {
+            setsockopt(handle, IPPROTO_IPV6, IPV6_V6ONLY,
+                       reinterpret_cast<const char*>(&disabled),
+                       sizeof(disabled));
+
+            auto* address6 = reinterpret_cast<sockaddr_in6*>(&address);
+            address6->sin6_family = AF_INET6;
+            address6->sin6_addr = in6addr_any;
+            address6->sin6_port = htons(static_cast<uint16_t>(port));
+            addressSize = sizeof(sockaddr_in6);
+        } else {
+            auto* address4 = reinterpret_cast<sockaddr_in*>(&address);
+            address4->sin_family = AF_INET;
+            address4->sin_addr.s_addr = htonl(INADDR_ANY);
+            address4->sin_port = htons(static_cast<uint16_t>(port));
+            addressSize = sizeof(sockaddr_in);
+        }
+
+        if (::bind(handle, reinterpret_cast<const sockaddr*>(&address),
+                   addressSize) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    static bool resolve(const std::string& host, sockaddr_storage& address) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) {
+            return false;
+        }
+
+        std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+        freeaddrinfo(result);
+        return true;
+    }
+
+    bool join(const sockaddr_storage& group) {
+        if (group.ss_family == AF_INET6) {
+            ipv6_mreq request{};
+            request.ipv6mr_multiaddr =
+                reinterpret_cast<const sockaddr_in6*>(&group)->sin6_addr;
+            return setsockopt(handle, IPPROTO_IPV6, IPV6_JOIN_GROUP,
+                              reinterpret_cast<const char*>(&request),
+                              sizeof(request)) == 0;
+        }
+
+        ip_mreq request{};
+        request.imr_multiaddr =
+            reinterpret_cast<const sockaddr_in*>(&group)->sin_addr;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        return setsockopt(handle, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                          reinterpret_cast<const char*>(&request),
+                          sizeof(request)) == 0;
+    }
+};
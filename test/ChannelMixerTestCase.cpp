@@ -0,0 +1,41 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "ChannelMixer.hpp"
+
+namespace {
+/** Mixes one sample per input channel, each its channel number plus 1. */
+std::vector<float> mix(int numInputs, int numOutputs) {
+    std::vector<float> inputs(static_cast<size_t>(numInputs));
+    std::vector<float> outputs(static_cast<size_t>(numOutputs), -1.0f);
+    std::vector<const float*> inputPointers;
+    std::vector<float*> outputPointers;
+    for (auto i = 0; i < numInputs; ++i) {
+        inputs[static_cast<size_t>(i)] = static_cast<float>(i + 1);
+        inputPointers.push_back(&inputs[static_cast<size_t>(i)]);
+    }
+    for (auto& output : outputs) {
+        outputPointers.push_back(&output);
+    }
+
+    ChannelMixer::process(inputPointers.data(), numInputs,
+                          outputPointers.data(), numOutputs, 1);
+    return outputs;
+}
+}  // namespace
+
+TEST_CASE("ChannelMixer plays mono from both sides") {
+    CHECK(mix(1, 2) == std::vector<float>{1.0f, 1.0f});
+    CHECK(mix(1, 4) == std::vector<float>{1.0f, 1.0f, 0.0f, 0.0f});
+}
+
+TEST_CASE("ChannelMixer folds extra channels down at equal level") {
+    CHECK(mix(2, 1) == std::vector<float>{1.5f});
+    CHECK(mix(4, 2) == std::vector<float>{2.0f, 3.0f});
+    CHECK(mix(3, 2) == std::vector<float>{2.0f, 2.0f});
+}
+
+TEST_CASE("ChannelMixer leaves the extra outputs of an up-mix silent") {
+    CHECK(mix(2, 4) == std::vector<float>{1.0f, 2.0f, 0.0f, 0.0f});
+    CHECK(mix(2, 2) == std::vector<float>{1.0f, 2.0f});
+}
@@ -0,0 +1,191 @@
+#include <catch2/catch.hpp>
+
+#include "CommandLineOptions.hpp"
+
+TEST_CASE("CommandLineOptions parses a sender") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--send", "192.168.1.20:9000", "--channels=4",
+                           "--block-size", "128", "--device", "USB Audio",
+                           "--format", "int16", "--compress"},
+                          error));
+    CHECK(error.empty());
+    CHECK(options.mode == CommandLineOptions::Mode::send);
+    REQUIRE(options.destinations.size() == 1);
+    CHECK(options.destinations[0].host == "192.168.1.20");
+    CHECK(options.destinations[0].port == 9000);
+    CHECK(options.numChannels == 4);
+    CHECK(options.blockSize == 128);
+    CHECK(options.deviceName == "USB Audio");
+    CHECK(options.sampleFormat == SampleFormat::int16);
+    CHECK(options.compress);
+    CHECK_FALSE(options.osc);
+    CHECK_FALSE(options.retransmit);
+}
+
+TEST_CASE("CommandLineOptions parses a receiver") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--recv=9000", "--buffer-ms", "80",
+                           "--sample-rate", "48000"},
+                          error));
+    CHECK(options.mode == CommandLineOptions::Mode::receive);
+    CHECK(options.port == 9000);
+    CHECK(options.bufferMs == 80);
+    CHECK(options.sampleRate == 48000.0);
+    CHECK(options.numChannels == 2);
+}
+
+TEST_CASE("CommandLineOptions enables retransmission") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--send", "192.168.1.20:9000", "--nack"}, error));
+    CHECK(options.retransmit);
+}
+
+TEST_CASE("CommandLineOptions enables discontinuous transmission") {
+    CommandLineOptions options;
+    std::string error;
+
+    CHECK_FALSE(options.dtx);
+    REQUIRE(options.parse({"--send", "192.168.1.20:9000", "--dtx"}, error));
+    CHECK(options.dtx);
+}
+
+TEST_CASE("CommandLineOptions parses the FEC group") {
+    CommandLineOptions options;
+    std::string error;
+
+    CHECK(options.fecNumParity == 0);
+    REQUIRE(options.parse({"--send", "192.168.1.20:9000", "--fec", "8:2"},
+                          error));
+    CHECK(options.fecNumData == 8);
+    CHECK(options.fecNumParity == 2);
+
+    for (const auto* value : {"8", "0:1", "33:1", "8:5", "8:x"}) {
+        CommandLineOptions invalid;
+        CHECK_FALSE(invalid.parse(
+            {"--send", "192.168.1.20:9000", std::string("--fec=") + value},
+            error));
+        CHECK_FALSE(error.empty());
+        error.clear();
+    }
+}
+
+TEST_CASE("CommandLineOptions turns latency measurement on at either end") {
+    std::string error;
+
+    CommandLineOptions sender;
+    CHECK_FALSE(sender.measureLatency);
+    REQUIRE(sender.parse({"--send", "127.0.0.1:9000", "--measure-latency"},
+                         error));
+    CHECK(sender.measureLatency);
+
+    CommandLineOptions receiver;
+    REQUIRE(receiver.parse({"--measure-latency", "--recv", "9000"}, error));
+    CHECK(receiver.measureLatency);
+    CHECK(receiver.mode == CommandLineOptions::Mode::receive);
+}
+
+TEST_CASE("CommandLineOptions accepts bracketed IPv6 hosts") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--send", "[::1]:5000"}, error));
+    REQUIRE(options.destinations.size() == 1);
+    CHECK(options.destinations[0].host == "::1");
+    CHECK(options.destinations[0].port == 5000);
+}
+
+TEST_CASE("CommandLineOptions collects several destinations") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--send", "10.0.0.1:9000,[::1]:9001", "--send",
+                           "239.1.2.3:9002"},
+                          error));
+    REQUIRE(options.destinations.size() == 3);
+    CHECK(options.destinations[0].host == "10.0.0.1");
+    CHECK(options.destinations[1].host == "::1");
+    CHECK(options.destinations[1].port == 9001);
+    CHECK(options.destinations[2].host == "239.1.2.3");
+    CHECK(options.destinations[2].port == 9002);
+}
+
+TEST_CASE("CommandLineOptions parses a multicast receiver") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--recv", "9000", "--group", "239.1.2.3"}, error));
+    CHECK(options.port == 9000);
+    CHECK(options.multicastGroup == "239.1.2.3");
+}
+
+TEST_CASE("CommandLineOptions parses the frame duration and MTU") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--send", "10.0.0.1:9000", "--block-size",
+                           "4096", "--frame-ms", "2.5", "--mtu=9000"},
+                          error));
+    CHECK(options.blockSize == 4096);
+    CHECK(options.frameDurationMs == 2.5);
+    CHECK(options.mtu == 9000);
+}
+
+TEST_CASE("CommandLineOptions parses the metrics file") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--recv", "9000"}, error));
+    CHECK(options.metricsFile.empty());
+    CHECK(options.metricsIntervalMs == AUDIO_STREAM_METRICS_INTERVAL_MS);
+
+    REQUIRE(options.parse({"--metrics-file", "stats.prom",
+                           "--metrics-interval=5000"},
+                          error));
+    CHECK(options.metricsFile == "stats.prom");
+    CHECK(options.metricsIntervalMs == 5000);
+}
+
+TEST_CASE("CommandLineOptions parses the recording file") {
+    CommandLineOptions options;
+    std::string error;
+
+    REQUIRE(options.parse({"--recv", "9000"}, error));
+    CHECK(options.recordFile.empty());
+
+    REQUIRE(options.parse({"--record=archive/show.flac"}, error));
+    CHECK(options.recordFile == "archive/show.flac");
+}
+
+TEST_CASE("CommandLineOptions rejects invalid command lines") {
+    const std::vector<std::vector<std::string>> invalid = {
+        {},
+        {"--send"},
+        {"--send", "localhost"},
+        {"--send", "localhost:0"},
+        {"--send", "localhost:9000,"},
+        {"--recv", "9000", "--metrics-interval", "10"},
+        {"--recv", "9000", "--record"},
+        {"--recv", "port"},
+        {"--send", "localhost:9000", "--recv", "9000"},
+        {"--recv", "9000", "--channels", "0"},
+        {"--recv", "9000", "--block-size", "16384"},
+        {"--send", "localhost:9000", "--frame-ms", "0.1"},
+        {"--send", "localhost:9000", "--mtu", "100"},
+        {"--recv", "9000", "--format", "int8"},
+        {"--recv", "9000", "--sample-rate", "fast"},
+        {"--recv", "9000", "--verbose"},
+    };
+
+    for (const auto& args : invalid) {
+        CommandLineOptions options;
+        std::string error;
+        CHECK_FALSE(options.parse(args, error));
+        CHECK_FALSE(error.empty());
+    }
+}
@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <vector>
+
+#include "DiscontinuousTransmission.hpp"
+
+namespace {
+using Decision = SilenceDetector::Decision;
+
+Decision process(SilenceDetector& detector, float level) {
+    const std::vector<float> frame(10, level);
+    return detector.process(frame.data(), 1, 10);
+}
+}  // namespace
+
+TEST_CASE("SilenceDetector measures peak and energy") {
+    std::vector<float> samples(37);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = (i % 2 == 0 ? 0.5f : -0.5f) * (i == 35 ? 1.5f : 1.0f);
+    }
+
+    const auto level = SilenceDetector::measure(samples.data(), samples.size());
+    CHECK(level.peak == Approx(0.75f));
+    CHECK(level.meanSquare == Approx((36 * 0.25f + 0.5625f) / 37.0f));
+    CHECK(SilenceDetector::measure(samples.data(), 0).peak == 0.0f);
+}
+
+TEST_CASE("SilenceDetector holds on through the hangover, then keeps alive") {
+    SilenceDetector detector;
+    // 20 samples of hangover and a descriptor every 30 at 1 kHz
+    detector.prepare(1, 1000.0, -60.0, -50.0, 0.02, 0.03);
+
+    CHECK(process(detector, 0.5f) == Decision::send);
+    CHECK(process(detector, 1.0e-4f) == Decision::send);
+    CHECK(process(detector, 1.0e-4f) == Decision::send);
+    CHECK(process(detector, 1.0e-4f) == Decision::startSilence);
+    CHECK(detector.isSilent());
+    CHECK(detector.getNoiseLevel(0) == Approx(1.0e-4f));
+
+    CHECK(process(detector, 1.0e-4f) == Decision::suppress);
+    CHECK(process(detector, 1.0e-4f) == Decision::suppress);
+    CHECK(process(detector, 1.0e-4f) == Decision::keepAlive);
+    CHECK(process(detector, 1.0e-4f) == Decision::suppress);
+
+    CHECK(process(detector, 0.5f) == Decision::send);
+    CHECK_FALSE(detector.isSilent());
+    CHECK(process(detector, 1.0e-4f) == Decision::send);
+}
+
+TEST_CASE("SilenceDetector treats a click as activity") {
+    SilenceDetector detector;
+    detector.prepare(2, 1000.0, -60.0, -50.0, 0.0, 1.0);
+
+    // Quiet in energy, but the peak on the second channel is at -40 dBFS
+    std::vector<float> frame(20, 0.0f);
+    frame[15] = 0.01f;
+    CHECK(detector.process(frame.data(), 2, 10) == Decision::send);
+
+    frame[15] = 0.0f;
+    CHECK(detector.process(frame.data(), 2, 10) == Decision::startSilence);
+}
+
+TEST_CASE("ComfortNoise plays at the level asked for") {
+    ComfortNoise noise;
+    noise.prepare(2);
+    noise.setLevel(0, 0.01f);
+
+    std::vector<float> left(48000), right(100, 1.0f);
+    float* outputs[] = {left.data(), right.data()};
+    noise.generate(outputs, 2, 0, 100);
+    noise.generate(0, left.data() + 100, 47900);
+
+    const auto level = SilenceDetector::measure(left.data(), left.size());
+    CHECK(std::sqrt(level.meanSquare) == Approx(0.01f).epsilon(0.02));
+    CHECK(level.peak <= 0.01f * std::sqrt(3.0f));
+
+    // A channel without a level stays silent
+    CHECK(SilenceDetector::measure(right.data(), right.size()).peak == 0.0f);
+}
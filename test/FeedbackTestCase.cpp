@@ -0,0 +1,73 @@
+#include <catch2/catch.hpp>
+
+#include "Feedback.hpp"
+
+TEST_CASE("getFractionLost counts in 256ths") {
+    CHECK(getFractionLost(0, 0) == 0);
+    CHECK(getFractionLost(0, 100) == 0);
+    CHECK(getFractionLost(25, 100) == 64);
+    CHECK(getFractionLost(100, 100) == 255);
+}
+
+TEST_CASE("RoundTripEstimator takes the time held off the echo") {
+    RoundTripEstimator roundTrip;
+
+    // Nothing echoed yet
+    roundTrip.addEcho(1'000'000, 0, 0);
+    CHECK_FALSE(roundTrip.hasRoundTripTime());
+
+    // Sent at 1 s, held for 400 ms, back at 1.41 s
+    roundTrip.addEcho(1'410'000, 1'000'000, 400'000);
+    REQUIRE(roundTrip.hasRoundTripTime());
+    CHECK(roundTrip.getRoundTripTime() == Approx(0.010));
+
+    // Later ones are smoothed, impossible ones ignored
+    roundTrip.addEcho(2'018'000, 2'000'000, 0);
+    CHECK(roundTrip.getRoundTripTime() == Approx(0.011));
+    roundTrip.addEcho(3'000'000, 2'999'000, 5'000);
+    CHECK(roundTrip.getRoundTripTime() == Approx(0.011));
+
+    roundTrip.reset();
+    CHECK_FALSE(roundTrip.hasRoundTripTime());
+}
+
+TEST_CASE("RoundTripEstimator takes the other end's times to this clock") {
+    RoundTripEstimator roundTrip;
+    roundTrip.addEcho(1'010'000, 1'000'000, 0);
+    REQUIRE(roundTrip.getRoundTripTime() == Approx(0.010));
+
+    // A report sent at 500 s of its clock arrived at 20.005 s of this one,
+    // 5 ms later, so that clock is 480 s ahead
+    CHECK(roundTrip.toLocalTime(499.9, 500.0, 20.005) == Approx(19.9));
+
+    // Sent 5 ms before it arrived by the same clock, as over localhost
+    CHECK(roundTrip.toLocalTime(19.9, 20.0, 20.005) == Approx(19.9));
+}
+
+TEST_CASE("ReceiverFeedback keeps the last report in seconds") {
+    ReceiverReportHeader report;
+    report.fractionLost = 128;
+    report.numReceived = 990;
+    report.numLost = 10;
+    report.jitter = 1'500;
+    report.bufferDelay = 20'000;
+    report.targetDelay = 15'000;
+    report.echoTime = 5'000'000;
+    report.echoDelay = 100'000;
+
+    ReceiverFeedback feedback;
+    feedback.addReport(report, 5'104'000);
+
+    CHECK(feedback.getNumReports() == 1);
+    CHECK(feedback.getFractionLost() == Approx(0.5));
+    CHECK(feedback.getNumReceived() == 990);
+    CHECK(feedback.getNumLost() == 10);
+    CHECK(feedback.getJitter() == Approx(0.0015));
+    CHECK(feedback.getBufferDelay() == Approx(0.020));
+    CHECK(feedback.getTargetDelay() == Approx(0.015));
+    CHECK(feedback.getRoundTrip().getRoundTripTime() == Approx(0.004));
+
+    feedback.reset();
+    CHECK(feedback.getNumReports() == 0);
+    CHECK_FALSE(feedback.getRoundTrip().hasRoundTripTime());
+}
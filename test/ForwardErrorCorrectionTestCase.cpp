@@ -0,0 +1,201 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "ForwardErrorCorrection.hpp"
+
+namespace {
+using Packet = std::vector<uint8_t>;
+
+Packet makePacket(uint32_t sequence, uint16_t numSamples) {
+    StreamPacketHeader header;
+    header.streamId = 7;
+    header.sequence = sequence;
+    header.timestamp = sequence * 64ull;
+    header.numSamples = numSamples;
+
+    Packet packet(StreamPacketHeader::size + header.getPayloadSize());
+    header.write(packet.data());
+    for (auto i = StreamPacketHeader::size; i < packet.size(); ++i) {
+        packet[i] = static_cast<uint8_t>(sequence * 31 + i * 7);
+    }
+    return packet;
+}
+
+struct Link {
+    FecEncoder encoder;
+    FecDecoder decoder;
+    std::vector<Packet> parity;
+    std::vector<Packet> recovered;
+
+    Link(int numData, int numParity) {
+        encoder.prepare(numData, numParity, 2, 1024);
+        decoder.prepare(64, 2, 1024);
+    }
+
+    void send(const Packet& packet) {
+        StreamPacketHeader header;
+        REQUIRE(header.read(packet.data(), packet.size()));
+        encoder.addPacket(packet.data(), packet.size(), header.streamId,
+                          header.sequence, header.channelIndex,
+                          [this](const uint8_t* data, size_t size) {
+                              parity.emplace_back(data, data + size);
+                          });
+    }
+
+    void receive(const Packet& packet) {
+        StreamPacketHeader header;
+        REQUIRE(header.read(packet.data(), packet.size()));
+        decoder.addData(header, packet.data(), packet.size(),
+                        [this](const uint8_t* data, size_t size) {
+                            recovered.emplace_back(data, data + size);
+                        });
+    }
+
+    void receiveParity(const Packet& packet) {
+        FecPacketHeader header;
+        REQUIRE(header.read(packet.data(), packet.size()));
+        decoder.addParity(header, packet.data() + header.headerSize,
+                          [this](const uint8_t* data, size_t size) {
+                              recovered.emplace_back(data, data + size);
+                          });
+    }
+};
+}  // namespace
+
+TEST_CASE("FecPacketHeader is not mistaken for a stream packet") {
+    FecPacketHeader header;
+    header.numData = 4;
+    header.numParity = 2;
+    header.streamId = 9;
+    header.baseSequence = 100;
+    header.channelIndex = 1;
+    header.parityIndex = 1;
+    header.unitSize = 16;
+
+    uint8_t packet[FecPacketHeader::size + 16] = {};
+    header.write(packet);
+
+    FecPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.numData == 4);
+    CHECK(parsed.numParity == 2);
+    CHECK(parsed.streamId == 9);
+    CHECK(parsed.baseSequence == 100);
+    CHECK(parsed.channelIndex == 1);
+    CHECK(parsed.parityIndex == 1);
+    CHECK(parsed.unitSize == 16);
+    CHECK_FALSE(parsed.read(packet, sizeof(packet) - 1));
+
+    StreamPacketHeader stream;
+    CHECK_FALSE(stream.read(packet, sizeof(packet)));
+}
+
+TEST_CASE("FecDecoder rebuilds any single loss from XOR parity") {
+    const auto lost = GENERATE(0u, 1u, 2u, 3u);
+
+    Link link(4, 1);
+    std::vector<Packet> packets;
+    for (auto sequence = 0u; sequence < 4; ++sequence) {
+        // Packets of different lengths share a group
+        packets.push_back(makePacket(sequence, static_cast<uint16_t>(
+                                                   16 + sequence * 8)));
+        link.send(packets.back());
+    }
+
+    REQUIRE(link.parity.size() == 1);
+
+    for (auto sequence = 0u; sequence < 4; ++sequence) {
+        if (sequence != lost) {
+            link.receive(packets[sequence]);
+        }
+    }
+    link.receiveParity(link.parity[0]);
+
+    REQUIRE(link.recovered.size() == 1);
+    CHECK(link.recovered[0] == packets[lost]);
+    CHECK(link.decoder.getNumRecovered() == 1);
+}
+
+TEST_CASE("FecDecoder rebuilds a burst from Reed-Solomon parity") {
+    Link link(8, 3);
+    std::vector<Packet> packets;
+    for (auto sequence = 0u; sequence < 8; ++sequence) {
+        packets.push_back(makePacket(sequence, 32));
+        link.send(packets.back());
+    }
+
+    REQUIRE(link.parity.size() == 3);
+
+    // Lose packets 2 to 4 and deliver packet 7 after the parity, recovery
+    // has to wait for it
+    for (const auto sequence : {0u, 1u, 5u, 6u}) {
+        link.receive(packets[sequence]);
+    }
+    for (const auto& parity : link.parity) {
+        link.receiveParity(parity);
+    }
+    CHECK(link.recovered.empty());
+
+    link.receive(packets[7]);
+
+    REQUIRE(link.recovered.size() == 3);
+    CHECK(link.recovered[0] == packets[2]);
+    CHECK(link.recovered[1] == packets[3]);
+    CHECK(link.recovered[2] == packets[4]);
+    CHECK(link.decoder.getNumRecovered() == 3);
+    CHECK(link.decoder.getNumUnrecoverable() == 0);
+}
+
+TEST_CASE("FecDecoder rebuilds losses from any subset of parity rows") {
+    Link link(6, 3);
+    std::vector<Packet> packets;
+    for (auto sequence = 0u; sequence < 6; ++sequence) {
+        packets.push_back(makePacket(sequence, 24));
+        link.send(packets.back());
+    }
+
+    for (const auto sequence : {1u, 2u, 3u, 5u}) {
+        link.receive(packets[sequence]);
+    }
+    link.receiveParity(link.parity[2]);
+    link.receiveParity(link.parity[1]);
+
+    REQUIRE(link.recovered.size() == 2);
+    CHECK(link.recovered[0] == packets[0]);
+    CHECK(link.recovered[1] == packets[4]);
+}
+
+TEST_CASE("FecDecoder counts losses it cannot rebuild") {
+    Link link(4, 1);
+    std::vector<Packet> packets;
+    for (auto sequence = 0u; sequence < 4 * 9; ++sequence) {
+        packets.push_back(makePacket(sequence, 16));
+        link.send(packets.back());
+    }
+
+    REQUIRE(link.parity.size() == 9);
+
+    // Two losses in the first group, then enough groups to replace it
+    for (auto sequence = 2u; sequence < packets.size(); ++sequence) {
+        link.receive(packets[sequence]);
+    }
+    for (const auto& parity : link.parity) {
+        link.receiveParity(parity);
+    }
+
+    CHECK(link.recovered.empty());
+    CHECK(link.decoder.getNumUnrecoverable() == 2);
+}
+
+TEST_CASE("FecEncoder leaves packets larger than prepared unprotected") {
+    Link link(4, 1);
+    for (auto sequence = 0u; sequence < 4; ++sequence) {
+        link.send(makePacket(sequence, 512));
+    }
+    CHECK(link.parity.empty());
+
+    for (auto sequence = 4u; sequence < 8; ++sequence) {
+        link.send(makePacket(sequence, 16));
+    }
+    CHECK(link.parity.size() == 1);
+}
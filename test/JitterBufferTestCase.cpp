@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+#include <numeric>
+
+#include "JitterBuffer.hpp"
+
+TEST_CASE("JitterBuffer keeps frames in order and zero-pads short frames") {
+    JitterBuffer buffer;
+    buffer.prepare(64, 16);
+
+    std::vector<float> first(16), second(8);
+    std::iota(first.begin(), first.end(), 1.0f);
+    std::iota(second.begin(), second.end(), 100.0f);
+
+    REQUIRE(buffer.push({1, 16}, first.data()));
+    REQUIRE(buffer.push({1, 8}, second.data()));
+
+    std::vector<float> out(16);
+    JitterBuffer::FrameInfo info;
+
+    REQUIRE(buffer.pop(out.data(), out.size(), &info));
+    CHECK(info.numSamples == 16);
+    CHECK(out == first);
+
+    REQUIRE(buffer.pop(out.data(), out.size(), &info));
+    CHECK(info.numSamples == 8);
+    CHECK(out[7] == 107.0f);
+    CHECK(out[8] == 0.0f);
+
+    CHECK_FALSE(buffer.pop(out.data(), out.size()));
+    CHECK(buffer.getNumUnderruns() == 1);
+}
+
+TEST_CASE("JitterBuffer rejects oversized frames and overruns") {
+    JitterBuffer buffer;
+    buffer.prepare(16, 16);
+
+    std::vector<float> frame(32, 1.0f);
+    CHECK_FALSE(buffer.push({2, 16}, frame.data()));
+    CHECK(buffer.getNumRejectedFrames() == 1);
+
+    auto pushed = 0;
+    while (buffer.push({1, 16}, frame.data())) {
+        ++pushed;
+    }
+    CHECK(pushed >= 1);
+    CHECK(buffer.getNumOverruns() == 1);
+}
+
+TEST_CASE("JitterBuffer drops the backlog on overrun when asked to") {
+    JitterBuffer buffer;
+    buffer.setOverrunPolicy(JitterBuffer::OverrunPolicy::dropBacklog);
+    buffer.prepare(16, 16);
+
+    std::vector<float> frame(16, 1.0f);
+    while (buffer.push({1, 16}, frame.data())) {
+    }
+
+    std::vector<float> out(16);
+    CHECK_FALSE(buffer.pop(out.data(), out.size()));
+    CHECK(buffer.push({1, 16}, frame.data()));
+    CHECK(buffer.pop(out.data(), out.size()));
+}
+
+TEST_CASE("JitterBuffer repeats the last frame with decaying gain") {
+    JitterBuffer buffer;
+    buffer.setUnderrunPolicy(JitterBuffer::UnderrunPolicy::repeatLastFrame);
+    buffer.prepare(16, 4);
+
+    std::vector<float> frame{1.0f, 1.0f, 1.0f, 1.0f}, out(4);
+    REQUIRE(buffer.push({1, 4}, frame.data()));
+    REQUIRE(buffer.pop(out.data(), out.size()));
+
+    CHECK_FALSE(buffer.pop(out.data(), out.size()));
+    CHECK(out[0] == 1.0f);
+    CHECK_FALSE(buffer.pop(out.data(), out.size()));
+    CHECK(out[0] == 0.5f);
+}
+
+TEST_CASE("JitterBuffer wraps frames around the end of its storage") {
+    JitterBuffer buffer;
+    buffer.prepare(24, 10);
+
+    std::vector<float> frame(7), out(7);
+    for (auto round = 0; round < 100; ++round) {
+        std::fill(frame.begin(), frame.end(), static_cast<float>(round));
+        REQUIRE(buffer.push({1, 7}, frame.data()));
+        REQUIRE(buffer.pop(out.data(), out.size()));
+        REQUIRE(out == frame);
+    }
+}
+
+TEST_CASE("JitterBuffer handles frames of varying size across wrap-around") {
+    JitterBuffer buffer;
+    buffer.prepare(40, 10);
+
+    std::vector<float> frame(10), out(10);
+    JitterBuffer::FrameInfo info;
+
+    for (uint32_t round = 0; round < 200; ++round) {
+        const auto size = 1 + round % 10;
+        std::fill(frame.begin(), frame.end(), static_cast<float>(round));
+
+        REQUIRE(buffer.push({1, size, round, 0}, frame.data()));
+        REQUIRE(buffer.pop(out.data(), out.size(), &info));
+        REQUIRE(info.sequence == round);
+        REQUIRE(info.numSamples == size);
+        REQUIRE(out[size - 1] == static_cast<float>(round));
+    }
+}
+
+TEST_CASE("JitterBuffer skips a tail too short for a header") {
+    // Three records of up to four samples: 120 bytes of storage
+    JitterBuffer buffer;
+    buffer.prepare(4, 4);
+
+    std::vector<float> four{1.0f, 2.0f, 3.0f, 4.0f}, two{3.0f, 3.0f},
+        out(2);
+    REQUIRE(buffer.push({1, 4}, four.data()));
+    REQUIRE(buffer.push({1, 4}, four.data()));
+    REQUIRE(buffer.push({1, 2}, two.data()));
+    REQUIRE(buffer.pop(out.data(), out.size()));
+    REQUIRE(buffer.pop(out.data(), out.size()));
+
+    // 8 bytes are left at the end, less than a header
+    std::vector<float> wrapped{4.0f, 5.0f};
+    REQUIRE(buffer.push({1, 2}, wrapped.data()));
+
+    REQUIRE(buffer.pop(out.data(), out.size()));
+    CHECK(out[0] == 3.0f);
+    REQUIRE(buffer.pop(out.data(), out.size()));
+    CHECK(out == wrapped);
+    CHECK_FALSE(buffer.pop(out.data(), out.size()));
+}
@@ -0,0 +1,44 @@
+#include <catch2/catch.hpp>
+
+#include "JitterEstimator.hpp"
+
+TEST_CASE("JitterEstimator targets one frame plus margin on a clean link") {
+    JitterEstimator estimator;
+    estimator.prepare(64, 48000.0, 96, 48, 4800);
+
+    for (uint64_t block = 0; block < 256; ++block) {
+        estimator.addArrival(static_cast<double>(block * 480) / 48000.0,
+                             block * 480, 480);
+    }
+
+    CHECK(estimator.getTargetDelay() == 480 + 96);
+    CHECK(estimator.getInterarrivalJitter() < 1.0f);
+}
+
+TEST_CASE("JitterEstimator grows the target with arrival jitter") {
+    JitterEstimator estimator;
+    estimator.prepare(64, 48000.0, 0, 0, 48000);
+
+    for (uint64_t block = 0; block < 256; ++block) {
+        // Every fourth block arrives 5 ms late
+        const auto lateness = block % 4 == 0 ? 0.005 : 0.0;
+        estimator.addArrival(
+            static_cast<double>(block * 480) / 48000.0 + lateness,
+            block * 480, 480);
+    }
+
+    CHECK(estimator.getTargetDelay() >= 480 + 239);
+    CHECK(estimator.getInterarrivalJitter() > 0.0f);
+}
+
+TEST_CASE("JitterEstimator clamps the target delay") {
+    JitterEstimator estimator;
+    estimator.prepare(16, 48000.0, 0, 0, 100);
+
+    for (uint64_t block = 0; block < 64; ++block) {
+        estimator.addArrival(static_cast<double>(block * 480) / 48000.0,
+                             block * 480, 480);
+    }
+
+    CHECK(estimator.getTargetDelay() == 100);
+}
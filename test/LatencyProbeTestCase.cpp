@@ -0,0 +1,271 @@
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <vector>
+
+#include "Feedback.hpp"
+#include "LatencyProbe.hpp"
+
+TEST_CASE("Fft transforms an impulse to a flat spectrum and back") {
+    Fft fft;
+    fft.prepare(6);
+    REQUIRE(fft.getSize() == 64);
+
+    std::vector<std::complex<float>> data(64);
+    data[3] = 1.0f;
+    fft.perform(data.data(), false);
+    for (const auto& bin : data) {
+        CHECK(std::abs(bin) == Approx(1.0f));
+    }
+
+    fft.perform(data.data(), true);
+    for (size_t i = 0; i < data.size(); ++i) {
+        CHECK(data[i].real() == Approx(i == 3 ? 1.0f : 0.0f).margin(1e-6));
+        CHECK(data[i].imag() == Approx(0.0f).margin(1e-6));
+    }
+}
+
+TEST_CASE("LatencyProbe generates maximum length sequences") {
+    for (const auto order : {4, 8, 12}) {
+        const auto sequence = LatencyProbe::generate(order);
+        const auto length = sequence.size();
+        REQUIRE(length == (size_t{1} << order) - 1);
+
+        // Circular autocorrelation is length at lag 0 and -1 at every other
+        for (const size_t lag : {size_t{0}, size_t{1}, length / 2}) {
+            auto sum = 0.0f;
+            for (size_t i = 0; i < length; ++i) {
+                sum += sequence[i] * sequence[(i + lag) % length];
+            }
+            CHECK(sum == (lag == 0 ? float(length) : -1.0f));
+        }
+    }
+}
+
+TEST_CASE("LatencyProbe adds probes at multiples of the interval") {
+    LatencyProbe probe;
+    probe.prepare(4, 100, 0.5f);
+    const auto& signal = probe.getSignal();
+    REQUIRE(signal.size() == 15);
+    CHECK(std::abs(signal[7]) == 0.5f);
+
+    CHECK(probe.getNextStart(0) == 100);
+    CHECK(probe.getNextStart(100) == 100);
+    CHECK(probe.getNextStart(101) == 200);
+
+    // Added in blocks that cut the probes anywhere, none at position 0
+    std::vector<float> stream(350, 0.0f);
+    for (size_t position = 0; position < stream.size(); position += 7) {
+        const auto count = std::min<size_t>(7, stream.size() - position);
+        probe.add(stream.data() + position, position, count);
+    }
+
+    for (size_t i = 0; i < stream.size(); ++i) {
+        const auto offset = i % 100;
+        const auto expected = i >= 100 && offset < 15 ? signal[offset] : 0.0f;
+        CHECK(stream[i] == expected);
+    }
+}
+
+TEST_CASE("ProbeDetector finds probes under noise by cross-correlation") {
+    LatencyProbe probe;
+    probe.prepare(10, 5000, 0.25f);
+
+    ProbeDetector detector;
+    detector.prepare(probe.getSignal(), 8.0);
+
+    std::mt19937 random(7);
+    std::normal_distribution<float> noise(0.0f, 0.25f);
+    std::vector<float> stream(26000);
+    for (auto& sample : stream) {
+        sample = noise(random);
+    }
+
+    SECTION("Noise alone is never a probe") {
+        auto numDetections = 0;
+        detector.process(stream.data(), stream.size(),
+                         [&](uint64_t) { ++numDetections; });
+        CHECK(numDetections == 0);
+    }
+
+    SECTION("Every probe is found where it starts") {
+        probe.add(stream.data(), 0, stream.size());
+
+        std::vector<uint64_t> detections;
+        for (size_t position = 0; position < stream.size(); position += 333) {
+            const auto count = std::min<size_t>(333, stream.size() - position);
+            detector.process(stream.data() + position, count,
+                             [&](uint64_t at) { detections.push_back(at); });
+        }
+
+        CHECK(detections == std::vector<uint64_t>{5000, 10000, 15000, 20000});
+        CHECK(detector.getPosition() == stream.size());
+    }
+
+    SECTION("Probes are found inverted too, and after a reset") {
+        probe.add(stream.data(), 0, stream.size());
+        for (auto& sample : stream) {
+            sample = -sample;
+        }
+
+        detector.reset();
+        std::vector<uint64_t> detections;
+        detector.process(stream.data() + 2500, stream.size() - 2500,
+                         [&](uint64_t at) { detections.push_back(at); });
+        CHECK(detections == std::vector<uint64_t>{2500, 7500, 12500, 17500});
+    }
+}
+
+TEST_CASE("LatencyStats keeps percentiles of the latest measurements") {
+    LatencyStats stats;
+    stats.prepare(100);
+    CHECK(stats.getNumMeasurements() == 0);
+
+    for (auto i = 1; i <= 100; ++i) {
+        stats.add(i * 0.001);
+    }
+
+    CHECK(stats.getNumMeasurements() == 100);
+    CHECK(stats.getMinimum() == Approx(0.001));
+    CHECK(stats.getMaximum() == Approx(0.100));
+    CHECK(stats.getMedian() == Approx(0.051));
+    CHECK(stats.get90thPercentile() == Approx(0.090));
+    CHECK(stats.get99thPercentile() == Approx(0.099));
+
+    // Older measurements make way for newer ones
+    for (auto i = 0; i < 100; ++i) {
+        stats.add(0.5);
+    }
+    CHECK(stats.getNumMeasurements() == 200);
+    CHECK(stats.getMinimum() == Approx(0.5));
+    CHECK(stats.get99thPercentile() == Approx(0.5));
+
+    stats.reset();
+    CHECK(stats.getNumMeasurements() == 0);
+}
+
+TEST_CASE("ProbeMatcher counts probes never played and hears each once") {
+    LatencyStats network;
+    LatencyStats acoustic;
+    network.prepare(10);
+    acoustic.prepare(10);
+
+    ProbeMatcher matcher;
+    matcher.prepare(1.0);
+
+    // Four probes fit, the fifth pushes out the first, never played
+    for (auto i = 0; i < 4; ++i) {
+        CHECK(matcher.addSent(i, network));
+    }
+    CHECK_FALSE(matcher.addSent(4.0, network));
+
+    // Paired with the latest probe sent before it
+    matcher.addPlayed(4.02, network);
+    CHECK(network.getNumMeasurements() == 1);
+    CHECK(network.getMedian() == Approx(0.02));
+
+    matcher.addHeard(4.03, acoustic);
+    matcher.addHeard(4.04, acoustic);
+    matcher.addHeard(3.9, acoustic);
+    CHECK(acoustic.getNumMeasurements() == 1);
+    CHECK(acoustic.getMedian() == Approx(0.01));
+}
+
+TEST_CASE("ProbeMatcher measures both latencies from delayed streams") {
+    // The sender's clock is far ahead across machines, and the same clock
+    // over localhost
+    const auto [clockAhead, oneWay] =
+        GENERATE(table<double, double>({{1000.0, 0.005}, {0.0, 0.00005}}));
+
+    constexpr auto rate = 48000.0;
+    constexpr size_t interval = 48000;
+    constexpr size_t numSamples = 5 * interval;
+    constexpr size_t blockSize = 4800;
+    constexpr size_t acousticDelay = 480;
+    constexpr auto networkLatency = 0.030;
+    // Local time of the first sample played and heard
+    constexpr auto start = 0.130;
+
+    LatencyProbe probe;
+    probe.prepare(12, interval, 0.0316f);
+
+    std::mt19937 random(3);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+    std::vector<float> playedStream(numSamples);
+    for (auto& sample : playedStream) {
+        sample = noise(random);
+    }
+    probe.add(playedStream.data(), 0, playedStream.size());
+
+    std::vector<float> heardStream(numSamples);
+    for (size_t i = 0; i < numSamples; ++i) {
+        heardStream[i] =
+            (i >= acousticDelay ? playedStream[i - acousticDelay] : 0.0f) +
+            noise(random);
+    }
+
+    // Each probe is sent networkLatency before it is played, and told of
+    // in a report sent 200 ms later
+    RoundTripEstimator roundTrip;
+    const auto roundTripMicros = static_cast<uint64_t>(2 * oneWay * 1.0e6);
+    roundTrip.addEcho(1'000'000 + roundTripMicros, 1'000'000, 0);
+    REQUIRE(roundTrip.hasRoundTripTime());
+
+    struct Report {
+        double arrival;
+        double probeTime;
+        double sendTime;
+    };
+    std::vector<Report> reports;
+    for (auto position = interval; position + 4095 < numSamples;
+         position += interval) {
+        const auto sent = start + position / rate - networkLatency;
+        const auto remoteSent = sent + clockAhead;
+        reports.push_back({sent + 0.2 + oneWay, remoteSent,
+                           remoteSent + 0.2});
+    }
+
+    ProbeDetector playedDetector;
+    ProbeDetector heardDetector;
+    playedDetector.prepare(LatencyProbe::generate(12), 8.0);
+    heardDetector.prepare(LatencyProbe::generate(12), 8.0);
+
+    LatencyStats network;
+    LatencyStats acoustic;
+    network.prepare(10);
+    acoustic.prepare(10);
+    ProbeMatcher matcher;
+    matcher.prepare(interval / rate);
+
+    // Reports and detections come in whatever order they reach the meter
+    size_t nextReport = 0;
+    for (size_t position = 0; position < numSamples; position += blockSize) {
+        const auto now = start + (position + blockSize) / rate;
+        for (; nextReport < reports.size() &&
+               reports[nextReport].arrival <= now;
+             ++nextReport) {
+            const auto& report = reports[nextReport];
+            CHECK(matcher.addSent(roundTrip.toLocalTime(report.probeTime,
+                                                        report.sendTime,
+                                                        report.arrival),
+                                  network));
+        }
+
+        playedDetector.process(
+            playedStream.data() + position, blockSize, [&](uint64_t at) {
+                matcher.addPlayed(start + at / rate, network);
+            });
+        heardDetector.process(
+            heardStream.data() + position, blockSize, [&](uint64_t at) {
+                matcher.addHeard(start + at / rate, acoustic);
+            });
+    }
+
+    CHECK(nextReport == reports.size());
+    CHECK(network.getNumMeasurements() == reports.size());
+    CHECK(network.getMinimum() == Approx(networkLatency).margin(1.0e-6));
+    CHECK(network.getMaximum() == Approx(networkLatency).margin(1.0e-6));
+    CHECK(acoustic.getNumMeasurements() == reports.size());
+    CHECK(acoustic.getMinimum() == Approx(acousticDelay / rate));
+    CHECK(acoustic.getMaximum() == Approx(acousticDelay / rate));
+}
@@ -0,0 +1,104 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+
+#include "LossConcealer.hpp"
+
+namespace {
+constexpr double sampleRate = 48000.0;
+
+float tone(int n) {
+    // 240 Hz, a period of 200 samples
+    return 0.5f * std::sin(2.0f * 3.14159265f * static_cast<float>(n) / 200.0f);
+}
+
+void playTone(LossConcealer& concealer, int numSamples) {
+    std::vector<float> block(static_cast<size_t>(numSamples));
+    for (auto i = 0; i < numSamples; ++i) {
+        block[static_cast<size_t>(i)] = tone(i);
+    }
+    const float* channels[] = {block.data()};
+    concealer.addHistory(channels, 1, 0, numSamples);
+}
+}  // namespace
+
+TEST_CASE("LossConcealer continues a periodic signal") {
+    const auto mode = GENERATE(LossConcealer::Mode::pitchRepetition,
+                               LossConcealer::Mode::linearPrediction);
+
+    LossConcealer concealer;
+    concealer.prepare(1, sampleRate);
+    concealer.setMode(mode);
+    playTone(concealer, 4800);
+
+    // Lost in two pieces, as when a gap straddles two device blocks
+    std::vector<float> lost(240);
+    float* outputs[] = {lost.data()};
+    concealer.conceal(outputs, 1, 0, 120);
+    concealer.conceal(outputs, 1, 120, 120);
+
+    REQUIRE(concealer.isConcealing());
+    CHECK(concealer.getNumConcealmentEvents() == 1);
+    CHECK(concealer.getNumConcealedSamples() == 240);
+
+    for (auto i = 0; i < 240; ++i) {
+        CHECK(lost[static_cast<size_t>(i)] ==
+              Approx(tone(4800 + i)).margin(0.02));
+    }
+}
+
+TEST_CASE("LossConcealer fades a long loss out to silence") {
+    const auto mode = GENERATE(LossConcealer::Mode::repeatWithFade,
+                               LossConcealer::Mode::pitchRepetition,
+                               LossConcealer::Mode::linearPrediction);
+
+    LossConcealer concealer;
+    concealer.prepare(1, sampleRate);
+    concealer.setMode(mode);
+    playTone(concealer, 4800);
+
+    std::vector<float> lost(4800);
+    float* outputs[] = {lost.data()};
+    concealer.conceal(outputs, 1, 0, 4800);
+
+    CHECK(std::abs(lost.front()) > 0.0f);
+    for (auto i = 3600; i < 4800; ++i) {
+        CHECK(lost[static_cast<size_t>(i)] == 0.0f);
+    }
+}
+
+TEST_CASE("LossConcealer crossfades into the audio that resumes") {
+    LossConcealer concealer;
+    concealer.prepare(1, sampleRate);
+    playTone(concealer, 4800);
+
+    std::vector<float> block(480);
+    float* outputs[] = {block.data()};
+    concealer.conceal(outputs, 1, 0, 240);
+
+    for (auto i = 240; i < 480; ++i) {
+        block[static_cast<size_t>(i)] = tone(4800 + i);
+    }
+    concealer.endConcealment(outputs, 1, 240, 240);
+    REQUIRE_FALSE(concealer.isConcealing());
+
+    // No step anywhere across the loss and the resumption
+    for (auto i = 1; i < 480; ++i) {
+        CHECK(std::abs(block[static_cast<size_t>(i)] -
+                       block[static_cast<size_t>(i - 1)]) < 0.03f);
+    }
+}
+
+TEST_CASE("LossConcealer outputs silence in silence mode") {
+    LossConcealer concealer;
+    concealer.prepare(1, sampleRate);
+    concealer.setMode(LossConcealer::Mode::silence);
+    playTone(concealer, 4800);
+
+    std::vector<float> lost(480, 1.0f);
+    float* outputs[] = {lost.data()};
+    concealer.conceal(outputs, 1, 0, 480);
+
+    for (const auto sample : lost) {
+        CHECK(sample == 0.0f);
+    }
+}
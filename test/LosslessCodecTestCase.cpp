@@ -0,0 +1,159 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "LosslessCodec.hpp"
+
+namespace {
+/** Music-like 16-bit material: a few decaying partials and some noise. */
+std::vector<float> makeMaterial(int numSamples, unsigned seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<float> noise(0.0f, 0.002f);
+
+    std::vector<float> material(static_cast<size_t>(numSamples));
+    for (auto i = 0; i < numSamples; ++i) {
+        const auto t = static_cast<float>(i) / 48000.0f;
+        auto value = 0.0f;
+        for (auto partial = 1; partial <= 6; ++partial) {
+            value += 0.3f / static_cast<float>(partial) *
+                     std::sin(2.0f * 3.14159265f * 220.0f *
+                              static_cast<float>(partial) * t) *
+                     std::exp(-t * static_cast<float>(partial));
+        }
+        value += noise(random);
+        material[static_cast<size_t>(i)] =
+            std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f) / 32768.0f;
+    }
+    return material;
+}
+
+/** Mono 16-bit little-endian PCM from $AUDIO_STREAM_BENCHMARK_PCM, if set. */
+std::vector<float> loadMaterial() {
+    std::vector<float> material;
+    if (const auto* path = std::getenv("AUDIO_STREAM_BENCHMARK_PCM")) {
+        std::ifstream file(path, std::ios::binary);
+        unsigned char bytes[2];
+        while (file.read(reinterpret_cast<char*>(bytes), 2)) {
+            const auto value = static_cast<int16_t>(bytes[0] | bytes[1] << 8);
+            material.push_back(static_cast<float>(value) / 32768.0f);
+        }
+    }
+    return material.empty() ? makeMaterial(48000 * 10, 1) : material;
+}
+
+std::vector<float> roundTrip(LosslessCodec& codec, const float* planar,
+                             int numChannels, int numSamples, size_t& size) {
+    std::vector<uint8_t> encoded(
+        LosslessCodec::getMaxEncodedSize(numChannels, numSamples));
+    size = codec.encode(planar, numChannels, numSamples, encoded.data(),
+                        encoded.size());
+    REQUIRE(size > 0);
+
+    std::vector<float> decoded(static_cast<size_t>(numChannels * numSamples));
+    REQUIRE(codec.decode(encoded.data(), size, numChannels, numSamples,
+                         decoded.data()));
+    return decoded;
+}
+}  // namespace
+
+TEST_CASE("LosslessCodec compresses 16-bit material bit exactly") {
+    const auto blockSize = GENERATE(16, 64, 480, 1024);
+
+    LosslessCodec codec;
+    codec.prepare(1024);
+
+    const auto material = makeMaterial(blockSize * 2, 2);
+    size_t size = 0;
+    const auto decoded =
+        roundTrip(codec, material.data(), 2, blockSize, size);
+
+    CHECK(decoded == material);
+    CHECK(size <= material.size() * sizeof(float) / 2);
+}
+
+TEST_CASE("LosslessCodec keeps arbitrary floats exact") {
+    LosslessCodec codec;
+    codec.prepare(256);
+
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+
+    std::vector<float> planar(3 * 256);
+    for (auto& sample : planar) {
+        sample = distribution(random);
+    }
+    // Silence and a constant channel use the short subframe
+    std::fill(planar.begin() + 256, planar.begin() + 512, 0.0f);
+    std::fill(planar.begin() + 512, planar.end(), 0.25f);
+
+    size_t size = 0;
+    const auto decoded = roundTrip(codec, planar.data(), 3, 256, size);
+
+    CHECK(decoded == planar);
+    CHECK(size == 1 + 256 * sizeof(float) + 2 * 5);
+}
+
+TEST_CASE("LosslessCodec rejects truncated data") {
+    LosslessCodec codec;
+    codec.prepare(512);
+
+    const auto material = makeMaterial(512, 4);
+    std::vector<uint8_t> encoded(LosslessCodec::getMaxEncodedSize(1, 512));
+    const auto size = codec.encode(material.data(), 1, 512, encoded.data(),
+                                   encoded.size());
+    REQUIRE(size > 0);
+
+    std::vector<float> decoded(512);
+    CHECK_FALSE(codec.decode(encoded.data(), size / 2, 1, 512,
+                             decoded.data()));
+    CHECK_FALSE(codec.decode(encoded.data(), size, 1, 1024, decoded.data()));
+}
+
+TEST_CASE("LosslessCodec cost per block and compression ratio",
+          "[.][benchmark]") {
+    const auto material = loadMaterial();
+
+    for (const auto blockSize : {64, 128, 256, 512, 1024}) {
+        LosslessCodec codec;
+        codec.prepare(blockSize);
+
+        std::vector<uint8_t> encoded(
+            LosslessCodec::getMaxEncodedSize(1, blockSize));
+        std::vector<float> decoded(static_cast<size_t>(blockSize));
+
+        const auto numBlocks =
+            static_cast<int>(material.size()) / blockSize;
+        size_t totalSize = 0;
+        std::chrono::nanoseconds encodeTime{0}, decodeTime{0};
+
+        for (auto block = 0; block < numBlocks; ++block) {
+            const auto* input =
+                material.data() + static_cast<size_t>(block) * blockSize;
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto size = codec.encode(input, 1, blockSize,
+                                           encoded.data(), encoded.size());
+            const auto middle = std::chrono::steady_clock::now();
+            REQUIRE(codec.decode(encoded.data(), size, 1, blockSize,
+                                 decoded.data()));
+            const auto end = std::chrono::steady_clock::now();
+
+            totalSize += size;
+            encodeTime += middle - start;
+            decodeTime += end - middle;
+        }
+
+        const auto ratio = static_cast<double>(totalSize) /
+                           (static_cast<double>(numBlocks) * blockSize * 2);
+        WARN("block " << blockSize << ": encode "
+                      << encodeTime.count() / numBlocks << " ns, decode "
+                      << decodeTime.count() / numBlocks
+                      << " ns per channel, size "
+                      << static_cast<int>(ratio * 100.0)
+                      << "% of 16-bit PCM");
+    }
+}
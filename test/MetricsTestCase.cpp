@@ -0,0 +1,95 @@
+#include <catch2/catch.hpp>
+
+#include <cmath>
+
+#include "Metrics.hpp"
+
+TEST_CASE("Histogram counts values into buckets") {
+    Histogram histogram(1.0, 2.0, 4);
+
+    REQUIRE(histogram.getNumBuckets() == 4);
+    CHECK(histogram.getUpperBound(0) == 1.0);
+    CHECK(histogram.getUpperBound(3) == 8.0);
+    CHECK(histogram.getPercentile(0.5) == 0.0);
+
+    for (const auto value : {0.5, 1.0, 1.5, 3.0, 8.0, 100.0}) {
+        histogram.record(value);
+    }
+
+    CHECK(histogram.getBucketCount(0) == 2);
+    CHECK(histogram.getBucketCount(1) == 1);
+    CHECK(histogram.getBucketCount(2) == 1);
+    CHECK(histogram.getBucketCount(3) == 1);
+    CHECK(histogram.getBucketCount(4) == 1);
+    CHECK(histogram.getCount() == 6);
+    CHECK(histogram.getSum() == Approx(114.0));
+
+    CHECK(histogram.getPercentile(0.0) == 1.0);
+    CHECK(histogram.getPercentile(0.5) == 2.0);
+    CHECK(histogram.getPercentile(0.8) == 8.0);
+    CHECK(std::isinf(histogram.getPercentile(1.0)));
+}
+
+TEST_CASE("ScopedTimer records one duration") {
+    Histogram histogram(1.0e-6, 2.0, 20);
+    { const ScopedTimer timer(histogram); }
+
+    CHECK(histogram.getCount() == 1);
+    CHECK(histogram.getSum() >= 0.0);
+}
+
+TEST_CASE("MetricsRegistry renders Prometheus text") {
+    MetricsRegistry registry;
+    Histogram histogram(0.5, 2.0, 2);
+    histogram.record(0.25);
+    histogram.record(3.0);
+
+    registry.addCounter("packets_total", "Packets", [] { return 7.0; },
+                        {{"stream", "0"}});
+    registry.addGauge("fill_ratio", "Fill", [] { return 0.5; });
+    registry.addCounter("packets_total", "Packets", [] { return 3.0; },
+                        {{"stream", "1"}});
+    registry.addCounter("packets_total", "Packets", [] { return NAN; },
+                        {{"stream", "2"}});
+    registry.addHistogram("time_seconds", "Time", histogram);
+
+    CHECK(registry.size() == 5);
+    CHECK(registry.toPrometheus() ==
+          "# HELP packets_total Packets\n"
+          "# TYPE packets_total counter\n"
+          "packets_total{stream=\"0\"} 7\n"
+          "packets_total{stream=\"1\"} 3\n"
+          "# HELP fill_ratio Fill\n"
+          "# TYPE fill_ratio gauge\n"
+          "fill_ratio 0.5\n"
+          "# HELP time_seconds Time\n"
+          "# TYPE time_seconds histogram\n"
+          "time_seconds_bucket{le=\"0.5\"} 1\n"
+          "time_seconds_bucket{le=\"1\"} 1\n"
+          "time_seconds_bucket{le=\"+Inf\"} 2\n"
+          "time_seconds_sum 3.25\n"
+          "time_seconds_count 2\n");
+}
+
+TEST_CASE("MetricsRegistry renders JSON") {
+    MetricsRegistry registry;
+    Histogram histogram(1.0, 2.0, 1);
+    histogram.record(0.5);
+
+    registry.addCounter("errors_total", "Errors", [] { return 2.0; },
+                        {{"destination", "a\"b"}});
+    registry.addGauge("unused", "Skipped", [] { return NAN; });
+    registry.addHistogram("time_seconds", "Time", histogram);
+
+    CHECK(registry.toJson() ==
+          "{\"metrics\":["
+          "{\"name\":\"errors_total\",\"type\":\"counter\","
+          "\"labels\":{\"destination\":\"a\\\"b\"},\"value\":2},"
+          "{\"name\":\"time_seconds\",\"type\":\"histogram\",\"labels\":{},"
+          "\"count\":1,\"sum\":0.5,\"buckets\":[{\"le\":1,\"count\":1},"
+          "{\"le\":null,\"count\":0}]}]}\n");
+
+    registry.clear();
+    CHECK(registry.size() == 0);
+    CHECK(registry.toJson() == "{\"metrics\":[]}\n");
+}
@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "JitterBuffer.hpp"
+#include "Packetizer.hpp"
+#include "StreamPlayout.hpp"
+
+namespace {
+struct Frame {
+    JitterBuffer::FrameInfo info;
+    std::vector<float> samples;
+};
+
+/** Two channels, the second the negative of the first. */
+std::vector<float> makeBlock(size_t numSamples, float start) {
+    std::vector<float> block(2 * numSamples);
+    for (size_t i = 0; i < numSamples; ++i) {
+        block[i] = start + static_cast<float>(i);
+        block[numSamples + i] = -block[i];
+    }
+    return block;
+}
+}  // namespace
+
+TEST_CASE("Packetizer re-blocks any block size into whole frames") {
+    Packetizer packetizer;
+    packetizer.prepare(2, 120);
+    REQUIRE(packetizer.getFrameSize() == 120);
+
+    std::vector<Frame> frames;
+    auto emit = [&frames](const float* samples,
+                          const JitterBuffer::FrameInfo& info) {
+        frames.push_back(
+            {info, {samples, samples + 2 * info.numSamples}});
+    };
+
+    // 32 + 500 + 64 samples: four whole frames and 116 samples left over
+    uint64_t timestamp = 0;
+    for (const size_t numSamples : {32, 500, 64}) {
+        const auto block =
+            makeBlock(numSamples, static_cast<float>(timestamp));
+        packetizer.add(block.data(), 2, numSamples, timestamp, emit);
+        timestamp += numSamples;
+    }
+
+    REQUIRE(frames.size() == 4);
+    CHECK(packetizer.getNumPending() == 116);
+
+    for (uint32_t i = 0; i < frames.size(); ++i) {
+        const auto& frame = frames[i];
+        CHECK(frame.info.numChannels == 2);
+        CHECK(frame.info.numSamples == 120);
+        CHECK(frame.info.sequence == i);
+        CHECK(frame.info.timestamp == i * 120);
+        CHECK(frame.samples[0] == static_cast<float>(i * 120));
+        CHECK(frame.samples[119] == static_cast<float>(i * 120 + 119));
+        CHECK(frame.samples[120] == -static_cast<float>(i * 120));
+    }
+
+    // A short last frame is packed
+    packetizer.flush(emit);
+    REQUIRE(frames.size() == 5);
+    CHECK(frames[4].info.numSamples == 116);
+    CHECK(frames[4].samples[115] == 595.0f);
+    CHECK(frames[4].samples[116] == -480.0f);
+}
+
+TEST_CASE("Packetizer skips sequence numbers over dropped blocks") {
+    Packetizer packetizer;
+    packetizer.prepare(2, 100);
+
+    std::vector<JitterBuffer::FrameInfo> frames;
+    auto emit = [&frames](const float*, const JitterBuffer::FrameInfo& info) {
+        frames.push_back(info);
+    };
+
+    const auto block = makeBlock(150, 0.0f);
+    packetizer.add(block.data(), 2, 150, 0, emit);
+    // 150 to 400 never arrived
+    packetizer.add(block.data(), 2, 150, 400, emit);
+
+    REQUIRE(frames.size() == 3);
+    CHECK(frames[0].sequence == 0);
+    CHECK(frames[1].sequence == 1);
+    CHECK(frames[1].numSamples == 50);
+    CHECK(frames[1].timestamp == 100);
+    CHECK(frames[2].sequence == 5);
+    CHECK(frames[2].timestamp == 400);
+}
+
+TEST_CASE("Network frames are played out at any device block size") {
+    constexpr size_t frameSize = 120;
+
+    JitterBuffer buffer;
+    buffer.prepare(16384, 2 * frameSize);
+    StreamPlayout playout;
+    playout.prepare(2 * frameSize, 48000, 2, 1000, 48000.0);
+    playout.setTargetDelay(1200);
+
+    Packetizer packetizer;
+    packetizer.prepare(2, frameSize);
+    auto push = [&buffer](const float* samples,
+                          const JitterBuffer::FrameInfo& info) {
+        REQUIRE(buffer.push(info, samples));
+    };
+
+    const std::vector<float> ones(2 * 1000, 1.0f);
+    std::vector<float> out(2 * 1000);
+    uint64_t sent = 0;
+    uint64_t played = 0;
+
+    // Enough queued ahead to ride out the uneven blocks
+    packetizer.add(ones.data(), 2, 1000, sent, push);
+    packetizer.add(ones.data(), 2, 1000, sent + 1000, push);
+    sent += 2000;
+
+    // Odd and large device blocks on both sides
+    for (auto round = 0; round < 60; ++round) {
+        const size_t sendSize = round % 2 == 0 ? 37 : 1000;
+        packetizer.add(ones.data(), 2, sendSize, sent, push);
+        sent += sendSize;
+
+        const auto readSize = static_cast<int>(round % 2 == 0 ? 45 : 992);
+        float* outputs[] = {out.data(), out.data() + readSize};
+        playout.read(buffer, outputs, 2, readSize);
+        played += static_cast<uint64_t>(readSize);
+    }
+
+    CHECK(buffer.getNumUnderruns() == 0);
+    CHECK(out[0] == Approx(1.0f).margin(0.01));
+    CHECK(out[44] == Approx(1.0f).margin(0.01));
+    CHECK(played < sent);
+}
@@ -0,0 +1,79 @@
+#include <catch2/catch.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JitterBuffer.hpp"
+#include "RealtimeChecker.hpp"
+#include "SmoothedGain.hpp"
+#include "StreamMixer.hpp"
+#include "StreamPlayout.hpp"
+
+TEST_CASE("RealtimeChecker counts blocking calls inside callbacks only") {
+    const auto before = RealtimeChecker::getNumViolations();
+
+    std::mutex mutex;
+    {
+        const std::lock_guard lock(mutex);
+    }
+    auto outside = std::make_unique<std::vector<int>>(16);
+    CHECK(RealtimeChecker::getNumViolations() == before);
+    CHECK_FALSE(RealtimeChecker::isInCallback());
+
+    {
+        const RealtimeChecker::ScopedCallback callback;
+        const std::lock_guard lock(mutex);
+        outside->resize(1024);
+    }
+
+    if (RealtimeChecker::isEnabled()) {
+        CHECK(RealtimeChecker::getNumViolations() >= before + 2);
+    } else {
+        CHECK(RealtimeChecker::getNumViolations() == before);
+    }
+}
+
+TEST_CASE("The receive path makes no blocking calls once prepared") {
+    // Nothing is counted without the checks, so this would always pass
+    if (!RealtimeChecker::isEnabled()) {
+        WARN("Skipped, configure with -DAUDIO_STREAM_REALTIME_CHECKS=ON");
+        return;
+    }
+
+    constexpr int blockSize = 64;
+
+    JitterBuffer buffer;
+    buffer.prepare(4096, 2 * blockSize);
+    StreamPlayout playout;
+    playout.prepare(2 * blockSize, 48000, 2, blockSize, 48000.0);
+    playout.setTargetDelay(2 * blockSize);
+    StreamMixer mixer;
+    mixer.prepare(1);
+    SmoothedGain gain;
+
+    const std::vector<float> input(2 * blockSize, 0.25f);
+    std::vector<float> mix(2 * blockSize);
+    std::vector<float> out(2 * blockSize);
+    float* mixChannels[] = {mix.data(), mix.data() + blockSize};
+    float* outputs[] = {out.data(), out.data() + blockSize};
+
+    const auto before = RealtimeChecker::getNumViolations();
+    for (uint32_t block = 0; block < 100; ++block) {
+        REQUIRE(buffer.push({2, blockSize, block, block * 64ull},
+                            input.data()));
+
+        // Everything ReceiveEngine::read() does per stream
+        const RealtimeChecker::ScopedCallback callback;
+        playout.read(buffer, mixChannels, 2, blockSize);
+        std::fill(out.begin(), out.end(), 0.0f);
+        mixer.setGain(0, block % 2 == 0 ? 1.0f : 0.5f);
+        mixer.add(0, mixChannels, outputs, 2, blockSize);
+        gain.setTarget(block % 3 == 0 ? 1.0f : 0.8f);
+        const auto segment = gain.next(blockSize);
+        for (auto* output : outputs) {
+            SmoothedGain::multiply(output, segment, blockSize);
+        }
+    }
+
+    CHECK(RealtimeChecker::getNumViolations() == before);
+}
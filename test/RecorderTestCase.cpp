@@ -0,0 +1,71 @@
+#include <JuceHeader.h>
+#include <catch2/catch.hpp>
+
+#include "Recorder.hpp"
+
+namespace {
+/** Records numSamples of a ramp starting at first, in blocks of 256. */
+void record(Recorder& recorder, const File& file, int first, int numSamples) {
+    REQUIRE(recorder.start(file));
+
+    std::vector<float> left(256), right(256);
+    for (auto start = 0; start < numSamples; start += 256) {
+        const auto count = jmin(256, numSamples - start);
+        for (auto i = 0; i < count; ++i) {
+            left[static_cast<size_t>(i)] =
+                static_cast<float>((first + start + i) % 1000) / 1000.0f;
+            right[static_cast<size_t>(i)] = -left[static_cast<size_t>(i)];
+        }
+        const float* channels[] = {left.data(), right.data()};
+        recorder.write(channels, 2, count);
+    }
+
+    recorder.stop();
+}
+
+/** Checks that file holds numSamples of the ramp starting at first. */
+void checkFile(const File& file, int first, int numSamples) {
+    WavAudioFormat format;
+    const std::unique_ptr<AudioFormatReader> reader(
+        format.createReaderFor(file.createInputStream().release(), true));
+    REQUIRE(reader != nullptr);
+    CHECK(reader->numChannels == 2u);
+    CHECK(reader->lengthInSamples == numSamples);
+
+    AudioBuffer<float> audio(2, numSamples);
+    REQUIRE(reader->read(&audio, 0, numSamples, 0, true, true));
+    for (auto i = 0; i < numSamples; ++i) {
+        const auto expected =
+            static_cast<float>((first + i) % 1000) / 1000.0f;
+        REQUIRE(audio.getSample(0, i) == Approx(expected).margin(1.0e-6));
+        REQUIRE(audio.getSample(1, i) == Approx(-expected).margin(1.0e-6));
+    }
+}
+}  // namespace
+
+TEST_CASE("Recorder writes each recording to its own file") {
+    const auto directory =
+        File::getSpecialLocation(File::tempDirectory)
+            .getChildFile("AudioStreamRecorderTest")
+            .getNonexistentSibling();
+    REQUIRE(directory.createDirectory().wasOk());
+
+    Recorder recorder;
+    recorder.prepare(48000.0, 2);
+
+    const auto first = directory.getChildFile("first.wav");
+    record(recorder, first, 0, 48000);
+    checkFile(first, 0, 48000);
+
+    // The second file only holds its own audio, and no space reserved
+    // for the first is left over at its end
+    const auto second = directory.getChildFile("second.wav");
+    record(recorder, second, 500, 10000);
+    checkFile(second, 500, 10000);
+    CHECK(second.getSize() < first.getSize());
+    CHECK(recorder.getNumSamplesWritten() == 58000);
+    CHECK(recorder.getNumDroppedBlocks() == 0);
+    CHECK(recorder.getNumWriteErrors() == 0);
+
+    directory.deleteRecursively();
+}
@@ -0,0 +1,227 @@
+#include <catch2/catch.hpp>
+
+#include "ReorderBuffer.hpp"
+#include "StreamPlayout.hpp"
+
+namespace {
+StreamPacketHeader makeHeader(uint32_t sequence, uint16_t channel) {
+    StreamPacketHeader header;
+    header.streamId = 7;
+    header.sequence = sequence;
+    header.timestamp = sequence * 4ull;
+    header.channelIndex = channel;
+    header.totalChannels = 2;
+    header.numSamples = 4;
+    return header;
+}
+
+void addBlock(ReorderBuffer& reorder, JitterBuffer& output,
+              uint32_t sequence) {
+    const std::vector<float> left(4, static_cast<float>(sequence));
+    const std::vector<float> right(4, -static_cast<float>(sequence));
+
+    reorder.addPacket(makeHeader(sequence, 0), left.data(), output);
+    reorder.addPacket(makeHeader(sequence, 1), right.data(), output);
+}
+}  // namespace
+
+TEST_CASE("ReorderBuffer releases swapped blocks in sequence order") {
+    ReorderBuffer reorder;
+    reorder.prepare(8, 2, 4, 1000);
+
+    JitterBuffer output;
+    output.prepare(256, 8);
+
+    addBlock(reorder, output, 0);
+    addBlock(reorder, output, 2);
+    addBlock(reorder, output, 1);
+
+    std::vector<float> frame(8);
+    JitterBuffer::FrameInfo info;
+
+    for (uint32_t sequence = 0; sequence < 3; ++sequence) {
+        REQUIRE(output.pop(frame.data(), frame.size(), &info));
+        CHECK(info.sequence == sequence);
+        CHECK(info.numChannels == 2);
+        CHECK(frame[0] == static_cast<float>(sequence));
+        CHECK(frame[4] == -static_cast<float>(sequence));
+    }
+
+    CHECK(reorder.getNumReordered() == 2);
+    CHECK(reorder.getNumLost() == 0);
+}
+
+TEST_CASE("ReorderBuffer accepts every channel of a block in one packet") {
+    ReorderBuffer reorder;
+    reorder.prepare(8, 2, 4, 1000);
+
+    JitterBuffer output;
+    output.prepare(256, 8);
+
+    auto header = makeHeader(0, 0);
+    header.numChannels = 2;
+    const std::vector<float> planar{1, 1, 1, 1, -1, -1, -1, -1};
+    reorder.addPacket(header, planar.data(), output);
+
+    std::vector<float> frame(8);
+    JitterBuffer::FrameInfo info;
+    REQUIRE(output.pop(frame.data(), frame.size(), &info));
+    CHECK(info.numChannels == 2);
+    CHECK(frame == planar);
+    CHECK(reorder.getNumIncomplete() == 0);
+}
+
+TEST_CASE("ReorderBuffer counts duplicates, late packets and losses") {
+    ReorderBuffer reorder;
+    reorder.prepare(8, 2, 4, 8);
+
+    JitterBuffer output;
+    output.prepare(256, 8);
+
+    addBlock(reorder, output, 0);
+    addBlock(reorder, output, 0);
+    CHECK(reorder.getNumLate() == 2);
+
+    // Sequence 1 never arrives and is given up once enough audio is newer
+    addBlock(reorder, output, 2);
+    addBlock(reorder, output, 3);
+    addBlock(reorder, output, 4);
+
+    CHECK(reorder.getNumLost() == 1);
+    CHECK(reorder.getNumReceived() == 4);
+}
+
+TEST_CASE("StreamPlayout fills timestamp gaps") {
+    JitterBuffer buffer;
+    buffer.prepare(64, 4);
+
+    StreamPlayout playout;
+    playout.prepare(4, 100, 1, 12, 48000.0);
+    playout.setConcealmentMode(LossConcealer::Mode::silence);
+
+    const std::vector<float> ones(4, 1.0f);
+    REQUIRE(buffer.push({1, 4, 0, 0}, ones.data()));
+    REQUIRE(buffer.push({1, 4, 2, 8}, ones.data()));
+
+    std::vector<float> out(12, -1.0f);
+    float* outputs[] = {out.data()};
+    playout.read(buffer, outputs, 1, 12);
+
+    CHECK(out[3] == 1.0f);
+    CHECK(out[4] == 0.0f);
+    CHECK(out[7] == 0.0f);
+    // The frame after the gap is crossfaded in from the concealment
+    CHECK(out[8] == Approx(0.2f));
+    CHECK(out[11] == Approx(0.8f));
+    CHECK(playout.getNumGapSamples() == 4);
+}
+
+TEST_CASE("StreamPlayout waits for its target delay, then shrinks excess") {
+    JitterBuffer buffer;
+    buffer.prepare(4096, 64);
+
+    StreamPlayout playout;
+    playout.prepare(64, 1000, 1, 64, 48000.0);
+    playout.setTargetDelay(128);
+
+    const std::vector<float> ones(64, 1.0f);
+    std::vector<float> out(64);
+    float* outputs[] = {out.data()};
+
+    REQUIRE(buffer.push({1, 64, 0, 0}, ones.data()));
+    playout.read(buffer, outputs, 1, 64);
+    CHECK(out[0] == 0.0f);
+
+    for (uint32_t sequence = 1; sequence < 40; ++sequence) {
+        REQUIRE(buffer.push({1, 64, sequence, sequence * 64ull},
+                            ones.data()));
+    }
+
+    for (auto block = 0; block < 30; ++block) {
+        playout.read(buffer, outputs, 1, 64);
+        CHECK(out[0] == Approx(1.0f).margin(1.0e-3));
+    }
+
+    CHECK(out[63] == Approx(1.0f).margin(0.01));
+    CHECK(playout.getResampleRatio() > 1.0);
+}
+
+TEST_CASE("StreamPlayout plays comfort noise while the sender is silent") {
+    JitterBuffer buffer;
+    buffer.prepare(64, 4);
+
+    StreamPlayout playout;
+    playout.prepare(4, 100, 1, 64, 48000.0);
+
+    const std::vector<float> ones(4, 1.0f);
+    const std::vector<float> noise{0.01f, -0.01f, 0.01f, -0.01f};
+    REQUIRE(buffer.push({1, 4, 0, 0}, ones.data()));
+    REQUIRE(buffer.push({1, 4, 1, 4, true}, noise.data()));
+
+    std::vector<float> out(64);
+    float* outputs[] = {out.data()};
+    playout.read(buffer, outputs, 1, 64);
+
+    // Nothing more arrives, yet nothing ran dry
+    CHECK(playout.isPlayingComfortNoise());
+    CHECK(playout.getNumComfortNoiseSamples() > 0);
+    CHECK(playout.getNumRebuffers() == 0);
+    CHECK(buffer.getNumUnderruns() == 0);
+    CHECK(std::abs(out[63]) > 0.0f);
+    CHECK(std::abs(out[63]) < 0.02f);
+
+    // Audio resumes past where the noise got to
+    REQUIRE(buffer.push({1, 4, 2, 100}, ones.data()));
+    playout.read(buffer, outputs, 1, 64);
+
+    CHECK_FALSE(playout.isPlayingComfortNoise());
+    CHECK(playout.getNumGapSamples() == 0);
+    CHECK(playout.getNumRebuffers() == 1);
+}
+
+TEST_CASE("ReorderBuffer reports the packets still missing") {
+    ReorderBuffer reorder;
+    reorder.prepare(8, 2, 4, 20);
+
+    JitterBuffer output;
+    output.prepare(256, 8);
+
+    addBlock(reorder, output, 0);
+    const std::vector<float> left(4, 2.0f);
+    CHECK(reorder.addPacket(makeHeader(2, 0), left.data(), output) ==
+          ReorderBuffer::Result::added);
+    addBlock(reorder, output, 3);
+
+    struct Missing {
+        uint32_t sequence;
+        uint32_t channelMask;
+        int64_t samplesLeft;
+    };
+    std::vector<Missing> missing;
+    reorder.forEachMissing([&](uint32_t sequence, uint32_t channelMask,
+                               int64_t samplesLeft) {
+        missing.push_back({sequence, channelMask, samplesLeft});
+    });
+
+    // Newest audio ends at 16: sequence 1 starts at 4, 2 at 8
+    REQUIRE(missing.size() == 2);
+    CHECK(missing[0].sequence == 1);
+    CHECK(missing[0].channelMask == 0x3);
+    CHECK(missing[0].samplesLeft == 8);
+    CHECK(missing[1].sequence == 2);
+    CHECK(missing[1].channelMask == 0x2);
+    CHECK(missing[1].samplesLeft == 12);
+
+    // Once the missing packets arrive, nothing is left to ask for
+    CHECK(reorder.addPacket(makeHeader(2, 0), left.data(), output) ==
+          ReorderBuffer::Result::duplicate);
+    addBlock(reorder, output, 1);
+    const std::vector<float> right(4, -2.0f);
+    reorder.addPacket(makeHeader(2, 1), right.data(), output);
+
+    auto numMissing = 0;
+    reorder.forEachMissing([&](uint32_t, uint32_t, int64_t) { ++numMissing; });
+    CHECK(numMissing == 0);
+    CHECK(reorder.addPacket(makeHeader(1, 0), left.data(), output) ==
+          ReorderBuffer::Result::late);
+}
@@ -0,0 +1,163 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+
+#include "DriftEstimator.hpp"
+#include "Resampler.hpp"
+#include "StreamPlayout.hpp"
+
+TEST_CASE("Resampler passes audio through unchanged at a ratio of 1") {
+    Resampler resampler;
+    resampler.prepare(1, 64);
+
+    std::vector<float> input(64), output(64), played;
+    for (auto block = 0; block < 4; ++block) {
+        for (auto i = 0; i < 64; ++i) {
+            input[static_cast<size_t>(i)] =
+                std::sin(0.05f * static_cast<float>(block * 64 + i));
+        }
+
+        const float* inputs[] = {input.data()};
+        float* outputs[] = {output.data()};
+        REQUIRE(resampler.getNumInputNeeded(64, 1.0) == 64);
+        resampler.process(inputs, 64, outputs, 1, 64, 1.0);
+        played.insert(played.end(), output.begin(), output.end());
+    }
+
+    // Copied through, without the filter's delay or its low-pass
+    for (auto i = 0; i < 256; ++i) {
+        CHECK(played[static_cast<size_t>(i)] ==
+              std::sin(0.05f * static_cast<float>(i)));
+    }
+}
+
+TEST_CASE("Resampler switches between copying and filtering seamlessly") {
+    Resampler resampler;
+    resampler.prepare(1, 128);
+
+    std::vector<float> input(128), output(64);
+    auto consumed = 0.0;
+    auto next = 0;
+
+    for (auto block = 0; block < 16; ++block) {
+        // Copies every other block, and barely resamples the others
+        const auto ratio = block % 2 == 0 ? 1.0 : 1.0001;
+        const auto numInput = resampler.getNumInputNeeded(64, ratio);
+        for (auto i = 0; i < numInput; ++i) {
+            input[static_cast<size_t>(i)] =
+                std::sin(0.05f * static_cast<float>(next + i));
+        }
+        next += numInput;
+
+        const float* inputs[] = {input.data()};
+        float* outputs[] = {output.data()};
+        resampler.process(inputs, numInput, outputs, 1, 64, ratio);
+
+        for (auto i = 0; i < 64; ++i) {
+            CHECK(output[static_cast<size_t>(i)] ==
+                  Approx(std::sin(0.05 * (consumed + i * ratio)))
+                      .margin(2.0e-3));
+        }
+        // Copying picks up at the sample the filter was last between
+        consumed = ratio == 1.0 ? consumed + 64
+                                : std::floor(consumed + 64 * ratio);
+    }
+}
+
+TEST_CASE("Resampler consumes input at the requested ratio") {
+    Resampler resampler;
+    resampler.prepare(1, 600);
+
+    std::vector<float> input(600, 0.5f), output(512);
+    const float* inputs[] = {input.data()};
+    float* outputs[] = {output.data()};
+
+    auto consumed = 0;
+    for (auto block = 0; block < 100; ++block) {
+        const auto numInput = resampler.getNumInputNeeded(512, 1.01);
+        resampler.process(inputs, numInput, outputs, 1, 512, 1.01);
+        consumed += numInput;
+    }
+
+    // The first block also reads the filter's lookahead
+    CHECK(consumed ==
+          Approx(51200 * 1.01 + Resampler::numTaps / 2).margin(2.0));
+    CHECK(output[511] == Approx(0.5f).margin(1.0e-3));
+}
+
+TEST_CASE("DriftEstimator learns a constant clock offset") {
+    DriftEstimator estimator;
+    estimator.prepare(48000.0, 0.005);
+
+    // The sender runs 100 ppm fast, so the delay grows unless corrected
+    auto delay = 960.0;
+    for (auto block = 0; block < 48000 / 512 * 300; ++block) {
+        const auto ratio = estimator.update(delay, 960.0, 512);
+        delay += 512 * 1.0001 - 512 * ratio;
+    }
+
+    CHECK(estimator.getDriftPpm() == Approx(100.0).margin(5.0));
+    CHECK(delay == Approx(960.0).margin(2.0));
+}
+
+TEST_CASE("StreamPlayout converts a stream to the device's rate") {
+    // 10 ms frames of a 1 kHz tone at 44.1 kHz, played at 48 kHz
+    constexpr uint32_t frameSize = 441;
+    constexpr auto twoPi = 6.283185307179586;
+
+    JitterBuffer buffer;
+    buffer.prepare(16384, frameSize);
+    StreamPlayout playout;
+    playout.prepare(frameSize, 44100, 1, 480, 48000.0, 96000.0);
+    playout.setSourceRate(44100.0);
+    playout.setTargetDelay(2 * frameSize);
+
+    std::vector<float> frame(frameSize), output(480);
+    float* outputs[] = {output.data()};
+    uint32_t sequence = 0;
+    uint64_t timestamp = 0;
+    auto previous = 0.0f;
+    auto numCrossings = 0;
+
+    for (auto block = 0; block < 200; ++block) {
+        for (uint32_t i = 0; i < frameSize; ++i) {
+            frame[i] = static_cast<float>(
+                std::sin(twoPi * 1000.0 *
+                         static_cast<double>(timestamp + i) / 44100.0));
+        }
+        REQUIRE(buffer.push({1, frameSize, sequence++, timestamp},
+                            frame.data()));
+        timestamp += frameSize;
+
+        playout.read(buffer, outputs, 1, 480);
+
+        // Counts rising zero crossings over the last second
+        for (const auto sample : output) {
+            if (block >= 100 && previous < 0.0f && sample >= 0.0f) {
+                ++numCrossings;
+            }
+            previous = sample;
+        }
+    }
+
+    CHECK(numCrossings == Approx(1000).margin(2));
+    CHECK(playout.getResampleRatio() ==
+          Approx(44100.0 / 48000.0).epsilon(0.005));
+    CHECK(buffer.getNumUnderruns() == 0);
+}
+
+TEST_CASE("StreamPlayout builds a filter ahead for each rate it downsamples") {
+    StreamPlayout::Filters filters;
+    filters.prepare(48000.0, 192000.0);
+
+    CHECK(filters.find(44100.0) == nullptr);
+    CHECK(filters.find(48000.0) == nullptr);
+
+    const auto* filter = filters.find(96000.0);
+    REQUIRE(filter != nullptr);
+    CHECK(filter->getCutoff() == Approx(0.95 * 48000.0 / 96000.0));
+
+    // Between standard rates, the next one up never lets anything alias
+    CHECK(filters.find(90000.0) == filter);
+    CHECK(filters.find(176400.0)->getCutoff() ==
+          Approx(0.95 * 48000.0 / 176400.0));
+}
@@ -0,0 +1,137 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "Retransmission.hpp"
+
+namespace {
+using Packet = std::vector<uint8_t>;
+
+Packet makePacket(uint32_t sequence, uint16_t channel) {
+    StreamPacketHeader header;
+    header.streamId = 7;
+    header.sequence = sequence;
+    header.timestamp = sequence * 4ull;
+    header.channelIndex = channel;
+    header.totalChannels = 2;
+    header.numSamples = 4;
+
+    Packet packet(StreamPacketHeader::size + header.getPayloadSize());
+    header.write(packet.data());
+    packet.back() = static_cast<uint8_t>(sequence * 2 + channel);
+    return packet;
+}
+
+void add(RetransmitHistory& history, const Packet& packet) {
+    StreamPacketHeader header;
+    REQUIRE(header.read(packet.data(), packet.size()));
+    history.add(header, packet.data(), packet.size());
+}
+
+std::vector<Packet> find(RetransmitHistory& history, uint32_t sequence,
+                         uint32_t channelMask) {
+    std::vector<Packet> found;
+    history.forEach(sequence, channelMask, [&](uint8_t* data, size_t size) {
+        found.emplace_back(data, data + size);
+    });
+    return found;
+}
+}  // namespace
+
+TEST_CASE("RetransmitHistory finds packets by sequence and channel") {
+    RetransmitHistory history;
+    history.prepare(4, 2, 256);
+
+    for (uint32_t sequence = 0; sequence < 6; ++sequence) {
+        add(history, makePacket(sequence, 0));
+        add(history, makePacket(sequence, 1));
+    }
+
+    SECTION("only the packets of the channels asked for") {
+        const auto found = find(history, 4, NackEntry::getChannelMask(1, 1));
+        REQUIRE(found.size() == 1);
+        CHECK(found[0] == makePacket(4, 1));
+
+        CHECK(find(history, 5, NackEntry::getChannelMask(0, 2)).size() == 2);
+    }
+
+    SECTION("older sequences are overwritten") {
+        CHECK(find(history, 1, ~0u).empty());
+        CHECK(find(history, 2, ~0u).size() == 2);
+    }
+
+    SECTION("packets may be marked before they are sent again") {
+        history.forEach(3, ~0u, [](uint8_t* data, size_t) {
+            StreamPacketHeader::addFlags(data,
+                                         StreamPacketHeader::retransmitted);
+        });
+
+        const auto found = find(history, 3, 0x1);
+        REQUIRE(found.size() == 1);
+        StreamPacketHeader header;
+        REQUIRE(header.read(found[0].data(), found[0].size()));
+        CHECK(header.isRetransmitted());
+    }
+}
+
+TEST_CASE("RetransmitHistory keeps nothing until prepared") {
+    RetransmitHistory history;
+    add(history, makePacket(0, 0));
+    CHECK(find(history, 0, ~0u).empty());
+}
+
+TEST_CASE("NackTracker asks only while an answer can arrive in time") {
+    NackTracker tracker;
+    tracker.prepare(8, 2, 0.005, 0.0);
+
+    SECTION("too close to the deadline") {
+        CHECK_FALSE(tracker.shouldRequest(1, 0.0, 0.004));
+        CHECK_FALSE(tracker.shouldRequest(1, 0.001, 0.003));
+        CHECK(tracker.getNumExpired() == 1);
+        CHECK(tracker.getNumRequests() == 0);
+    }
+
+    SECTION("asked again after twice the round trip, up to the limit") {
+        CHECK(tracker.shouldRequest(1, 0.0, 0.030));
+        CHECK_FALSE(tracker.shouldRequest(1, 0.005, 0.025));
+        CHECK(tracker.shouldRequest(1, 0.010, 0.020));
+        CHECK_FALSE(tracker.shouldRequest(1, 0.020, 0.010));
+        CHECK(tracker.getNumRequests() == 2);
+
+        // Answers to a frame asked for twice aren't timed
+        tracker.addRetransmission(1, 0.012, ReorderBuffer::Result::added);
+        CHECK_FALSE(tracker.hasRoundTripTime());
+        CHECK(tracker.getNumRecovered() == 1);
+    }
+}
+
+TEST_CASE("NackTracker gives reordered packets time to arrive") {
+    NackTracker tracker;
+    tracker.prepare(8, 2, 0.005, 0.002);
+
+    // First seen missing at 1 s, asked for 2 ms later
+    CHECK_FALSE(tracker.shouldRequest(1, 1.0, 0.030));
+    CHECK_FALSE(tracker.shouldRequest(1, 1.001, 0.029));
+    CHECK(tracker.shouldRequest(1, 1.002, 0.028));
+    CHECK(tracker.getNumRequests() == 1);
+
+    // A frame that turned up in the meantime was never asked for
+    CHECK_FALSE(tracker.shouldRequest(2, 1.002, 0.030));
+    CHECK(tracker.getNumRequests() == 1);
+}
+
+TEST_CASE("NackTracker measures the round trip from answers") {
+    NackTracker tracker;
+    tracker.prepare(8, 2, 0.005, 0.0);
+
+    REQUIRE(tracker.shouldRequest(1, 1.0, 0.030));
+    tracker.addRetransmission(1, 1.002, ReorderBuffer::Result::added);
+    REQUIRE(tracker.hasRoundTripTime());
+    CHECK(tracker.getRoundTripTime() == Approx(0.002));
+
+    // Later measurements are smoothed
+    REQUIRE(tracker.shouldRequest(2, 2.0, 0.030));
+    tracker.addRetransmission(2, 2.010, ReorderBuffer::Result::late);
+    CHECK(tracker.getRoundTripTime() == Approx(0.003));
+    CHECK(tracker.getNumLate() == 1);
+    CHECK(tracker.getNumRecovered() == 1);
+}
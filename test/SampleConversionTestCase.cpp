@@ -0,0 +1,97 @@
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <vector>
+
+#include "SampleConversion.hpp"
+
+namespace {
+std::vector<float> makeSignal(size_t numSamples) {
+    std::vector<float> signal(numSamples);
+    for (size_t i = 0; i < numSamples; ++i) {
+        signal[i] = 0.8f * std::sin(0.01f * static_cast<float>(i));
+    }
+    return signal;
+}
+}  // namespace
+
+TEST_CASE("SampleConverter round-trips integer steps exactly") {
+    const SampleFormat formats[] = {SampleFormat::int16, SampleFormat::int24};
+    const float scales[] = {32768.0f, 8388608.0f};
+
+    for (size_t f = 0; f < 2; ++f) {
+        // An odd count exercises the vector loops and the scalar tail
+        std::vector<float> input(101), output(101);
+        for (size_t i = 0; i < input.size(); ++i) {
+            input[i] = std::round((static_cast<float>(i) - 50.0f) * 317.0f) /
+                       scales[f];
+        }
+
+        SampleConverter converter;
+        converter.setDitherEnabled(false);
+        std::vector<uint8_t> wire(input.size() *
+                                  getBytesPerSample(formats[f]));
+        converter.toWire(formats[f], input.data(), wire.data(), input.size());
+        SampleConverter::fromWire(formats[f], wire.data(), output.data(),
+                                  output.size());
+
+        CHECK(output == input);
+    }
+}
+
+TEST_CASE("SampleConverter writes little-endian integers and clips") {
+    SampleConverter converter;
+    converter.setDitherEnabled(false);
+
+    const float input[] = {-1.0f, 0.5f, 2.0f, -2.0f};
+    uint8_t wire[4 * 3] = {};
+
+    converter.toWire(SampleFormat::int16, input, wire, 4);
+    CHECK(wire::readLE<uint16_t>(wire) == 0x8000);
+    CHECK(wire::readLE<uint16_t>(wire + 2) == 0x4000);
+    CHECK(wire::readLE<uint16_t>(wire + 4) == 0x7fff);
+    CHECK(wire::readLE<uint16_t>(wire + 6) == 0x8000);
+
+    converter.toWire(SampleFormat::int24, input, wire, 4);
+    const uint8_t expected[] = {0x00, 0x00, 0x80, 0x00, 0x00, 0x40,
+                                0xff, 0xff, 0x7f, 0x00, 0x00, 0x80};
+    CHECK(std::equal(wire, wire + sizeof(wire), expected));
+}
+
+TEST_CASE("SampleConverter dithers within one step") {
+    const auto input = makeSignal(1000);
+    std::vector<float> output(input.size());
+    std::vector<uint8_t> wire(input.size() * 2);
+
+    SampleConverter converter;
+    converter.toWire(SampleFormat::int16, input.data(), wire.data(),
+                     input.size());
+    SampleConverter::fromWire(SampleFormat::int16, wire.data(), output.data(),
+                              output.size());
+
+    // TPDF dither of +-1 step plus rounding stays within 1.5 steps, and on
+    // average the error is close to zero
+    auto sum = 0.0;
+    auto numChanged = 0;
+    for (size_t i = 0; i < input.size(); ++i) {
+        const auto error = (output[i] - input[i]) * 32768.0f;
+        CHECK(std::abs(error) <= 1.5f);
+        sum += error;
+        numChanged += std::abs(error) > 0.5f ? 1 : 0;
+    }
+    CHECK(std::abs(sum / static_cast<double>(input.size())) < 0.1);
+    CHECK(numChanged > 0);
+}
+
+TEST_CASE("SampleConverter passes float32 through untouched") {
+    const auto input = makeSignal(37);
+    std::vector<float> output(input.size());
+    std::vector<uint8_t> wire(input.size() * sizeof(float));
+
+    SampleConverter converter;
+    converter.toWire(SampleFormat::float32, input.data(), wire.data(),
+                     input.size());
+    SampleConverter::fromWire(SampleFormat::float32, wire.data(),
+                              output.data(), output.size());
+
+    CHECK(output == input);
+}
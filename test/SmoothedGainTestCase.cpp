@@ -0,0 +1,48 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "SmoothedGain.hpp"
+
+TEST_CASE("SmoothedGain ramps to a new target across blocks") {
+    SmoothedGain gain(1.0f, 8);
+
+    auto segment = gain.next(4);
+    CHECK(segment.rampLength == 0);
+    CHECK(segment.end == 1.0f);
+
+    gain.setTarget(0.0f);
+    CHECK(gain.getTarget() == 0.0f);
+
+    // The ramp is split over three blocks and continues where it left off
+    std::vector<float> ramp;
+    for (const auto numSamples : {3, 3, 4}) {
+        std::vector<float> block(static_cast<size_t>(numSamples), 1.0f);
+        segment = gain.next(block.size());
+        SmoothedGain::multiply(block.data(), segment, block.size());
+        ramp.insert(ramp.end(), block.begin(), block.end());
+    }
+
+    for (size_t i = 0; i < 8; ++i) {
+        CHECK(ramp[i] == Approx(1.0f - static_cast<float>(i) / 8.0f));
+    }
+    CHECK(ramp[8] == 0.0f);
+    CHECK(ramp[9] == 0.0f);
+
+    segment = gain.next(4);
+    CHECK(segment.rampLength == 0);
+    CHECK(segment.end == 0.0f);
+}
+
+TEST_CASE("SmoothedGain copies with the gain and resets without a ramp") {
+    SmoothedGain gain(0.5f, 4);
+    const std::vector<float> src{2.0f, 2.0f, 2.0f, 2.0f};
+    std::vector<float> dest(4);
+
+    SmoothedGain::copy(dest.data(), src.data(), gain.next(4), 4);
+    CHECK(dest == std::vector<float>{1.0f, 1.0f, 1.0f, 1.0f});
+
+    gain.setTarget(2.0f);
+    gain.reset();
+    SmoothedGain::copy(dest.data(), src.data(), gain.next(4), 4);
+    CHECK(dest == std::vector<float>{4.0f, 4.0f, 4.0f, 4.0f});
+}
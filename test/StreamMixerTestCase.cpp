@@ -0,0 +1,122 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "StreamMixer.hpp"
+
+namespace {
+std::vector<float> makeSignal(size_t numSamples, float frequency) {
+    std::vector<float> signal(numSamples);
+    for (size_t i = 0; i < numSamples; ++i) {
+        signal[i] = 0.5f * std::sin(frequency * static_cast<float>(i));
+    }
+    return signal;
+}
+}  // namespace
+
+TEST_CASE("StreamMixer kernels match the scalar sums") {
+    // An odd count exercises the vector loops and the scalar tail
+    const auto src = makeSignal(101, 0.01f);
+    const auto base = makeSignal(101, 0.03f);
+
+    auto dest = base;
+    StreamMixer::addWithGain(dest.data(), src.data(), 0.7f, src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        CHECK(dest[i] == Approx(base[i] + src[i] * 0.7f).margin(1.0e-6));
+    }
+
+    dest = base;
+    StreamMixer::addWithRamp(dest.data(), src.data(), 1.0f, -0.01f,
+                             src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+        const auto gain = 1.0f - 0.01f * static_cast<float>(i);
+        CHECK(dest[i] == Approx(base[i] + src[i] * gain).margin(1.0e-5));
+    }
+}
+
+TEST_CASE("StreamMixer sums streams with their own gains") {
+    constexpr int numSamples = 64;
+    const auto first = makeSignal(numSamples, 0.02f);
+    const auto second = makeSignal(numSamples, 0.05f);
+    std::vector<float> output(numSamples, 0.0f);
+
+    const float* firstChannels[] = {first.data()};
+    const float* secondChannels[] = {second.data()};
+    float* outputs[] = {output.data()};
+
+    StreamMixer mixer;
+    mixer.prepare(2);
+    CHECK(mixer.getGain(0) == 1.0f);
+
+    mixer.setGain(1, 0.25f);
+    mixer.resetGain(0);
+
+    SECTION("a new gain is ramped to over one block") {
+        mixer.add(1, secondChannels, outputs, 1, numSamples);
+        CHECK(output[0] == Approx(second[0]));
+        CHECK(output[numSamples - 1] ==
+              Approx(second[numSamples - 1] *
+                     (1.0f - 0.75f * (numSamples - 1) / numSamples)));
+
+        std::fill(output.begin(), output.end(), 0.0f);
+        mixer.add(1, secondChannels, outputs, 1, numSamples);
+        CHECK(output[10] == Approx(second[10] * 0.25f));
+    }
+
+    SECTION("the mix is the sum of the scaled streams") {
+        // Settle the ramp first
+        mixer.add(1, secondChannels, outputs, 1, numSamples);
+        std::fill(output.begin(), output.end(), 0.0f);
+
+        mixer.add(0, firstChannels, outputs, 1, numSamples);
+        mixer.add(1, secondChannels, outputs, 1, numSamples);
+        for (auto i = 0; i < numSamples; ++i) {
+            CHECK(output[i] == Approx(first[i] + 0.25f * second[i]));
+        }
+    }
+
+    SECTION("resetting jumps back to unity") {
+        mixer.resetGain(1);
+        mixer.add(1, secondChannels, outputs, 1, numSamples);
+        CHECK(output == second);
+    }
+}
+
+TEST_CASE("StreamMixer mixing 32 talkers", "[.][benchmark]") {
+    constexpr size_t numStreams = 32;
+    constexpr int numChannels = 2;
+    constexpr int numSamples = 256;
+    constexpr int numBlocks = 20000;
+
+    std::vector<std::vector<float>> inputs;
+    for (size_t i = 0; i < numStreams * numChannels; ++i) {
+        inputs.push_back(makeSignal(numSamples, 0.001f * (i + 1)));
+    }
+    std::vector<float> left(numSamples), right(numSamples);
+    float* outputs[] = {left.data(), right.data()};
+
+    StreamMixer mixer;
+    mixer.prepare(numStreams);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (auto block = 0; block < numBlocks; ++block) {
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+
+        for (size_t stream = 0; stream < numStreams; ++stream) {
+            // Every other stream moves its fader, to time the ramp too
+            mixer.setGain(stream, (block + stream) % 2 == 0 ? 0.5f : 0.6f);
+            const float* channels[] = {inputs[stream * 2].data(),
+                                       inputs[stream * 2 + 1].data()};
+            mixer.add(stream, channels, outputs, numChannels, numSamples);
+        }
+    }
+    const auto seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+    WARN(numStreams << " streams of " << numChannels << " x " << numSamples
+                    << " samples: " << seconds * 1.0e6 / numBlocks
+                    << " us per block, checksum " << left[numSamples / 2]);
+}
@@ -0,0 +1,255 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+
+#include "StreamPacket.hpp"
+
+TEST_CASE("StreamPacketHeader round-trips through its wire format") {
+    StreamPacketHeader header;
+    header.streamId = 0xdeadbeef;
+    header.sequence = 42;
+    header.timestamp = 0x123456789abcull;
+    header.channelIndex = 1;
+    header.numChannels = 1;
+    header.totalChannels = 2;
+    header.numSamples = 256;
+
+    uint8_t packet[StreamPacketHeader::size + 256 * sizeof(float)] = {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.streamId == header.streamId);
+    CHECK(parsed.sequence == header.sequence);
+    CHECK(parsed.timestamp == header.timestamp);
+    CHECK(parsed.channelIndex == header.channelIndex);
+    CHECK(parsed.totalChannels == header.totalChannels);
+    CHECK(parsed.numSamples == header.numSamples);
+    CHECK(parsed.getPayloadSize() == 256 * sizeof(float));
+}
+
+TEST_CASE("StreamPacketHeader rejects foreign and truncated packets") {
+    StreamPacketHeader header;
+    header.numSamples = 64;
+
+    uint8_t packet[StreamPacketHeader::size + 64 * sizeof(float)] = {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    CHECK_FALSE(parsed.read(packet, sizeof(packet) - 1));
+
+    packet[0] = '/';
+    CHECK_FALSE(parsed.read(packet, sizeof(packet)));
+}
+
+TEST_CASE("StreamPacketHeader announces the stream's sample rate") {
+    StreamPacketHeader header;
+    header.numSamples = 16;
+    header.sampleRate = 44100;
+
+    uint8_t packet[StreamPacketHeader::size + 16 * sizeof(float)] = {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.sampleRate == 44100);
+
+    SECTION("a header from before the rate was added reads it as unknown") {
+        // Same fields, payload straight after the shorter header
+        packet[5] = StreamPacketHeader::minSize;
+        REQUIRE(parsed.read(packet, StreamPacketHeader::minSize +
+                                        16 * sizeof(float)));
+        CHECK(parsed.headerSize == StreamPacketHeader::minSize);
+        CHECK(parsed.sampleRate == 0);
+        CHECK(parsed.numSamples == 16);
+    }
+}
+
+TEST_CASE("sequenceDistance survives wrap-around") {
+    CHECK(sequenceDistance(1, 0xffffffffu) == 2);
+    CHECK(sequenceDistance(0xffffffffu, 1) == -2);
+}
+
+TEST_CASE("StreamPacketHeader bounds compressed payloads") {
+    StreamPacketHeader header;
+    header.numSamples = 64;
+    header.flags = StreamPacketHeader::compressed;
+
+    uint8_t packet[StreamPacketHeader::size + 1 + 64 * sizeof(float) + 1] =
+        {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, StreamPacketHeader::size + 8));
+    CHECK(parsed.isCompressed());
+    CHECK(parsed.getPayloadSize() == 64 * sizeof(float));
+
+    // Verbatim float32 is the most a compressed payload takes
+    CHECK(parsed.read(packet, sizeof(packet) - 1));
+    CHECK_FALSE(parsed.read(packet, sizeof(packet)));
+    CHECK_FALSE(parsed.read(packet, StreamPacketHeader::size));
+}
+
+TEST_CASE("StreamPacketHeader sizes payloads by sample format") {
+    StreamPacketHeader header;
+    header.numChannels = 2;
+    header.totalChannels = 2;
+    header.numSamples = 10;
+
+    header.sampleFormat = SampleFormat::int16;
+    CHECK(header.getPayloadSize() == 40);
+    header.sampleFormat = SampleFormat::int24;
+    CHECK(header.getPayloadSize() == 60);
+
+    uint8_t packet[StreamPacketHeader::size + 60] = {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.sampleFormat == SampleFormat::int24);
+    CHECK_FALSE(parsed.read(packet, sizeof(packet) - 1));
+}
+
+TEST_CASE("NackPacketHeader round-trips with its entries") {
+    NackPacketHeader header;
+    header.streamId = 0xdeadbeef;
+    header.numEntries = 2;
+    header.roundTripTime = 1500;
+
+    uint8_t packet[NackPacketHeader::size + 2 * NackEntry::size] = {};
+    header.write(packet);
+
+    NackEntry entry;
+    entry.sequence = 41;
+    entry.channelMask = NackEntry::getChannelMask(0, 2);
+    entry.deadline = 20000;
+    entry.write(packet + NackPacketHeader::size);
+    entry.sequence = 43;
+    entry.channelMask = NackEntry::getChannelMask(1, 1);
+    entry.write(packet + NackPacketHeader::size + NackEntry::size);
+
+    NackPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.streamId == header.streamId);
+    CHECK(parsed.roundTripTime == 1500);
+    REQUIRE(parsed.numEntries == 2);
+
+    CHECK(parsed.getEntry(packet, 0).sequence == 41);
+    CHECK(parsed.getEntry(packet, 0).channelMask == 0x3);
+    CHECK(parsed.getEntry(packet, 0).deadline == 20000);
+    CHECK(parsed.getEntry(packet, 1).sequence == 43);
+    CHECK(parsed.getEntry(packet, 1).channelMask == 0x2);
+
+    // Too short for its entries, or not a NACK at all
+    CHECK_FALSE(parsed.read(packet, sizeof(packet) - 1));
+    StreamPacketHeader stream;
+    CHECK_FALSE(stream.read(packet, sizeof(packet)));
+}
+
+TEST_CASE("NackEntry folds high channels into the last bit") {
+    CHECK(NackEntry::getChannelMask(0, 1) == 0x1);
+    CHECK(NackEntry::getChannelMask(2, 3) == 0x1c);
+    CHECK(NackEntry::getChannelMask(31, 1) == 0x80000000u);
+    CHECK(NackEntry::getChannelMask(40, 2) == 0x80000000u);
+}
+
+TEST_CASE("StreamPacketHeader flags retransmissions") {
+    StreamPacketHeader header;
+    header.numSamples = 4;
+    header.flags = StreamPacketHeader::retransmittable;
+
+    uint8_t packet[StreamPacketHeader::size + 4 * sizeof(float)] = {};
+    header.write(packet);
+    StreamPacketHeader::addFlags(packet, StreamPacketHeader::retransmitted);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.isRetransmittable());
+    CHECK(parsed.isRetransmitted());
+    CHECK_FALSE(parsed.isCompressed());
+}
+
+TEST_CASE("StreamPacketHeader carries comfort noise levels") {
+    StreamPacketHeader header;
+    header.numChannels = 2;
+    header.totalChannels = 2;
+    header.numSamples = 240;
+    header.flags = StreamPacketHeader::comfortNoise;
+
+    // One level per channel instead of a frame of samples
+    CHECK(header.getPayloadSize() == 2 * sizeof(float));
+
+    uint8_t packet[StreamPacketHeader::size + 2 * sizeof(float)] = {};
+    header.write(packet);
+
+    StreamPacketHeader parsed;
+    REQUIRE(parsed.read(packet, sizeof(packet)));
+    CHECK(parsed.isComfortNoise());
+    CHECK(parsed.numSamples == 240);
+    CHECK_FALSE(parsed.read(packet, sizeof(packet) - 1));
+}
+
+TEST_CASE("Receiver and sender reports round-trip") {
+    ReceiverReportHeader report;
+    report.fractionLost = 3;
+    report.streamId = 42;
+    report.sendTime = 0x123456789abull;
+    report.echoTime = 0x98765ull;
+    report.echoDelay = 250'000;
+    report.numReceived = 1000;
+    report.numLost = 7;
+    report.jitter = 800;
+    report.bufferDelay = 12'000;
+    report.targetDelay = 10'000;
+
+    uint8_t packet[std::max(ReceiverReportHeader::size,
+                            SenderReportHeader::size)];
+    report.write(packet);
+
+    ReceiverReportHeader parsedReport;
+    REQUIRE(parsedReport.read(packet, sizeof(packet)));
+    CHECK(parsedReport.fractionLost == 3);
+    CHECK(parsedReport.streamId == 42);
+    CHECK(parsedReport.sendTime == 0x123456789abull);
+    CHECK(parsedReport.echoTime == 0x98765ull);
+    CHECK(parsedReport.echoDelay == 250'000);
+    CHECK(parsedReport.numReceived == 1000);
+    CHECK(parsedReport.numLost == 7);
+    CHECK(parsedReport.jitter == 800);
+    CHECK(parsedReport.bufferDelay == 12'000);
+    CHECK(parsedReport.targetDelay == 10'000);
+    CHECK_FALSE(parsedReport.read(packet, ReceiverReportHeader::size - 1));
+
+    // Neither is mistaken for the other, or for a NACK
+    SenderReportHeader answer;
+    NackPacketHeader nack;
+    CHECK_FALSE(answer.read(packet, sizeof(packet)));
+    CHECK_FALSE(nack.read(packet, sizeof(packet)));
+
+    answer.streamId = 42;
+    answer.sendTime = 77;
+    answer.timestamp = 48000;
+    answer.echoTime = report.sendTime;
+    answer.echoDelay = 15;
+    answer.probeTimestamp = 96000;
+    answer.probeTime = 0x1234567ull;
+    answer.write(packet);
+
+    SenderReportHeader parsedAnswer;
+    REQUIRE(parsedAnswer.read(packet, SenderReportHeader::size));
+    CHECK(parsedAnswer.streamId == 42);
+    CHECK(parsedAnswer.sendTime == 77);
+    CHECK(parsedAnswer.timestamp == 48000);
+    CHECK(parsedAnswer.echoTime == report.sendTime);
+    CHECK(parsedAnswer.echoDelay == 15);
+    CHECK(parsedAnswer.probeTimestamp == 96000);
+    CHECK(parsedAnswer.probeTime == 0x1234567ull);
+    CHECK_FALSE(parsedReport.read(packet, sizeof(packet)));
+
+    // A sender that doesn't measure latency may leave the probe out
+    packet[5] = SenderReportHeader::minSize;
+    REQUIRE(parsedAnswer.read(packet, SenderReportHeader::minSize));
+    CHECK(parsedAnswer.echoDelay == 15);
+    CHECK(parsedAnswer.probeTimestamp == 0);
+    CHECK(parsedAnswer.probeTime == 0);
+}
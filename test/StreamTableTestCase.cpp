@@ -0,0 +1,58 @@
+#include <catch2/catch.hpp>
+#include <vector>
+
+#include "StreamTable.hpp"
+
+TEST_CASE("StreamTable hands out one slot per stream") {
+    StreamTable table;
+    table.prepare(2, 1024, 256);
+    REQUIRE(table.getNumSlots() == 2);
+    CHECK(table.find(7) == -1);
+
+    const auto first = table.claim(7, 44100, 1);
+    const auto second = table.claim(9);
+    REQUIRE(first >= 0);
+    REQUIRE(second >= 0);
+    CHECK(first != second);
+    CHECK(table.find(7) == first);
+    CHECK(table.find(9) == second);
+    CHECK(table.getStreamId(static_cast<size_t>(second)) == 9);
+    CHECK(table.getNumActive() == 2);
+    CHECK(table.getSampleRate(static_cast<size_t>(first)) == 44100);
+    CHECK(table.getNumChannels(static_cast<size_t>(first)) == 1);
+    CHECK(table.getSampleRate(static_cast<size_t>(second)) == 0);
+
+    SECTION("a full table turns new streams away, counting each once") {
+        for (auto packet = 0; packet < 10; ++packet) {
+            CHECK(table.claim(11) == -1);
+        }
+        CHECK(table.claim(13) == -1);
+        CHECK(table.getNumRejected() == 2);
+
+        // Turned away again after it had a slot, it counts again
+        table.retire(static_cast<size_t>(first));
+        table.release(static_cast<size_t>(first));
+        REQUIRE(table.claim(11) == first);
+        table.retire(static_cast<size_t>(first));
+        CHECK(table.claim(11) == -1);
+        CHECK(table.getNumRejected() == 3);
+    }
+
+    SECTION("a retired slot is reused once released") {
+        const auto slot = static_cast<size_t>(first);
+        const std::vector<float> samples(64, 0.5f);
+        REQUIRE(table.getBuffer(slot).push({1, 64, 0, 0}, samples.data()));
+
+        table.retire(slot);
+        CHECK(table.getState(slot) == StreamTable::State::retiring);
+        CHECK(table.find(7) == -1);
+        CHECK(table.claim(11) == -1);
+
+        table.release(slot);
+        CHECK(table.getState(slot) == StreamTable::State::free);
+        CHECK(table.getBuffer(slot).getNumSamplesQueued() == 0);
+
+        CHECK(table.claim(11) == first);
+        CHECK(table.find(11) == first);
+    }
+}
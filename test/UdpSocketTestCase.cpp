@@ -0,0 +1,261 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <ctime>
+#include <vector>
+
+#include "UdpSocket.hpp"
+
+namespace {
+/** Drains the receiver until count datagrams arrived or it times out. */
+std::vector<std::vector<uint8_t>> receiveAll(UdpReceiver& receiver,
+                                             size_t count) {
+    std::vector<std::vector<uint8_t>> received;
+    while (received.size() < count && receiver.waitUntilReady(1000) > 0) {
+        receiver.receive([&](const uint8_t* data, size_t size) {
+            received.emplace_back(data, data + size);
+        });
+    }
+    return received;
+}
+
+/**
+ * Builds the OSC message OSCSender sends for a blob, with the same two heap
+ * allocations: the MemoryBlock argument and the serialised message.
+ */
+std::vector<char> encodeOscMessage(const uint8_t* data, size_t size) {
+    const std::vector<uint8_t> blob(data, data + size);
+    const char address[] = "/AudioStream\0\0\0\0,b\0\0";
+
+    std::vector<char> message(sizeof(address) - 1);
+    std::memcpy(message.data(), address, message.size());
+    for (auto shift = 24; shift >= 0; shift -= 8) {
+        message.push_back(static_cast<char>(blob.size() >> shift));
+    }
+    message.insert(message.end(), blob.begin(), blob.end());
+    message.resize((message.size() + 3) & ~size_t{3});
+    return message;
+}
+}  // namespace
+
+TEST_CASE("UdpSender delivers packets over loopback") {
+    UdpReceiver receiver;
+    REQUIRE(receiver.bind(0, 1500));
+    const auto port = receiver.getLocalPort();
+    REQUIRE(port > 0);
+
+    UdpSender sender;
+    sender.prepare(1500);
+    REQUIRE(sender.connect("127.0.0.1", port));
+
+    CHECK(receiver.receive([](const uint8_t*, size_t) {}) == 0);
+
+    const uint8_t single[] = {1, 2, 3};
+    REQUIRE(sender.send(single, sizeof(single)));
+
+    auto received = receiveAll(receiver, 1);
+    REQUIRE(received.size() == 1);
+    CHECK(received[0] == std::vector<uint8_t>{1, 2, 3});
+
+    SECTION("queued packets arrive in order after a flush") {
+        // More than one batch, so the queue flushes on its own once
+        const auto count = UdpSender::maxBatchSize + 3;
+        for (size_t i = 0; i < count; ++i) {
+            std::vector<uint8_t> packet(i + 1, static_cast<uint8_t>(i));
+            REQUIRE(sender.queue(packet.data(), packet.size()));
+        }
+        sender.flush();
+
+        received = receiveAll(receiver, count);
+        REQUIRE(received.size() == count);
+        for (size_t i = 0; i < count; ++i) {
+            CHECK(received[i] ==
+                  std::vector<uint8_t>(i + 1, static_cast<uint8_t>(i)));
+        }
+        CHECK(sender.getNumSent() == count + 1);
+        CHECK(sender.getNumErrors() == 0);
+    }
+}
+
+TEST_CASE("UdpSender rejects unusable destinations") {
+    UdpSender sender;
+    CHECK_FALSE(sender.connect("127.0.0.1", 0));
+    CHECK_FALSE(sender.isConnected());
+
+    const uint8_t packet[] = {0};
+    CHECK_FALSE(sender.send(packet, sizeof(packet)));
+}
+
+TEST_CASE("UdpSender fans packets out to every destination") {
+    UdpReceiver first;
+    UdpReceiver second;
+    REQUIRE(first.bind(0, 1500));
+    REQUIRE(second.bind(0, 1500));
+
+    UdpSender sender;
+    sender.prepare(1500);
+    REQUIRE(sender.addDestination("127.0.0.1", first.getLocalPort()));
+    // Over IPv6 where the machine has it, to cover both sockets
+    const auto added =
+        sender.addDestination("::1", second.getLocalPort()) ||
+        sender.addDestination("127.0.0.1", second.getLocalPort());
+    REQUIRE(added);
+    REQUIRE(sender.getNumDestinations() == 2);
+
+    const auto count = UdpSender::maxBatchSize + 3;
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<uint8_t> packet(i + 1, static_cast<uint8_t>(i));
+        REQUIRE(sender.queue(packet.data(), packet.size()));
+    }
+    sender.flush();
+
+    for (auto* receiver : {&first, &second}) {
+        const auto received = receiveAll(*receiver, count);
+        REQUIRE(received.size() == count);
+        for (size_t i = 0; i < count; ++i) {
+            CHECK(received[i] ==
+                  std::vector<uint8_t>(i + 1, static_cast<uint8_t>(i)));
+        }
+    }
+
+    const auto numBytes = count * (count + 1) / 2;
+    for (size_t d = 0; d < 2; ++d) {
+        CHECK(sender.getNumSent(d) == count);
+        CHECK(sender.getNumBytesSent(d) == numBytes);
+        CHECK(sender.getNumErrors(d) == 0);
+    }
+    CHECK(sender.getNumSent() == 2 * count);
+
+    SECTION("connect replaces every destination") {
+        REQUIRE(sender.connect("127.0.0.1", first.getLocalPort()));
+        CHECK(sender.getNumDestinations() == 1);
+        CHECK(sender.getNumSent() == 0);
+    }
+}
+
+TEST_CASE("UdpReceiver answers the sender of a datagram") {
+    UdpReceiver receiver;
+    REQUIRE(receiver.bind(0, 1500));
+
+    UdpSender sender;
+    sender.prepare(1500);
+    REQUIRE(sender.connect("127.0.0.1", receiver.getLocalPort()));
+
+    const uint8_t request[] = {1, 2};
+    REQUIRE(sender.send(request, sizeof(request)));
+    REQUIRE(receiver.waitUntilReady(1000) > 0);
+
+    udp::Address source;
+    REQUIRE(receiver.receive([&](const uint8_t*, size_t size,
+                                 const udp::Address& from) {
+        CHECK(size == sizeof(request));
+        source = from;
+    }) == 1);
+
+    const uint8_t answer[] = {3, 4, 5};
+    REQUIRE(receiver.sendTo(answer, sizeof(answer), source));
+
+    // The sender reads it back without blocking and can answer in turn
+    std::vector<uint8_t> received;
+    udp::Address replyTo;
+    const auto start = std::chrono::steady_clock::now();
+    while (received.empty() &&
+           std::chrono::steady_clock::now() - start <
+               std::chrono::seconds(1)) {
+        sender.receive([&](const uint8_t* data, size_t size,
+                           const udp::Address& from) {
+            received.assign(data, data + size);
+            replyTo = from;
+        });
+    }
+    CHECK(received == std::vector<uint8_t>{3, 4, 5});
+
+    REQUIRE(sender.sendTo(request, sizeof(request), replyTo));
+    CHECK(receiveAll(receiver, 1).size() == 1);
+}
+
+TEST_CASE("UdpReceiver receives from a multicast group") {
+    const std::string group = "239.255.42.99";
+
+    UdpReceiver receiver;
+    if (!receiver.bind(0, 1500, group)) {
+        WARN("Couldn't join " << group << ", skipping");
+        return;
+    }
+
+    UdpSender sender;
+    REQUIRE(sender.connect(group, receiver.getLocalPort()));
+
+    const uint8_t packet[] = {4, 5, 6};
+    if (!sender.send(packet, sizeof(packet))) {
+        WARN("No multicast route, skipping");
+        return;
+    }
+
+    const auto received = receiveAll(receiver, 1);
+    if (received.empty()) {
+        WARN("Multicast isn't looped back here, skipping");
+        return;
+    }
+    CHECK(received[0] == std::vector<uint8_t>{4, 5, 6});
+}
+
+TEST_CASE("UdpSocket loopback throughput against OSC encoding",
+          "[.][benchmark]") {
+    constexpr size_t packetSize = 4 * 1024 + 32;
+    constexpr size_t numPackets = 100000;
+    constexpr size_t burst = 8;
+
+    enum class Mode { sendto, sendmmsg, osc };
+
+    for (const auto mode : {Mode::sendto, Mode::sendmmsg, Mode::osc}) {
+        UdpReceiver receiver;
+        REQUIRE(receiver.bind(0, packetSize + 64));
+        UdpSender sender;
+        sender.prepare(packetSize);
+        REQUIRE(sender.connect("127.0.0.1", receiver.getLocalPort()));
+
+        const std::vector<uint8_t> packet(packetSize, 0x55);
+        size_t numReceived = 0;
+        auto drain = [&] {
+            while (receiver.receive([&](const uint8_t*, size_t) {
+                ++numReceived;
+            }) > 0) {
+            }
+        };
+
+        const auto cpuStart = std::clock();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t sent = 0; sent < numPackets; sent += burst) {
+            for (size_t i = 0; i < burst; ++i) {
+                if (mode == Mode::sendto) {
+                    sender.send(packet.data(), packet.size());
+                } else if (mode == Mode::sendmmsg) {
+                    sender.queue(packet.data(), packet.size());
+                } else {
+                    const auto message =
+                        encodeOscMessage(packet.data(), packet.size());
+                    sender.send(reinterpret_cast<const uint8_t*>(
+                                    message.data()),
+                                message.size());
+                }
+            }
+            sender.flush();
+            drain();
+        }
+
+        const auto seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        const auto cpuSeconds =
+            static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+        const char* names[] = {"sendto", "sendmmsg", "osc"};
+        WARN(names[static_cast<int>(mode)]
+             << ": " << static_cast<int>(numPackets / seconds)
+             << " packets/s, "
+             << cpuSeconds * 1.0e9 / static_cast<double>(numPackets)
+             << " ns CPU per packet (send and receive), " << numReceived
+             << " of " << numPackets << " received");
+    }
+}